@@ -0,0 +1,44 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <assert.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+// 等待的字所在的页只被读过（映射到零页），唤醒方写入后该页不能被换到另一个物理页上，否则唤醒丢失
+
+volatile uint32_t *word;
+
+static long futex(volatile uint32_t *uaddr, int op, uint32_t val) {
+    return syscall(SYS_futex, uaddr, op, val, NULL, NULL, 0);
+}
+
+void *waiter_func(void* param) {
+    while(*word == 0) {
+        futex(word, FUTEX_WAIT, 0);
+    }
+    printf("Waiter: woken with %d\n", *word);
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    word = (volatile uint32_t*)mmap(NULL, 4096, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    assert(word != MAP_FAILED);
+    assert(*word == 0);
+
+    pthread_t th;
+    pthread_create(&th, NULL, waiter_func, NULL);
+    usleep(1000);
+
+    *word = 1;
+    long n = futex(word, FUTEX_WAKE, 1);
+    printf("Main: wake %ld\n", n);
+
+    pthread_join(th, NULL);
+    munmap((void*)word, 4096);
+    printf("Pass\n");
+    return 0;
+}
@@ -495,12 +495,34 @@ typedef struct {
     uint64_t    uaddr2;
     uint32_t    fval2;
     uint32_t    val3;
+    uint64_t    timeout;
 } HostFutexArgs;
 
 const uint32_t futex_wait = 0;
 const uint32_t futex_wait_bitset = 9;
 const uint32_t futex_wake = 1;
 const uint32_t futex_wake_bitset = 10;
+const uint32_t futex_requeue = 3;
+const uint32_t futex_cmp_requeue = 4;
+const uint32_t futex_wake_op = 5;
+
+/**
+ * FUTEX_WAKE_OP中对*uaddr2的原子操作，返回旧值
+ */
+static int32_t _futex_atomic_op(int32_t *uaddr2, uint32_t val3) {
+    uint32_t op = ((val3 >> 28) & 0xf);
+    int32_t oparg = (((int32_t)(val3 << 8)) >> 20);
+    if(op & 8) oparg = (1 << (oparg & 31));
+    switch (op & 7)
+    {
+    case 0: return __atomic_exchange_n(uaddr2, oparg, __ATOMIC_SEQ_CST);
+    case 1: return __atomic_fetch_add(uaddr2, oparg, __ATOMIC_SEQ_CST);
+    case 2: return __atomic_fetch_or(uaddr2, oparg, __ATOMIC_SEQ_CST);
+    case 3: return __atomic_fetch_and(uaddr2, ~oparg, __ATOMIC_SEQ_CST);
+    case 4: return __atomic_fetch_xor(uaddr2, oparg, __ATOMIC_SEQ_CST);
+    }
+    return *uaddr2;
+}
 
 /**
  * Syscall 98 futex - fast user-space locking
@@ -508,25 +530,33 @@ const uint32_t futex_wake_bitset = 10;
 */
 void proxy_98_futex(uint32_t *uaddr, int futex_op, uint32_t val, struct timespec *timeout, uint32_t *uaddr2, uint32_t val3) {
     HostFutexArgs *args = (HostFutexArgs *)_host_malloc(sizeof(HostFutexArgs));
+    struct timespec *htimeout = 0;
     args->futex_op = futex_op;
     args->val = val;
     args->val2 = (uint64_t)timeout;
     args->val3 = val3;
-    args->uaddr = args->uaddr2 = args->fval = args->fval2 = 0;
+    args->uaddr = args->uaddr2 = args->fval = args->fval2 = args->timeout = 0;
 
     int raw_op = (futex_op & 127);
-    // int use_futex2 = (raw_op == 3) || (raw_op == 4) || (raw_op == 5);
+    int use_futex2 = (raw_op == futex_requeue) || (raw_op == futex_cmp_requeue) || (raw_op == futex_wake_op);
 
     args->uaddr = (uint64_t)uaddr;
-    // args->uaddr2 = (use_futex2?((uint64_t)uaddr2):0);
+    args->uaddr2 = (use_futex2?((uint64_t)uaddr2):0);
 
-    if(raw_op == futex_wait || raw_op == futex_wait_bitset) args->fval = *uaddr;
-    // if(use_futex2) {
-    //     args->fval2 = *uaddr2;
-    // }
+    if(raw_op == futex_wait || raw_op == futex_wait_bitset || raw_op == futex_cmp_requeue) args->fval = *uaddr;
+    if((raw_op == futex_wait || raw_op == futex_wait_bitset) && timeout) {
+        htimeout = (struct timespec *)_host_malloc(sizeof(struct timespec));
+        htimeout->tv_sec = timeout->tv_sec;
+        htimeout->tv_usec = timeout->tv_usec;
+        args->timeout = (uint64_t)htimeout;
+    }
+    if(raw_op == futex_wake_op) {
+        args->fval2 = _futex_atomic_op((int32_t*)uaddr2, val3);
+    }
 
     uint64_t ret = _host_syscall_1((uint64_t)(args), 1098);
     
+    if(htimeout) _host_free(htimeout);
     _host_free(args);
     _ecall_ret(ret);
 }
@@ -562,6 +592,34 @@ void proxy_115_clock_nanosleep(uint64_t clockid, uint64_t flags, struct timespec
     _ecall_ret(ret);
 }
 
+/**
+ * Syscall 122 sched_setaffinity - set a thread's CPU affinity mask
+ * int sched_setaffinity(pid_t pid, size_t cpusetsize, const cpu_set_t *mask);
+*/
+void proxy_122_sched_setaffinity(int64_t pid, uint64_t cpusetsize, uint8_t *mask) {
+    uint64_t ret = 0;
+    uint8_t *hmask = _host_malloc(cpusetsize);
+    _rv64memcpy(hmask, mask, cpusetsize);
+    ret = _host_syscall_3(pid, cpusetsize, (uint64_t)hmask, 1122);
+    _host_free(hmask);
+    _ecall_ret(ret);
+}
+
+/**
+ * Syscall 123 sched_getaffinity - get a thread's CPU affinity mask
+ * int sched_getaffinity(pid_t pid, size_t cpusetsize, cpu_set_t *mask);
+*/
+void proxy_123_sched_getaffinity(int64_t pid, uint64_t cpusetsize, uint8_t *mask) {
+    int64_t ret = 0;
+    uint8_t *hmask = _host_malloc(cpusetsize);
+    ret = _host_syscall_3(pid, cpusetsize, (uint64_t)hmask, 1123);
+    if(ret > 0) {
+        _rv64memcpy(mask, hmask, ret);
+    }
+    _host_free(hmask);
+    _ecall_ret(ret);
+}
+
 #define SIZEOF_SIGSET_T (8UL)
 #define SIZEOF_KERNEL_SIGACTION (16UL + SIZEOF_SIGSET_T)
 
@@ -31,6 +31,16 @@ typedef uint32_t BusNodeT; // 一个节点可以有多个端口，同节点不
 typedef uint32_t BusPortT;
 typedef uint32_t ChannelT;
 
+/**
+ * 以对象形式在总线上传递的消息，总线不拷贝其内容，只根据bus_size计算包数量用于时序模拟
+ * send_msg后消息归总线所有，recv_msg后归接收方所有
+*/
+class BusMessage {
+public:
+    virtual ~BusMessage() {};
+    virtual uint32_t bus_size() = 0;
+};
+
 class BusInterfaceV2 : public SimObject {
 public:
     virtual void can_send(BusPortT port, vector<bool> &out) = 0;
@@ -40,6 +50,12 @@ public:
     virtual void can_recv(BusPortT port, vector<bool> &out) = 0;
     virtual bool can_recv(BusPortT port, ChannelT channel) = 0;
     virtual bool recv(BusPortT port, ChannelT channel, vector<uint8_t> &buf) = 0;
+
+    virtual bool send_msg(BusPortT port, BusPortT dst_port, ChannelT channel, BusMessage *msg) = 0;
+    virtual bool recv_msg(BusPortT port, ChannelT channel, BusMessage **msg) = 0;
+
+    // 端口收到消息时唤醒休眠的owner
+    virtual void set_port_owner(BusPortT port, SimObject *owner) {};
 };
 
 typedef BusNodeT SrcNodeT;
@@ -43,6 +43,9 @@ SymmetricMultiChannelBus::SymmetricMultiChannelBus(
     width = conf::get_int("symmulcha", "width", 64);
     route_latency = conf::get_int("symmulcha", "route_latency", 3);
     node_buf_sz = conf::get_int("symmulcha", "node_buf_sz", 512);
+    port_buf_sz = conf::get_int("symmulcha", "port_buf_sz", 64);
+    port_send_latency = conf::get_int("symmulcha", "port_send_latency", 0);
+    port_recv_latency = conf::get_int("symmulcha", "port_recv_latency", 1);
 
     cha_cnt = cha_widths.size();
 
@@ -93,8 +96,10 @@ SymmetricMultiChannelBus::SymmetricMultiChannelBus(
 
     for(auto &p2n : port2node) {
         auto iter = ports.emplace(p2n.first, PortStruct()).first;
-        iter->second.send_buf.resize(cha_cnt);
-        iter->second.recv_buf.resize(cha_cnt);
+        for(uint32_t c = 0; c < cha_cnt; c++) {
+            iter->second.send_buf.emplace_back(make_unique<PortChannel>(port_buf_sz, port_send_latency));
+            iter->second.recv_buf.emplace_back(make_unique<PortChannel>(port_buf_sz, port_recv_latency));
+        }
         nodes[p2n.second].port.emplace(p2n.first, &(iter->second));
     }
 
@@ -139,6 +144,12 @@ void SymmetricMultiChannelBus::clear_statistic() {
 #define LOGTOFILE(fmt, ...) do{sprintf(log_buf, fmt, ##__VA_ARGS__);ofile << log_buf;}while(0)
 
 void SymmetricMultiChannelBus::print_statistic(std::ofstream &ofile) {
+    uint64_t tx_pack_num = 0;
+    uint64_t tx_pack_cycle_sum = 0;
+    for(auto &e : ports) {
+        tx_pack_num += e.second.rx_pack_num;
+        tx_pack_cycle_sum += e.second.rx_pack_cycle_sum;
+    }
     LOGTOFILE("transmit_package_number: %ld\n", tx_pack_num);
     LOGTOFILE("avg_transmit_latency: %f\n", ((double)(tx_pack_cycle_sum)) / tx_pack_num);
     long cur = simroot::get_current_tick();
@@ -150,13 +161,17 @@ void SymmetricMultiChannelBus::print_statistic(std::ofstream &ofile) {
     for(auto &e : edges) {
         LOGTOFILE("edge_%d_to_%d_busy_rate: %f\n", e.from, e.to, ((double)(e.busy_cycles))/ cur);
     }
-    for(auto &e : transmit_cnt) {
-        LOGTOFILE("transmit_package_number_from_%ld_to_%ld: %ld\n", e.first >> 32, e.first & (0xffffffffUL), e.second);
+    for(auto &e : ports) {
+        for(auto &f : e.second.rx_pack_num_from) {
+            LOGTOFILE("transmit_package_number_from_%d_to_%d: %ld\n", f.first, e.first, f.second);
+        }
     }
 }
 
 void SymmetricMultiChannelBus::print_setup_info(std::ofstream &ofile) {
     LOGTOFILE("port_number: %ld\n", port2node.size());
+    LOGTOFILE("port_send_latency: %d\n", port_send_latency);
+    LOGTOFILE("port_recv_latency: %d\n", port_recv_latency);
     for(auto &e : port2node) {
         LOGTOFILE("node_id_of_port_%d: %d\n", e.first, e.second);
     }
@@ -172,22 +187,41 @@ void SymmetricMultiChannelBus::dump_core(std::ofstream &ofile) {
 #undef LOGTOFILE
 
 void SymmetricMultiChannelBus::apply_next_tick() {
+    cur_tick = simroot::get_current_tick();
     for(auto &e : nodes) {
         process_node(&(e.second));
     }
     for(auto &e : edges) {
         process_edge(&e);
     }
+    if(pending_pack_cnt.load(std::memory_order_relaxed) == 0) {
+        sim_sleep();
+    }
 }
 
 
 
+/**
+ * 端口所有者可能与总线位于不同线程，端口链路的延迟与释放延迟都不能小于跨线程通道延迟，
+ * 使一个同步周期内的发送、投递与取出只在之后的同步周期中被另一端看到
+*/
+void SymmetricMultiChannelBus::on_sim_start() {
+    uint32_t xlat = simroot::get_cross_thread_latency();
+    for(auto &e : ports) {
+        for(uint32_t c = 0; c < cha_cnt; c++) {
+            e.second.send_buf[c]->set_latency(std::max(port_send_latency, xlat), xlat);
+            e.second.recv_buf[c]->set_latency(std::max(port_recv_latency, xlat), xlat);
+        }
+    }
+}
+
 void SymmetricMultiChannelBus::can_send(BusPortT port, vector<bool> &out) {
     auto res = ports.find(port);
     simroot_assertf(res != ports.end(), "Bus: Unknown port %d", port);
     out.assign(cha_cnt, false);
+    uint64_t tick = simroot::get_current_tick();
     for(uint32_t c = 0; c < cha_cnt; c++) {
-        out[c] = (res->second.send_buf[c].empty());
+        out[c] = (res->second.send_buf[c]->drained(tick));
     }
 }
 
@@ -195,8 +229,7 @@ bool SymmetricMultiChannelBus::can_send(BusPortT port, ChannelT channel) {
     simroot_assertf(channel < cha_widths.size(), "Bus: Unknown channel index %d", channel);
     auto res = ports.find(port);
     simroot_assertf(res != ports.end(), "Bus: Unknown port %d", port);
-    list<MsgPack*> &sbuf = res->second.send_buf[channel];
-    return (sbuf.empty());
+    return (res->second.send_buf[channel]->drained(simroot::get_current_tick()));
 }
 
 bool SymmetricMultiChannelBus::send(BusPortT port, BusPortT dst_port, ChannelT channel, vector<uint8_t> &data) {
@@ -204,14 +237,18 @@ bool SymmetricMultiChannelBus::send(BusPortT port, BusPortT dst_port, ChannelT c
     auto res = ports.find(port);
     simroot_assertf(res != ports.end(), "Bus: Unknown port %d", port);
 
-    list<MsgPack*> &sbuf = res->second.send_buf[channel];
-    if(!sbuf.empty()) [[unlikely]] return false;
+    PortStruct &sport = res->second;
+    PortChannel &sbuf = *(sport.send_buf[channel]);
+    uint64_t tick = simroot::get_current_tick();
+    if(!sbuf.drained(tick)) [[unlikely]] return false;
 
     uint32_t cwid = cha_widths[channel];
     uint32_t len = ALIGN(data.size(), cwid);
     uint32_t pac_cnt = len / cwid;
+    simroot_assertf(pac_cnt <= sbuf.capacity(), "Bus: Message too long (%d packages) for port buffer %d", pac_cnt, sbuf.capacity());
     uint32_t pos = 0;
-    uint32_t xmt = (xmtid_alloc++);
+    XmitIDT xmt = (((XmitIDT)port) << 32) | (sport.xmtid_alloc++);
+    pending_pack_cnt.fetch_add(pac_cnt, std::memory_order_relaxed);
     for(uint32_t i = 0; i < pac_cnt; i++) {
         MsgPack *p = new MsgPack();
         p->src = port;
@@ -223,11 +260,13 @@ bool SymmetricMultiChannelBus::send(BusPortT port, BusPortT dst_port, ChannelT c
         p->pac_idx = i;
         p->pac_cnt = pac_cnt;
         p->data.assign(cwid, 0);
-        p->tx_start_tick = simroot::get_current_tick();
+        p->msg = nullptr;
+        p->tx_start_tick = tick;
         memcpy(p->data.data(), data.data() + pos, std::min<uint32_t>(cwid, data.size() - pos));
         pos += cwid;
-        sbuf.push_back(p);
+        sbuf.push(p, tick);
     }
+    sim_wakeup(sbuf.latency());
     if(log_ofile) {
         sprintf(log_buf, "SEND: %x -> %x (%d): len %ld : ", port, dst_port, channel, data.size());
         uint32_t sz = std::min<uint32_t>(data.size(), 16);
@@ -246,8 +285,7 @@ void SymmetricMultiChannelBus::can_recv(BusPortT port, vector<bool> &out) {
     simroot_assertf(res != ports.end(), "Bus: Unknown port %d", port);
     out.assign(cha_cnt, false);
     for(uint32_t c = 0; c < cha_cnt; c++) {
-        list<MsgPack*> &rbuf = res->second.recv_buf[c];
-        out[c] = (!rbuf.empty() && rbuf.size() >= rbuf.front()->pac_cnt);
+        out[c] = recv_ready(*(res->second.recv_buf[c]));
     }
 }
 
@@ -255,41 +293,46 @@ bool SymmetricMultiChannelBus::can_recv(BusPortT port, ChannelT channel) {
     simroot_assertf(channel < cha_widths.size(), "Bus: Unknown channel index %d", channel);
     auto res = ports.find(port);
     simroot_assertf(res != ports.end(), "Bus: Unknown port %d", port);
-    list<MsgPack*> &rbuf = res->second.recv_buf[channel];
-    return (!rbuf.empty() && rbuf.size() >= rbuf.front()->pac_cnt);
+    return recv_ready(*(res->second.recv_buf[channel]));
+}
+
+bool SymmetricMultiChannelBus::recv_ready(PortChannel &rbuf) {
+    uint64_t tick = simroot::get_current_tick();
+    MsgPack **head = rbuf.peek(0, tick);
+    if(!head) return false;
+    // 同一消息的所有包由总线一次性写入，最后一个包可见即表示整个消息可见
+    return (rbuf.peek((*head)->pac_cnt - 1, tick) != nullptr);
+}
+
+void SymmetricMultiChannelBus::set_port_owner(BusPortT port, SimObject *owner) {
+    auto res = ports.find(port);
+    simroot_assertf(res != ports.end(), "Bus: Unknown port %d", port);
+    res->second.owner = owner;
 }
 
 bool SymmetricMultiChannelBus::recv(BusPortT port, ChannelT channel, vector<uint8_t> &buf) {
     simroot_assertf(channel < cha_widths.size(), "Bus: Unknown channel index %d", channel);
     auto res = ports.find(port);
     simroot_assertf(res != ports.end(), "Bus: Unknown port %d", port);
-    list<MsgPack*> &rbuf = res->second.recv_buf[channel];
-    if(rbuf.empty() || rbuf.size() < rbuf.front()->pac_cnt) [[unlikely]] return false;
+    PortChannel &rbuf = *(res->second.recv_buf[channel]);
+    if(!recv_ready(rbuf)) [[unlikely]] return false;
+    uint64_t tick = simroot::get_current_tick();
 
     uint32_t cwid = cha_widths[channel];
-    MsgPack *head = rbuf.front();
+    MsgPack *head = rbuf.top();
     uint32_t len = head->len;
     uint32_t pac_cnt = head->pac_cnt;
     buf.resize(ALIGN(len, cwid));
     uint32_t pos = 0;
     for(uint32_t i = 0; i < pac_cnt; i++) {
-        MsgPack *p = rbuf.front();
+        MsgPack *p = rbuf.top();
         simroot_assertf(i == p->pac_idx, "Bus: Un-ordered package sequence in port %d, channel %d", port, channel);
+        simroot_assertf(p->msg == nullptr, "Bus: Typed message received as raw data in port %d, channel %d", port, channel);
         memcpy(buf.data() + pos, p->data.data(), cwid);
         pos += cwid;
-        {
-            tx_pack_num ++;
-            tx_pack_cycle_sum += (simroot::get_current_tick() - p->tx_start_tick);
-            uint64_t key = ((uint64_t)(p->src) << 32) | (p->dst);
-            auto iter = transmit_cnt.find(key);
-            if(iter == transmit_cnt.end()) {
-                iter = transmit_cnt.emplace(key, 0).first;
-            }
-            iter->second++;
-        }
-        
+        on_pack_recieved(&(res->second), p);
         delete p;
-        rbuf.pop_front();
+        rbuf.pop(tick);
     }
     buf.resize(len);
     if(log_ofile) {
@@ -313,7 +356,7 @@ void SymmetricMultiChannelBus::process_node(NodeStruct *node) {
     for(int i = 0; i < node->rxs.size(); i++) {
         EdgeInChannel *e = node->rxs[node->rx_ptr];
         for(int c = 0; c < cha_cnt; c++) {
-            if(e->output[c]) {
+            if(e->output[c] && can_deliver(node, e->output[c])) {
                 recv = e->output[c];
                 e->output[c] = nullptr;
                 break;
@@ -330,9 +373,10 @@ void SymmetricMultiChannelBus::process_node(NodeStruct *node) {
     for(int i = 0; i < node->port.size() && !recv; i++) {
         PortStruct *p = node->sd_ptr->second;
         for(auto &l : p->send_buf) {
-            if(!l.empty()) {
-                recv = l.front();
-                l.pop_front();
+            MsgPack **head = l->peek(0, cur_tick);
+            if(head && can_deliver(node, *head)) {
+                recv = *head;
+                l->pop(cur_tick);
                 break;
             }
         }
@@ -349,12 +393,15 @@ void SymmetricMultiChannelBus::process_node(NodeStruct *node) {
 
     if(recv) {
         if(recv->tgt == node->myid) {
+            pending_pack_cnt.fetch_sub(1, std::memory_order_relaxed);
             XmitIDT xmt = recv->xmtid;
             ChannelT cha = recv->cha;
             uint32_t cnt = recv->pac_cnt;
             BusPortT dst = recv->dst;
+            PortStruct *dstport = node->port[dst];
             if(cnt <= 1) {
-                node->port[dst]->recv_buf[cha].push_back(recv);
+                dstport->recv_buf[cha]->push(recv, cur_tick);
+                if(dstport->owner) dstport->owner->sim_wakeup(dstport->recv_buf[cha]->latency());
             }
             else {
                 auto res = node->order_buf.find(xmt);
@@ -364,8 +411,9 @@ void SymmetricMultiChannelBus::process_node(NodeStruct *node) {
                 for(; iter != l.end() && (*iter)->pac_idx < recv->pac_idx; iter++) ;
                 l.insert(iter, recv);
                 if(l.size() == recv->pac_cnt) {
-                    node->port[dst]->recv_buf[cha].splice(node->port[dst]->recv_buf[cha].end(), l);
+                    for(auto m : l) dstport->recv_buf[cha]->push(m, cur_tick);
                     node->order_buf.erase(xmt);
+                    if(dstport->owner) dstport->owner->sim_wakeup(dstport->recv_buf[cha]->latency());
                 }
             }
             if(cnt == recv->pac_idx + 1) {
@@ -406,13 +454,103 @@ void SymmetricMultiChannelBus::process_node(NodeStruct *node) {
     if(busy) node->busy_cycles++;
 }
 
+bool SymmetricMultiChannelBus::send_msg(BusPortT port, BusPortT dst_port, ChannelT channel, BusMessage *msg) {
+    simroot_assertf(channel < cha_widths.size(), "Bus: Unknown channel index %d", channel);
+    auto res = ports.find(port);
+    simroot_assertf(res != ports.end(), "Bus: Unknown port %d", port);
+
+    PortStruct &sport = res->second;
+    PortChannel &sbuf = *(sport.send_buf[channel]);
+    uint64_t tick = simroot::get_current_tick();
+    if(!sbuf.drained(tick)) [[unlikely]] return false;
+
+    // 消息内容不经过总线拷贝，只按其大小生成对应数量的空包用于时序模拟
+    uint32_t cwid = cha_widths[channel];
+    uint32_t len = msg->bus_size();
+    uint32_t pac_cnt = std::max<uint32_t>(1, CEIL_DIV(len, cwid));
+    simroot_assertf(pac_cnt <= sbuf.capacity(), "Bus: Message too long (%d packages) for port buffer %d", pac_cnt, sbuf.capacity());
+    XmitIDT xmt = (((XmitIDT)port) << 32) | (sport.xmtid_alloc++);
+    pending_pack_cnt.fetch_add(pac_cnt, std::memory_order_relaxed);
+    for(uint32_t i = 0; i < pac_cnt; i++) {
+        MsgPack *p = new MsgPack();
+        p->src = port;
+        p->dst = dst_port;
+        p->tgt = port2node[dst_port];
+        p->cha = channel;
+        p->xmtid = xmt;
+        p->len = len;
+        p->pac_idx = i;
+        p->pac_cnt = pac_cnt;
+        p->msg = ((i == 0)?msg:nullptr);
+        p->tx_start_tick = tick;
+        sbuf.push(p, tick);
+    }
+    sim_wakeup(sbuf.latency());
+    if(log_ofile) {
+        sprintf(log_buf, "SEND: %x -> %x (%d): msg len %d", port, dst_port, channel, len);
+        simroot::log_line(log_ofile, log_buf);
+    }
+    return true;
+}
+
+bool SymmetricMultiChannelBus::recv_msg(BusPortT port, ChannelT channel, BusMessage **msg) {
+    simroot_assertf(channel < cha_widths.size(), "Bus: Unknown channel index %d", channel);
+    auto res = ports.find(port);
+    simroot_assertf(res != ports.end(), "Bus: Unknown port %d", port);
+    PortChannel &rbuf = *(res->second.recv_buf[channel]);
+    if(!recv_ready(rbuf)) [[unlikely]] return false;
+    uint64_t tick = simroot::get_current_tick();
+
+    MsgPack *head = rbuf.top();
+    uint32_t len = head->len;
+    uint32_t pac_cnt = head->pac_cnt;
+    simroot_assertf(head->msg, "Bus: Raw data received as typed message in port %d, channel %d", port, channel);
+    *msg = head->msg;
+    for(uint32_t i = 0; i < pac_cnt; i++) {
+        MsgPack *p = rbuf.top();
+        simroot_assertf(i == p->pac_idx, "Bus: Un-ordered package sequence in port %d, channel %d", port, channel);
+        on_pack_recieved(&(res->second), p);
+        delete p;
+        rbuf.pop(tick);
+    }
+    if(log_ofile) {
+        sprintf(log_buf, "RECV: %x (%d): msg len %d", port, channel, len);
+        simroot::log_line(log_ofile, log_buf);
+    }
+    return true;
+}
+
+void SymmetricMultiChannelBus::on_pack_recieved(PortStruct *port, MsgPack *p) {
+    port->rx_pack_num ++;
+    port->rx_pack_cycle_sum += (simroot::get_current_tick() - p->tx_start_tick);
+    auto iter = port->rx_pack_num_from.find(p->src);
+    if(iter == port->rx_pack_num_from.end()) {
+        iter = port->rx_pack_num_from.emplace(p->src, 0).first;
+    }
+    iter->second++;
+}
+
+/**
+ * 到达目标节点的包需要端口接收缓存中有足够的空间，否则该包留在原处等待
+ * 多包消息只在最后一个包到达、整体写入接收缓存时检查
+*/
+bool SymmetricMultiChannelBus::can_deliver(NodeStruct *node, MsgPack *pack) {
+    if(pack->tgt != node->myid) return true;
+    PortChannel &rbuf = *(node->port[pack->dst]->recv_buf[pack->cha]);
+    if(pack->pac_cnt <= 1) return (rbuf.can_push(cur_tick) > 0);
+    auto res = node->order_buf.find(pack->xmtid);
+    uint32_t arrived = ((res == node->order_buf.end())?0:res->second.size());
+    if(arrived + 1 < pack->pac_cnt) return true;
+    return (rbuf.can_push(cur_tick) >= pack->pac_cnt);
+}
+
 void SymmetricMultiChannelBus::process_edge(EdgeInChannel *edge) {
     uint32_t total_sz = 0;
     for(int i = 0; i < cha_cnt && total_sz < width; i++) {
         if(edge->input[i] && !edge->output[i]) {
             edge->output[i] = edge->input[i];
             edge->input[i] = nullptr;
-            total_sz += edge->output[i]->data.size();
+            total_sz += cha_widths[i];
             edge->busy_cycles ++;
         }
     }
@@ -505,6 +643,7 @@ bool test_sym_mul_cha_bus() {
 
         bus->on_current_tick();
         bus->apply_next_tick();
+        simroot::set_current_tick(tick + 1);
 
         if(tick % log_interval == 0) {
             printf("\rSend:(%ld/%ld), Recv(%ld/%ld)", send_cnt, test_cnt, recv_cnt, test_cnt);
@@ -517,4 +656,140 @@ bool test_sym_mul_cha_bus() {
     return true;
 }
 
+// 每个端口一个流量对象，发送的时刻、目标与内容只由相对周期、端口号与发送序号决定，没有工作时休眠
+class TestBusTrafficNode : public SimObject {
+public:
+    TestBusTrafficNode(SymmetricMultiChannelBus *bus, BusPortT port, uint32_t portnum, uint32_t chanum, uint64_t start_tick, uint64_t stop_tick)
+    : bus(bus), port(port), portnum(portnum), chanum(chanum), start_tick(start_tick), stop_tick(stop_tick) {
+        do_on_current_tick = 0;
+        bus->set_port_owner(port, this);
+    };
+
+    SymmetricMultiChannelBus *bus;
+    BusPortT port;
+    uint32_t portnum, chanum;
+    uint64_t start_tick, stop_tick;
+    uint64_t sent = 0;
+    uint64_t next_send_tick = 0;
+    bool corrupted = false;
+    // 每次接收记录：相对周期、通道、来源端口与序号、长度
+    vector<uint64_t> log;
+
+    static inline uint64_t hash(uint64_t a, uint64_t b) {
+        uint64_t x = (a * 0x9E3779B97F4A7C15UL) ^ (b + 0x632BE59BD9B4E019UL + (a << 6) + (a >> 2));
+        x ^= (x >> 31); x *= 0xBF58476D1CE4E5B9UL; x ^= (x >> 29);
+        return x;
+    }
+
+    virtual void apply_next_tick() {
+        uint64_t tick = simroot::get_current_tick() - start_tick;
+        for(uint32_t c = 0; c < chanum && tick < stop_tick; c++) {
+            if(bus->can_recv(port, c)) {
+                vector<uint8_t> d;
+                bus->recv(port, c, d);
+                uint64_t head = *((uint64_t*)(d.data()));
+                uint64_t h = hash(head >> 32, head & 0xffffffffUL);
+                for(uint32_t i = 8; i < d.size(); i++) if(d[i] != (uint8_t)(h + i)) corrupted = true;
+                log.push_back(tick);
+                log.push_back(c);
+                log.push_back(head);
+                log.push_back(d.size());
+            }
+        }
+        // 同步周期大于1时结束模拟后其他对象仍会执行到同步周期结束，这些周期不参与比较
+        if(tick >= stop_tick) {
+            if(port == 0) simroot::stop_sim_and_exit();
+            return;
+        }
+        bool waiting_send = false;
+        if(tick >= next_send_tick) {
+            uint64_t h = hash(port, sent);
+            uint32_t cha = h % chanum;
+            if(bus->can_send(port, cha)) {
+                BusPortT dst = (port + 1 + ((h >> 8) % (portnum - 1))) % portnum;
+                vector<uint8_t> d;
+                d.resize(ALIGN(32 + ((h >> 16) % 224), 8));
+                *((uint64_t*)(d.data())) = ((uint64_t)port << 32) | sent;
+                for(uint32_t i = 8; i < d.size(); i++) d[i] = (uint8_t)(h + i);
+                bus->send(port, dst, cha, d);
+                sent++;
+                next_send_tick = tick + 1 + ((h >> 24) % 16);
+            }
+            else {
+                waiting_send = true;
+            }
+        }
+        if(!waiting_send) sim_sleep(next_send_tick + start_tick);
+    };
+};
+
+// 总线与各端口的流量对象分布在两个线程上，在不同同步周期下多次运行，每个端口逐周期的接收记录应完全相同
+bool test_sym_mul_cha_bus_threads() {
+    const uint32_t portnum = 8;
+    const uint32_t chanum = 4;
+    const uint64_t run_ticks = 2000;
+
+    simroot::set_sim_thread_num(2);
+
+    auto run = [&](uint64_t quantum, vector<vector<uint64_t>> &logs) -> bool {
+        vector<BusPortT> ports;
+        vector<BusNodeT> port2node;
+        vector<BusNodeT> nodes;
+        for(uint32_t i = 0; i < portnum; i++) {
+            ports.push_back(i);
+            port2node.push_back(i / 2);
+        }
+        for(uint32_t i = 0; i < portnum / 2; i++) nodes.push_back(i);
+        BusRouteTable routetable;
+        simbus::genroute_mesh2d_xy(nodes, 2, 2, true, routetable);
+        vector<uint32_t> channel_width;
+        channel_width.assign(chanum, 32);
+        SymmetricMultiChannelBus bus(ports, port2node, channel_width, routetable, "testbus");
+
+        uint64_t start = simroot::get_current_tick();
+        vector<unique_ptr<TestBusTrafficNode>> traffic;
+        simroot::add_sim_object_next_thread(&bus, "Bus", 1);
+        for(uint32_t i = 0; i < portnum; i++) {
+            traffic.emplace_back(make_unique<TestBusTrafficNode>(&bus, ports[i], portnum, chanum, start, run_ticks));
+            simroot::add_sim_object_next_thread(traffic.back().get(), "Traffic" + std::to_string(i), 1);
+        }
+        simroot::set_cross_thread_lookahead(bus.get_route_latency());
+        simroot::set_sync_quantum(quantum);
+        simroot::start_sim();
+
+        bool ret = true;
+        uint64_t sent = 0, recved = 0;
+        logs.clear();
+        for(auto &t : traffic) {
+            sent += t->sent;
+            recved += t->log.size() / 4;
+            if(t->corrupted) ret = false;
+            logs.emplace_back(std::move(t->log));
+        }
+        printf("Quantum %ld: Send %ld, Recv %ld\n", quantum, sent, recved);
+        if(!ret) printf("Corrupted data received with quantum %ld\n", quantum);
+        if(recved == 0 || recved * 2 < sent) {
+            printf("Messages lost with quantum %ld\n", quantum);
+            ret = false;
+        }
+        return ret;
+    };
+
+    bool ret = true;
+    vector<vector<uint64_t>> ref, cur;
+    ret = run(1, ref) && ret;
+    for(uint64_t quantum : {3UL, 3UL, 2UL}) {
+        ret = run(quantum, cur) && ret;
+        if(cur != ref) {
+            printf("Results differ with quantum %ld\n", quantum);
+            ret = false;
+        }
+    }
+
+    simroot::set_sync_quantum(conf::get_int("root", "sync_quantum", 1));
+    simroot::set_sim_thread_num(conf::get_int("root", "thread_num", 4));
+    if(ret) printf("Pass!!!\n");
+    return ret;
+}
+
 }
@@ -25,10 +25,14 @@
 
 #include "businterface.h"
 #include "simroot.h"
+#include "tickqueue.h"
+#include "objpool.h"
+
+#include <atomic>
 
 namespace simbus {
 
-typedef uint32_t XmitIDT;
+typedef uint64_t XmitIDT;
 
 /**
  * 对称多通道的抽象物理层总线模拟实现
@@ -56,7 +60,16 @@ public:
     virtual bool can_recv(BusPortT port, ChannelT channel);
     virtual bool recv(BusPortT port, ChannelT channel, vector<uint8_t> &buf);
 
+    virtual bool send_msg(BusPortT port, BusPortT dst_port, ChannelT channel, BusMessage *msg);
+    virtual bool recv_msg(BusPortT port, ChannelT channel, BusMessage **msg);
+
+    virtual void set_port_owner(BusPortT port, SimObject *owner);
+
+    // 消息跨越一个总线节点所需的最少周期，可作为总线两端对象之间的通信延迟
+    inline uint32_t get_route_latency() { return route_latency; }
+
     virtual void apply_next_tick();
+    virtual void on_sim_start();
 
     virtual void clear_statistic();
     virtual void print_statistic(std::ofstream &ofile);
@@ -69,13 +82,15 @@ protected:
     uint32_t width = 0;
     uint32_t route_latency = 0;
     uint32_t node_buf_sz = 0;
-    uint32_t xmtid_alloc = 0;
+    uint32_t port_buf_sz = 0;
+    uint32_t port_send_latency = 0;     // 端口到所在节点的链路延迟
+    uint32_t port_recv_latency = 0;     // 节点到端口的链路延迟
     vector<uint32_t> cha_widths;
     vector<BusNodeT> init_port_to_node;
     unordered_map<BusPortT, BusNodeT> port2node;
     BusRouteTable route;
     
-    typedef struct {
+    typedef struct MsgPack {
         BusPortT        src;
         BusPortT        dst;
         BusNodeT        tgt;
@@ -85,7 +100,9 @@ protected:
         uint16_t        pac_idx;
         uint16_t        pac_cnt;
         vector<uint8_t> data;
+        BusMessage      *msg;       // 对象消息只挂在第0个包上，此时data为空
         uint64_t        tx_start_tick;
+        OBJPOOL_NEW_DELETE(MsgPack)
     } MsgPack;
 
     typedef struct {
@@ -101,9 +118,19 @@ protected:
         uint64_t            busy_cycles = 0;
     } EdgeInChannel;
 
+    // 端口缓存的生产者与消费者可能位于不同的模拟线程
+    // send_buf: 端口所有者写入，总线读取；recv_buf: 总线写入，端口所有者读取
+    typedef SPSCTickChannel<MsgPack*> PortChannel;
+
+    // xmtid_alloc与接收统计只由端口所有者访问
     typedef struct {
-        vector<list<MsgPack*>>      recv_buf;
-        vector<list<MsgPack*>>      send_buf;
+        vector<unique_ptr<PortChannel>>     recv_buf;
+        vector<unique_ptr<PortChannel>>     send_buf;
+        SimObject                           *owner = nullptr;
+        uint32_t                            xmtid_alloc = 0;
+        uint64_t                            rx_pack_num = 0;
+        uint64_t                            rx_pack_cycle_sum = 0;
+        unordered_map<BusPortT, uint64_t>   rx_pack_num_from;
     } PortStruct;
 
     typedef struct {
@@ -133,9 +160,15 @@ protected:
     void process_node(NodeStruct *node);
     void process_edge(EdgeInChannel *edge);
 
-    uint64_t tx_pack_num = 0;
-    uint64_t tx_pack_cycle_sum = 0;
-    unordered_map<uint64_t, uint64_t> transmit_cnt;
+    bool can_deliver(NodeStruct *node, MsgPack *pack);
+
+    void on_pack_recieved(PortStruct *port, MsgPack *p);
+    bool recv_ready(PortChannel &rbuf);
+
+    uint64_t cur_tick = 0;
+
+    // 已发送但尚未到达目标节点的包数量，为0时总线进入空闲休眠，由send唤醒
+    std::atomic<int64_t> pending_pack_cnt = 0;
 
     string logname;
     simroot::LogFileT log_ofile = nullptr;
@@ -149,6 +182,7 @@ protected:
 namespace test {
 
 bool test_sym_mul_cha_bus();
+bool test_sym_mul_cha_bus_threads();
 
 }
 
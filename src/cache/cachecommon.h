@@ -29,123 +29,257 @@
 
 namespace simcache {
 
+enum class CacheReplacePolicy {
+    lru = 0,    // 真LRU，每路记录最近访问时间戳
+    plru,       // 树形伪LRU，每组的树节点位压缩在一个uint64_t中，要求路数为2的幂
+};
+
+/**
+ * 组相联缓存存储，每组的tag与payload分别连续存放在定长数组中
+ * 有效位与pin位按组压缩为位图，每组最多64路
+ * 被pin的行不会被选为替换对象，直到unpin
+*/
 template <typename PayloadT>
 class GenericLRUCacheBlock {
 public:
-    GenericLRUCacheBlock(uint32_t set_addr_offset, uint32_t line_per_set) {
+    GenericLRUCacheBlock(uint32_t set_addr_offset, uint32_t line_per_set, CacheReplacePolicy policy = CacheReplacePolicy::lru) {
+        simroot_assertf(line_per_set > 0 && line_per_set <= 64, "Cache Block: Unsupported way count %d", line_per_set);
+        simroot_assertf(policy != CacheReplacePolicy::plru || !(line_per_set & (line_per_set - 1)), "Cache Block: PLRU requires power-of-2 ways, got %d", line_per_set);
         this->set_addr_offset = set_addr_offset;
         this->line_per_set = line_per_set;
         this->set_count = 1 << set_addr_offset;
-        p_sets = new std::unordered_map<LineIndexT, PayloadT>[set_count];
-        p_lrus = new std::list<LineIndexT>[set_count];
-    };
-    ~GenericLRUCacheBlock() {
-        if(p_sets) delete[] p_sets;
-        if(p_lrus) delete[] p_lrus;
+        this->policy = policy;
+        plru_level = std::__countr_zero<uint32_t>(line_per_set);
+        tags.assign((uint64_t)set_count * line_per_set, 0);
+        payloads.resize((uint64_t)set_count * line_per_set);
+        lru_stamps.assign((uint64_t)set_count * line_per_set, 0);
+        valid_mask.assign(set_count, 0);
+        pinned_mask.assign(set_count, 0);
+        plru_bits.assign(set_count, 0);
     };
 
     // return true if hit
     bool get_line(LineIndexT lindex, PayloadT **out, bool lru_tag = false) {
-        bool hit = false;
-        std::unordered_map<LineIndexT, PayloadT> &set = p_sets[line_index_to_set_index(lindex)];
-        std::list<LineIndexT> &lru = p_lrus[line_index_to_set_index(lindex)];
-        auto res = set.find(lindex);
-        if(res != set.end()) {
-            if(out) *out = &(res->second);
-            hit = true;
-            if(lru_tag) {
-                tag_lru(lindex);
-            }
-        }
-        return hit;
+        uint32_t set = line_index_to_set_index(lindex);
+        int32_t way = find_way(set, lindex);
+        if(way < 0) return false;
+        if(out) *out = &(payloads[set * line_per_set + way]);
+        if(lru_tag) touch(set, way);
+        return true;
     }
     // return true if hit
     bool update_line(LineIndexT lindex, PayloadT *buf, bool lru_tag = false) {
-        bool hit = false;
-        std::unordered_map<LineIndexT, PayloadT> &set = p_sets[line_index_to_set_index(lindex)];
-        auto res = set.find(lindex);
-        if(res != set.end()) {
-            res->second = *buf;
-            hit = true;
-            if(lru_tag) {
-                tag_lru(lindex);
-            }
-        }
-        return hit;
+        uint32_t set = line_index_to_set_index(lindex);
+        int32_t way = find_way(set, lindex);
+        if(way < 0) return false;
+        payloads[set * line_per_set + way] = *buf;
+        if(lru_tag) touch(set, way);
+        return true;
     }
     // return true if replaced
     bool insert_line(LineIndexT lindex, PayloadT *buf, LineIndexT *replaced, PayloadT *replaced_buf) {
         bool ret = false;
-        std::unordered_map<LineIndexT, PayloadT> &set = p_sets[line_index_to_set_index(lindex)];
-        std::list<LineIndexT> &lru = p_lrus[line_index_to_set_index(lindex)];
-        auto res = set.find(lindex);
-        if(res != set.end()) {
-            res->second = *buf;
-            tag_lru(lindex);
-        }
-        else if(set.size() < line_per_set) {
-            set.insert(std::make_pair(lindex, *buf));
-            tag_lru(lindex);
-        }
-        else {
-            ret = true;
-            if(replaced) *replaced = lru.back();
-            PayloadT *tmp = nullptr;
-            simroot_assert(get_line(lru.back(), &tmp, false));
-            if(replaced_buf) *replaced_buf = *tmp;
-            remove_line(lru.back());
-            set.insert(std::make_pair(lindex, *buf));
-            tag_lru(lindex);
+        uint32_t set = line_index_to_set_index(lindex);
+        int32_t way = find_way(set, lindex);
+        if(way < 0) {
+            uint64_t free_ways = ~valid_mask[set] & way_mask();
+            if(free_ways) {
+                way = std::__countr_zero<uint64_t>(free_ways);
+            }
+            else {
+                ret = true;
+                way = victim(set);
+                if(replaced) *replaced = tags[set * line_per_set + way];
+                if(replaced_buf) *replaced_buf = payloads[set * line_per_set + way];
+            }
+            tags[set * line_per_set + way] = lindex;
+            valid_mask[set] |= (1UL << way);
+            pinned_mask[set] &= ~(1UL << way);
         }
+        payloads[set * line_per_set + way] = *buf;
+        touch(set, way);
         return ret;
     }
     void remove_line(LineIndexT lindex) {
-        bool hit = false;
-        std::unordered_map<LineIndexT, PayloadT> &set = p_sets[line_index_to_set_index(lindex)];
-        std::list<LineIndexT> &lru = p_lrus[line_index_to_set_index(lindex)];
-        set.erase(lindex);
-        lru.remove(lindex);
-        pinned_line.erase(lindex);
+        uint32_t set = line_index_to_set_index(lindex);
+        int32_t way = find_way(set, lindex);
+        if(way < 0) return;
+        valid_mask[set] &= ~(1UL << way);
+        pinned_mask[set] &= ~(1UL << way);
     }
     void clear() {
-        for(int i = 0; i < set_count; i++) {
-            p_sets[i].clear();
-            p_lrus[i].clear();
-        }
+        valid_mask.assign(set_count, 0);
+        pinned_mask.assign(set_count, 0);
+        plru_bits.assign(set_count, 0);
     }
     void pin(LineIndexT lindex) {
-        std::list<LineIndexT> &lru = p_lrus[line_index_to_set_index(lindex)];
-        auto iter = find_iteratable(lru.begin(), lru.end(), lindex);
-        if(iter != lru.end()) {
-            lru.erase(iter);
-            pinned_line.insert(lindex);
-        }
+        uint32_t set = line_index_to_set_index(lindex);
+        int32_t way = find_way(set, lindex);
+        if(way >= 0) pinned_mask[set] |= (1UL << way);
     }
     void unpin(LineIndexT lindex) {
-        std::list<LineIndexT> &lru = p_lrus[line_index_to_set_index(lindex)];
-        auto iter = pinned_line.find(lindex);
-        if(iter != pinned_line.end()) {
-            pinned_line.erase(lindex);
-            lru.push_front(lindex);
+        uint32_t set = line_index_to_set_index(lindex);
+        int32_t way = find_way(set, lindex);
+        if(way >= 0 && (pinned_mask[set] & (1UL << way))) {
+            pinned_mask[set] &= ~(1UL << way);
+            touch(set, way);
+        }
+    }
+
+    /**
+     * 获取一组中所有有效的行，用于调试输出
+    */
+    void get_set_lines(uint32_t set, std::vector<std::pair<LineIndexT, PayloadT*>> &out) {
+        out.clear();
+        for(uint64_t m = valid_mask[set]; m; m &= (m - 1)) {
+            uint32_t way = std::__countr_zero<uint64_t>(m);
+            out.emplace_back(tags[set * line_per_set + way], &(payloads[set * line_per_set + way]));
         }
     }
 
     uint32_t set_addr_offset;
     uint32_t set_count;
     uint32_t line_per_set;
+    CacheReplacePolicy policy;
 
-    std::unordered_map<LineIndexT, PayloadT> *p_sets = nullptr;
-    std::list<LineIndexT> *p_lrus = nullptr;
-    std::set<LineIndexT> pinned_line;
-
-    inline void tag_lru(LineIndexT lindex) {
-        std::list<LineIndexT> &lru = p_lrus[line_index_to_set_index(lindex)];
-        lru.remove(lindex);
-        lru.push_front(lindex);
-    }
     inline uint32_t line_index_to_set_index(LineIndexT lindex) {
         return (lindex & (set_count - 1));
     }
+
+protected:
+    std::vector<LineIndexT> tags;
+    std::vector<PayloadT> payloads;
+    std::vector<uint64_t> lru_stamps;
+    std::vector<uint64_t> valid_mask;
+    std::vector<uint64_t> pinned_mask;
+    std::vector<uint64_t> plru_bits;
+    uint32_t plru_level = 0;
+    uint64_t lru_clock = 0;
+
+    inline uint64_t way_mask() {
+        return ((line_per_set == 64)?(~0UL):((1UL << line_per_set) - 1));
+    }
+
+    // 无分支比较整组tag生成命中位图，便于编译器向量化
+    inline int32_t find_way(uint32_t set, LineIndexT lindex) {
+        const LineIndexT *t = tags.data() + (uint64_t)set * line_per_set;
+        uint64_t hit = 0;
+        for(uint32_t w = 0; w < line_per_set; w++) {
+            hit |= ((uint64_t)(t[w] == lindex) << w);
+        }
+        hit &= valid_mask[set];
+        return (hit ? (int32_t)std::__countr_zero<uint64_t>(hit) : -1);
+    }
+
+    inline void touch(uint32_t set, uint32_t way) {
+        if(policy == CacheReplacePolicy::lru) {
+            lru_stamps[(uint64_t)set * line_per_set + way] = (++lru_clock);
+        }
+        else {
+            // 与ReplacerPLRU相同的树结构，节点i的位为1表示左子树较新
+            uint64_t &bits = plru_bits[set];
+            uint32_t idx = way + line_per_set;
+            for(uint32_t n = 0; n < plru_level; n++) {
+                uint32_t node = (idx >> 1);
+                if(idx & 1) bits &= ~(1UL << node);
+                else bits |= (1UL << node);
+                idx = node;
+            }
+        }
+    }
+
+    inline uint32_t victim(uint32_t set) {
+        uint64_t cand = valid_mask[set] & ~pinned_mask[set];
+        simroot_assertf(cand, "Cache Block: All lines in set %d are pinned", set);
+        if(policy == CacheReplacePolicy::plru) {
+            uint64_t bits = plru_bits[set];
+            uint32_t i = 1;
+            for(uint32_t n = 0; n < plru_level; n++) {
+                i = (i << 1) | ((bits >> i) & 1);
+            }
+            uint32_t way = i - line_per_set;
+            if(cand & (1UL << way)) return way;
+            return std::__countr_zero<uint64_t>(cand);
+        }
+        const uint64_t *st = lru_stamps.data() + (uint64_t)set * line_per_set;
+        uint32_t ret = std::__countr_zero<uint64_t>(cand);
+        for(uint64_t m = cand & (cand - 1); m; m &= (m - 1)) {
+            uint32_t way = std::__countr_zero<uint64_t>(m);
+            if(st[way] < st[ret]) ret = way;
+        }
+        return ret;
+    }
+};
+
+/**
+ * 目录项的共享者位图，编号小于INLINE_WORDS*64的节点内联存放，更大的编号放在扩展位图中
+ * 一致性协议要求失效消息只发给真正的共享者，因此超出内联宽度后仍然精确记录，不退化为粗粒度位向量
+ * 扩展位图为空时复制不分配内存
+*/
+template<uint32_t INLINE_WORDS>
+class SharerBitmap {
+public:
+    static const uint32_t INLINE_BITS = INLINE_WORDS * 64;
+
+    inline void insert(uint32_t idx) {
+        if(idx < INLINE_BITS) [[likely]] {
+            bits[idx >> 6] |= (1UL << (idx & 63));
+            return;
+        }
+        idx -= INLINE_BITS;
+        if(ext.size() <= (idx >> 6)) ext.resize((idx >> 6) + 1, 0);
+        ext[idx >> 6] |= (1UL << (idx & 63));
+    }
+    inline void erase(uint32_t idx) {
+        if(idx < INLINE_BITS) [[likely]] {
+            bits[idx >> 6] &= ~(1UL << (idx & 63));
+            return;
+        }
+        idx -= INLINE_BITS;
+        if(ext.size() > (idx >> 6)) ext[idx >> 6] &= ~(1UL << (idx & 63));
+    }
+    inline bool contains(uint32_t idx) {
+        if(idx < INLINE_BITS) [[likely]] return (bits[idx >> 6] >> (idx & 63)) & 1;
+        idx -= INLINE_BITS;
+        return ext.size() > (idx >> 6) && ((ext[idx >> 6] >> (idx & 63)) & 1);
+    }
+    inline void clear() {
+        for(uint32_t i = 0; i < INLINE_WORDS; i++) bits[i] = 0;
+        ext.clear();
+    }
+    inline uint32_t count() {
+        uint32_t ret = 0;
+        for(uint32_t i = 0; i < INLINE_WORDS; i++) ret += std::__popcount<uint64_t>(bits[i]);
+        for(auto w : ext) ret += std::__popcount<uint64_t>(w);
+        return ret;
+    }
+    inline bool empty() {
+        for(uint32_t i = 0; i < INLINE_WORDS; i++) if(bits[i]) return false;
+        for(auto w : ext) if(w) return false;
+        return true;
+    }
+    // 编号最小的共享者，为空时返回UINT32_MAX
+    inline uint32_t first() {
+        for(uint32_t i = 0; i < INLINE_WORDS; i++) if(bits[i]) return (i << 6) + std::__countr_zero<uint64_t>(bits[i]);
+        for(uint32_t i = 0; i < ext.size(); i++) if(ext[i]) return INLINE_BITS + (i << 6) + std::__countr_zero<uint64_t>(ext[i]);
+        return UINT32_MAX;
+    }
+    template<typename F>
+    inline void for_each(F f) {
+        for(uint32_t i = 0; i < INLINE_WORDS; i++) {
+            for(uint64_t m = bits[i]; m; m &= (m - 1)) f((i << 6) + std::__countr_zero<uint64_t>(m));
+        }
+        for(uint32_t i = 0; i < ext.size(); i++) {
+            for(uint64_t m = ext[i]; m; m &= (m - 1)) f(INLINE_BITS + (i << 6) + std::__countr_zero<uint64_t>(m));
+        }
+    }
+    inline uint64_t ext_bytes() {
+        return ext.capacity() * sizeof(uint64_t);
+    }
+
+protected:
+    uint64_t bits[INLINE_WORDS] = {0};
+    std::vector<uint64_t> ext;
 };
 
 template<typename PayloadT>
@@ -26,6 +26,7 @@
 #include "common.h"
 #include "simerror.h"
 #include "tickqueue.h"
+#include "objpool.h"
 
 #include "cpu/amo.h"
 
@@ -41,6 +42,7 @@ typedef struct {
     uint32_t    index_width = 2;
     uint32_t    nuca_num = 1;
     uint32_t    nuca_index = 0;
+    uint32_t    bank_num = 1;       // 按行地址低位交织的Bank数，需为2的幂，每个Bank有独立的索引流水线与MSHR
 } CacheParam;
 
 typedef std::array<uint8_t, CACHE_LINE_LEN_BYTE> CacheLineT;
@@ -87,6 +89,14 @@ public:
     /// @brief Get the index of the lines arrived in current cycle
     /// @return Count
     virtual uint32_t arrival_line(vector<ArrivalLine> *out) = 0;
+
+    /// @brief 提示随后的访存操作所属指令的PC，供PC索引的预取器训练，不支持预取的Cache可忽略
+    /// @param pc 访存指令的虚拟地址
+    virtual void set_access_pc(VirtAddrT pc) {};
+
+    /// @brief 提示Cache预取指定地址所在的行，不保证执行，不支持预取的Cache可忽略
+    /// @param paddr simulated-physical-address
+    virtual void prefetch(PhysAddrT paddr) {};
 };
 
 enum class CacheOPCode {
@@ -95,7 +105,7 @@ enum class CacheOPCode {
     amo
 };
 
-typedef struct {
+typedef struct CacheOP {
     CacheOPCode     opcode = CacheOPCode::load;
     void*           param = nullptr;
     PhysAddrT       addr = 0;
@@ -104,9 +114,12 @@ typedef struct {
     SimError        err = SimError::success;
     vector<uint8_t> data;
     vector<bool>    valid;
+    OBJPOOL_NEW_DELETE(CacheOP)
 } CacheOP;
 
 
+// CPU与L1之间的队列按每周期的输入/输出宽度模拟流水级，由CPU在同一注册组中驱动，不会跨越模拟线程，
+// 因此仍使用SimpleTickQueue而不是带链路延迟的SPSCTickChannel
 class CacheInterfaceV2 : public CacheInterface {
 public:
     /// @brief 
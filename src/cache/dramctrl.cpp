@@ -0,0 +1,361 @@
+// MIT License
+
+// Copyright (c) 2024 Meng Chengzhen, in Shandong University
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "dramctrl.h"
+
+#include "simroot.h"
+#include "configuration.h"
+
+namespace simcache {
+
+DRAMController::DRAMController(DRAMParam &param) : param(param) {
+    simroot_assertf(param.channels && param.ranks && param.banks, "DRAM: channels, ranks and banks must be positive");
+    simroot_assertf(param.row_size_byte >= CACHE_LINE_LEN_BYTE, "DRAM: row_size_byte < CACHE_LINE_LEN_BYTE");
+    simroot_assertf(param.write_low_watermark < param.write_high_watermark && param.write_high_watermark <= param.write_queue_size,
+        "DRAM: write watermarks must satisfy low < high <= write_queue_size");
+    lines_per_row = param.row_size_byte / CACHE_LINE_LEN_BYTE;
+    banks.resize(param.channels * param.ranks * param.banks);
+    ranks.resize(param.channels * param.ranks);
+    channels.resize(param.channels);
+    bank_claimed.resize(param.ranks * param.banks);
+    // 各Rank的刷新错开
+    for(uint32_t i = 0; i < ranks.size(); i++) {
+        ranks[i].next_refresh = param.tREFI + (uint64_t)(param.tREFI) * i / ranks.size();
+    }
+}
+
+void DRAMController::load_param(DRAMParam &param, uint32_t dwidth) {
+    param.channels = conf::get_int("dram", "channels", param.channels);
+    param.ranks = conf::get_int("dram", "ranks", param.ranks);
+    param.banks = conf::get_int("dram", "banks", param.banks);
+    param.row_size_byte = conf::get_int("dram", "row_size_byte", param.row_size_byte);
+    param.page_policy = conf::get_int("dram", "page_policy", param.page_policy);
+    param.tCAS = conf::get_int("dram", "tCAS", param.tCAS);
+    param.tCWL = conf::get_int("dram", "tCWL", param.tCWL);
+    param.tRCD = conf::get_int("dram", "tRCD", param.tRCD);
+    param.tRP = conf::get_int("dram", "tRP", param.tRP);
+    param.tRAS = conf::get_int("dram", "tRAS", param.tRAS);
+    param.tWR = conf::get_int("dram", "tWR", param.tWR);
+    param.tRTP = conf::get_int("dram", "tRTP", param.tRTP);
+    param.tWTR = conf::get_int("dram", "tWTR", param.tWTR);
+    param.tRTW = conf::get_int("dram", "tRTW", param.tRTW);
+    param.tBURST = conf::get_int("dram", "tBURST", 0);
+    if(param.tBURST == 0) param.tBURST = CEIL_DIV(CACHE_LINE_LEN_BYTE, dwidth);
+    param.tREFI = conf::get_int("dram", "tREFI", param.tREFI);
+    param.tRFC = conf::get_int("dram", "tRFC", param.tRFC);
+    param.read_queue_size = conf::get_int("dram", "read_queue_size", param.read_queue_size);
+    param.write_queue_size = conf::get_int("dram", "write_queue_size", param.write_queue_size);
+    param.write_high_watermark = conf::get_int("dram", "write_high_watermark", param.write_high_watermark);
+    param.write_low_watermark = conf::get_int("dram", "write_low_watermark", param.write_low_watermark);
+}
+
+void DRAMController::catch_up(uint64_t now) {
+    if(now <= cur_tick) return;
+    cur_tick = now;
+    // 空闲期间错过的刷新直接补记，刷新会关闭所有行
+    for(uint32_t i = 0; i < ranks.size(); i++) {
+        DRAMRank &rk = ranks[i];
+        if(rk.next_refresh + param.tREFI > cur_tick) continue;
+        DRAMBank *pb = &(banks[i * param.banks]);
+        while(rk.next_refresh + param.tREFI <= cur_tick) {
+            uint64_t start = rk.next_refresh;
+            for(uint32_t b = 0; b < param.banks; b++) {
+                if(pb[b].open_row >= 0) start = std::max(start, pb[b].next_pre + param.tRP);
+                else start = std::max(start, pb[b].next_act);
+                pb[b].open_row = -1;
+            }
+            rk.refresh_until = start + param.tRFC;
+            for(uint32_t b = 0; b < param.banks; b++) {
+                pb[b].next_act = std::max(pb[b].next_act, rk.refresh_until);
+            }
+            rk.next_refresh += param.tREFI;
+            statistic.refresh_cnt++;
+        }
+    }
+}
+
+void DRAMController::push(uint64_t now, uint64_t id, uint64_t local_line, bool write) {
+    catch_up(now);
+    DRAMRequest r;
+    r.id = id;
+    r.arrive = cur_tick;
+    r.write = write;
+    uint64_t l = local_line / lines_per_row;
+    r.channel = l % param.channels;
+    l /= param.channels;
+    r.bank = l % param.banks;
+    l /= param.banks;
+    r.rank = l % param.ranks;
+    r.row = l / param.ranks;
+    if(write) {
+        simroot_assert(write_q.size() < param.write_queue_size);
+        write_q.push_back(r);
+    }
+    else {
+        simroot_assert(read_q.size() < param.read_queue_size);
+        read_q.push_back(r);
+    }
+}
+
+void DRAMController::tick(uint64_t now, vector<uint64_t> &done) {
+    catch_up(now);
+
+    if(!write_mode) {
+        if(write_q.size() >= param.write_high_watermark) {
+            write_mode = true;
+            statistic.write_drain_cnt++;
+        }
+        else if(read_q.empty() && !write_q.empty()) {
+            write_mode = true;
+        }
+    }
+    else if(write_q.empty() || (write_q.size() <= param.write_low_watermark && !read_q.empty())) {
+        write_mode = false;
+    }
+
+    for(uint32_t ch = 0; ch < param.channels; ch++) {
+        do_refresh(ch);
+        schedule(ch);
+    }
+
+    for(uint64_t i = 0; i < inflight.size(); ) {
+        if(inflight[i].first <= cur_tick) {
+            done.push_back(inflight[i].second);
+            inflight[i] = inflight.back();
+            inflight.pop_back();
+        }
+        else i++;
+    }
+}
+
+void DRAMController::do_refresh(uint32_t ch) {
+    for(uint32_t r = 0; r < param.ranks; r++) {
+        DRAMRank &rk = ranks[ch * param.ranks + r];
+        if(cur_tick < rk.next_refresh) continue;
+        // 关闭所有行后刷新，期间整个Rank不能激活
+        uint64_t start = cur_tick;
+        DRAMBank *pb = &(banks[(ch * param.ranks + r) * param.banks]);
+        for(uint32_t b = 0; b < param.banks; b++) {
+            if(pb[b].open_row >= 0) start = std::max(start, pb[b].next_pre + param.tRP);
+            else start = std::max(start, pb[b].next_act);
+        }
+        rk.refresh_until = start + param.tRFC;
+        for(uint32_t b = 0; b < param.banks; b++) {
+            pb[b].open_row = -1;
+            pb[b].next_act = rk.refresh_until;
+        }
+        rk.next_refresh += param.tREFI;
+        statistic.refresh_cnt++;
+    }
+}
+
+bool DRAMController::has_row_hit(DRAMRequest &r) {
+    for(auto *q : {&read_q, &write_q}) {
+        for(auto &e : *q) {
+            if(e.channel == r.channel && e.rank == r.rank && e.bank == r.bank && e.row == r.row) return true;
+        }
+    }
+    return false;
+}
+
+bool DRAMController::try_issue_column(std::deque<DRAMRequest> &q, std::deque<DRAMRequest>::iterator iter) {
+    DRAMRequest &r = *iter;
+    DRAMBank &b = bank_of(r);
+    DRAMChannel &c = channels[r.channel];
+    if(cur_tick < b.next_col) return false;
+    if(cur_tick < (r.write ? c.next_wr : c.next_rd)) return false;
+    uint64_t data_start = cur_tick + (r.write ? param.tCWL : param.tCAS);
+    if(data_start < c.bus_free) return false;
+    uint64_t data_end = data_start + param.tBURST;
+    c.bus_free = data_end;
+    b.next_col = cur_tick + param.tBURST;
+    if(r.write) {
+        c.next_rd = std::max(c.next_rd, data_end + param.tWTR);
+        b.next_pre = std::max(b.next_pre, data_end + param.tWR);
+        statistic.write_cnt++;
+    }
+    else {
+        c.next_wr = std::max(c.next_wr, data_end + param.tRTW);
+        b.next_pre = std::max(b.next_pre, cur_tick + param.tRTP);
+        statistic.read_cnt++;
+        statistic.read_latency_sum += (data_end - r.arrive);
+        inflight.emplace_back(data_end, r.id);
+    }
+    if(r.conflicted) statistic.row_conflict_cnt++;
+    else if(r.activated) statistic.row_miss_cnt++;
+    else statistic.row_hit_cnt++;
+    statistic.data_bus_busy += param.tBURST;
+
+    DRAMRequest done = r;
+    q.erase(iter);
+    if(param.page_policy == 1 && !has_row_hit(done)) {
+        // 关页策略：队列中没有其他请求命中该行时自动预充电
+        b.open_row = -1;
+        b.next_act = std::max(b.next_act, b.next_pre + param.tRP);
+    }
+    return true;
+}
+
+void DRAMController::schedule(uint32_t ch) {
+    std::deque<DRAMRequest> &q = (write_mode ? write_q : read_q);
+
+    // First-Ready：最早的已经可以发出列命令的行命中请求
+    for(auto iter = q.begin(); iter != q.end(); iter++) {
+        if(iter->channel != ch) continue;
+        if(bank_of(*iter).open_row == (int64_t)(iter->row) && try_issue_column(q, iter)) return;
+    }
+
+    // FCFS：为每个bank上最早的请求发出PRE或ACT，每周期一条命令
+    std::fill(bank_claimed.begin(), bank_claimed.end(), false);
+    for(auto iter = q.begin(); iter != q.end(); iter++) {
+        DRAMRequest &r = *iter;
+        if(r.channel != ch) continue;
+        uint32_t bidx = r.rank * param.banks + r.bank;
+        if(bank_claimed[bidx]) continue;
+        bank_claimed[bidx] = true;
+        DRAMBank &b = bank_of(r);
+        if(b.open_row == (int64_t)(r.row)) continue;
+        if(b.open_row >= 0) {
+            if(cur_tick < b.next_pre) continue;
+            b.open_row = -1;
+            b.next_act = std::max(b.next_act, cur_tick + param.tRP);
+            r.conflicted = true;
+            return;
+        }
+        if(cur_tick < b.next_act || cur_tick < rank_of(r).refresh_until) continue;
+        b.open_row = r.row;
+        b.next_col = std::max(b.next_col, cur_tick + param.tRCD);
+        b.next_pre = std::max(b.next_pre, cur_tick + param.tRAS);
+        r.activated = true;
+        return;
+    }
+}
+
+#define LOGTOFILE(fmt, ...) do{sprintf(log_buf, fmt, ##__VA_ARGS__);ofile << log_buf;}while(0)
+
+void DRAMController::print_statistic(std::ofstream &ofile) {
+    uint64_t access = statistic.row_hit_cnt + statistic.row_miss_cnt + statistic.row_conflict_cnt;
+    uint64_t total_ticks = cur_tick;
+    LOGTOFILE("dram_read_count: %ld\n", statistic.read_cnt);
+    LOGTOFILE("dram_write_count: %ld\n", statistic.write_cnt);
+    LOGTOFILE("dram_row_hit_rate: %f\n", (access)?(((double)statistic.row_hit_cnt) / access):0.);
+    LOGTOFILE("dram_row_miss_count: %ld\n", statistic.row_miss_cnt);
+    LOGTOFILE("dram_bank_conflict_count: %ld\n", statistic.row_conflict_cnt);
+    LOGTOFILE("dram_refresh_count: %ld\n", statistic.refresh_cnt);
+    LOGTOFILE("dram_write_drain_count: %ld\n", statistic.write_drain_cnt);
+    LOGTOFILE("dram_avg_read_latency: %f\n", (statistic.read_cnt)?(((double)statistic.read_latency_sum) / statistic.read_cnt):0.);
+    LOGTOFILE("dram_bandwidth_utilization: %f\n", (total_ticks)?(((double)statistic.data_bus_busy) / total_ticks / param.channels):0.);
+}
+
+void DRAMController::print_setup_info(std::ofstream &ofile) {
+    LOGTOFILE("dram_channels: %d\n", param.channels);
+    LOGTOFILE("dram_ranks: %d\n", param.ranks);
+    LOGTOFILE("dram_banks: %d\n", param.banks);
+    LOGTOFILE("dram_row_size_byte: %d\n", param.row_size_byte);
+    LOGTOFILE("dram_page_policy: %s\n", (param.page_policy == 1)?"closed":"open");
+    LOGTOFILE("dram_timing: tCAS=%d tCWL=%d tRCD=%d tRP=%d tRAS=%d tWR=%d tRTP=%d tWTR=%d tRTW=%d tBURST=%d tREFI=%d tRFC=%d\n",
+        param.tCAS, param.tCWL, param.tRCD, param.tRP, param.tRAS, param.tWR, param.tRTP, param.tWTR, param.tRTW,
+        param.tBURST, param.tREFI, param.tRFC);
+    LOGTOFILE("dram_queue_size: read %d, write %d\n", param.read_queue_size, param.write_queue_size);
+}
+
+#undef LOGTOFILE
+
+}
+
+namespace test {
+
+using simcache::DRAMController;
+using simcache::DRAMParam;
+
+static uint64_t _dram_run(DRAMParam &param, vector<uint64_t> &lines, uint64_t &done_cnt) {
+    DRAMController ctrl(param);
+    vector<uint64_t> done;
+    vector<bool> finished(lines.size(), false);
+    uint64_t pushed = 0, cycles = 0;
+    done_cnt = 0;
+    while(pushed < lines.size() || !ctrl.idle()) {
+        if(pushed < lines.size() && ctrl.can_accept()) {
+            ctrl.push(cycles, pushed, lines[pushed], false);
+            pushed++;
+        }
+        done.clear();
+        ctrl.tick(cycles, done);
+        for(auto id : done) {
+            if(id >= lines.size() || finished[id]) return UINT64_MAX;
+            finished[id] = true;
+            done_cnt++;
+        }
+        cycles++;
+        if(cycles > 100000000UL) return UINT64_MAX;
+    }
+    return cycles;
+}
+
+bool test_dram_ctrl() {
+    DRAMParam param;
+    const uint64_t num = 1024;
+    uint32_t lines_per_row = param.row_size_byte / CACHE_LINE_LEN_BYTE;
+    uint64_t done_cnt = 0;
+
+    // 顺序访问：绝大部分为行命中
+    vector<uint64_t> seq(num);
+    for(uint64_t i = 0; i < num; i++) seq[i] = i;
+    uint64_t seq_cycles = _dram_run(param, seq, done_cnt);
+    if(seq_cycles == UINT64_MAX || done_cnt != num) {
+        printf("Sequential reads not completed: %ld/%ld\n", done_cnt, num);
+        return false;
+    }
+
+    // 同一bank的不同行：每次访问都是行冲突
+    vector<uint64_t> conflict(num);
+    uint64_t row_stride = (uint64_t)lines_per_row * param.channels * param.banks * param.ranks;
+    for(uint64_t i = 0; i < num; i++) conflict[i] = i * row_stride;
+    uint64_t conflict_cycles = _dram_run(param, conflict, done_cnt);
+    if(conflict_cycles == UINT64_MAX || done_cnt != num) {
+        printf("Conflicting reads not completed: %ld/%ld\n", done_cnt, num);
+        return false;
+    }
+    if(conflict_cycles < seq_cycles * 4) {
+        printf("Row conflicts are too cheap: %ld cycles vs %ld cycles sequential\n", conflict_cycles, seq_cycles);
+        return false;
+    }
+
+    // 两行交替访问：FR-FCFS应当合并行命中，比关页策略更快
+    vector<uint64_t> pingpong(num);
+    for(uint64_t i = 0; i < num; i++) pingpong[i] = ((i & 1) ? row_stride : 0) + ((i >> 1) % lines_per_row);
+    uint64_t frfcfs_cycles = _dram_run(param, pingpong, done_cnt);
+    DRAMParam closed = param;
+    closed.page_policy = 1;
+    closed.read_queue_size = 1;
+    uint64_t fcfs_cycles = _dram_run(closed, pingpong, done_cnt);
+    if(frfcfs_cycles >= fcfs_cycles) {
+        printf("FR-FCFS does not reorder row hits: %ld cycles vs %ld cycles in order\n", frfcfs_cycles, fcfs_cycles);
+        return false;
+    }
+
+    printf("DRAM read %ld lines: sequential %ld cycles, conflict %ld cycles, ping-pong %ld/%ld cycles\n",
+        num, seq_cycles, conflict_cycles, frfcfs_cycles, fcfs_cycles);
+    return true;
+}
+
+}
@@ -0,0 +1,170 @@
+// MIT License
+
+// Copyright (c) 2024 Meng Chengzhen, in Shandong University
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef RVSIM_CACHE_DRAM_CTRL_H
+#define RVSIM_CACHE_DRAM_CTRL_H
+
+#include "common.h"
+
+#include <deque>
+
+namespace simcache {
+
+typedef struct {
+    uint32_t    channels = 1;
+    uint32_t    ranks = 1;
+    uint32_t    banks = 8;
+    uint32_t    row_size_byte = 8192;
+    uint32_t    page_policy = 0;    // 0: open page, 1: closed page
+    // 以下时序参数的单位均为模拟周期
+    uint32_t    tCAS = 34;
+    uint32_t    tCWL = 24;
+    uint32_t    tRCD = 34;
+    uint32_t    tRP = 34;
+    uint32_t    tRAS = 78;
+    uint32_t    tWR = 36;
+    uint32_t    tRTP = 18;
+    uint32_t    tWTR = 18;
+    uint32_t    tRTW = 8;
+    uint32_t    tBURST = 8;         // 一个CacheLine占用数据总线的周期数
+    uint32_t    tREFI = 18720;
+    uint32_t    tRFC = 840;
+    uint32_t    read_queue_size = 32;
+    uint32_t    write_queue_size = 32;
+    uint32_t    write_high_watermark = 24;
+    uint32_t    write_low_watermark = 8;
+} DRAMParam;
+
+/**
+ * 按通道/Rank/Bank建模的DRAM控制器，放在MemoryNode之后，只负责时序
+ * 地址是节点内的CacheLine下标（MemCtrlLineAddrMap给出的本地偏移），映射顺序为Row:Rank:Bank:Channel:Column
+ * 读写分为两个队列，按FR-FCFS调度：优先发出行命中的列命令，否则为最早的请求发出PRE/ACT
+ * 写队列超过高水位后切换为写优先，直到低于低水位
+ * 时钟跟随调用者传入的全局周期，空闲期间不调用tick，再次访问时先追赶时钟并补记错过的刷新
+ */
+class DRAMController {
+
+public:
+    DRAMController(DRAMParam &param);
+
+    // 从配置文件[dram]中读取参数，tBURST为0时按数据宽度计算
+    static void load_param(DRAMParam &param, uint32_t dwidth);
+
+    inline bool can_accept() {
+        return read_q.size() < param.read_queue_size && write_q.size() < param.write_queue_size;
+    }
+    void push(uint64_t now, uint64_t id, uint64_t local_line, bool write);
+
+    // 推进到周期now，数据传输完成的请求id输出到done
+    void tick(uint64_t now, vector<uint64_t> &done);
+
+    inline bool idle() {
+        return read_q.empty() && write_q.empty() && inflight.empty();
+    }
+
+    void print_statistic(std::ofstream &ofile);
+    void print_setup_info(std::ofstream &ofile);
+
+protected:
+    DRAMParam param;
+    uint32_t lines_per_row = 1;
+    uint64_t cur_tick = 0;
+
+    typedef struct {
+        uint64_t    id = 0;
+        uint64_t    arrive = 0;
+        uint64_t    row = 0;
+        uint32_t    channel = 0;
+        uint32_t    rank = 0;
+        uint32_t    bank = 0;
+        bool        write = false;
+        bool        activated = false;  // 为该请求发出过ACT
+        bool        conflicted = false; // 为该请求关闭过其他行
+    } DRAMRequest;
+
+    typedef struct {
+        int64_t     open_row = -1;
+        uint64_t    next_act = 0;
+        uint64_t    next_pre = 0;
+        uint64_t    next_col = 0;
+    } DRAMBank;
+
+    typedef struct {
+        uint64_t    next_refresh = 0;
+        uint64_t    refresh_until = 0;
+    } DRAMRank;
+
+    typedef struct {
+        uint64_t    bus_free = 0;
+        uint64_t    next_rd = 0;
+        uint64_t    next_wr = 0;
+    } DRAMChannel;
+
+    vector<DRAMBank> banks;     // [channel][rank][bank]
+    vector<DRAMRank> ranks;     // [channel][rank]
+    vector<DRAMChannel> channels;
+
+    std::deque<DRAMRequest> read_q;
+    std::deque<DRAMRequest> write_q;
+    bool write_mode = false;
+    vector<std::pair<uint64_t, uint64_t>> inflight;  // (完成周期, id)
+
+    inline DRAMBank &bank_of(DRAMRequest &r) {
+        return banks[(r.channel * param.ranks + r.rank) * param.banks + r.bank];
+    }
+    inline DRAMRank &rank_of(DRAMRequest &r) {
+        return ranks[r.channel * param.ranks + r.rank];
+    }
+
+    vector<bool> bank_claimed;
+
+    void catch_up(uint64_t now);
+    void do_refresh(uint32_t ch);
+    // 为通道ch发出至多一条命令
+    void schedule(uint32_t ch);
+    bool try_issue_column(std::deque<DRAMRequest> &q, std::deque<DRAMRequest>::iterator iter);
+    bool has_row_hit(DRAMRequest &r);
+
+    struct {
+        uint64_t read_cnt = 0;
+        uint64_t write_cnt = 0;
+        uint64_t row_hit_cnt = 0;
+        uint64_t row_miss_cnt = 0;      // bank空闲，只需ACT
+        uint64_t row_conflict_cnt = 0;  // bank打开了其他行，需要PRE+ACT
+        uint64_t refresh_cnt = 0;
+        uint64_t read_latency_sum = 0;
+        uint64_t data_bus_busy = 0;
+        uint64_t write_drain_cnt = 0;
+    } statistic;
+
+    char log_buf[256];
+};
+
+}
+
+namespace test {
+
+bool test_dram_ctrl();
+
+}
+
+#endif
@@ -36,6 +36,8 @@ DMAL1MoesiDirNoi::DMAL1MoesiDirNoi(
 ) : bus(bus), my_port_id(my_port_id), busmap(busmap), mshrs(32), push_lock(16) {
     do_on_current_tick = 2;
     do_apply_next_tick = 1;
+
+    bus->set_port_owner(my_port_id, this);
 }
 
 void DMAL1MoesiDirNoi::handle_recv_msg(CacheCohenrenceMsg &msgbuf) {
@@ -173,13 +175,13 @@ void DMAL1MoesiDirNoi::handle_recv_msg(CacheCohenrenceMsg &msgbuf) {
 }
 
 void DMAL1MoesiDirNoi::on_current_tick() {
-    CacheCohenrenceMsg recv;
-    vector<uint8_t> buf;
     for(uint32_t c = 0; c < CHANNEL_CNT; c++) {
         if(bus->can_recv(my_port_id, c)) {
-            simroot_assert(bus->recv(my_port_id, c, buf));
-            parse_msg_pack(buf, recv);
-            handle_recv_msg(recv);
+            simbus::BusMessage *m = nullptr;
+            simroot_assert(bus->recv_msg(my_port_id, c, &m));
+            CacheCohenrenceMsg *recv = static_cast<CacheCohenrenceMsg*>(m);
+            handle_recv_msg(*recv);
+            delete recv;
             break;
         }
     }
@@ -290,7 +292,7 @@ void DMAL1MoesiDirNoi::on_current_tick() {
     for(auto iter = send_buf.begin(); iter != send_buf.end(); ) {
         if(can_send[iter->cha]) {
             can_send[iter->cha] = false;
-            simroot_assert(bus->send(my_port_id, iter->dst, iter->cha, iter->msg));
+            simroot_assert(bus->send_msg(my_port_id, iter->dst, iter->cha, iter->msg));
             iter = send_buf.erase(iter);
         }
         else {
@@ -298,6 +300,10 @@ void DMAL1MoesiDirNoi::on_current_tick() {
         }
     }
 
+    bus_recv_pending = false;
+    for(uint32_t c = 0; c < CHANNEL_CNT && !bus_recv_pending; c++) {
+        bus_recv_pending = bus->can_recv(my_port_id, c);
+    }
 }
 
 }}
@@ -60,6 +60,7 @@ public:
         push_lock.lock();
         arrival_reqs.splice(arrival_reqs.end(), req);
         push_lock.unlock();
+        sim_wakeup();
     }
 
     // SimObject
@@ -67,6 +68,9 @@ public:
     virtual void apply_next_tick() {
         dma_req_queue.splice(dma_req_queue.end(), arrival_reqs);
         arrival_reqs.clear();
+        if(current == nullptr && dma_req_queue.empty() && send_buf.empty() && !bus_recv_pending) {
+            sim_sleep();
+        }
     }
 
     bool do_log = false;
@@ -102,36 +106,35 @@ protected:
     ProcessingDMAReq *current = nullptr;
 
     typedef struct {
-        vector<uint8_t>     msg;
+        CacheCohenrenceMsg  *msg;
         BusPortT            dst;
         uint32_t            cha;
     } ReadyToSend;
 
     std::list<ReadyToSend> send_buf;
     uint32_t send_buf_size = 4;
+    bool bus_recv_pending = false;
     inline void push_send_buf(BusPortT dst, uint32_t channel, uint32_t type, LineIndexT line, uint32_t arg) {
         send_buf.emplace_back();
         auto &send = send_buf.back();
         send.dst = dst;
         send.cha = channel;
-        CacheCohenrenceMsg tmp;
-        tmp.type = type;
-        tmp.line = line;
-        tmp.arg = arg;
-        construct_msg_pack(tmp, send.msg);
+        send.msg = new CacheCohenrenceMsg();
+        send.msg->type = type;
+        send.msg->line = line;
+        send.msg->arg = arg;
     }
     inline void push_send_buf_with_line(BusPortT dst, uint32_t channel, uint32_t type, LineIndexT line, uint32_t arg, void* linebuf) {
         send_buf.emplace_back();
         auto &send = send_buf.back();
         send.dst = dst;
         send.cha = channel;
-        CacheCohenrenceMsg tmp;
-        tmp.type = type;
-        tmp.line = line;
-        tmp.arg = arg;
-        tmp.data.resize(CACHE_LINE_LEN_BYTE);
-        cache_line_copy(tmp.data.data(), linebuf);
-        construct_msg_pack(tmp, send.msg);
+        send.msg = new CacheCohenrenceMsg();
+        send.msg->type = type;
+        send.msg->line = line;
+        send.msg->arg = arg;
+        send.msg->data.resize(CACHE_LINE_LEN_BYTE);
+        cache_line_copy(send.msg->data.data(), linebuf);
     }
 
     typedef struct {
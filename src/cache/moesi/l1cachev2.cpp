@@ -273,11 +273,13 @@ SimError L1CacheMoesiDirNoiV2::amo(PhysAddrT paddr, uint32_t len, void *buf, isa
 
 void L1CacheMoesiDirNoiV2::recieve_msg_nolock() {
     if(!has_recieved) {
-        vector<uint8_t> buf;
         for(uint32_t c = 0; c < CHANNEL_CNT; c++) {
             if(bus->can_recv(my_port_id, c)) {
-                simroot_assert(bus->recv(my_port_id, c, buf));
-                parse_msg_pack(buf, msgbuf);
+                simbus::BusMessage *m = nullptr;
+                simroot_assert(bus->recv_msg(my_port_id, c, &m));
+                CacheCohenrenceMsg *msg = static_cast<CacheCohenrenceMsg*>(m);
+                std::swap(msgbuf, *msg);
+                delete msg;
                 has_recieved = true;
                 break;
             }
@@ -508,7 +510,7 @@ void L1CacheMoesiDirNoiV2::send_msg_nolock() {
     bus->can_send(my_port_id, can_send);
     for(auto iter = send_buf.begin(); iter != send_buf.end(); ) {
         if(can_send[iter->cha]) {
-            simroot_assert(bus->send(my_port_id, iter->dst, iter->cha, iter->msg));
+            simroot_assert(bus->send_msg(my_port_id, iter->dst, iter->cha, iter->msg));
             can_send[iter->cha] = false;
             iter = send_buf.erase(iter);
         }
@@ -716,8 +718,10 @@ void L1CacheMoesiDirNoiV2::dump_core(std::ofstream &ofile) {
     for(uint32_t s = 0; s < block->set_count; s++) {
         sprintf(log_buf, "set %d: ", s);
         ofile << log_buf;
-        for(auto &e : block->p_sets[s]) {
-            sprintf(log_buf, "0x%lx:%s ", e.first, get_cache_state_name_str(e.second.state).c_str());
+        std::vector<std::pair<LineIndexT, TagedCacheLine*>> lines;
+        block->get_set_lines(s, lines);
+        for(auto &e : lines) {
+            sprintf(log_buf, "0x%lx:%s ", e.first, get_cache_state_name_str(e.second->state).c_str());
             ofile << log_buf;
         }
         ofile << "\n";
@@ -118,7 +118,7 @@ protected:
     std::vector<SimpleTickQueue<CacheOP*>> misc_queues;
 
     typedef struct {
-        vector<uint8_t>     msg;
+        CacheCohenrenceMsg  *msg;
         BusPortT            dst;
         uint32_t            cha;
     } ReadyToSend;
@@ -130,24 +130,22 @@ protected:
         auto &send = send_buf.back();
         send.dst = dst;
         send.cha = channel;
-        CacheCohenrenceMsg tmp;
-        tmp.type = type;
-        tmp.line = line;
-        tmp.arg = arg;
-        construct_msg_pack(tmp, send.msg);
+        send.msg = new CacheCohenrenceMsg();
+        send.msg->type = type;
+        send.msg->line = line;
+        send.msg->arg = arg;
     }
     inline void push_send_buf_with_line(BusPortT dst, uint32_t channel, uint32_t type, LineIndexT line, uint32_t arg, void* linebuf) {
         send_buf.emplace_back();
         auto &send = send_buf.back();
         send.dst = dst;
         send.cha = channel;
-        CacheCohenrenceMsg tmp;
-        tmp.type = type;
-        tmp.line = line;
-        tmp.arg = arg;
-        tmp.data.resize(CACHE_LINE_LEN_BYTE);
-        cache_line_copy(tmp.data.data(), linebuf);
-        construct_msg_pack(tmp, send.msg);
+        send.msg = new CacheCohenrenceMsg();
+        send.msg->type = type;
+        send.msg->line = line;
+        send.msg->arg = arg;
+        send.msg->data.resize(CACHE_LINE_LEN_BYTE);
+        cache_line_copy(send.msg->data.data(), linebuf);
     }
 
     typedef struct {
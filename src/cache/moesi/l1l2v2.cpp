@@ -52,6 +52,8 @@ PrivL1L2Moesi::PrivL1L2Moesi(
         l1d_st_queues.resize(query_cycle + 1, SimpleTickQueue<CacheOP*>(l1d_query_width, l1d_query_width, 0));
         l1d_amo_queues.resize(query_cycle + 1, SimpleTickQueue<CacheOP*>(l1d_query_width, l1d_query_width, 0));
         l1d_misc_queues.resize(query_cycle + 1, SimpleTickQueue<CacheOP*>(l1d_query_width, l1d_query_width, 0));
+        simroot_assertf(l1d_param.mshr_num, "L1D: mshr_num must be positive");
+        l1d_reqs.resize(l1d_param.mshr_num);
     }
 
     {
@@ -60,59 +62,94 @@ PrivL1L2Moesi::PrivL1L2Moesi(
         uint32_t query_cycle = l1i_param.index_latency;
         if(query_cycle < 1) query_cycle = 1;
         l1i_ld_queues.resize(query_cycle + 1, SimpleTickQueue<CacheOP*>(l1i_query_width, l1i_query_width, 0));
+        simroot_assertf(l1i_param.mshr_num, "L1I: mshr_num must be positive");
+        l1i_reqs.resize(l1i_param.mshr_num);
     }
 
-    mshrs = make_unique<MSHRArray<MSHREntry>>(l2_param.mshr_num);
     block = make_unique<GenericLRUCacheBlock<TagedCacheLine>>(l2_param.set_offset, l2_param.way_cnt);
     index_cycle = l2_param.index_latency;
     if(index_cycle < 1) index_cycle = 1;
 
-    queue_index = make_unique<SimpleTickQueue<ProcessingPackage*>>(1, 1, 0);
+    bank_num = l2_param.bank_num;
+    simroot_assertf(bank_num && !(bank_num & (bank_num - 1)) && bank_num <= block->set_count,
+        "L2: bank_num %d should be power of 2 and no more than set count %d", bank_num, block->set_count);
+    for(uint32_t b = 0; b < bank_num; b++) {
+        mshrs.emplace_back(make_unique<MSHRArray<MSHREntry>>(l2_param.mshr_num));
+        queue_index.emplace_back(make_unique<SimpleTickQueue<ProcessingPackage*>>(1, 1, 0));
+    }
+    bank_access_count.assign(bank_num, 0);
+    bank_conflict_cycle.assign(bank_num, 0);
+    bank_conflict.assign(bank_num, false);
+
+    bus->set_port_owner(my_port_id, this);
 
     // log_info = true;
 }
 
+void PrivL1L2Moesi::set_prefetcher(PrefetcherParam &param, string l1d_type, string l2_type, bool l1i_next_line) {
+    l1d_prefetcher.reset(Prefetcher::create(l1d_type, param));
+    l2_prefetcher.reset(Prefetcher::create(l2_type, param));
+    this->l1i_next_line = l1i_next_line;
+    pf_queue_size = param.queue_size;
+    pf_mshr_reserve = param.mshr_reserve;
+    simroot_assertf(pf_mshr_reserve < l2_param.mshr_num, "L2 Prefetch: mshr_reserve %d >= mshr_num %d", pf_mshr_reserve, l2_param.mshr_num);
+}
+
 void PrivL1L2Moesi::dump_core(std::ofstream &ofile) {
     ofile << "L2:\n";
     for(uint32_t s = 0; s < block->set_count; s++) {
         sprintf(log_buf, "set %d: ", s);
         ofile << log_buf;
-        for(auto &e : block->p_sets[s]) {
-            sprintf(log_buf, "0x%lx:%s-%d ", e.first, get_cache_state_name_str(e.second.state).c_str(), e.second.flag);
+        std::vector<std::pair<LineIndexT, TagedCacheLine*>> lines;
+        block->get_set_lines(s, lines);
+        for(auto &e : lines) {
+            sprintf(log_buf, "0x%lx:%s-%d ", e.first, get_cache_state_name_str(e.second->state).c_str(), e.second->flag);
             ofile << log_buf;
         }
         ofile << "\n";
     }
     ofile << "mshr: ";
-    for(auto &e : mshrs->hashmap) {
-        sprintf(log_buf, "0x%lx:%s,%d-%d ", e.first, get_cache_mshr_state_name_str(e.second.state).c_str(), e.second.line_flag, e.second.finish_flag);
-        ofile << log_buf;
+    for(auto &m : mshrs) {
+        for(auto &e : m->hashmap) {
+            sprintf(log_buf, "0x%lx:%s,%d-%d ", e.first, get_cache_mshr_state_name_str(e.second.state).c_str(), e.second.line_flag, e.second.finish_flag);
+            ofile << log_buf;
+        }
     }
     ofile << "\n";
     ofile << "L1-I:\n";
     for(uint32_t s = 0; s < l1i_block->set_count; s++) {
         sprintf(log_buf, "set %d: ", s);
         ofile << log_buf;
-        for(auto &e : l1i_block->p_sets[s]) {
-            sprintf(log_buf, "0x%lx:%d ", e.first, e.second.state);
+        std::vector<std::pair<LineIndexT, TagedCacheLine*>> lines;
+        l1i_block->get_set_lines(s, lines);
+        for(auto &e : lines) {
+            sprintf(log_buf, "0x%lx:%d ", e.first, e.second->state);
             ofile << log_buf;
         }
         ofile << "\n";
     }
-    sprintf(log_buf, "L1-I-REQ: %d, %s, 0x%lx\n", l1i_req.type, l1i_req.indexing?"indexing":"waiting", l1i_req.lindex);
-    ofile << log_buf;
+    for(auto &r : l1i_reqs) {
+        if(!r.type) continue;
+        sprintf(log_buf, "L1-I-REQ: %d, %s, 0x%lx\n", r.type, r.indexing?"indexing":"waiting", r.lindex);
+        ofile << log_buf;
+    }
     ofile << "L1-D:\n";
     for(uint32_t s = 0; s < l1d_block->set_count; s++) {
         sprintf(log_buf, "set %d: ", s);
         ofile << log_buf;
-        for(auto &e : l1d_block->p_sets[s]) {
-            sprintf(log_buf, "0x%lx:%d ", e.first, e.second.flag);
+        std::vector<std::pair<LineIndexT, TagedCacheLine*>> lines;
+        l1d_block->get_set_lines(s, lines);
+        for(auto &e : lines) {
+            sprintf(log_buf, "0x%lx:%d ", e.first, e.second->flag);
             ofile << log_buf;
         }
         ofile << "\n";
     }
-    sprintf(log_buf, "L1-D-REQ: %d, %s, 0x%lx\n", l1d_req.type, l1d_req.indexing?"indexing":"waiting", l1d_req.lindex);
-    ofile << log_buf;
+    for(auto &r : l1d_reqs) {
+        if(!r.type) continue;
+        sprintf(log_buf, "L1-D-REQ: %d, %s, 0x%lx\n", r.type, r.indexing?"indexing":"waiting", r.lindex);
+        ofile << log_buf;
+    }
 }
 
 SimError PrivL1L2Moesi::l1i_load(PhysAddrT paddr, uint32_t len, void *buf, vector<bool> &valid) {
@@ -131,27 +168,36 @@ SimError PrivL1L2Moesi::l1i_load(PhysAddrT paddr, uint32_t len, void *buf, vecto
                 }
             }
         }
+        if(p_line->flag & L1FLG_PREFETCH) {
+            p_line->flag &= (~L1FLG_PREFETCH);
+            statistic.l1i_pf_useful_count++;
+        }
         statistic.l1i_hit_count++;
         return SimError::success;
     }
 
-    if(l1i_req.type == 0) {
-        l1i_req.type = L1REQ_GETS;
-        l1i_req.indexing = false;
-        l1i_req.lindex = lindex;
-        l1i_req.data.clear();
-        if(trace) {
-            l1i_req.trans_id = trace->alloc_trans_id();
-            trace->insert_event(l1i_req.trans_id, CacheEvent::L1_LD_MISS);
-        }
-        statistic.l1i_miss_count++;
-        return SimError::miss;
-    }
-    else if((l1i_req.type == L1REQ_GETS || l1i_req.type == L1REQ_GETM) && l1i_req.lindex == lindex) {
+    if(l1_find_req(l1i_reqs, lindex)) {
+        statistic.l1i_mshr_merge_count++;
         return SimError::miss;
     }
 
-    return SimError::busy;
+    L1Request *req = l1_alloc_req(l1i_reqs);
+    if(!req) {
+        statistic.l1i_mshr_full_count++;
+        return SimError::busy;
+    }
+    req->type = L1REQ_GETS;
+    req->indexing = false;
+    req->lindex = lindex;
+    req->start_tick = simroot::get_current_tick();
+    req->data.clear();
+    if(trace) {
+        req->trans_id = trace->alloc_trans_id();
+        trace->insert_event(req->trans_id, CacheEvent::L1_LD_MISS);
+    }
+    statistic.l1i_miss_count++;
+    statistic.l1i_mshr_max_inflight = std::max<uint64_t>(statistic.l1i_mshr_max_inflight, l1_req_count(l1i_reqs));
+    return SimError::miss;
 }
 
 void PrivL1L2Moesi::l1i_clear_ld(std::list<CacheOP*> *to_free) {
@@ -184,27 +230,39 @@ SimError PrivL1L2Moesi::l1d_load(PhysAddrT paddr, uint32_t len, void *buf, vecto
                 }
             }
         }
+        if(p_line->flag & L1FLG_PREFETCH) {
+            p_line->flag &= (~L1FLG_PREFETCH);
+            statistic.l1d_pf_useful_count++;
+        }
         statistic.l1d_hit_count++;
+        pf_train_l1d(lindex, false);
         return SimError::success;
     }
 
-    if(l1d_req.type == 0) {
-        l1d_req.type = L1REQ_GETS;
-        l1d_req.indexing = false; 
-        l1d_req.lindex = lindex;
-        l1d_req.data.clear();
-        if(trace) {
-            l1d_req.trans_id = trace->alloc_trans_id();
-            trace->insert_event(l1d_req.trans_id, CacheEvent::L1_LD_MISS);
-        }
-        statistic.l1d_miss_count++;
-        return SimError::miss;
-    }
-    else if((l1d_req.type == L1REQ_GETS || l1d_req.type == L1REQ_GETM) && l1d_req.lindex == lindex) {
+    if(l1_find_req(l1d_reqs, lindex)) {
+        statistic.l1d_mshr_merge_count++;
         return SimError::miss;
     }
 
-    return SimError::busy;
+    L1Request *req = l1_alloc_req(l1d_reqs);
+    if(!req) {
+        statistic.l1d_mshr_full_count++;
+        return SimError::busy;
+    }
+    req->type = L1REQ_GETS;
+    req->indexing = false;
+    req->lindex = lindex;
+    req->start_tick = simroot::get_current_tick();
+    req->pc = l1d_access_pc;
+    req->data.clear();
+    if(trace) {
+        req->trans_id = trace->alloc_trans_id();
+        trace->insert_event(req->trans_id, CacheEvent::L1_LD_MISS);
+    }
+    statistic.l1d_miss_count++;
+    statistic.l1d_mshr_max_inflight = std::max<uint64_t>(statistic.l1d_mshr_max_inflight, l1_req_count(l1d_reqs));
+    pf_train_l1d(lindex, true);
+    return SimError::miss;
 }
 
 SimError PrivL1L2Moesi::l1d_store(PhysAddrT paddr, uint32_t len, void *buf, vector<bool> &valid) {
@@ -214,7 +272,13 @@ SimError PrivL1L2Moesi::l1d_store(PhysAddrT paddr, uint32_t len, void *buf, vect
     SizeT offset = (paddr & (CACHE_LINE_LEN_BYTE - 1));
 
     TagedCacheLine *p_line = nullptr;
-    if(l1d_block->get_line(lindex, &p_line, true) && (p_line->flag & L1FLG_WRITE)) {
+    bool line_hit = l1d_block->get_line(lindex, &p_line, true);
+    if(line_hit && (p_line->flag & L1FLG_PREFETCH)) {
+        // 预取的行是只读的，写操作仍需升级权限，但数据已经在L1中
+        p_line->flag &= (~L1FLG_PREFETCH);
+        statistic.l1d_pf_useful_count++;
+    }
+    if(line_hit && (p_line->flag & L1FLG_WRITE)) {
         if(len) {
             if(valid.size() != len) memcpy(((uint8_t*)(p_line->data)) + offset, buf, len);
             else {
@@ -226,26 +290,38 @@ SimError PrivL1L2Moesi::l1d_store(PhysAddrT paddr, uint32_t len, void *buf, vect
         p_line->flag |= L1FLG_DIRTY;
         reserved_address_valid = false;
         statistic.l1d_hit_count++;
+        pf_train_l1d(lindex, false);
         return SimError::success;
     }
 
-    if(l1d_req.type == 0 || (l1d_req.type == L1REQ_GETS && l1d_req.lindex == lindex)) {
-        l1d_req.type = L1REQ_GETM;
-        l1d_req.indexing = false;
-        l1d_req.lindex = lindex;
-        l1d_req.data.clear();
-        if(trace) {
-            l1d_req.trans_id = trace->alloc_trans_id();
-            trace->insert_event(l1d_req.trans_id, CacheEvent::L1_ST_MISS);
-        }
-        statistic.l1d_miss_count++;
-        return SimError::miss;
-    }
-    else if(l1d_req.type == L1REQ_GETM && l1d_req.lindex == lindex) {
+    L1Request *req = l1_find_req(l1d_reqs, lindex);
+    if(req && req->type == L1REQ_GETM) {
+        statistic.l1d_mshr_merge_count++;
         return SimError::miss;
     }
 
-    return SimError::busy;
+    // 同一行上已有的读缺失升级为写缺失
+    bool new_miss = (req == nullptr);
+    if(new_miss && !(req = l1_alloc_req(l1d_reqs))) {
+        statistic.l1d_mshr_full_count++;
+        return SimError::busy;
+    }
+    req->type = L1REQ_GETM;
+    req->indexing = false;
+    req->lindex = lindex;
+    req->pc = l1d_access_pc;
+    req->data.clear();
+    if(new_miss) req->start_tick = simroot::get_current_tick();
+    if(trace) {
+        req->trans_id = trace->alloc_trans_id();
+        trace->insert_event(req->trans_id, CacheEvent::L1_ST_MISS);
+    }
+    statistic.l1d_miss_count++;
+    if(new_miss) {
+        statistic.l1d_mshr_max_inflight = std::max<uint64_t>(statistic.l1d_mshr_max_inflight, l1_req_count(l1d_reqs));
+        pf_train_l1d(lindex, !line_hit);
+    }
+    return SimError::miss;
 }
 
 SimError PrivL1L2Moesi::l1d_amo(PhysAddrT paddr, uint32_t len, void *buf, isa::RV64AMOOP5 amoop) {
@@ -353,9 +429,69 @@ bool PrivL1L2Moesi::l1d_is_empty() {
     return empty;
 }
 
+void PrivL1L2Moesi::pf_enqueue(LineIndexT lindex, uint32_t pf_flag) {
+    if(pf_flag == MSHR_FIFLG_PF_L1D && l1d_block->get_line(lindex, nullptr, false)) return;
+    if(pf_flag == MSHR_FIFLG_PF_L1I && l1i_block->get_line(lindex, nullptr, false)) return;
+    if(pf_flag == MSHR_FIFLG_PF_L2 && block->get_line(lindex, nullptr, false)) return;
+    if(bank_mshrs(lindex)->get(lindex)) return;
+    for(auto &pf : pf_queue) {
+        if(pf.lindex == lindex) return;
+    }
+    if(pf_queue.size() >= pf_queue_size) {
+        // 丢弃最旧的请求，保证预取跟得上当前的访问位置
+        pf_queue.pop_front();
+        statistic.pf_drop_count++;
+    }
+    pf_queue.emplace_back(PrefetchRequest{lindex, pf_flag});
+}
+
+void PrivL1L2Moesi::pf_train_l1d(LineIndexT lindex, bool miss) {
+    if(!l1d_prefetcher) return;
+    pf_candidates.clear();
+    l1d_prefetcher->train(l1d_access_pc, lindex, miss, pf_candidates);
+    for(auto l : pf_candidates) pf_enqueue(l, MSHR_FIFLG_PF_L1D);
+}
+
+void PrivL1L2Moesi::pf_train_l2(VirtAddrT pc, LineIndexT lindex, bool miss) {
+    if(!l2_prefetcher) return;
+    pf_candidates.clear();
+    l2_prefetcher->train(pc, lindex, miss, pf_candidates);
+    for(auto l : pf_candidates) pf_enqueue(l, MSHR_FIFLG_PF_L2);
+}
+
+void PrivL1L2Moesi::l1i_prefetch(PhysAddrT paddr) {
+    if(!l1i_next_line) return;
+    pf_enqueue(addr_to_line_index(paddr), MSHR_FIFLG_PF_L1I);
+}
+
+PrivL1L2Moesi::L1Request *PrivL1L2Moesi::l1_select_req(vector<L1Request> &reqs) {
+    L1Request *ret = nullptr;
+    for(auto &r : reqs) {
+        if(!r.type || r.indexing || processing_line.find(r.lindex) != processing_line.end()) continue;
+        if(!bank_can_push(r.lindex)) continue;
+        if(!ret || r.start_tick < ret->start_tick) ret = &r;
+    }
+    return ret;
+}
+
+void PrivL1L2Moesi::push_to_bank(ProcessingPackage *pak) {
+    uint32_t b = bank_of(pak->lindex);
+    simroot_assert(queue_index[b]->push(pak));
+    processing_line.insert(pak->lindex);
+    block->pin(pak->lindex);
+    bank_access_count[b]++;
+}
 
 void PrivL1L2Moesi::p1_fetch() {
-    if(queue_index->can_push() == 0) {
+    // 每个Bank每周期接收一个新请求，优先级依次为总线消息、L1D、L1I、预取
+    bool all_full = true;
+    for(auto &q : queue_index) {
+        if(q->can_push()) {
+            all_full = false;
+            break;
+        }
+    }
+    if(all_full) {
         return;
     }
 
@@ -368,61 +504,73 @@ void PrivL1L2Moesi::p1_fetch() {
         recv_msg = nullptr;
     }
 
-    for(auto iter = waiting_msg.begin(); iter != waiting_msg.end(); iter++) {
-        if(processing_line.find((*iter)->line) == processing_line.end()) {
-            ProcessingPackage *pak = new ProcessingPackage;
-            pak->lindex = (*iter)->line;
-            pak->msg = (*iter);
-            switch ((*iter)->type)
-            {
-            case MSG_INVALID_ACK:
-            case MSG_GETM_ACK:
-            case MSG_PUT_ACK:
-                // 这些只需要索引MSHR，不需要索引CacheBlock
-                pak->index_cycle = 1;
-                break;
-            default:
-                pak->index_cycle = index_cycle;
-            }
-            simroot_assert(queue_index->push(pak));
-            processing_line.insert(pak->lindex);
-            block->pin(pak->lindex);
-            waiting_msg.erase(iter);
-            return;
+    for(auto iter = waiting_msg.begin(); iter != waiting_msg.end(); ) {
+        if(processing_line.find((*iter)->line) != processing_line.end() || !bank_can_push((*iter)->line)) {
+            iter++;
+            continue;
         }
+        ProcessingPackage *pak = new ProcessingPackage;
+        pak->lindex = (*iter)->line;
+        pak->msg = (*iter);
+        switch ((*iter)->type)
+        {
+        case MSG_INVALID_ACK:
+        case MSG_GETM_ACK:
+        case MSG_PUT_ACK:
+            // 这些只需要索引MSHR，不需要索引CacheBlock
+            pak->index_cycle = 1;
+            break;
+        default:
+            pak->index_cycle = index_cycle;
+        }
+        push_to_bank(pak);
+        iter = waiting_msg.erase(iter);
     }
 
-    if(l1d_req.type && !l1d_req.indexing && processing_line.find(l1d_req.lindex) == processing_line.end()) {
-        ProcessingPackage *pak = new ProcessingPackage;
-        pak->lindex = l1d_req.lindex;
-        pak->msg = nullptr;
-        pak->index_cycle = index_cycle;
-        simroot_assert(queue_index->push(pak));
-        processing_line.insert(pak->lindex);
-        block->pin(pak->lindex);
-        l1d_req.indexing = true;
-        return;
+    for(auto *reqs : {&l1d_reqs, &l1i_reqs}) {
+        L1Request *req = nullptr;
+        while((req = l1_select_req(*reqs))) {
+            ProcessingPackage *pak = new ProcessingPackage;
+            pak->lindex = req->lindex;
+            pak->msg = nullptr;
+            pak->index_cycle = index_cycle;
+            push_to_bank(pak);
+            req->indexing = true;
+        }
     }
 
-    if(l1i_req.type && !l1i_req.indexing && processing_line.find(l1i_req.lindex) == processing_line.end()) {
+    for(auto iter = pf_queue.begin(); iter != pf_queue.end(); ) {
+        if(processing_line.find(iter->lindex) != processing_line.end()) {
+            statistic.pf_drop_count++;
+            iter = pf_queue.erase(iter);
+            continue;
+        }
+        // 预取不参与Bank冲突统计
+        if(!queue_index[bank_of(iter->lindex)]->can_push() || !pf_has_spare_mshr(iter->lindex)) {
+            iter++;
+            continue;
+        }
         ProcessingPackage *pak = new ProcessingPackage;
-        pak->lindex = l1i_req.lindex;
+        pak->lindex = iter->lindex;
         pak->msg = nullptr;
         pak->index_cycle = index_cycle;
-        simroot_assert(queue_index->push(pak));
-        processing_line.insert(pak->lindex);
-        block->pin(pak->lindex);
-        l1i_req.indexing = true;
-        return;
+        pak->pf_flag = iter->pf_flag;
+        push_to_bank(pak);
+        iter = pf_queue.erase(iter);
     }
 
+    for(uint32_t b = 0; b < bank_num; b++) {
+        if(bank_conflict[b]) bank_conflict_cycle[b]++;
+        bank_conflict[b] = false;
+    }
 }
 
-void PrivL1L2Moesi::p2_index() {
-    if(queue_index->can_pop() == 0) {
+void PrivL1L2Moesi::p2_index(uint32_t bank) {
+    auto &queue = queue_index[bank];
+    if(queue->can_pop() == 0) {
         return;
     }
-    ProcessingPackage *pak = queue_index->top();
+    ProcessingPackage *pak = queue->top();
     if(pak->index_cycle > 1) {
         pak->index_cycle--;
         return;
@@ -430,7 +578,7 @@ void PrivL1L2Moesi::p2_index() {
     if(send_buf.size() + 2 > send_buf_size) {
         return;
     }
-    queue_index->pop();
+    queue->pop();
 
     LineIndexT lindex = pak->lindex;
     BusPortT hn_port = 0;
@@ -440,7 +588,7 @@ void PrivL1L2Moesi::p2_index() {
         uint32_t type = pak->msg->type;
         uint32_t arg = pak->msg->arg;
         uint32_t transid = pak->msg->transid;
-        vector<uint8_t> &data = pak->msg->data;
+        CacheLinePayload &data = pak->msg->data;
 
         if(log_info) {
             sprintf(log_buf, "%s: Handle from bus: @0x%lx, %d, %d", logname.c_str(), lindex, type, arg);
@@ -455,7 +603,7 @@ void PrivL1L2Moesi::p2_index() {
             l1i_busy_cycle++;
             l1d_busy_cycle++;
             MSHREntry *mshr = nullptr;
-            if((mshr = mshrs->get(lindex))) {
+            if((mshr = bank_mshrs(lindex)->get(lindex))) {
                 switch (mshr->state)
                 {
                 case MSHR_STOI:
@@ -479,7 +627,7 @@ void PrivL1L2Moesi::p2_index() {
         else if(type == MSG_INVALID_ACK) {
             bool getm_finished = false;
             MSHREntry *mshr = nullptr;
-            simroot_assert(mshr = mshrs->get(lindex));
+            simroot_assert(mshr = bank_mshrs(lindex)->get(lindex));
             if(mshr->state == MSHR_ITOM) {
                 if(mshr->get_ack_cnt_ready == 0 || mshr->need_invalid_ack != mshr->invalid_ack + 1 || mshr->get_data_ready == 0) {
                     mshr->invalid_ack++;
@@ -505,7 +653,7 @@ void PrivL1L2Moesi::p2_index() {
         else if(type == MSG_GETS_FORWARD) {
             TagedCacheLine *p_line = nullptr;
             bool hit = block->get_line(lindex, &p_line);
-            MSHREntry *mshr = mshrs->get(lindex);
+            MSHREntry *mshr = bank_mshrs(lindex)->get(lindex);
             bool mshr_handle = (mshr && (
                 mshr->state == MSHR_STOM || 
                 mshr->state == MSHR_MTOI || 
@@ -533,7 +681,7 @@ void PrivL1L2Moesi::p2_index() {
         else if(type == MSG_GETM_FORWARD) {
             TagedCacheLine *p_line = nullptr;
             bool hit = block->get_line(lindex, &p_line);
-            MSHREntry *mshr = mshrs->get(lindex);
+            MSHREntry *mshr = bank_mshrs(lindex)->get(lindex);
             bool mshr_handle = (mshr && (
                 mshr->state == MSHR_STOM || 
                 mshr->state == MSHR_MTOI || 
@@ -571,7 +719,7 @@ void PrivL1L2Moesi::p2_index() {
         else if(type == MSG_GETM_ACK) {
             bool getm_finished = false;
             MSHREntry *mshr = nullptr;
-            simroot_assert(mshr = mshrs->get(lindex));
+            simroot_assert(mshr = bank_mshrs(lindex)->get(lindex));
             if(mshr->state == MSHR_ITOM) {
                 if(arg != mshr->invalid_ack || mshr->get_data_ready == 0) {
                     mshr->get_ack_cnt_ready = 1;
@@ -598,7 +746,7 @@ void PrivL1L2Moesi::p2_index() {
         }
         else if(type == MSG_GETS_RESP) {
             MSHREntry *mshr = nullptr;
-            simroot_assert((mshr = mshrs->get(lindex)) && MSHR_ITOS);
+            simroot_assert((mshr = bank_mshrs(lindex)->get(lindex)) && MSHR_ITOS);
             cache_line_copy(mshr->line_buf, data.data());
             if(arg > 0) {
                 push_send_buf(hn_port, CHANNEL_ACK, MSG_GET_ACK, lindex, my_port_id, transid);
@@ -609,7 +757,7 @@ void PrivL1L2Moesi::p2_index() {
         else if(type == MSG_GETM_RESP) {
             bool getm_finished = false;
             MSHREntry *mshr = nullptr;
-            simroot_assert((mshr = mshrs->get(lindex)) && mshr->state == MSHR_ITOM);
+            simroot_assert((mshr = bank_mshrs(lindex)->get(lindex)) && mshr->state == MSHR_ITOM);
             if(arg == 0 && (mshr->get_ack_cnt_ready == 0 || mshr->need_invalid_ack != mshr->invalid_ack)) {
                 cache_line_copy(mshr->line_buf, data.data());
                 mshr->get_data_ready = 1;
@@ -624,7 +772,7 @@ void PrivL1L2Moesi::p2_index() {
         else if(type == MSG_GET_RESP_MEM) {
             push_send_buf(hn_port, CHANNEL_ACK, MSG_GET_ACK, lindex, my_port_id, transid);
             MSHREntry *mshr = nullptr;
-            simroot_assert(mshr = mshrs->get(lindex));
+            simroot_assert(mshr = bank_mshrs(lindex)->get(lindex));
             cache_line_copy(mshr->line_buf, data.data());
             if(mshr->state == MSHR_ITOM) {
                 if(trace) trace->insert_event(transid, CacheEvent::L2_FINISH);
@@ -640,7 +788,7 @@ void PrivL1L2Moesi::p2_index() {
         }
         else if(type == MSG_PUT_ACK) {
             MSHREntry *mshr = nullptr;
-            simroot_assert(mshr = mshrs->get(lindex));
+            simroot_assert(mshr = bank_mshrs(lindex)->get(lindex));
             if(mshr->state == MSHR_ITOI || 
                 mshr->state == MSHR_MTOI || 
                 mshr->state == MSHR_STOI || 
@@ -648,15 +796,15 @@ void PrivL1L2Moesi::p2_index() {
                 mshr->state == MSHR_OTOI
             ) {
                 uint32_t mshr_finish_flg = mshr->finish_flag;
-                mshrs->remove(lindex);
+                bank_mshrs(lindex)->remove(lindex);
                 if(mshr_finish_flg & MSHR_FIFLG_L1DREQM) {
-                    simroot_assert(mshr = mshrs->alloc(lindex));
+                    simroot_assert(mshr = bank_mshrs(lindex)->alloc(lindex));
                     mshr->state = MSHR_ITOM;
                     mshr->finish_flag = mshr_finish_flg;
                     push_send_buf(hn_port, CHANNEL_REQ, MSG_GETM, lindex, my_port_id, (trace?(trace->alloc_trans_id()):0));
                 }
                 else if((mshr_finish_flg & MSHR_FIFLG_L1DREQS) || (mshr_finish_flg & MSHR_FIFLG_L1IREQ)) {
-                    simroot_assert(mshr = mshrs->alloc(lindex));
+                    simroot_assert(mshr = bank_mshrs(lindex)->alloc(lindex));
                     mshr->state = MSHR_ITOS;
                     mshr->finish_flag = mshr_finish_flg;
                     push_send_buf(hn_port, CHANNEL_REQ, MSG_GETS, lindex, my_port_id, (trace?(trace->alloc_trans_id()):0));
@@ -667,27 +815,60 @@ void PrivL1L2Moesi::p2_index() {
             }
         }
     }
+    else if(pak->pf_flag) {
+        TagedCacheLine *pline = nullptr;
+        MSHREntry *mshr = nullptr;
+        if(block->get_line(lindex, &pline, false)) {
+            // L2命中时只需要填入L1
+            if(pak->pf_flag == MSHR_FIFLG_PF_L1D && !(pline->flag & L2FLG_IN_D)) {
+                pline->flag |= L2FLG_IN_D;
+                insert_to_l1d(lindex, pline->data, false, true);
+                statistic.l1d_pf_issue_count++;
+            }
+            else if(pak->pf_flag == MSHR_FIFLG_PF_L1I && !(pline->flag & L2FLG_IN_I)) {
+                pline->flag |= L2FLG_IN_I;
+                insert_to_l1i(lindex, pline->data, true);
+                statistic.l1i_pf_issue_count++;
+            }
+        }
+        else if(!bank_mshrs(lindex)->get(lindex) && pf_has_spare_mshr(lindex) && (mshr = bank_mshrs(lindex)->alloc(lindex))) {
+            mshr->state = MSHR_ITOS;
+            mshr->finish_flag = pak->pf_flag;
+            push_send_buf(hn_port, CHANNEL_REQ, MSG_GETS, lindex, my_port_id, (trace?(trace->alloc_trans_id()):0));
+            if(pak->pf_flag == MSHR_FIFLG_PF_L1D) statistic.l1d_pf_issue_count++;
+            else if(pak->pf_flag == MSHR_FIFLG_PF_L1I) statistic.l1i_pf_issue_count++;
+            else statistic.l2_pf_issue_count++;
+        }
+        else {
+            statistic.pf_drop_count++;
+        }
+    }
     else {
         // 检查L1REQ
         uint32_t req = L1REQ_GETS;
         uint32_t transid = 0;
-        bool resp_i = false, resp_d = false;
-
-        if(l1i_req.lindex == lindex && l1i_req.type == L1REQ_GETS) {
-            resp_i = true;
-            transid = l1i_req.trans_id;
+        L1Request *ireq = l1_find_req(l1i_reqs, lindex);
+        L1Request *dreq = l1_find_req(l1d_reqs, lindex);
+        if(ireq && ireq->type != L1REQ_GETS) ireq = nullptr;
+        bool resp_i = (ireq != nullptr), resp_d = (dreq != nullptr);
+
+        // 同一行的L1I与L1D请求在这里一起处理，需要重试的请求会被重新标记为等待
+        if(resp_i) {
+            ireq->indexing = true;
+            transid = ireq->trans_id;
         }
-        if(l1d_req.lindex == lindex && l1d_req.type) {
-            resp_d = true;
-            if(l1d_req.type == L1REQ_GETM) {
+        if(resp_d) {
+            dreq->indexing = true;
+            if(dreq->type == L1REQ_GETM) {
                 req = L1REQ_GETM;
             }
-            transid = l1d_req.trans_id;
+            transid = dreq->trans_id;
             if(resp_i) {
-                if(trace) trace->cancel_transaction(l1i_req.trans_id);
-                l1i_req.trans_id = transid;
+                if(trace) trace->cancel_transaction(ireq->trans_id);
+                ireq->trans_id = transid;
             }
         }
+        VirtAddrT pc = (resp_d?(dreq->pc):0);
 
         if(log_info) {
             sprintf(log_buf, "%s: Handle from L1: @0x%lx, %s %s, %d", logname.c_str(), lindex, resp_i?"i":"", resp_d?"d":"", req);
@@ -699,6 +880,11 @@ void PrivL1L2Moesi::p2_index() {
             MSHREntry *mshr = nullptr;
             if(block->get_line(lindex, &pline, true)) {
                 if(trace) trace->insert_event(transid, CacheEvent::L2_HIT);
+                if(pline->flag & L2FLG_PREFETCH) {
+                    pline->flag &= (~L2FLG_PREFETCH);
+                    statistic.l2_pf_useful_count++;
+                }
+                if(resp_d) pf_train_l2(pc, lindex, false);
                 if(resp_i) {
                     pline->flag |= L2FLG_IN_I;
                     insert_to_l1i(lindex, pline->data);
@@ -709,8 +895,15 @@ void PrivL1L2Moesi::p2_index() {
                 }
                 statistic.l2_hit_count ++;
             }
-            else if(mshr = mshrs->get(lindex)) {
+            else if(mshr = bank_mshrs(lindex)->get(lindex)) {
                 if(trace) trace->insert_event(transid, CacheEvent::L2_HIT);
+                if(mshr->finish_flag & MSHR_FIFLG_PF_ALL) {
+                    // 预取已经发出但数据尚未到达，需求请求合并到该MSHR
+                    if(mshr->finish_flag & MSHR_FIFLG_PF_L1D) statistic.l1d_pf_late_count++;
+                    else if(mshr->finish_flag & MSHR_FIFLG_PF_L1I) statistic.l1i_pf_late_count++;
+                    else statistic.l2_pf_late_count++;
+                    mshr->finish_flag &= (~MSHR_FIFLG_PF_ALL);
+                }
                 if(mshr->state == MSHR_OTOM || mshr->state == MSHR_STOM) {
                     if(resp_i) {
                         mshr->line_flag |= L2FLG_IN_I;
@@ -727,17 +920,18 @@ void PrivL1L2Moesi::p2_index() {
                 }
                 statistic.l2_hit_count ++;
             }
-            else if(mshr = mshrs->alloc(lindex)) {
+            else if(mshr = bank_mshrs(lindex)->alloc(lindex)) {
                 mshr->state = MSHR_ITOS;
                 if(resp_i) mshr->finish_flag |= MSHR_FIFLG_L1IREQ;
                 if(resp_d) mshr->finish_flag |= MSHR_FIFLG_L1DREQS;
                 push_send_buf(hn_port, CHANNEL_REQ, MSG_GETS, lindex, my_port_id, transid);
                 statistic.l2_miss_count ++;
                 if(trace) trace->insert_event(transid, CacheEvent::L2_MISS);
+                if(resp_d) pf_train_l2(pc, lindex, true);
             }
             else {
-                if(resp_i) l1i_req.indexing = false;
-                if(resp_d) l1d_req.indexing = false;
+                if(resp_i) ireq->indexing = false;
+                if(resp_d) dreq->indexing = false;
             }
         }
         else if(resp_d && req == L1REQ_GETM) {
@@ -745,15 +939,20 @@ void PrivL1L2Moesi::p2_index() {
             MSHREntry *mshr = nullptr;
             bool is_miss = true;
             if(block->get_line(lindex, &pline, true)) {
+                if(pline->flag & L2FLG_PREFETCH) {
+                    pline->flag &= (~L2FLG_PREFETCH);
+                    statistic.l2_pf_useful_count++;
+                }
                 if(pline->state == CC_EXCLUSIVE || pline->state == CC_MODIFIED) {
                     if(trace) trace->insert_event(transid, CacheEvent::L2_HIT);
+                    pf_train_l2(pc, lindex, false);
                     pline->flag |= L2FLG_IN_D;
                     pline->flag |= L2FLG_IN_D_W;
                     insert_to_l1d(lindex, pline->data, true);
                     is_miss = false;
                 }
             }
-            else if(mshr = mshrs->get(lindex)) {
+            else if(mshr = bank_mshrs(lindex)->get(lindex)) {
                 if(mshr->state == MSHR_STOM || mshr->state == MSHR_OTOM || mshr->state == MSHR_ITOM) {
                     mshr->line_flag |= L2FLG_IN_D;
                     mshr->line_flag |= L2FLG_IN_D_W;
@@ -761,11 +960,16 @@ void PrivL1L2Moesi::p2_index() {
                     if(trace) trace->insert_event(transid, CacheEvent::L2_HIT);
                 }
                 else {
-                    l1d_req.indexing = false;
+                    if(mshr->finish_flag & MSHR_FIFLG_PF_ALL) {
+                        if(mshr->finish_flag & MSHR_FIFLG_PF_L1D) statistic.l1d_pf_late_count++;
+                        else if(mshr->finish_flag & MSHR_FIFLG_PF_L2) statistic.l2_pf_late_count++;
+                        mshr->finish_flag &= (~MSHR_FIFLG_PF_ALL);
+                    }
+                    dreq->indexing = false;
                 }
                 is_miss = false;
             }
-            if(is_miss && (mshr = mshrs->alloc(lindex))) {
+            if(is_miss && (mshr = bank_mshrs(lindex)->alloc(lindex))) {
                 if(pline) {
                     cache_line_copy(mshr->line_buf, pline->data);
                     mshr->line_flag = (pline->flag | L2FLG_IN_D | L2FLG_IN_D_W);
@@ -786,9 +990,10 @@ void PrivL1L2Moesi::p2_index() {
                 push_send_buf(hn_port, CHANNEL_REQ, MSG_GETM, lindex, my_port_id, transid);
                 statistic.l2_miss_count ++;
                 if(trace) trace->insert_event(transid, CacheEvent::L2_MISS);
+                pf_train_l2(pc, lindex, (pline == nullptr));
             }
             else if(is_miss) {
-                l1d_req.indexing = false;
+                dreq->indexing = false;
             }
         }
     }
@@ -828,6 +1033,10 @@ void PrivL1L2Moesi::handle_new_line_nolock(LineIndexT lindex, MSHREntry *mshr, u
         newline.flag |= L2FLG_IN_D;
         insert_to_l1d(lindex, mshr->line_buf, false);
     }
+    else if(mshr->finish_flag & MSHR_FIFLG_PF_L1D) {
+        newline.flag |= L2FLG_IN_D;
+        insert_to_l1d(lindex, mshr->line_buf, false, true);
+    }
     if((mshr->line_flag & L2FLG_IN_I) || (mshr->finish_flag & MSHR_FIFLG_L1IREQ)) {
         if(log_info) {
             sprintf(log_buf, "%s: Sync to l1i(S): @0x%lx", logname.c_str(), lindex);
@@ -836,9 +1045,16 @@ void PrivL1L2Moesi::handle_new_line_nolock(LineIndexT lindex, MSHREntry *mshr, u
         newline.flag |= L2FLG_IN_I;
         insert_to_l1i(lindex, mshr->line_buf);
     }
+    else if(mshr->finish_flag & MSHR_FIFLG_PF_L1I) {
+        newline.flag |= L2FLG_IN_I;
+        insert_to_l1i(lindex, mshr->line_buf, true);
+    }
+    if(mshr->finish_flag & MSHR_FIFLG_PF_L2) {
+        newline.flag |= L2FLG_PREFETCH;
+    }
 
     if(!block->insert_line(lindex, &newline, &replaced, &replacedline)) {
-        mshrs->remove(lindex);
+        bank_mshrs(lindex)->remove(lindex);
         return ;
     }
 
@@ -855,16 +1071,26 @@ void PrivL1L2Moesi::handle_new_line_nolock(LineIndexT lindex, MSHREntry *mshr, u
         simroot::print_log_info(str);
     }
 
-    mshrs->remove(lindex);
-    simroot_assert(mshr = mshrs->alloc(replaced));
+    bank_mshrs(lindex)->remove(lindex);
+    simroot_assert(mshr = bank_mshrs(replaced)->alloc(replaced));
 
+    if(replacedline.flag & L2FLG_PREFETCH) {
+        statistic.l2_pf_unused_count++;
+    }
     if(replacedline.flag & L2FLG_IN_I) {
+        TagedCacheLine *pline = nullptr;
+        if(l1i_block->get_line(replaced, &pline, false) && (pline->flag & L1FLG_PREFETCH)) {
+            statistic.l1i_pf_unused_count++;
+        }
         l1i_block->remove_line(replaced);
         l1i_busy_cycle++;
     }
     if(replacedline.flag & L2FLG_IN_D) {
         TagedCacheLine *pline = nullptr;
         simroot_assert(l1d_block->get_line(replaced, &pline, false));
+        if(pline->flag & L1FLG_PREFETCH) {
+            statistic.l1d_pf_unused_count++;
+        }
         if(pline->flag & L1FLG_DIRTY) {
             cache_line_copy(replacedline.data, pline->data);
             simroot_assert(replacedline.state == CC_MODIFIED || replacedline.state == CC_EXCLUSIVE);
@@ -906,7 +1132,7 @@ void PrivL1L2Moesi::handle_new_line_nolock(LineIndexT lindex, MSHREntry *mshr, u
 
 }
 
-void PrivL1L2Moesi::insert_to_l1i(LineIndexT lindex, void * line_buf) {
+void PrivL1L2Moesi::insert_to_l1i(LineIndexT lindex, void * line_buf, bool prefetched) {
     TagedCacheLine newline, replacedline;
     LineIndexT replaced = 0;
 
@@ -916,17 +1142,23 @@ void PrivL1L2Moesi::insert_to_l1i(LineIndexT lindex, void * line_buf) {
     l1i_newlines.back().readonly = true;
     cache_line_copy(l1i_newlines.back().data.data(), line_buf);
 
-    if(l1i_req.lindex == lindex) {
-        l1i_req.type = l1i_req.lindex = l1i_req.indexing = 0;
-        if(trace) trace->insert_event(l1i_req.trans_id, CacheEvent::L1_FINISH);
+    L1Request *req = l1_find_req(l1i_reqs, lindex);
+    if(req) {
+        req->type = req->lindex = req->indexing = 0;
+        if(trace) trace->insert_event(req->trans_id, CacheEvent::L1_FINISH);
     }
 
-    newline.flag = newline.state = 0;
+    newline.flag = (prefetched?L1FLG_PREFETCH:0);
+    newline.state = 0;
     cache_line_copy(newline.data, line_buf);
     if(!l1i_block->insert_line(lindex, &newline, &replaced, &replacedline)) {
         return;
     }
 
+    if(replacedline.flag & L1FLG_PREFETCH) {
+        statistic.l1i_pf_unused_count++;
+    }
+
     if(log_info) {
         sprintf(log_buf, "%s: L1I Replaced @0x%lx: ", logname.c_str(), replaced);
         string str = log_buf;
@@ -943,12 +1175,12 @@ void PrivL1L2Moesi::insert_to_l1i(LineIndexT lindex, void * line_buf) {
     if(block->get_line(replaced, &pline, true)) {
         pline->flag &= (~L2FLG_IN_I);
     }
-    if(mshr = mshrs->get(replaced)) {
+    if(mshr = bank_mshrs(replaced)->get(replaced)) {
         mshr->line_flag &= (~L2FLG_IN_I);
     }
 }
 
-void PrivL1L2Moesi::insert_to_l1d(LineIndexT lindex, void * line_buf, bool writable) {
+void PrivL1L2Moesi::insert_to_l1d(LineIndexT lindex, void * line_buf, bool writable, bool prefetched) {
     TagedCacheLine newline, replacedline;
     LineIndexT replaced = 0;
 
@@ -958,23 +1190,28 @@ void PrivL1L2Moesi::insert_to_l1d(LineIndexT lindex, void * line_buf, bool writa
     l1d_newlines.back().readonly = (!writable);
     cache_line_copy(l1d_newlines.back().data.data(), line_buf);
 
-    if(l1d_req.lindex == lindex) {
-        if(l1d_req.type == L1REQ_GETM && !writable) {
-            l1d_req.indexing = 0;
+    L1Request *req = l1_find_req(l1d_reqs, lindex);
+    if(req) {
+        if(req->type == L1REQ_GETM && !writable) {
+            req->indexing = 0;
         }
         else {
-            l1d_req.type = l1d_req.lindex = l1d_req.indexing = 0;
-            if(trace) trace->insert_event(l1d_req.trans_id, CacheEvent::L1_FINISH);
+            req->type = req->lindex = req->indexing = 0;
+            if(trace) trace->insert_event(req->trans_id, CacheEvent::L1_FINISH);
         }
     }
 
-    newline.flag = (writable?L1FLG_WRITE:0);
+    newline.flag = (writable?L1FLG_WRITE:0) | (prefetched?L1FLG_PREFETCH:0);
     newline.state = 0;
     cache_line_copy(newline.data, line_buf);
     if(!l1d_block->insert_line(lindex, &newline, &replaced, &replacedline)) {
         return;
     }
 
+    if(replacedline.flag & L1FLG_PREFETCH) {
+        statistic.l1d_pf_unused_count++;
+    }
+
     if(log_info) {
         sprintf(log_buf, "%s: L1D Replaced @0x%lx %d: ", logname.c_str(), replaced, replacedline.flag);
         string str = log_buf;
@@ -1001,7 +1238,7 @@ void PrivL1L2Moesi::insert_to_l1d(LineIndexT lindex, void * line_buf, bool writa
             pline->state = CC_MODIFIED;
         }
     }
-    if(mshr = mshrs->get(replaced)) {
+    if(mshr = bank_mshrs(replaced)->get(replaced)) {
         mshr->line_flag &= (~L2FLG_IN_I);
         pline->flag &= (~L2FLG_IN_D_W);
         if(replacedline.flag & L1FLG_DIRTY) {
@@ -1045,9 +1282,15 @@ void PrivL1L2Moesi::main_on_current_tick() {
     is_main_cur = false;
 
     cur_recieve_msg();
+    bus_recv_pending = false;
+    for(uint32_t c = 0; c < CHANNEL_CNT && !bus_recv_pending; c++) {
+        bus_recv_pending = bus->can_recv(my_port_id, c);
+    }
 
     p1_fetch();
-    p2_index();
+    for(uint32_t b = 0; b < bank_num; b++) {
+        p2_index(b);
+    }
 
     cur_send_msg();
 
@@ -1114,7 +1357,9 @@ void PrivL1L2Moesi::main_apply_next_tick() {
     }
     is_main_cur = true;
 
-    queue_index->apply_next_tick();
+    for(auto &q : queue_index) {
+        q->apply_next_tick();
+    }
 
     for(auto &q : l1d_ld_queues) {
         q.apply_next_tick();
@@ -1128,6 +1373,21 @@ void PrivL1L2Moesi::main_apply_next_tick() {
     for(auto &q : l1i_ld_queues) {
         q.apply_next_tick();
     }
+
+    // 由CPU端口驱动时可能在休眠期间收到新的请求，此时需要恢复自身的调度
+    if(is_idle()) sim_sleep();
+    else if(is_sim_sleeping()) sim_wakeup();
+}
+
+bool PrivL1L2Moesi::is_idle() {
+    bool index_empty = true;
+    for(auto &q : queue_index) {
+        index_empty = (index_empty && q->empty());
+    }
+    return (!recv_msg && !bus_recv_pending && waiting_msg.empty() && index_empty && send_buf.empty() && pf_queue.empty() &&
+        !l1_req_count(l1d_reqs) && !l1_req_count(l1i_reqs) && !l1i_busy_cycle && !l1d_busy_cycle &&
+        l1i_is_empty() && l1d_is_empty()
+    );
 }
 
 #define LOGTOFILE(fmt, ...) do{sprintf(log_buf, fmt, ##__VA_ARGS__);ofile << log_buf;}while(0)
@@ -1140,19 +1400,53 @@ void PrivL1L2Moesi::print_statistic(std::ofstream &ofile) {
     PIPELINE_5_GENERATE_PRINTSTATISTIC(l1d_miss_count)
     PIPELINE_5_GENERATE_PRINTSTATISTIC(l2_hit_count)
     PIPELINE_5_GENERATE_PRINTSTATISTIC(l2_miss_count)
+    PIPELINE_5_GENERATE_PRINTSTATISTIC(l1i_mshr_merge_count)
+    PIPELINE_5_GENERATE_PRINTSTATISTIC(l1i_mshr_full_count)
+    PIPELINE_5_GENERATE_PRINTSTATISTIC(l1i_mshr_max_inflight)
+    PIPELINE_5_GENERATE_PRINTSTATISTIC(l1d_mshr_merge_count)
+    PIPELINE_5_GENERATE_PRINTSTATISTIC(l1d_mshr_full_count)
+    PIPELINE_5_GENERATE_PRINTSTATISTIC(l1d_mshr_max_inflight)
+    for(uint32_t b = 0; b < bank_num; b++) {
+        LOGTOFILE("l2_bank%d_access_count: %ld\n", b, bank_access_count[b]);
+        LOGTOFILE("l2_bank%d_conflict_cycle: %ld\n", b, bank_conflict_cycle[b]);
+    }
+
+    if(!l1d_prefetcher && !l2_prefetcher && !l1i_next_line) return;
+    // accuracy: 被需求访问命中的预取行占发出预取的比例
+    // coverage: 预取消除的缺失占原本缺失(预取命中+剩余缺失)的比例
+    // late: 需求请求到达时预取的数据尚未返回
+    #define L1L2_GENERATE_PF_STATISTIC(lv) \
+    PIPELINE_5_GENERATE_PRINTSTATISTIC(lv##_pf_issue_count) \
+    PIPELINE_5_GENERATE_PRINTSTATISTIC(lv##_pf_useful_count) \
+    PIPELINE_5_GENERATE_PRINTSTATISTIC(lv##_pf_unused_count) \
+    PIPELINE_5_GENERATE_PRINTSTATISTIC(lv##_pf_late_count) \
+    LOGTOFILE(#lv "_pf_accuracy: %f\n", (statistic.lv##_pf_issue_count)?((double)(statistic.lv##_pf_useful_count) / statistic.lv##_pf_issue_count):0.); \
+    LOGTOFILE(#lv "_pf_coverage: %f\n", (statistic.lv##_pf_useful_count + statistic.lv##_miss_count)? \
+        ((double)(statistic.lv##_pf_useful_count) / (statistic.lv##_pf_useful_count + statistic.lv##_miss_count)):0.);
+    L1L2_GENERATE_PF_STATISTIC(l1i)
+    L1L2_GENERATE_PF_STATISTIC(l1d)
+    L1L2_GENERATE_PF_STATISTIC(l2)
+    #undef L1L2_GENERATE_PF_STATISTIC
+    PIPELINE_5_GENERATE_PRINTSTATISTIC(pf_drop_count)
 }
 
 void PrivL1L2Moesi::print_setup_info(std::ofstream &ofile) {
     LOGTOFILE("port_id: %d\n", my_port_id);
     LOGTOFILE("l1i_way_count: %d\n", l1i_param.way_cnt);
     LOGTOFILE("l1i_set_count: %d\n", 1 << l1i_param.set_offset);
+    LOGTOFILE("l1i_mshr_count: %d\n", l1i_param.mshr_num);
     LOGTOFILE("l1d_way_count: %d\n", l1d_param.way_cnt);
     LOGTOFILE("l1d_set_count: %d\n", 1 << l1d_param.set_offset);
+    LOGTOFILE("l1d_mshr_count: %d\n", l1d_param.mshr_num);
     LOGTOFILE("l2_way_count: %d\n", l2_param.way_cnt);
     LOGTOFILE("l2_set_count: %d\n", 1 << l2_param.set_offset);
-    LOGTOFILE("l2_mshr_count: %d\n", l2_param.mshr_num);
+    LOGTOFILE("l2_bank_count: %d\n", bank_num);
+    LOGTOFILE("l2_mshr_count_per_bank: %d\n", l2_param.mshr_num);
     LOGTOFILE("l2_index_width: %d\n", l2_param.index_width);
     LOGTOFILE("l2_index_latency: %d\n", l2_param.index_latency);
+    LOGTOFILE("l1i_prefetcher: %s\n", l1i_next_line?"nextline":"none");
+    LOGTOFILE("l1d_prefetcher: %s\n", l1d_prefetcher?l1d_prefetcher->name():"none");
+    LOGTOFILE("l2_prefetcher: %s\n", l2_prefetcher?l2_prefetcher->name():"none");
 }
 
 }}
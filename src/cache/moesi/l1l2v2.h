@@ -27,12 +27,14 @@
 
 #include "cache/cacheinterface.h"
 #include "cache/cachecommon.h"
+#include "cache/prefetcher.h"
 #include "cache/trace.h"
 
 #include "bus/businterface.h"
 
 #include "common.h"
 #include "tickqueue.h"
+#include "objpool.h"
 
 namespace simcache {
 namespace moesi {
@@ -65,6 +67,9 @@ public:
 
     virtual void dump_core(std::ofstream &ofile);
 
+    // 为L1D与L2设置预取器，类型为none时关闭，l1i_next_line打开由CPU提示的L1I顺序预取
+    void set_prefetcher(PrefetcherParam &param, string l1d_type, string l2_type, bool l1i_next_line);
+
     friend class PrivL1L2MoesiL1DPort;
     friend class PrivL1L2MoesiL1IPort;
 protected:
@@ -84,7 +89,7 @@ protected:
     CacheCohenrenceMsg *recv_msg = nullptr;
 
     typedef struct {
-        vector<uint8_t>     msg;
+        CacheCohenrenceMsg  *msg;
         BusPortT            dst;
         uint32_t            cha;
     } ReadyToSend;
@@ -96,37 +101,33 @@ protected:
         auto &send = send_buf.back();
         send.dst = dst;
         send.cha = channel;
-        CacheCohenrenceMsg tmp;
-        tmp.type = type;
-        tmp.line = line;
-        tmp.arg = arg;
-        tmp.transid = transid;
-        construct_msg_pack(tmp, send.msg);
+        send.msg = new CacheCohenrenceMsg();
+        send.msg->type = type;
+        send.msg->line = line;
+        send.msg->arg = arg;
+        send.msg->transid = transid;
     }
     inline void push_send_buf_with_line(BusPortT dst, uint32_t channel, uint32_t type, LineIndexT line, uint32_t arg, void* linebuf, uint32_t transid) {
         send_buf.emplace_back();
         auto &send = send_buf.back();
         send.dst = dst;
         send.cha = channel;
-        CacheCohenrenceMsg tmp;
-        tmp.type = type;
-        tmp.line = line;
-        tmp.arg = arg;
-        tmp.transid = transid;
-        tmp.data.resize(CACHE_LINE_LEN_BYTE);
-        cache_line_copy(tmp.data.data(), linebuf);
-        construct_msg_pack(tmp, send.msg);
+        send.msg = new CacheCohenrenceMsg();
+        send.msg->type = type;
+        send.msg->line = line;
+        send.msg->arg = arg;
+        send.msg->transid = transid;
+        send.msg->data.resize(CACHE_LINE_LEN_BYTE);
+        cache_line_copy(send.msg->data.data(), linebuf);
     }
 
     inline void cur_recieve_msg() {
         if(recv_msg) return;
-        uint32_t transid = 0;
-        vector<uint8_t> buf;
         for(uint32_t c = 0; c < CHANNEL_CNT; c++) {
             if(!bus->can_recv(my_port_id, c)) continue;
-            simroot_assert(bus->recv(my_port_id, c, buf));
-            recv_msg = new CacheCohenrenceMsg;
-            parse_msg_pack(buf, *recv_msg);
+            simbus::BusMessage *m = nullptr;
+            simroot_assert(bus->recv_msg(my_port_id, c, &m));
+            recv_msg = static_cast<CacheCohenrenceMsg*>(m);
             // has_recieved = true;
             break;
         }
@@ -137,7 +138,7 @@ protected:
         bus->can_send(my_port_id, can_send);
         for(auto iter = send_buf.begin(); iter != send_buf.end(); ) {
             if(can_send[iter->cha]) {
-                simroot_assert(bus->send(my_port_id, iter->dst, iter->cha, iter->msg));
+                simroot_assert(bus->send_msg(my_port_id, iter->dst, iter->cha, iter->msg));
                 can_send[iter->cha] = false;
                 iter = send_buf.erase(iter);
             }
@@ -152,6 +153,7 @@ protected:
     const uint32_t L2FLG_IN_I           = (1<<0);
     const uint32_t L2FLG_IN_D           = (1<<1);
     const uint32_t L2FLG_IN_D_W         = (1<<2);
+    const uint32_t L2FLG_PREFETCH       = (1<<3);   // 由预取填入且尚未被需求访问
 
     typedef struct {
         uint64_t    data[CACHE_LINE_LEN_I64];
@@ -162,6 +164,10 @@ protected:
     const uint32_t MSHR_FIFLG_L1IREQ    = (1<<0);
     const uint32_t MSHR_FIFLG_L1DREQS   = (1<<1);
     const uint32_t MSHR_FIFLG_L1DREQM   = (1<<2);
+    const uint32_t MSHR_FIFLG_PF_L1I    = (1<<3);
+    const uint32_t MSHR_FIFLG_PF_L1D    = (1<<4);
+    const uint32_t MSHR_FIFLG_PF_L2     = (1<<5);
+    const uint32_t MSHR_FIFLG_PF_ALL    = (MSHR_FIFLG_PF_L1I | MSHR_FIFLG_PF_L1D | MSHR_FIFLG_PF_L2);
 
     typedef struct {
         uint64_t line_buf[CACHE_LINE_LEN_I64];
@@ -177,7 +183,22 @@ protected:
     } MSHREntry;
 
     unique_ptr<GenericLRUCacheBlock<TagedCacheLine>> block;
-    unique_ptr<MSHRArray<MSHREntry>> mshrs;
+    vector<unique_ptr<MSHRArray<MSHREntry>>> mshrs;   // 每个Bank一组
+
+// ------------- L2 Banks ---------------
+
+    // 组号的低位选择Bank，被替换的行与新行总在同一个Bank中
+    uint32_t bank_num = 1;
+    inline uint32_t bank_of(LineIndexT lindex) {
+        return lindex & (bank_num - 1);
+    }
+    inline MSHRArray<MSHREntry> *bank_mshrs(LineIndexT lindex) {
+        return mshrs[bank_of(lindex)].get();
+    }
+
+    vector<uint64_t> bank_access_count;
+    vector<uint64_t> bank_conflict_cycle;  // 有请求因Bank流水线被占用而等待的周期数
+    vector<bool> bank_conflict;
 
 // ------------- L2 Main Pipeline ---------------
 
@@ -187,21 +208,32 @@ protected:
 
     uint32_t index_cycle = 4;
 
-    typedef struct {
+    typedef struct ProcessingPackage {
         LineIndexT              lindex = 0;
         CacheCohenrenceMsg*     msg = nullptr;
         uint32_t                index_cycle = 0;
+        uint32_t                pf_flag = 0;        // 非0表示预取请求，值为对应的MSHR_FIFLG_PF_*
+        OBJPOOL_NEW_DELETE(ProcessingPackage)
     } ProcessingPackage;
 
-    unique_ptr<SimpleTickQueue<ProcessingPackage*>> queue_index;
+    vector<unique_ptr<SimpleTickQueue<ProcessingPackage*>>> queue_index;
+
+    // 检查lindex所在Bank本周期能否接收新的请求，不能时记录一次Bank冲突
+    inline bool bank_can_push(LineIndexT lindex) {
+        uint32_t b = bank_of(lindex);
+        if(queue_index[b]->can_push()) return true;
+        bank_conflict[b] = true;
+        return false;
+    }
+    void push_to_bank(ProcessingPackage *pak);
 
     void p1_fetch();
-    void p2_index();
+    void p2_index(uint32_t bank);
 
     void handle_new_line_nolock(LineIndexT lindex, MSHREntry *mshr, uint32_t init_state);
 
-    void insert_to_l1i(LineIndexT lindex, void * line_buf);
-    void insert_to_l1d(LineIndexT lindex, void * line_buf, bool writable);
+    void insert_to_l1i(LineIndexT lindex, void * line_buf, bool prefetched = false);
+    void insert_to_l1d(LineIndexT lindex, void * line_buf, bool writable, bool prefetched = false);
 
     void snoop_l1d_and_set_readonly(LineIndexT lindex, void * l2_line_buf);
     void snoop_l1_and_invalid(LineIndexT lindex, void * l2_line_buf);
@@ -209,11 +241,43 @@ protected:
     void main_on_current_tick();
     void main_apply_next_tick();
     bool is_main_cur = true;    // 保证main_on_current_tick和main_apply_next_tick每周期被交替调用一次
+    bool bus_recv_pending = false;
+    bool is_idle();
+
+// ------------- Prefetch ---------------
+
+    // 预取请求优先级最低，只在流水线空闲且MSHR有余量时发出，为需求请求保留pf_mshr_reserve项MSHR
+    unique_ptr<Prefetcher> l1d_prefetcher;
+    unique_ptr<Prefetcher> l2_prefetcher;
+    bool l1i_next_line = false;
+
+    typedef struct {
+        LineIndexT  lindex;
+        uint32_t    pf_flag;
+    } PrefetchRequest;
+
+    std::list<PrefetchRequest> pf_queue;
+    uint32_t pf_queue_size = 8;
+    uint32_t pf_mshr_reserve = 2;
+    vector<LineIndexT> pf_candidates;
+
+    VirtAddrT l1d_access_pc = 0;
+
+    void pf_enqueue(LineIndexT lindex, uint32_t pf_flag);
+    void pf_train_l1d(LineIndexT lindex, bool miss);
+    void pf_train_l2(VirtAddrT pc, LineIndexT lindex, bool miss);
+    inline bool pf_has_spare_mshr(LineIndexT lindex) {
+        auto *m = bank_mshrs(lindex);
+        return m->hashmap.size() + pf_mshr_reserve < m->max_sz;
+    }
+
+    void l1i_prefetch(PhysAddrT paddr);
 
 // ------------- L1 Types ---------------
 
     const uint32_t L1FLG_WRITE      = (1<<0);
     const uint32_t L1FLG_DIRTY      = (1<<1);
+    const uint32_t L1FLG_PREFETCH   = (1<<2);   // 由预取填入且尚未被需求访问
 
     const uint32_t L1REQ_GETS       = 1;
     const uint32_t L1REQ_GETM       = 2;
@@ -226,14 +290,34 @@ protected:
         LineIndexT      lindex = 0;
         uint64_t        start_tick = 0;
         uint32_t        trans_id = 0;
+        VirtAddrT       pc = 0;
         vector<uint8_t> data;
     } L1Request;
 
+    // L1的MSHR，每行最多占用一项，同一行的后续缺失合并到已有项，type为0表示空闲
+    // 合并不可关闭：L2按行串行处理请求（processing_line），回填与L1的到达记录都按行匹配，同一行的两项无法区分
+    // 合并也不改变原有行为，原来只有一项请求时，对同一行的再次访问同样返回miss
+    inline L1Request *l1_find_req(vector<L1Request> &reqs, LineIndexT lindex) {
+        for(auto &r : reqs) if(r.type && r.lindex == lindex) return &r;
+        return nullptr;
+    }
+    inline L1Request *l1_alloc_req(vector<L1Request> &reqs) {
+        for(auto &r : reqs) if(!r.type) return &r;
+        return nullptr;
+    }
+    inline uint32_t l1_req_count(vector<L1Request> &reqs) {
+        uint32_t cnt = 0;
+        for(auto &r : reqs) if(r.type) cnt++;
+        return cnt;
+    }
+    // 选择最早的尚未进入L2流水线的请求
+    L1Request *l1_select_req(vector<L1Request> &reqs);
+
 // ------------- L1I Cache ---------------
 
     unique_ptr<GenericLRUCacheBlock<TagedCacheLine>> l1i_block;
 
-    L1Request   l1i_req;
+    vector<L1Request> l1i_reqs;
 
     uint32_t    l1i_busy_cycle = 0; // 由于L2Cache通过总线访问L1 Cache Block对L1流水线产生的阻塞
 
@@ -256,7 +340,7 @@ protected:
     bool reserved_address_valid = false;
     PhysAddrT reserved_address = 0;
 
-    L1Request   l1d_req;
+    vector<L1Request> l1d_reqs;
 
     uint32_t    l1d_busy_cycle = 0; // 由于L2Cache通过总线访问L1 Cache Block对L1流水线产生的阻塞
 
@@ -294,6 +378,27 @@ protected:
 
         uint64_t    l2_hit_count = 0;
         uint64_t    l2_miss_count = 0;
+
+        uint64_t    l1i_mshr_merge_count = 0;   // 对已缺失行的再次访问
+        uint64_t    l1i_mshr_full_count = 0;    // MSHR已满而返回busy
+        uint64_t    l1i_mshr_max_inflight = 0;
+        uint64_t    l1d_mshr_merge_count = 0;
+        uint64_t    l1d_mshr_full_count = 0;
+        uint64_t    l1d_mshr_max_inflight = 0;
+
+        uint64_t    l1i_pf_issue_count = 0;
+        uint64_t    l1i_pf_useful_count = 0;
+        uint64_t    l1i_pf_unused_count = 0;
+        uint64_t    l1i_pf_late_count = 0;
+        uint64_t    l1d_pf_issue_count = 0;
+        uint64_t    l1d_pf_useful_count = 0;
+        uint64_t    l1d_pf_unused_count = 0;
+        uint64_t    l1d_pf_late_count = 0;
+        uint64_t    l2_pf_issue_count = 0;
+        uint64_t    l2_pf_useful_count = 0;
+        uint64_t    l2_pf_unused_count = 0;
+        uint64_t    l2_pf_late_count = 0;
+        uint64_t    pf_drop_count = 0;
     } statistic;
 
     string logname;
@@ -335,6 +440,9 @@ public:
         if(out) out->insert(out->end(), arrivals.begin(), arrivals.end());
         return ret;
     }
+    virtual void set_access_pc(VirtAddrT pc) {
+        l1l2_controler->l1d_access_pc = pc;
+    }
 
     // CacheInterfaceV2
     virtual void clear_ld(std::list<CacheOP*> *to_free) {
@@ -403,6 +511,9 @@ public:
         if(out) out->insert(out->end(), arrivals.begin(), arrivals.end());
         return ret;
     }
+    virtual void prefetch(PhysAddrT paddr) {
+        l1l2_controler->l1i_prefetch(paddr);
+    }
 
     // CacheInterfaceV2
     virtual void clear_ld(std::list<CacheOP*> *to_free) {
@@ -37,8 +37,7 @@ LLCMoesiDirNoi::LLCMoesiDirNoi(
     BusPortMapping *busmap,
     string logname,
     CacheEventTrace *trace
-) : bus(bus), my_port_id(my_port_id), busmap(busmap), logname(logname), trace(trace), param(param),
-queue_index(1,1,0), queue_writeback(1,1,4), queue_index_result(1,1,0)
+) : bus(bus), my_port_id(my_port_id), busmap(busmap), logname(logname), trace(trace), param(param)
 {
     do_on_current_tick = 5;
     do_apply_next_tick = 1;
@@ -54,36 +53,48 @@ queue_index(1,1,0), queue_writeback(1,1,4), queue_index_result(1,1,0)
 
     block = make_unique<GenericLRUCacheBlock<CacheLineT>>(param.set_offset, param.way_cnt);
     directory = make_unique<GenericLRUCacheBlock<DirEntry>>(param.dir_set_offset, param.dir_way_cnt);
+
+    bank_num = param.bank_num;
+    simroot_assertf(bank_num && !(bank_num & (bank_num - 1)) && bank_num <= block->set_count,
+        "LLC: bank_num %d should be power of 2 and no more than set count %d", bank_num, block->set_count);
+    simroot_assertf(bank_num <= directory->set_count,
+        "LLC: bank_num %d should be no more than directory set count %d", bank_num, directory->set_count);
+    banks.resize(bank_num);
+    recv_buf_size *= bank_num;
+
+    bus->set_port_owner(my_port_id, this);
 }
 
 void LLCMoesiDirNoi::p1_fetch() {
-    CacheCohenrenceMsg msg;
-    bool recv = false;
-    if(recv_buf.size() < recv_buf_size) {
+    CacheCohenrenceMsg *msg = nullptr;
+    {
         vector<bool> can_recv;
         bus->can_recv(my_port_id, can_recv);
         for(uint32_t c = 0; c < CHANNEL_CNT; c++) {
             if(!can_recv[c]) continue;
-            vector<uint8_t> buf;
-            simroot_assert(bus->recv(my_port_id, c, buf));
-            parse_msg_pack(buf, msg);
-            recv = true;
+            // 接收缓冲满时仍然接收ACK通道，否则缓冲中等待的请求与其所等待的GET_ACK互相阻塞
+            if(recv_buf.size() >= recv_buf_size && c != CHANNEL_ACK) continue;
+            simbus::BusMessage *m = nullptr;
+            simroot_assert(bus->recv_msg(my_port_id, c, &m));
+            msg = static_cast<CacheCohenrenceMsg*>(m);
             break;
         }
     }
-    if(recv) {
-        simroot_assertf(nuca_check(msg.line), "Unexpected Line @0x%lx at NUCA node %ld/%ld", msg.line, nuca_index, nuca_num);
-        switch (msg.type)
+    if(msg) {
+        simroot_assertf(nuca_check(msg->line), "Unexpected Line @0x%lx at NUCA node %ld/%ld", msg->line, nuca_index, nuca_num);
+        switch (msg->type)
         {
         case MSG_INVALID_ACK :
+            delete msg;
             break;
         case MSG_GET_ACK :
-            processing_lindex.erase(msg.line);
-            block->unpin(lindex_to_nuca_tag(msg.line));
+            processing_lindex.erase(msg->line);
+            block->unpin(lindex_to_nuca_tag(msg->line));
+            delete msg;
             break;
         case MSG_PUTM :
         case MSG_PUTO :
-            simroot_assert(msg.data.size() == CACHE_LINE_LEN_BYTE);
+            simroot_assert(msg->data.size() == CACHE_LINE_LEN_BYTE);
         case MSG_GETS :
         case MSG_GETM :
         case MSG_PUTS :
@@ -95,33 +106,46 @@ void LLCMoesiDirNoi::p1_fetch() {
         }
     }
 
-    if(recv_buf.empty() || !(queue_index.can_push())) {
-        return;
-    }
-
-    for(auto iter = recv_buf.begin(); iter != recv_buf.end(); iter++) {
-        if(processing_lindex.find(iter->line) != processing_lindex.end()) {
+    // 每个Bank每周期接收一个请求
+    vector<bool> conflict(bank_num, false);
+    for(auto iter = recv_buf.begin(); iter != recv_buf.end(); ) {
+        CacheCohenrenceMsg *m = *iter;
+        if(processing_lindex.find(m->line) != processing_lindex.end()) {
+            iter++;
+            continue;
+        }
+        Bank &bank = bank_of(m->line);
+        if(!(bank.queue_index.can_push())) {
+            conflict[&bank - banks.data()] = true;
+            iter++;
             continue;
         }
         RequestPackage *topush = new RequestPackage;
-        topush->type = iter->type;
-        topush->lindex = iter->line;
-        topush->arg = iter->arg;
-        topush->transid = iter->transid;
+        topush->type = m->type;
+        topush->lindex = m->line;
+        topush->arg = m->arg;
+        topush->transid = m->transid;
         topush->index_cycle = this->index_cycle;
-        if(iter->data.size() > 0) {
-            simroot_assert(iter->data.size() == CACHE_LINE_LEN_BYTE);
-            cache_line_copy(topush->line_buf, iter->data.data());
+        if(m->data.size() > 0) {
+            simroot_assert(m->data.size() == CACHE_LINE_LEN_BYTE);
+            cache_line_copy(topush->line_buf, m->data.data());
         }
-        queue_index.push(topush);
-        processing_lindex.insert(iter->line);
-        block->pin(lindex_to_nuca_tag(iter->line));
-        recv_buf.erase(iter);
-        break;
+        bank.queue_index.push(topush);
+        bank.access_count++;
+        processing_lindex.insert(m->line);
+        block->pin(lindex_to_nuca_tag(m->line));
+        delete m;
+        iter = recv_buf.erase(iter);
+    }
+    for(uint32_t b = 0; b < bank_num; b++) {
+        if(conflict[b]) banks[b].conflict_cycle++;
     }
 }
 
-void LLCMoesiDirNoi::p2_index() {
+void LLCMoesiDirNoi::p2_index(Bank &bank) {
+    auto &queue_writeback = bank.queue_writeback;
+    auto &queue_index = bank.queue_index;
+    auto &queue_index_result = bank.queue_index_result;
     if(queue_writeback.can_pop()) {
         RequestPackage *wb = queue_writeback.top();
         if(wb->dir_evict) {
@@ -199,7 +223,7 @@ void LLCMoesiDirNoi::p2_index() {
             statistic.llc_hit_count++;
         }
         else {
-            simroot_assert(pak->entry.exists.find(pak->entry.owner) != pak->entry.exists.end());
+            simroot_assert(pak->entry.exists.contains(pak->entry.owner));
             simroot_assert(busmap->get_reqnode_port(pak->entry.owner, &dst));
             pak->push_send_buf(dst, CHANNEL_REQ, MSG_GETS_FORWARD, pak->lindex, pak->arg, transid);
 
@@ -255,20 +279,25 @@ void LLCMoesiDirNoi::p2_index() {
                 block->remove_line(lindex_to_nuca_tag(pak->lindex));
             }
             bool skip_owner = false;
-            if(std::find(pak->entry.exists.begin(), pak->entry.exists.end(), l1_index) == pak->entry.exists.end())
+            if(!(pak->entry.exists.contains(l1_index)))
             {
                 simroot_assert(busmap->get_reqnode_port(pak->entry.owner, &dst));
                 pak->push_send_buf(dst, CHANNEL_REQ, MSG_GETM_FORWARD, pak->lindex, pak->arg, transid);
                 skip_owner = true;
             }
-            uint32_t invalid_cnt = 0;
-            for(auto l1 : pak->entry.exists) {
-                if(l1 == l1_index || (skip_owner && l1 == pak->entry.owner)) {
-                    continue;
-                }
+            // 除请求者与被转发的owner外的共享者都需要失效
+            auto &sharers = pak->entry.exists;
+            sharers.erase(l1_index);
+            if(skip_owner) sharers.erase(pak->entry.owner);
+            uint32_t invalid_cnt = sharers.count();
+            sharers.for_each([&](uint32_t l1) {
                 simroot_assert(busmap->get_reqnode_port(l1, &dst));
                 pak->push_send_buf(dst, CHANNEL_RESP, MSG_INVALID, pak->lindex, pak->arg, transid);
-                invalid_cnt++;
+            });
+            if(invalid_cnt) {
+                statistic.invalid_request_count++;
+                statistic.invalid_msg_count += invalid_cnt;
+                statistic.invalid_fanout_max = std::max<uint64_t>(statistic.invalid_fanout_max, invalid_cnt);
             }
             pak->push_send_buf(src_port, CHANNEL_RESP, MSG_GETM_ACK, pak->lindex, invalid_cnt, transid);
 
@@ -294,7 +323,7 @@ void LLCMoesiDirNoi::p2_index() {
             pak->entry = *pentry;
             pak->entry.exists.erase(l1_index);
             if(l1_index == pak->entry.owner && !(pak->entry.exists.empty())) {
-                pak->entry.owner = *(pak->entry.exists.begin());
+                pak->entry.owner = pak->entry.exists.first();
             }
             pak->dir_evict = (pak->entry.exists.empty());
         }
@@ -324,10 +353,11 @@ void LLCMoesiDirNoi::p2_index() {
                 bool rep_dir_hit = directory->get_line(lindex_to_nuca_tag(pak->lindex_replaced), &rep_ent, false);
 
                 if(rep_dir_hit && !(rep_ent->dirty)) {
-                    for(auto l1 : rep_ent->exists) {
+                    rep_ent->exists.for_each([&](uint32_t l1) {
                         simroot_assert(busmap->get_reqnode_port(l1, &dst));
                         pak->push_send_buf(dst, CHANNEL_RESP, MSG_INVALID, pak->lindex_replaced, my_port_id, 0);
-                    }
+                    });
+                    statistic.dir_evict_invalid_count += rep_ent->exists.count();
                     directory->remove_line(lindex_to_nuca_tag(pak->lindex_replaced));
                 }
 
@@ -341,7 +371,7 @@ void LLCMoesiDirNoi::p2_index() {
         pak->entry.dirty = (pak->entry.owner != l1_index);
         pak->entry.exists.erase(l1_index);
         if(!(pak->entry.exists.empty())) {
-            pak->entry.owner = *(pak->entry.exists.begin());
+            pak->entry.owner = pak->entry.exists.first();
         }
         pak->dir_evict = (pak->entry.exists.empty());
     }
@@ -350,7 +380,10 @@ void LLCMoesiDirNoi::p2_index() {
     }
 }
 
-void LLCMoesiDirNoi::p3_process() {
+void LLCMoesiDirNoi::p3_process(Bank &bank, vector<bool> &can_send) {
+    auto &process_buf = bank.process_buf;
+    auto &queue_index_result = bank.queue_index_result;
+    auto &queue_writeback = bank.queue_writeback;
 
     if(process_buf.size() < process_buf_size && queue_index_result.can_pop()) {
         process_buf.push_back(queue_index_result.top());
@@ -361,13 +394,11 @@ void LLCMoesiDirNoi::p3_process() {
         return;
     }
 
-    vector<bool> can_send;
-    bus->can_send(my_port_id, can_send);
-
+    // 各Bank共用总线端口，can_send在Bank之间传递
     for(auto &pak : process_buf) {
         for(auto iter = pak->need_send.begin(); iter != pak->need_send.end(); ) {
             if(can_send[iter->cha]) {
-                simroot_assert(bus->send(my_port_id, iter->dst, iter->cha, iter->msg));
+                simroot_assert(bus->send_msg(my_port_id, iter->dst, iter->cha, iter->msg));
                 can_send[iter->cha] = false;
                 iter = pak->need_send.erase(iter);
             }
@@ -393,14 +424,36 @@ void LLCMoesiDirNoi::p3_process() {
 
 void LLCMoesiDirNoi::on_current_tick() {
     p1_fetch();
-    p2_index();
-    p3_process();
+    for(auto &bank : banks) {
+        p2_index(bank);
+    }
+    vector<bool> can_send;
+    bus->can_send(my_port_id, can_send);
+    for(uint32_t i = 0; i < bank_num; i++) {
+        // 轮转起始Bank，避免低编号Bank总是先占用总线
+        p3_process(banks[(i + rr_bank) & (bank_num - 1)], can_send);
+    }
+    rr_bank = (rr_bank + 1) & (bank_num - 1);
+    bus_recv_pending = false;
+    for(uint32_t c = 0; c < CHANNEL_CNT && !bus_recv_pending; c++) {
+        bus_recv_pending = bus->can_recv(my_port_id, c);
+    }
 }
 
 void LLCMoesiDirNoi::apply_next_tick() {
-    queue_index.apply_next_tick();
-    queue_writeback.apply_next_tick();
-    queue_index_result.apply_next_tick();
+    bool banks_empty = true;
+    for(auto &bank : banks) {
+        bank.queue_index.apply_next_tick();
+        bank.queue_writeback.apply_next_tick();
+        bank.queue_index_result.apply_next_tick();
+        banks_empty = (banks_empty && bank.process_buf.empty() &&
+            bank.queue_index.empty() && bank.queue_writeback.empty() && bank.queue_index_result.empty());
+    }
+
+    // 等待中的事务由总线消息推进，总线投递时会唤醒
+    if(!bus_recv_pending && recv_buf.empty() && banks_empty) {
+        sim_sleep();
+    }
 }
 
 
@@ -410,13 +463,35 @@ void LLCMoesiDirNoi::apply_next_tick() {
 void LLCMoesiDirNoi::print_statistic(std::ofstream &ofile) {
     PIPELINE_5_GENERATE_PRINTSTATISTIC(llc_hit_count)
     PIPELINE_5_GENERATE_PRINTSTATISTIC(llc_miss_count)
+    PIPELINE_5_GENERATE_PRINTSTATISTIC(invalid_msg_count)
+    PIPELINE_5_GENERATE_PRINTSTATISTIC(invalid_request_count)
+    PIPELINE_5_GENERATE_PRINTSTATISTIC(invalid_fanout_max)
+    PIPELINE_5_GENERATE_PRINTSTATISTIC(dir_evict_invalid_count)
+    LOGTOFILE("invalid_fanout_avg: %f\n", (statistic.invalid_request_count)?(((double)statistic.invalid_msg_count) / statistic.invalid_request_count):0.);
+    // 目录容量按全部表项计算，另加超出内联宽度的共享者位图
+    uint64_t dir_bytes = (uint64_t)(directory->set_count) * param.dir_way_cnt * sizeof(DirEntry);
+    uint64_t dir_valid = 0;
+    for(uint32_t s = 0; s < directory->set_count; s++) {
+        std::vector<std::pair<LineIndexT, DirEntry*>> lines;
+        directory->get_set_lines(s, lines);
+        dir_valid += lines.size();
+        for(auto &e : lines) dir_bytes += e.second->exists.ext_bytes();
+    }
+    LOGTOFILE("dir_entry_bytes: %ld\n", sizeof(DirEntry));
+    LOGTOFILE("dir_valid_entries: %ld\n", dir_valid);
+    LOGTOFILE("dir_footprint_bytes: %ld\n", dir_bytes);
+    for(uint32_t b = 0; b < bank_num; b++) {
+        LOGTOFILE("bank%d_access_count: %ld\n", b, banks[b].access_count);
+        LOGTOFILE("bank%d_conflict_cycle: %ld\n", b, banks[b].conflict_cycle);
+    }
 }
 
 void LLCMoesiDirNoi::print_setup_info(std::ofstream &ofile) {
     LOGTOFILE("port_id: %d\n", my_port_id);
     LOGTOFILE("way_count: %d\n", param.way_cnt);
     LOGTOFILE("set_count: %d\n", 1 << param.set_offset);
-    LOGTOFILE("mshr_count: %d\n", param.mshr_num);
+    LOGTOFILE("bank_count: %d\n", bank_num);
+    LOGTOFILE("mshr_count_per_bank: %d\n", param.mshr_num);
     LOGTOFILE("index_width: %d\n", param.index_width);
     LOGTOFILE("index_latency: %d\n", param.index_latency);
     LOGTOFILE("nuca_index: %d\n", param.nuca_index);
@@ -428,7 +503,9 @@ void LLCMoesiDirNoi::dump_core(std::ofstream &ofile) {
     for(uint32_t s = 0; s < block->set_count; s++) {
         sprintf(log_buf, "set %d: ", s);
         ofile << log_buf;
-        for(auto &e : block->p_sets[s]) {
+        std::vector<std::pair<LineIndexT, CacheLineT*>> lines;
+        block->get_set_lines(s, lines);
+        for(auto &e : lines) {
             sprintf(log_buf, "0x%lx ", nuca_tag_to_lindex(e.first));
             ofile << log_buf;
         }
@@ -437,13 +514,15 @@ void LLCMoesiDirNoi::dump_core(std::ofstream &ofile) {
     for(uint32_t s = 0; s < directory->set_count; s++) {
         sprintf(log_buf, "dir %d: ", s);
         ofile << log_buf;
-        for(auto &e : directory->p_sets[s]) {
-            sprintf(log_buf, "0x%lx-d%d-o%d", nuca_tag_to_lindex(e.first), e.second.dirty, e.second.owner);
+        std::vector<std::pair<LineIndexT, DirEntry*>> lines;
+        directory->get_set_lines(s, lines);
+        for(auto &e : lines) {
+            sprintf(log_buf, "0x%lx-d%d-o%d", nuca_tag_to_lindex(e.first), e.second->dirty, e.second->owner);
             ofile << log_buf;
-            for(auto &s : e.second.exists) {
+            e.second->exists.for_each([&](uint32_t s) {
                 sprintf(log_buf, "-%d", s);
                 ofile << log_buf;
-            }
+            });
             ofile << " ";
         }
         ofile << "\n";
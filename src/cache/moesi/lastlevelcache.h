@@ -87,13 +87,13 @@ protected:
 
     uint32_t index_cycle = 4;
 
-    std::list<CacheCohenrenceMsg> recv_buf;
+    std::list<CacheCohenrenceMsg*> recv_buf;
     uint32_t recv_buf_size = 4;
 
     std::set<LineIndexT> processing_lindex;
 
     typedef struct {
-        std::set<uint32_t>      exists;
+        SharerBitmap<2>         exists;
         uint32_t                owner = 0;
         bool                    dirty = false;
     } DirEntry;
@@ -102,7 +102,7 @@ protected:
     unique_ptr<GenericLRUCacheBlock<DirEntry>> directory;
 
     typedef struct {
-        vector<uint8_t>     msg;
+        CacheCohenrenceMsg  *msg;
         BusPortT            dst;
         uint32_t            cha;
     } ReadyToSend;
@@ -134,45 +134,65 @@ protected:
             auto &send = need_send.back();
             send.dst = dst;
             send.cha = channel;
-            CacheCohenrenceMsg tmp;
-            tmp.type = type;
-            tmp.line = line;
-            tmp.arg = arg;
-            tmp.transid = transid;
-            construct_msg_pack(tmp, send.msg);
+            send.msg = new CacheCohenrenceMsg();
+            send.msg->type = type;
+            send.msg->line = line;
+            send.msg->arg = arg;
+            send.msg->transid = transid;
         }
         inline void push_send_buf_with_line(BusPortT dst, uint32_t channel, uint32_t type, LineIndexT line, uint32_t arg, uint8_t* linebuf, uint32_t transid) {
             need_send.emplace_back();
             auto &send = need_send.back();
             send.dst = dst;
             send.cha = channel;
-            CacheCohenrenceMsg tmp;
-            tmp.type = type;
-            tmp.line = line;
-            tmp.arg = arg;
-            tmp.transid = transid;
-            tmp.data.resize(CACHE_LINE_LEN_BYTE);
-            cache_line_copy(tmp.data.data(), linebuf);
-            construct_msg_pack(tmp, send.msg);
+            send.msg = new CacheCohenrenceMsg();
+            send.msg->type = type;
+            send.msg->line = line;
+            send.msg->arg = arg;
+            send.msg->transid = transid;
+            send.msg->data.resize(CACHE_LINE_LEN_BYTE);
+            cache_line_copy(send.msg->data.data(), linebuf);
         }
     } RequestPackage;
 
-    SimpleTickQueue<RequestPackage*> queue_index;
-    SimpleTickQueue<RequestPackage*> queue_writeback;
-    SimpleTickQueue<RequestPackage*> queue_index_result;
+    // 每个Bank有独立的索引流水线与MSHR(process_buf)，Bank由NUCA内的组号低位选择
+    typedef struct Bank {
+        SimpleTickQueue<RequestPackage*> queue_index;
+        SimpleTickQueue<RequestPackage*> queue_writeback;
+        SimpleTickQueue<RequestPackage*> queue_index_result;
+
+        std::list<RequestPackage*> process_buf;
+
+        uint64_t    access_count = 0;
+        uint64_t    conflict_cycle = 0;     // 有请求因该Bank流水线被占用而等待的周期数
+
+        Bank() : queue_index(1,1,0), queue_writeback(1,1,4), queue_index_result(1,1,0) {}
+    } Bank;
+
+    vector<Bank> banks;
+    uint32_t bank_num = 1;
+    uint32_t rr_bank = 0;
+    inline Bank &bank_of(LineIndexT lindex) {
+        return banks[lindex_to_nuca_tag(lindex) & (bank_num - 1)];
+    }
 
-    std::list<RequestPackage*> process_buf;
     uint32_t process_buf_size = 4;
 
     void p1_fetch();
-    void p2_index();
-    void p3_process();
+    void p2_index(Bank &bank);
+    void p3_process(Bank &bank, vector<bool> &can_send);
+
+    bool bus_recv_pending = false;
 
     CacheEventTrace *trace = nullptr;
 
     struct {
         uint64_t llc_hit_count = 0;
         uint64_t llc_miss_count = 0;
+        uint64_t invalid_msg_count = 0;
+        uint64_t invalid_request_count = 0;  // 需要发出失效消息的请求数
+        uint64_t invalid_fanout_max = 0;
+        uint64_t dir_evict_invalid_count = 0;
     } statistic;
 
 };
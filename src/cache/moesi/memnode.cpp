@@ -41,6 +41,13 @@ MemoryNode::MemoryNode(
     do_apply_next_tick = 0;
 
     memory_access_buf_size = conf::get_int("mem", "memory_access_buf_size", 4);
+    if(conf::get_int("mem", "dram_timing_model", 0)) {
+        DRAMParam param;
+        DRAMController::load_param(param, dwidth);
+        dram = std::make_unique<DRAMController>(param);
+    }
+
+    bus->set_port_owner(my_port, this);
 }
 
 #define LOGTOFILE(fmt, ...) do{sprintf(log_buf, fmt, ##__VA_ARGS__);ofile << log_buf;}while(0)
@@ -48,60 +55,77 @@ MemoryNode::MemoryNode(
 void MemoryNode::print_statistic(std::ofstream &ofile) {
     LOGTOFILE("message_precossed: %ld\n", statistic.request_precossed);
     LOGTOFILE("busy_rate: %f\n", ((double)(statistic.busy_cycles))/(simroot::get_current_tick()));
+    if(dram) dram->print_statistic(ofile);
 }
 
 void MemoryNode::print_setup_info(std::ofstream &ofile) {
     LOGTOFILE("port_id: %d\n", my_port);
     LOGTOFILE("data_width: %d\n", dwidth);
+    if(dram) dram->print_setup_info(ofile);
 }
 
 
 
-void MemoryNode::on_current_tick() {
+bool MemoryNode::recv_request(MemoryAccessBuf &mb) {
     CacheCohenrenceMsg msg;
     bool recv = false;
-    bool busy = false;
-    if(membufs.size() < memory_access_buf_size) {
-        for(uint32_t c = 0; c < CHANNEL_CNT; c++) {
-            if(bus->can_recv(my_port, c)) {
-                vector<uint8_t> buf;
-                simroot_assert(bus->recv(my_port, c, buf));
-                parse_msg_pack(buf, msg);
-                recv = true;
-                break;
-            }
+    for(uint32_t c = 0; c < CHANNEL_CNT; c++) {
+        if(bus->can_recv(my_port, c)) {
+            simbus::BusMessage *m = nullptr;
+            simroot_assert(bus->recv_msg(my_port, c, &m));
+            CacheCohenrenceMsg *p = static_cast<CacheCohenrenceMsg*>(m);
+            std::swap(msg, *p);
+            delete p;
+            recv = true;
+            break;
         }
     }
+    if(!recv) return false;
+
+    mb.lindex = msg.line;
+    simroot_assert(addr_map->is_responsible(msg.line));
+    mb.hostoff = addr_map->get_local_mem_offset(msg.line);
+    mb.src_port = msg.arg;
+    mb.transid = msg.transid;
+    switch (msg.type)
+    {
+    case MSG_GETS_FORWARD :
+    case MSG_GETM_FORWARD :
+        mb.op = 0;
+        break;
+    case MSG_PUTM :
+    case MSG_PUTO :
+        mb.op = 1;
+        simroot_assert(msg.data.size() == CACHE_LINE_LEN_BYTE);
+        cache_line_copy(mb.linebuf, msg.data.data());
+        break;
+    default:
+        simroot_assert(0);
+    }
+    if(trace) trace->insert_event(msg.transid, CacheEvent::MEM_HANDLE);
+    statistic.request_precossed ++;
+    return true;
+}
+
+void MemoryNode::on_current_tick() {
+    if(dram) {
+        on_current_tick_dram();
+        return;
+    }
 
-    if(recv) {
+    bool busy = false;
+    if(membufs.size() < memory_access_buf_size) {
         membufs.emplace_back();
-        auto &mb = membufs.back();
-        mb.lindex = msg.line;
-        simroot_assert(addr_map->is_responsible(msg.line));
-        mb.hostoff = addr_map->get_local_mem_offset(msg.line);
-        mb.src_port = msg.arg;
-        mb.transid = msg.transid;
-        switch (msg.type)
-        {
-        case MSG_GETS_FORWARD :
-        case MSG_GETM_FORWARD :
-            mb.op = 0;
-            break;
-        case MSG_PUTM :
-        case MSG_PUTO :
-            mb.op = 1;
-            simroot_assert(msg.data.size() == CACHE_LINE_LEN_BYTE);
-            cache_line_copy(mb.linebuf, msg.data.data());
-            break;
-        default:
-            simroot_assert(0);
-        }
-        if(trace) trace->insert_event(msg.transid, CacheEvent::MEM_HANDLE);
-        statistic.request_precossed ++;
-        busy = true;
+        if(recv_request(membufs.back())) busy = true;
+        else membufs.pop_back();
     }
 
     if(membufs.empty()) {
+        bool pending = false;
+        for(uint32_t c = 0; c < CHANNEL_CNT && !pending; c++) {
+            pending = bus->can_recv(my_port, c);
+        }
+        if(!pending) sim_sleep();
         return;
     }
 
@@ -131,16 +155,14 @@ void MemoryNode::on_current_tick() {
     for(auto iter = membufs.begin(); iter != membufs.end(); iter++) {
         if(iter->processed >= CACHE_LINE_LEN_BYTE) {
             simroot_assert(!(iter->op));
-            CacheCohenrenceMsg send;
-            send.line = iter->lindex;
-            send.arg = 0;
-            send.type = MSG_GET_RESP_MEM;
-            send.transid = iter->transid;
-            send.data.assign(CACHE_LINE_LEN_BYTE, 0);
-            cache_line_copy(send.data.data(), iter->linebuf);
-            vector<uint8_t> buf;
-            construct_msg_pack(send, buf);
-            simroot_assert(bus->send(my_port, iter->src_port, CHANNEL_RESP, buf));
+            CacheCohenrenceMsg *send = new CacheCohenrenceMsg();
+            send->line = iter->lindex;
+            send->arg = 0;
+            send->type = MSG_GET_RESP_MEM;
+            send->transid = iter->transid;
+            send->data.resize(CACHE_LINE_LEN_BYTE);
+            cache_line_copy(send->data.data(), iter->linebuf);
+            simroot_assert(bus->send_msg(my_port, iter->src_port, CHANNEL_RESP, send));
             membufs.erase(iter);
             break;
             busy = true;
@@ -152,4 +174,61 @@ void MemoryNode::on_current_tick() {
     }
 }
 
+void MemoryNode::on_current_tick_dram() {
+    bool busy = false;
+    if(dram->can_accept()) {
+        MemoryAccessBuf mb;
+        if(recv_request(mb)) {
+            uint8_t *ptr = memblk + mb.hostoff;
+            if(mb.op) {
+                memcpy(ptr, mb.linebuf, CACHE_LINE_LEN_BYTE);
+            }
+            else {
+                memcpy(mb.linebuf, ptr, CACHE_LINE_LEN_BYTE);
+                dram_reads.emplace(dram_seq, mb);
+            }
+            dram->push(simroot::get_current_tick(), dram_seq, mb.hostoff >> CACHE_LINE_ADDR_OFFSET, mb.op);
+            dram_seq++;
+            busy = true;
+        }
+    }
+
+    if(!dram->idle()) {
+        vector<uint64_t> done;
+        dram->tick(simroot::get_current_tick(), done);
+        for(auto id : done) {
+            auto res = dram_reads.find(id);
+            simroot_assert(res != dram_reads.end());
+            dram_resps.push_back(res->second);
+            dram_reads.erase(res);
+        }
+        busy = true;
+    }
+
+    if(!dram_resps.empty() && bus->can_send(my_port, CHANNEL_RESP)) {
+        auto &mb = dram_resps.front();
+        CacheCohenrenceMsg *send = new CacheCohenrenceMsg();
+        send->line = mb.lindex;
+        send->arg = 0;
+        send->type = MSG_GET_RESP_MEM;
+        send->transid = mb.transid;
+        send->data.resize(CACHE_LINE_LEN_BYTE);
+        cache_line_copy(send->data.data(), mb.linebuf);
+        simroot_assert(bus->send_msg(my_port, mb.src_port, CHANNEL_RESP, send));
+        dram_resps.pop_front();
+        busy = true;
+    }
+
+    if(busy) {
+        statistic.busy_cycles++;
+    }
+    else if(dram_resps.empty()) {
+        bool pending = false;
+        for(uint32_t c = 0; c < CHANNEL_CNT && !pending; c++) {
+            pending = bus->can_recv(my_port, c);
+        }
+        if(!pending) sim_sleep();
+    }
+}
+
 }}
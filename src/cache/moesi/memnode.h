@@ -28,6 +28,7 @@
 #include "protocal.h"
 
 #include "cache/meminterface.h"
+#include "cache/dramctrl.h"
 #include "cache/trace.h"
 
 #include "bus/businterface.h"
@@ -77,6 +78,16 @@ protected:
     uint32_t memory_access_buf_size = 4;
     std::list<MemoryAccessBuf> membufs;
 
+    // 从总线上接收一个请求，写请求的数据放入linebuf
+    bool recv_request(MemoryAccessBuf &mb);
+
+    // mem.dram_timing_model非0时由DRAM控制器决定时序，数据在请求到达时读写，完成后再回复
+    std::unique_ptr<DRAMController> dram;
+    uint64_t dram_seq = 0;
+    std::unordered_map<uint64_t, MemoryAccessBuf> dram_reads;
+    std::list<MemoryAccessBuf> dram_resps;
+    void on_current_tick_dram();
+
     struct {
         uint64_t request_precossed = 0;
         uint64_t busy_cycles = 0;
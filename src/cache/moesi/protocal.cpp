@@ -81,6 +81,10 @@ string get_cc_msg_type_name_str(uint32_t type) {
 
 const uint32_t head_size = 20;
 
+uint32_t CacheCohenrenceMsg::bus_size() {
+    return head_size + data.size();
+}
+
 void construct_msg_pack(CacheCohenrenceMsg &msg, vector<uint8_t> &buf) {
     buf.resize(msg.data.size() + head_size);
     *((uint32_t*)(buf.data() + 0)) = msg.type;
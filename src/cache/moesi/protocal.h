@@ -25,6 +25,11 @@
 
 #include "common.h"
 
+#include <array>
+
+#include "bus/businterface.h"
+#include "objpool.h"
+
 namespace simcache {
 namespace moesi {
 
@@ -95,13 +100,43 @@ const uint32_t CHANNEL_WIDTH_ACK = 32;
 const uint32_t CHANNEL_WIDTH_RESP = 64;
 const uint32_t CHANNEL_WIDTH_REQ = 96;
 
-typedef struct {
-    uint32_t    type;
+/**
+ * 消息携带的缓存行数据，直接存放在消息对象中，长度为0或一个缓存行
+ * 消息经对象池复用时不再为数据单独分配内存
+*/
+class CacheLinePayload {
+public:
+    inline uint32_t size() {return len;}
+    inline bool empty() {return (len == 0);}
+    inline uint8_t *data() {return buf.data();}
+    inline uint8_t &operator[](uint32_t i) {return buf[i];}
+    inline void resize(uint32_t n) {
+        assert(n <= CACHE_LINE_LEN_BYTE);
+        len = n;
+    }
+    inline void assign(uint32_t n, uint8_t v) {
+        resize(n);
+        memset(buf.data(), v, n);
+    }
+    inline void clear() {len = 0;}
+protected:
+    std::array<uint8_t, CACHE_LINE_LEN_BYTE> buf;
+    uint32_t len = 0;
+};
+
+class CacheCohenrenceMsg : public simbus::BusMessage {
+public:
+    uint32_t    type = 0;
     uint32_t    arg = 0;
     uint32_t    transid = 0;
     LineIndexT  line = 0;
-    std::vector<uint8_t>    data;
-} CacheCohenrenceMsg;
+    CacheLinePayload    data;
+
+    virtual uint32_t bus_size();
+
+    // 发送方分配的消息由接收方释放
+    OBJPOOL_NEW_DELETE(CacheCohenrenceMsg)
+};
 
 void construct_msg_pack(CacheCohenrenceMsg &msg, vector<uint8_t> &buf);
 void parse_msg_pack(vector<uint8_t> &buf, CacheCohenrenceMsg &msg);
@@ -84,6 +84,15 @@ public:
     virtual bool send(BusPortT port, BusPortT dst_port, uint32_t channel, vector<uint8_t> &data) {
         CacheCohenrenceMsg msg;
         parse_msg_pack(data, msg);
+        return handle_msg(msg);
+    }
+    virtual bool send_msg(BusPortT port, BusPortT dst_port, uint32_t channel, simbus::BusMessage *m) {
+        CacheCohenrenceMsg *msg = static_cast<CacheCohenrenceMsg*>(m);
+        bool ret = handle_msg(*msg);
+        delete msg;
+        return ret;
+    }
+    bool handle_msg(CacheCohenrenceMsg &msg) {
         LineIndexT lindex = msg.line;
         PhysAddrT addr = line_index_to_line_addr(lindex);
         if(msg.type == MSG_GETS) {
@@ -161,6 +170,16 @@ public:
         }
         return false;
     };
+    virtual bool recv_msg(BusPortT port, uint32_t channel, simbus::BusMessage **m) {
+        if(recv_queue[channel].size()) {
+            CacheCohenrenceMsg *msg = new CacheCohenrenceMsg();
+            std::swap(*msg, recv_queue[channel].front());
+            recv_queue[channel].pop_front();
+            *m = msg;
+            return true;
+        }
+        return false;
+    };
 
     vector<list<CacheCohenrenceMsg>> recv_queue;
 };
@@ -403,6 +422,7 @@ bool test_cache_1l24l1_seq_wr() {
         bus->apply_next_tick();
         mem->apply_next_tick();
         tick++;
+        simroot::set_current_tick(tick);
     };
 
     simroot::add_sim_object(bus, "bus");
@@ -538,6 +558,7 @@ bool test_cache_1l24l1_rand_wr() {
         bus->apply_next_tick();
         mem->apply_next_tick();
         tick++;
+        simroot::set_current_tick(tick);
     };
 
     simroot::add_sim_object(bus, "bus");
@@ -711,6 +732,111 @@ bool test_moesi_l1l2_dcache() {
     
 }
 
+bool test_moesi_l1l2_dcache_nonblock() {
+
+    simcache::CacheParam param_l1i, param_l1d, param_l2;
+
+    uint64_t memsz = 1024UL * 1024UL * 16UL;
+
+    uint8_t *hostmem = new uint8_t[memsz];
+    uint8_t *simmem = new uint8_t[memsz];
+
+    memset(hostmem, 0, memsz);
+    memset(simmem, 0, memsz);
+
+    TestL1CacheBus bus(simmem, hostmem);
+
+    TestL1CacheBusMapping busmap;
+
+    param_l1d.set_offset = 5;
+    param_l1d.way_cnt = 8;
+    param_l1d.mshr_num = 6;
+    param_l1d.index_latency = 2;
+    param_l1d.index_width = 1;
+
+    param_l1i.set_offset = 5;
+    param_l1i.way_cnt = 4;
+    param_l1i.mshr_num = 4;
+    param_l1i.index_latency = 1;
+    param_l1i.index_width = 2;
+
+    param_l2.set_offset = 7;
+    param_l2.way_cnt = 8;
+    param_l2.mshr_num = 16;
+    param_l2.index_latency = 4;
+    param_l2.index_width = 1;
+
+    PrivL1L2Moesi l1l2(param_l2, param_l1d, param_l1i, &bus, 1, &busmap, "l1l2", nullptr);
+    simroot::add_sim_object(&l1l2, "l1", 1);
+
+    PrivL1L2MoesiL1DPort l1d(&l1l2);
+
+    // 冷缺失不同的行，MSHR满之前都应返回miss，之后返回busy，对已缺失行的访问合并
+    uint64_t data = 0;
+    for(uint32_t i = 0; i < param_l1d.mshr_num; i++) {
+        simroot_assert(l1d.load(i * CACHE_LINE_LEN_BYTE * 3, 8, &data, false) == SimError::miss);
+    }
+    simroot_assert(l1d.load(param_l1d.mshr_num * CACHE_LINE_LEN_BYTE * 3, 8, &data, false) == SimError::busy);
+    simroot_assert(l1d.store(8, 8, &data, false) == SimError::miss);
+
+    // 同时保持多个不同行上的访问，每周期重试所有未完成的访问
+    typedef struct {
+        PhysAddrT   addr;
+        uint64_t    data;
+        bool        write;
+    } PendingOP;
+    std::list<PendingOP> pending;
+    const uint32_t window = param_l1d.mshr_num + 2;
+
+    uint64_t round = 256UL * 1024UL;
+    uint64_t log_interval = 1024;
+    uint64_t done = 0;
+    printf("(0/%ld)", round);
+    while(done < round) {
+        while(pending.size() < window) {
+            PendingOP op;
+            op.addr = ((rand_long() % memsz) & (~(7UL)));
+            op.data = rand_long();
+            op.write = RAND(0, 2);
+            bool conflict = false;
+            for(auto &p : pending) conflict = (conflict || addr_to_line_index(p.addr) == addr_to_line_index(op.addr));
+            if(!conflict) pending.push_back(op);
+        }
+
+        for(auto iter = pending.begin(); iter != pending.end(); ) {
+            SimError res = SimError::success;
+            if(iter->write) {
+                res = l1d.store(iter->addr, 8, &(iter->data), false);
+            }
+            else {
+                res = l1d.load(iter->addr, 8, &(iter->data), false);
+            }
+            if(res != SimError::success) {
+                simroot_assert(res == SimError::miss || res == SimError::busy);
+                iter++;
+                continue;
+            }
+            if(iter->write) {
+                *((uint64_t*)(hostmem + iter->addr)) = iter->data;
+            }
+            else {
+                simroot_assert(*((uint64_t*)(hostmem + iter->addr)) == iter->data);
+            }
+            iter = pending.erase(iter);
+            if((++done) % log_interval == 0) {
+                printf("\r(%ld/%ld)", done, round);
+                fflush(stdout);
+            }
+        }
+
+        l1l2.on_current_tick();
+        l1l2.apply_next_tick();
+    }
+
+    printf("\nPass!!!\n");
+    return true;
+}
+
 bool test_moesi_l1l2_icache() {
 
     simcache::CacheParam param_l1i, param_l1d, param_l2;
@@ -794,6 +920,8 @@ bool test_moesi_l1l2_cache() {
     assert(test_moesi_l1l2_icache());
     printf("Test L1-D:\n");
     assert(test_moesi_l1l2_dcache());
+    printf("Test L1-D Non-blocking:\n");
+    assert(test_moesi_l1l2_dcache_nonblock());
     return true;
 }
 
@@ -887,6 +1015,7 @@ bool test_moesi_cache_l1l2l3_seq() {
         bus->apply_next_tick();
         mem->apply_next_tick();
         tick++;
+        simroot::set_current_tick(tick);
     };
 
     simroot::add_sim_object(bus, "bus");
@@ -1047,6 +1176,7 @@ bool test_moesi_cache_l1l2l3_rand() {
         bus->apply_next_tick();
         mem->apply_next_tick();
         tick++;
+        simroot::set_current_tick(tick);
     };
 
     simroot::add_sim_object(bus, "bus");
@@ -1149,7 +1279,9 @@ public:
     };
 };
 
-bool test_moesi_cache_l3nuca_rand() {
+// prefetch: 在L1D/L2上开启预取，预取请求与随机访问的一致性请求交错
+// l2_bank_num/llc_bank_num: L2与每个LLC切片的Bank数
+bool test_cache_l3nuca_rand_wr(const char *name, bool prefetch, uint32_t l2_bank_num, uint32_t llc_bank_num) {
 
     
     vector<BusNodeT> nodes;
@@ -1188,6 +1320,7 @@ bool test_moesi_cache_l3nuca_rand() {
     param.mshr_num = 8;
     param.index_latency = 10;
     param.index_width = 1;
+    param.bank_num = llc_bank_num;
 
     LLCMoesiDirNoi *l3s[4];
     for(int i = 0; i < 4; i++) {
@@ -1222,6 +1355,9 @@ bool test_moesi_cache_l3nuca_rand() {
     param_l2.mshr_num = 16;
     param_l2.index_latency = 4;
     param_l2.index_width = 1;
+    param_l2.bank_num = l2_bank_num;
+
+    simcache::PrefetcherParam pfparam;
 
     PrivL1L2Moesi *l1l2s[4];
     PrivL1L2MoesiL1IPort *l1is[4];
@@ -1235,6 +1371,7 @@ bool test_moesi_cache_l3nuca_rand() {
             string("l1-") + to_string(i),
             nullptr
         );
+        if(prefetch) l1l2s[i]->set_prefetcher(pfparam, "nextline", "stream", true);
         l1is[i] = new PrivL1L2MoesiL1IPort(l1l2s[i]);
         l1ds[i] = new PrivL1L2MoesiL1DPort(l1l2s[i]);
         // l1l2s[i]->log_info = true;
@@ -1251,6 +1388,7 @@ bool test_moesi_cache_l3nuca_rand() {
         bus->apply_next_tick();
         mem->apply_next_tick();
         tick++;
+        simroot::set_current_tick(tick);
     };
 
     simroot::add_sim_object(bus, "bus");
@@ -1317,7 +1455,7 @@ bool test_moesi_cache_l3nuca_rand() {
 
     printf("\n");
 
-    printf("Pass test_moesi_cache_l3nuca_rand() !!!\n");
+    printf("Pass %s() !!!\n", name);
 
     delete mem;
     delete bus;
@@ -1331,6 +1469,18 @@ bool test_moesi_cache_l3nuca_rand() {
     return true;
 }
 
+bool test_moesi_cache_l3nuca_rand() {
+    return test_cache_l3nuca_rand_wr("test_moesi_cache_l3nuca_rand", false, 1, 1);
+}
+
+bool test_moesi_cache_l3nuca_rand_prefetch() {
+    return test_cache_l3nuca_rand_wr("test_moesi_cache_l3nuca_rand_prefetch", true, 1, 1);
+}
+
+bool test_moesi_cache_l3nuca_rand_banked() {
+    return test_cache_l3nuca_rand_wr("test_moesi_cache_l3nuca_rand_banked", false, 2, 4);
+}
+
 
 
 
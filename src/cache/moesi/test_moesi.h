@@ -41,6 +41,10 @@ bool test_moesi_cache_l1l2l3_seq();
 
 bool test_moesi_cache_l3nuca_rand();
 
+bool test_moesi_cache_l3nuca_rand_prefetch();
+
+bool test_moesi_cache_l3nuca_rand_banked();
+
 }
 
 #endif
@@ -0,0 +1,212 @@
+// MIT License
+
+// Copyright (c) 2024 Meng Chengzhen, in Shandong University
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "prefetcher.h"
+
+#include "simroot.h"
+#include "configuration.h"
+
+namespace simcache {
+
+Prefetcher *Prefetcher::create(string type, PrefetcherParam &param) {
+    if(type.empty() || type.compare("none") == 0) return nullptr;
+    if(type.compare("nextline") == 0) return new NextLinePrefetcher(param);
+    if(type.compare("stride") == 0) return new StridePrefetcher(param);
+    if(type.compare("stream") == 0) return new StreamPrefetcher(param);
+    simroot_assertf(0, "Unknown prefetcher type: %s", type.c_str());
+    return nullptr;
+}
+
+void Prefetcher::load_param(PrefetcherParam &param) {
+    param.degree = conf::get_int("prefetch", "degree", param.degree);
+    param.distance = conf::get_int("prefetch", "distance", param.distance);
+    param.stride_table_size = conf::get_int("prefetch", "stride_table_size", param.stride_table_size);
+    param.stream_num = conf::get_int("prefetch", "stream_num", param.stream_num);
+    param.queue_size = conf::get_int("prefetch", "queue_size", param.queue_size);
+    param.mshr_reserve = conf::get_int("prefetch", "mshr_reserve", param.mshr_reserve);
+}
+
+void NextLinePrefetcher::train(VirtAddrT pc, LineIndexT lindex, bool miss, vector<LineIndexT> &out) {
+    if(!miss) return;
+    for(uint32_t i = 1; i <= param.degree; i++) {
+        if(!same_page(lindex + i, lindex)) break;
+        out.push_back(lindex + i);
+    }
+}
+
+StridePrefetcher::StridePrefetcher(PrefetcherParam &param) : Prefetcher(param) {
+    simroot_assertf(param.stride_table_size && !(param.stride_table_size & (param.stride_table_size - 1)),
+        "Stride Prefetcher: table size %d is not power of 2", param.stride_table_size);
+    table.resize(param.stride_table_size);
+}
+
+void StridePrefetcher::train(VirtAddrT pc, LineIndexT lindex, bool miss, vector<LineIndexT> &out) {
+    StrideEntry &e = table[(pc >> 1) & (param.stride_table_size - 1)];
+    if(!e.valid || e.pc != pc) {
+        e.valid = true;
+        e.pc = pc;
+        e.last = lindex;
+        e.stride = 0;
+        e.conf = 0;
+        return;
+    }
+    int64_t delta = (int64_t)lindex - (int64_t)(e.last);
+    if(delta == 0) return;
+    if(delta == e.stride) {
+        if(e.conf < 3) e.conf++;
+    }
+    else {
+        e.stride = delta;
+        e.conf = 0;
+    }
+    e.last = lindex;
+    if(e.conf == 0) return;
+    for(uint32_t i = 1; i <= param.degree; i++) {
+        LineIndexT target = lindex + e.stride * i;
+        if(!same_page(target, lindex)) break;
+        out.push_back(target);
+    }
+}
+
+StreamPrefetcher::StreamPrefetcher(PrefetcherParam &param) : Prefetcher(param) {
+    simroot_assertf(param.stream_num, "Stream Prefetcher: stream_num must be positive");
+    streams.resize(param.stream_num);
+}
+
+void StreamPrefetcher::train(VirtAddrT pc, LineIndexT lindex, bool miss, vector<LineIndexT> &out) {
+    stamp++;
+    StreamEntry *hit = nullptr;
+    for(auto &e : streams) {
+        if(!e.valid || !same_page(e.last, lindex)) continue;
+        int64_t d = (int64_t)lindex - (int64_t)(e.last);
+        if(d <= (int64_t)(param.distance) && d >= -(int64_t)(param.distance)) {
+            hit = &e;
+            break;
+        }
+    }
+    if(!hit) {
+        if(!miss) return;
+        StreamEntry *victim = &(streams[0]);
+        for(auto &e : streams) {
+            if(!e.valid) { victim = &e; break; }
+            if(e.lru < victim->lru) victim = &e;
+        }
+        victim->valid = true;
+        victim->last = victim->next_pf = lindex;
+        victim->dir = 0;
+        victim->conf = 0;
+        victim->lru = stamp;
+        return;
+    }
+
+    hit->lru = stamp;
+    int64_t d = (int64_t)lindex - (int64_t)(hit->last);
+    if(d == 0) return;
+    int32_t dir = (d > 0)?1:-1;
+    if(dir == hit->dir) {
+        if(hit->conf < 3) hit->conf++;
+    }
+    else {
+        hit->dir = dir;
+        hit->conf = 1;
+        hit->next_pf = lindex;
+    }
+    hit->last = lindex;
+    // 连续两次同向访问后确认方向
+    if(hit->conf < 2) return;
+
+    if(((int64_t)(hit->next_pf) - (int64_t)lindex) * dir <= 0) hit->next_pf = lindex + dir;
+    for(uint32_t i = 0; i < param.degree; i++) {
+        LineIndexT target = hit->next_pf;
+        if(((int64_t)target - (int64_t)lindex) * dir > (int64_t)(param.distance) || !same_page(target, lindex)) break;
+        out.push_back(target);
+        hit->next_pf += dir;
+    }
+}
+
+}
+
+namespace test {
+
+using simcache::Prefetcher;
+using simcache::PrefetcherParam;
+
+bool test_prefetcher() {
+    PrefetcherParam param;
+    param.degree = 2;
+    param.distance = 4;
+    vector<LineIndexT> out;
+    const LineIndexT base = 0x10000;
+
+    std::unique_ptr<Prefetcher> nl(Prefetcher::create("nextline", param));
+    nl->train(0, base, true, out);
+    if(out.size() != 2 || out[0] != base + 1 || out[1] != base + 2) {
+        printf("nextline: unexpected output\n");
+        return false;
+    }
+    out.clear();
+    nl->train(0, base + 63, true, out);
+    if(!out.empty()) {
+        printf("nextline: prefetch crossed page boundary\n");
+        return false;
+    }
+
+    // 两条指令交错访问，各自的步长为3和-2
+    std::unique_ptr<Prefetcher> st(Prefetcher::create("stride", param));
+    for(uint32_t i = 0; i < 6; i++) {
+        out.clear();
+        st->train(0x1000, base + 3 * i, true, out);
+        if(i >= 2 && (out.size() != 2 || out[0] != base + 3 * i + 3 || out[1] != base + 3 * i + 6)) {
+            printf("stride: pc 0x1000 step %d unexpected output\n", i);
+            return false;
+        }
+        out.clear();
+        st->train(0x1010, base + 48 - 2 * i, true, out);
+        if(i >= 2 && (out.size() != 2 || out[0] != base + 48 - 2 * i - 2 || out[1] != base + 44 - 2 * i)) {
+            printf("stride: pc 0x1010 step %d unexpected output\n", i);
+            return false;
+        }
+    }
+
+    // 顺序访问一页，预取应保持领先且不重复
+    std::unique_ptr<Prefetcher> sm(Prefetcher::create("stream", param));
+    std::set<LineIndexT> issued;
+    for(uint32_t i = 0; i < 64; i++) {
+        out.clear();
+        sm->train(0, base + i, issued.find(base + i) == issued.end(), out);
+        for(auto l : out) {
+            if(issued.find(l) != issued.end() || l <= base + i || l > base + i + param.distance) {
+                printf("stream: unexpected prefetch 0x%lx at 0x%lx\n", l, base + i);
+                return false;
+            }
+            issued.insert(l);
+        }
+    }
+    if(issued.size() != 61) {
+        printf("stream: %ld lines prefetched, expected 61\n", issued.size());
+        return false;
+    }
+
+    return true;
+}
+
+}
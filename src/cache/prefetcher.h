@@ -0,0 +1,122 @@
+// MIT License
+
+// Copyright (c) 2024 Meng Chengzhen, in Shandong University
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef RVSIM_CACHE_PREFETCHER_H
+#define RVSIM_CACHE_PREFETCHER_H
+
+#include "common.h"
+
+namespace simcache {
+
+typedef struct {
+    uint32_t    degree = 2;             // 每次触发最多产生的预取行数
+    uint32_t    distance = 4;           // stream预取领先访问位置的行数
+    uint32_t    stride_table_size = 64; // PC索引的stride表项数，需为2的幂
+    uint32_t    stream_num = 8;         // 同时跟踪的stream数
+    uint32_t    queue_size = 8;         // Cache中等待发出的预取请求数
+    uint32_t    mshr_reserve = 2;       // 为需求请求保留的MSHR数
+} PrefetcherParam;
+
+/**
+ * 硬件预取器，由Cache在每次需求访问时训练，输出需要预取的行号
+ * 预取器只负责地址模式识别，去重、过滤与发出请求由Cache完成
+ * 预取地址不跨越4KB物理页，因为相邻物理页不一定属于同一段虚拟地址
+ */
+class Prefetcher {
+public:
+    Prefetcher(PrefetcherParam &param) : param(param) {};
+    virtual ~Prefetcher() {};
+
+    // pc为0表示访问来源未知
+    virtual void train(VirtAddrT pc, LineIndexT lindex, bool miss, vector<LineIndexT> &out) = 0;
+
+    virtual const char *name() = 0;
+
+    // type: none, nextline, stride, stream
+    static Prefetcher *create(string type, PrefetcherParam &param);
+    // 从配置文件[prefetch]中读取参数
+    static void load_param(PrefetcherParam &param);
+
+protected:
+    PrefetcherParam param;
+
+    inline bool same_page(LineIndexT a, LineIndexT b) {
+        const uint32_t shift = PAGE_ADDR_OFFSET - CACHE_LINE_ADDR_OFFSET;
+        return (a >> shift) == (b >> shift);
+    }
+};
+
+// 缺失时预取之后的degree行
+class NextLinePrefetcher : public Prefetcher {
+public:
+    NextLinePrefetcher(PrefetcherParam &param) : Prefetcher(param) {};
+    virtual void train(VirtAddrT pc, LineIndexT lindex, bool miss, vector<LineIndexT> &out);
+    virtual const char *name() { return "nextline"; };
+};
+
+// 按访存指令PC记录上次访问的行与步长，连续两次步长相同后按步长预取
+class StridePrefetcher : public Prefetcher {
+public:
+    StridePrefetcher(PrefetcherParam &param);
+    virtual void train(VirtAddrT pc, LineIndexT lindex, bool miss, vector<LineIndexT> &out);
+    virtual const char *name() { return "stride"; };
+
+protected:
+    typedef struct {
+        VirtAddrT   pc = 0;
+        LineIndexT  last = 0;
+        int64_t     stride = 0;
+        uint8_t     conf = 0;
+        bool        valid = false;
+    } StrideEntry;
+    vector<StrideEntry> table;
+};
+
+// 识别页内连续上升或下降的缺失序列，确认方向后保持领先distance行预取
+class StreamPrefetcher : public Prefetcher {
+public:
+    StreamPrefetcher(PrefetcherParam &param);
+    virtual void train(VirtAddrT pc, LineIndexT lindex, bool miss, vector<LineIndexT> &out);
+    virtual const char *name() { return "stream"; };
+
+protected:
+    typedef struct {
+        LineIndexT  last = 0;       // 最近一次需求访问的行
+        LineIndexT  next_pf = 0;    // 下一个将要预取的行
+        int32_t     dir = 0;        // 0: 训练中, 1: 上升, -1: 下降
+        uint8_t     conf = 0;
+        uint64_t    lru = 0;
+        bool        valid = false;
+    } StreamEntry;
+    vector<StreamEntry> streams;
+    uint64_t stamp = 0;
+};
+
+}
+
+namespace test {
+
+bool test_prefetcher();
+
+}
+
+#endif
@@ -31,6 +31,7 @@
 #include <list>
 #include <map>
 #include <memory>
+#include <atomic>
 #include <filesystem>
 #include <unordered_map>
 #include <unordered_set>
@@ -136,6 +137,9 @@ static_assert(CACHE_LINE_ADDR_OFFSET > 3);
 #define PAGE_ADDR_OFFSET (12)
 static_assert(PAGE_ADDR_OFFSET > CACHE_LINE_ADDR_OFFSET);
 #define PAGE_LEN_BYTE (1<<PAGE_ADDR_OFFSET)
+#define HUGE_PAGE_ADDR_OFFSET (21)
+#define HUGE_PAGE_LEN_BYTE (1<<HUGE_PAGE_ADDR_OFFSET)
+#define HUGE_PAGE_PGCNT (1<<(HUGE_PAGE_ADDR_OFFSET-PAGE_ADDR_OFFSET))
 
 typedef uint64_t LineAddrT;
 typedef uint64_t LineIndexT;
@@ -184,6 +188,8 @@ inline void cache_line_copy(void* dst, void *src) {
 #define PGFLAG_SHARE    (1U<<4)
 #define PGFLAG_ANON     (1U<<5)
 #define PGFLAG_COW      (1U<<6)
+#define PGFLAG_LAZY     (1U<<7) // 仅保留虚拟页，物理页在首次访问时分配
+#define PGFLAG_HUGE     (1U<<8) // 属于一个物理连续、按2MB对齐的完整大页
 
 #define PGFLAG_ELF      (1U<<16)
 #define PGFLAG_STACK    (1U<<17)
@@ -294,6 +300,45 @@ public:
     virtual void print_statistic(std::ofstream &ofile) {};
     virtual void print_setup_info(std::ofstream &ofile) {};
     virtual void dump_core(std::ofstream &ofile) {};
+    // start_sim确定线程分配与同步周期后、模拟线程启动前调用
+    virtual void on_sim_start() {};
+
+    /**
+     * 空闲调度：对象在apply_next_tick中确认自身没有待处理的工作时调用sim_sleep进入休眠，
+     * 此后simroot跳过该对象的on_current_tick/apply_next_tick，直到其他对象调用sim_wakeup，
+     * 或者到达wakeup_tick（为0时表示不设定时唤醒）。
+     * 在on_current_tick中被唤醒的对象会在同一周期执行apply_next_tick。
+     * 要求on_current_tick/apply_next_tick成对调用的对象不应使用该机制。
+     */
+    inline void sim_sleep(uint64_t wakeup_tick = 0) {
+        sim_wakeup_tick = wakeup_tick;
+        sim_sleep_tick = sim_tick_for_wakeup();
+        sim_sleeping = true;
+    }
+    // 可能由host线程（如IO reactor）调用，唤醒请求通过原子访问交给模拟线程
+    // delay: 请求对应的数据在delay周期后才可见（如跨线程通道），对象在此之前保持唤醒
+    // 多个线程同时请求时保留最晚的请求
+    inline void sim_wakeup(uint64_t delay = 0) {
+        std::atomic_ref<uint64_t> req(sim_wakeup_req_tick);
+        uint64_t tick = sim_tick_for_wakeup() + delay;
+        uint64_t cur = req.load(std::memory_order_relaxed);
+        while((cur == UINT64_MAX || cur < tick) && !req.compare_exchange_weak(cur, tick, std::memory_order_release, std::memory_order_relaxed)) ;
+    }
+    inline uint64_t get_sim_wakeup_req_tick() {
+        return std::atomic_ref<uint64_t>(sim_wakeup_req_tick).load(std::memory_order_acquire);
+    }
+    inline bool is_sim_sleeping() {
+        return sim_sleeping;
+    }
+
+    bool sim_sleeping = false;
+    uint64_t sim_sleep_tick = 0;
+    uint64_t sim_wakeup_tick = 0;
+    // UINT64_MAX表示没有唤醒请求，只通过sim_wakeup/get_sim_wakeup_req_tick访问
+    alignas(std::atomic_ref<uint64_t>::required_alignment) uint64_t sim_wakeup_req_tick = UINT64_MAX;
+
+protected:
+    uint64_t sim_tick_for_wakeup();
 };
 
 class SimWorkload {
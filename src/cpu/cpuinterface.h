@@ -37,12 +37,24 @@ class CPUInterface : public SimObject {
 public:
     virtual void halt() = 0;
     virtual void redirect(VirtAddrT addr, RVRegArray &regs) = 0;
+    // 页表修改后由系统调用，可能来自其他模拟线程，CPU需要在自己的周期内完成失效
     virtual void flush_tlb(VPageIndexT vpn) {};
+    virtual void flush_tlb_all() {};
+
+    // 停机时允许进入空闲休眠，仅当Cache端口由其他SimObject独立驱动时才可开启
+    bool sleep_on_halt = false;
 };
 
 class CPUSystemInterface {
 public:
     virtual SimError v_to_p(uint32_t cpu_id, VirtAddrT addr, PhysAddrT *out, PageFlagT flg) = 0;
+    // 同v_to_p，同时输出该映射的页大小（地址偏移位数），供TLB按页大小缓存
+    virtual SimError v_to_p_pgofs(uint32_t cpu_id, VirtAddrT addr, PhysAddrT *out, PageFlagT flg, uint32_t *pgofs) {
+        *pgofs = PAGE_ADDR_OFFSET;
+        return v_to_p(cpu_id, addr, out, flg);
+    };
+    // 当前在该CPU上运行的线程所属地址空间的ASID
+    virtual AsidT get_asid(uint32_t cpu_id) { return 0; };
 
     virtual uint32_t is_dev_mem(uint32_t cpu_id, VirtAddrT addr) = 0;
 
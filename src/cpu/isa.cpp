@@ -22,6 +22,7 @@
 
 
 #include "isa.h"
+#include "simroot.h"
 
 #include "assert.h"
 
@@ -158,6 +159,31 @@ RVInstTypeJ parse_inst_J(RVInstT inst) {
 
 bool decode_rv64c(RVInstT raw, RV64InstDecoded *dec);
 
+DecodeCache::DecodeCache(uint32_t entry_cnt) {
+    uint32_t bits = 0;
+    while((1U << bits) < entry_cnt) bits++;
+    if(bits == 0) bits = 1;
+    simroot_assertf(bits < 32, "Decode cache too large: %d entries", entry_cnt);
+    entries.resize(1U << bits);
+    shift = 32 - bits;
+}
+
+bool DecodeCache::refill(Entry &e, RVInstT raw, RV64InstDecoded *dec) {
+    bool legal = decode_rv64(raw, dec);
+    e.raw = raw;
+    e.valid = true;
+    e.legal = legal;
+    e.opcode = dec->opcode;
+    e.param = dec->param;
+    e.rs1 = dec->rs1;
+    e.rs2 = dec->rs2;
+    e.rs3 = dec->rs3;
+    e.rd = dec->rd;
+    e.imm = dec->imm;
+    e.flag = dec->flag;
+    return legal;
+}
+
 bool decode_rv64(RVInstT raw, RV64InstDecoded *dec) {
     dec->opcode = RV64OPCode::nop;
     dec->rs1 = dec->rs2 = dec->rs3 = dec->rd = dec->flag = 0;
@@ -1051,6 +1077,27 @@ bool test_decoder_rv64() {
 
     #undef DECODER_TEST_FP
 
+    // 译码缓存与直接译码的结果一致，包括非法指令和缓存冲突的情况
+    {
+        DecodeCache dcache(64);
+        vector<RVInstT> raws(256);
+        for(auto &r : raws) r = (RVInstT)rand_long();
+        for(uint32_t n = 0; n < 65536; n++) {
+            RVInstT raw = raws[rand() % raws.size()];
+            RV64InstDecoded d1, d2;
+            bool r1 = isa::decode_rv64(raw, &d1);
+            bool r2 = dcache.decode(raw, &d2);
+            assert(r1 == r2);
+            if(!r1) continue;
+            assert(d1.opcode == d2.opcode);
+            assert(memcmp(&(d1.param), &(d2.param), sizeof(d1.param)) == 0);
+            assert(d1.rs1 == d2.rs1 && d1.rs2 == d2.rs2 && d1.rs3 == d2.rs3 && d1.rd == d2.rd);
+            assert(d1.imm == d2.imm);
+            assert(d1.flag == d2.flag);
+        }
+        assert(dcache.hit_cnt > 0 && dcache.miss_cnt > 0);
+    }
+
     printf("Pass!!!\n");
     return true;
 }
@@ -407,6 +407,58 @@ bool decode_rv64(RVInstT raw, RV64InstDecoded *dec);
 
 void init_rv64_inst_name_str(RV64InstDecoded *inst);
 
+/**
+ * 译码缓存：以指令编码为索引的直接映射表，保存decode_rv64的结果
+ * 译码结果只由取到的指令编码决定，因此缓存项不需要在代码页被写入、mprotect、munmap或fence.i时失效
+ * 每个CPU持有独立的实例，不需要加锁
+ */
+class DecodeCache {
+public:
+    DecodeCache(uint32_t entry_cnt);
+
+    inline bool decode(RVInstT raw, RV64InstDecoded *dec) {
+        Entry &e = entries[((uint32_t)(raw * 0x9E3779B1U)) >> shift];
+        if(e.valid && e.raw == raw) [[likely]] {
+            hit_cnt++;
+            dec->opcode = e.opcode;
+            dec->param = e.param;
+            dec->rs1 = e.rs1;
+            dec->rs2 = e.rs2;
+            dec->rs3 = e.rs3;
+            dec->rd = e.rd;
+            dec->imm = e.imm;
+            dec->flag = e.flag;
+            dec->debug_name_str.clear();
+            return e.legal;
+        }
+        miss_cnt++;
+        return refill(e, raw, dec);
+    }
+
+    uint64_t hit_cnt = 0;
+    uint64_t miss_cnt = 0;
+
+protected:
+    typedef struct {
+        RVInstT         raw = 0;
+        bool            valid = false;
+        bool            legal = false;
+        RV64OPCode      opcode = RV64OPCode::nop;
+        RV64InstParam   param;
+        RVRegIndexT     rs1 = 0;
+        RVRegIndexT     rs2 = 0;
+        RVRegIndexT     rs3 = 0;
+        RVRegIndexT     rd = 0;
+        IntDataT        imm = 0;
+        RVInstFlagT     flag = 0;
+    } Entry;
+
+    vector<Entry> entries;
+    uint32_t shift = 0;
+
+    bool refill(Entry &e, RVInstT raw, RV64InstDecoded *dec);
+};
+
 inline bool isRVC(RVInstT inst) {
     return ((inst & 3) != 3);
 }
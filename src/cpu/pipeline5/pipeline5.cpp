@@ -48,6 +48,22 @@ void PipeLine5CPU::init_all() {
     else {
         log_info = false;
     }
+    decode_cache = make_unique<isa::DecodeCache>(conf::get_int("pipeline5", "decode_cache_size", 4096));
+
+    uint32_t tlb_entries = conf::get_int("pipeline5", "tlb_entries", 64);
+    uint32_t tlb_ways = conf::get_int("pipeline5", "tlb_ways", 4);
+    simroot_assertf(tlb_ways > 0 && tlb_entries >= tlb_ways && tlb_entries % tlb_ways == 0, "Pipeline5: Bad TLB size %d ways %d", tlb_entries, tlb_ways);
+    uint32_t tlb_sets = tlb_entries / tlb_ways;
+    simroot_assertf(!(tlb_sets & (tlb_sets - 1)), "Pipeline5: TLB set count %d is not power of 2", tlb_sets);
+    tlb = make_unique<simcache::GenericLRUCacheBlock<TLBEntry>>(std::__countr_zero<uint32_t>(tlb_sets), tlb_ways);
+    uint32_t tlb_huge_entries = conf::get_int("pipeline5", "tlb_huge_entries", 16);
+    uint32_t tlb_huge_ways = conf::get_int("pipeline5", "tlb_huge_ways", 4);
+    simroot_assertf(tlb_huge_ways > 0 && tlb_huge_entries >= tlb_huge_ways && tlb_huge_entries % tlb_huge_ways == 0, "Pipeline5: Bad huge page TLB size %d ways %d", tlb_huge_entries, tlb_huge_ways);
+    uint32_t tlb_huge_sets = tlb_huge_entries / tlb_huge_ways;
+    simroot_assertf(!(tlb_huge_sets & (tlb_huge_sets - 1)), "Pipeline5: Huge page TLB set count %d is not power of 2", tlb_huge_sets);
+    tlb_huge = make_unique<simcache::GenericLRUCacheBlock<TLBEntry>>(std::__countr_zero<uint32_t>(tlb_huge_sets), tlb_huge_ways);
+    tlb_miss_latency = conf::get_int("pipeline5", "tlb_miss_latency", 0);
+
     log_regs = conf::get_int("pipeline5", "log_register", 0);
     log_fregs = conf::get_int("pipeline5", "log_fp_register", 0);
     if(conf::get_int("pipeline5", "log_inst_to_file", 0)) {
@@ -105,9 +121,23 @@ void PipeLine5CPU::process_pipeline_1_fetch() {
                 cache_operation_result_check_error(res2, vpc, vpc2, ppc2, 2);
                 if(res2 == SimError::success) {
                     icache_fetched = true;
+                    // 顺序预取下一行，跨页时需要额外的地址翻译，不预取
+                    PhysAddrT prefetch_paddr = addr_to_line_addr(ppc2) + CACHE_LINE_LEN_BYTE;
+                    if((prefetch_paddr >> PAGE_ADDR_OFFSET) == (ppc2 >> PAGE_ADDR_OFFSET)) {
+                        io_icache_port->prefetch(prefetch_paddr);
+                    }
                 }
             }
         }
+        else if(res1 == SimError::miss || res2 == SimError::miss) {
+            // TLB项在tlb_miss_latency个周期后才可用，取指停顿到回填完成
+            statistic.itlb_refill_stall_count++;
+            if(log_info) {
+                sprintf(log_buf, "CPU%d P1: ITLB refill @0x%lx", cpu_id, pc);
+                simroot::print_log_info(log_buf);
+            }
+            return;
+        }
         else {
             // Access Illeagle Address
             if(p2_workload.first || p3_workload.first || p4_workload.first || p5_workload.first) {
@@ -132,12 +162,6 @@ void PipeLine5CPU::process_pipeline_1_fetch() {
         }
     }
     else {
-        LineAddrT prefetch_addr = addr_to_line_addr(pc) + CACHE_LINE_LEN_BYTE;
-        PhysAddrT prefetch_paddr;
-        // if(trans(prefetch_addr, &prefetch_paddr)) {
-        //     io_icache_port->prefetch(prefetch_paddr);
-        // }
-
         int32_t target = 0;
         bool isj = isa::pdec_isJ(inst.inst_raw);
         bool isji = isa::pdec_get_J_target(inst.inst_raw, &target);
@@ -195,7 +219,7 @@ void PipeLine5CPU::process_pipeline_2_decode() {
     InstRaw raw = p2_workload.second;
     P5InstDecoded &p5dec = p2_result.second;
     RV64InstDecoded &dec = p2_result.second.inst;
-    if(!isa::decode_rv64(raw.inst_raw, &(dec))) {
+    if(!decode_cache->decode(raw.inst_raw, &(dec))) {
         sprintf(log_buf, "UNKOWN INST @0x%lx : 0x%x", raw.pc, raw.inst_raw);
         LOG(ERROR) << string(log_buf);
         simroot_assert(0);
@@ -393,6 +417,7 @@ void PipeLine5CPU::process_pipeline_4_memory() {
     }
 
     io_dcache_port->arrival_line(nullptr); // 用不到，清空cache的到达记录
+    io_dcache_port->set_access_pc(inst.pc);
 
     if(inst.opcode == RV64OPCode::amo && inst.param.amo.op == isa::RV64AMOOP5::SC) {
         VirtAddrT vaddr = p5inst.vaddr;
@@ -403,6 +428,9 @@ void PipeLine5CPU::process_pipeline_4_memory() {
         }
         else {
             SimError res = trans(vaddr, &paddr, PGFLAG_R | PGFLAG_W);
+            if(res == SimError::miss) {
+                return;
+            }
             if(res != SimError::success) {
                 p5inst.err = res;
                 p4_result.second = p4_workload.second;
@@ -422,7 +450,6 @@ void PipeLine5CPU::process_pipeline_4_memory() {
             else {
                 p5inst.arg0 = 0;
             }
-            dcache_prefetch(vaddr);
         }
         if(log_file_ldst) {
             sprintf(log_buf, "%ld: SC @0x%lx Vaddr:0x%lx Paddr:0x%lx Value:0x%lx Ret:0x%lx\n", simroot::get_current_tick(),
@@ -439,6 +466,9 @@ void PipeLine5CPU::process_pipeline_4_memory() {
         }
         else {
             SimError res = trans(vaddr, &paddr, PGFLAG_R | PGFLAG_W);
+            if(res == SimError::miss) {
+                return;
+            }
             if(res != SimError::success) {
                 p5inst.err = res;
                 p4_result.second = p4_workload.second;
@@ -462,7 +492,6 @@ void PipeLine5CPU::process_pipeline_4_memory() {
                 p5inst.cache_missed = true;
                 return;
             }
-            dcache_prefetch(vaddr);
             RAW_DATA_AS(p5inst.arg0).i64 = data;
         }
         if(log_file_ldst) {
@@ -484,6 +513,9 @@ void PipeLine5CPU::process_pipeline_4_memory() {
         else {
             PhysAddrT paddr = 0;
             SimError res = trans(vaddr, &paddr, PGFLAG_R | PGFLAG_W);
+            if(res == SimError::miss) {
+                return;
+            }
             if(res != SimError::success) {
                 p5inst.err = res;
                 p4_result.second = p4_workload.second;
@@ -519,7 +551,6 @@ void PipeLine5CPU::process_pipeline_4_memory() {
                 p5inst.cache_missed = true;
                 return;
             }
-            dcache_prefetch(vaddr);
         }
         if(log_file_ldst) {
             string amo_op_name;
@@ -557,6 +588,9 @@ void PipeLine5CPU::process_pipeline_4_memory() {
         }
         else {
             SimError res = trans(vaddr, &paddr, PGFLAG_R);
+            if(res == SimError::miss) {
+                return;
+            }
             if(res != SimError::success) {
                 p5inst.err = res;
                 p4_result.second = p4_workload.second;
@@ -574,7 +608,6 @@ void PipeLine5CPU::process_pipeline_4_memory() {
                 sprintf(log_buf, "CPU%d Load from MainMem 0x%lx->0x%lx: 0x%lx", cpu_id, vaddr, paddr, buf);
                 simroot::print_log_info(log_buf);
             }
-            dcache_prefetch(vaddr);
         }
         if(log_file_ldst) {
             sprintf(log_buf, "%ld: LD @0x%lx Vaddr:0x%lx Paddr:0x%lx Value:0x%lx\n", simroot::get_current_tick(),
@@ -608,6 +641,9 @@ void PipeLine5CPU::process_pipeline_4_memory() {
         }
         else {
             SimError res = trans(vaddr, &paddr, PGFLAG_W);
+            if(res == SimError::miss) {
+                return;
+            }
             if(res != SimError::success) {
                 p5inst.err = res;
                 p4_result.second = p4_workload.second;
@@ -624,7 +660,6 @@ void PipeLine5CPU::process_pipeline_4_memory() {
                 sprintf(log_buf, "CPU%d Store to MainMem 0x%lx->0x%lx: 0x%lx", cpu_id, vaddr, paddr, buf);
                 simroot::print_log_info(log_buf);
             }
-            dcache_prefetch(vaddr);
         }
         if(log_file_ldst) {
             sprintf(log_buf, "%ld: ST @0x%lx Vaddr:0x%lx Paddr:0x%lx Value:0x%lx\n", simroot::get_current_tick(),
@@ -912,7 +947,39 @@ void PipeLine5CPU::process_pipeline_5_commit() {
     p5_result.first = true;
 };
 
+void PipeLine5CPU::apply_tlb_flush() {
+    tlb_flush_lock.lock();
+    bool all = tlb_flush_all;
+    vector<VPageIndexT> pages;
+    pages.swap(tlb_flush_pages);
+    tlb_flush_all = false;
+    tlb_flush_pending.store(false, std::memory_order_relaxed);
+    tlb_flush_lock.unlock();
+
+    if(all) {
+        tlb->clear();
+        tlb_huge->clear();
+        return;
+    }
+    // 失效请求不携带ASID，清除所有ASID下该VPN的表项
+    vector<std::pair<LineIndexT, TLBEntry*>> lines;
+    for(auto vpn : pages) {
+        tlb->get_set_lines(tlb->line_index_to_set_index(vpn), lines);
+        for(auto &l : lines) {
+            if((l.first & ((1UL << TLB_ASID_SHIFT) - 1)) == vpn) tlb->remove_line(l.first);
+        }
+        VPageIndexT hvpn = vpn / HUGE_PAGE_PGCNT;
+        tlb_huge->get_set_lines(tlb_huge->line_index_to_set_index(hvpn), lines);
+        for(auto &l : lines) {
+            if((l.first & ((1UL << TLB_ASID_SHIFT) - 1)) == hvpn) tlb_huge->remove_line(l.first);
+        }
+    }
+}
+
 void PipeLine5CPU::on_current_tick() {
+    if(tlb_flush_pending.load(std::memory_order_acquire)) [[unlikely]] {
+        apply_tlb_flush();
+    }
     io_icache_port->on_current_tick();
     io_dcache_port->on_current_tick();
     if(is_halt) {
@@ -929,6 +996,7 @@ void PipeLine5CPU::apply_next_tick() {
     io_icache_port->apply_next_tick();
     io_dcache_port->apply_next_tick();
     if(is_halt && !apply_cpu_wakeup) {
+        if(sleep_on_halt) sim_sleep();
         return;
     }
     if(apply_halt) {
@@ -1053,6 +1121,7 @@ void PipeLine5CPU::apply_next_tick() {
 
 void PipeLine5CPU::clear_statistic() {
     memset(&statistic, 0, sizeof(statistic));
+    decode_cache->hit_cnt = decode_cache->miss_cnt = 0;
 };
 
 void PipeLine5CPU::print_statistic(std::ofstream &ofile) {
@@ -1079,6 +1148,14 @@ void PipeLine5CPU::print_statistic(std::ofstream &ofile) {
     PIPELINE_5_GENERATE_PRINTSTATISTIC(st_cache_hit_count)
     PIPELINE_5_GENERATE_PRINTSTATISTIC(st_inst_cnt)
     PIPELINE_5_GENERATE_PRINTSTATISTIC(st_mem_tick_sum)
+    statistic.decode_cache_hit_count = decode_cache->hit_cnt;
+    statistic.decode_cache_miss_count = decode_cache->miss_cnt;
+    PIPELINE_5_GENERATE_PRINTSTATISTIC(decode_cache_hit_count)
+    PIPELINE_5_GENERATE_PRINTSTATISTIC(decode_cache_miss_count)
+    PIPELINE_5_GENERATE_PRINTSTATISTIC(tlb_hit_count)
+    PIPELINE_5_GENERATE_PRINTSTATISTIC(tlb_miss_count)
+    PIPELINE_5_GENERATE_PRINTSTATISTIC(tlb_huge_hit_count)
+    PIPELINE_5_GENERATE_PRINTSTATISTIC(itlb_refill_stall_count)
     #undef PIPELINE_5_GENERATE_PRINTSTATISTIC
 };
 
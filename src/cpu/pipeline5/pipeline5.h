@@ -30,6 +30,7 @@
 #include "cpu/isa.h"
 
 #include "cache/cacheinterface.h"
+#include "cache/cachecommon.h"
 
 namespace simcpu {
 
@@ -39,6 +40,25 @@ using isa::RV64InstDecoded;
 
 using simcache::CacheInterface;
 
+typedef struct {
+    VirtAddrT pc;
+    RVInstT inst_raw;
+} InstRaw;
+
+typedef struct {
+    RV64InstDecoded inst;
+    RawDataT arg0;
+    RawDataT arg1;
+    RawDataT vaddr;
+    SimError err = SimError::success;
+    bool passp3 = false;
+    bool passp4 = false;
+    uint64_t mem_start_tick = 0;
+    uint64_t mem_finish_tick = 0;
+    bool cache_missed = false;
+} P5InstDecoded;
+
+
 class PipeLine5CPU : public CPUInterface {
 public:
 
@@ -107,6 +127,9 @@ public:
         apply_pc_redirect = true;
         pc_redirect = addr;
         apply_cpu_wakeup = true;
+        new_asid = io_sys_port->get_asid(cpu_id);
+        apply_new_pagetable = true;
+        sim_wakeup();
         if(regs.size() >= RV_REG_CNT_INT) {
             memcpy(apply_ireg_buf, regs.data(), sizeof(uint64_t) * RV_REG_CNT_INT);
             apply_iregs = true;
@@ -117,7 +140,16 @@ public:
         }
     };
     virtual void flush_tlb(VPageIndexT vpn) {
-        tlb.clear();
+        tlb_flush_lock.lock();
+        tlb_flush_pages.push_back(vpn);
+        tlb_flush_pending.store(true, std::memory_order_release);
+        tlb_flush_lock.unlock();
+    };
+    virtual void flush_tlb_all() {
+        tlb_flush_lock.lock();
+        tlb_flush_all = true;
+        tlb_flush_pending.store(true, std::memory_order_release);
+        tlb_flush_lock.unlock();
     };
 
     void ifence() {
@@ -145,41 +177,78 @@ protected:
     CacheInterface *io_dcache_port;
     CPUSystemInterface *io_sys_port;
 
-    unordered_map<uint64_t, PageIndexT> tlb;
+    unique_ptr<isa::DecodeCache> decode_cache;
+
+    // TLB: 以(ASID, VPN)为tag的组相联结构，每项记录已经检查过的访问权限
+    // 缺失时立即查询页表，新项在tlb_miss_latency个周期后可用，期间trans返回SimError::miss
+    // 大页使用独立的tlb_huge，tag为(ASID, VPN / HUGE_PAGE_PGCNT)，ppn为大页首个4K页
+    typedef struct {
+        PageIndexT  ppn = 0;
+        PageFlagT   perm = 0;
+        uint64_t    ready_tick = 0;
+    } TLBEntry;
+    unique_ptr<simcache::GenericLRUCacheBlock<TLBEntry>> tlb;
+    unique_ptr<simcache::GenericLRUCacheBlock<TLBEntry>> tlb_huge;
+    uint32_t tlb_miss_latency = 0;
+
+    static const uint32_t TLB_ASID_SHIFT = 48;
+    inline LineIndexT tlb_key(AsidT id, VPageIndexT vpn) {
+        return (((LineIndexT)id) << TLB_ASID_SHIFT) | vpn;
+    }
+
+    SpinLock tlb_flush_lock;
+    std::atomic<bool> tlb_flush_pending = false;
+    bool tlb_flush_all = false;
+    vector<VPageIndexT> tlb_flush_pages;
+    void apply_tlb_flush();
+
     SimError trans(VirtAddrT vaddr, PhysAddrT *paddr, uint32_t flg) {
-        uint64_t key = ((vaddr >> PAGE_ADDR_OFFSET) << PAGE_ADDR_OFFSET) + flg;
-        auto iter = tlb.find(key);
-        if(iter != tlb.end()) {
-            *paddr = (iter->second << PAGE_ADDR_OFFSET) + (vaddr & (PAGE_LEN_BYTE - 1));
+        VPageIndexT vpn = (vaddr >> PAGE_ADDR_OFFSET);
+        LineIndexT key = tlb_key(asid, vpn);
+        TLBEntry *e = nullptr;
+        bool tag_hit = tlb->get_line(key, &e, true);
+        TLBEntry *hit = ((tag_hit && (e->perm & flg) == flg)?e:nullptr);
+        VirtAddrT ofs_mask = PAGE_LEN_BYTE - 1;
+        if(!hit) [[unlikely]] {
+            TLBEntry *he = nullptr;
+            if(tlb_huge->get_line(tlb_key(asid, vpn / HUGE_PAGE_PGCNT), &he, true) && (he->perm & flg) == flg) {
+                hit = he;
+                ofs_mask = HUGE_PAGE_LEN_BYTE - 1;
+            }
+        }
+        if(hit) [[likely]] {
+            if(hit->ready_tick > simroot::get_current_tick()) [[unlikely]] return SimError::miss;
+            statistic.tlb_hit_count++;
+            if(hit != e) statistic.tlb_huge_hit_count++;
+            *paddr = (hit->ppn << PAGE_ADDR_OFFSET) + (vaddr & ofs_mask);
             return SimError::success;
         }
-        SimError ret = io_sys_port->v_to_p(cpu_id, vaddr, paddr, flg);
+        statistic.tlb_miss_count++;
+        uint32_t pgofs = PAGE_ADDR_OFFSET;
+        SimError ret = io_sys_port->v_to_p_pgofs(cpu_id, vaddr, paddr, flg, &pgofs);
         if(ret == SimError::success) {
-            tlb.emplace(key, (*paddr) >> PAGE_ADDR_OFFSET);
+            TLBEntry ne;
+            ne.perm = flg;
+            ne.ready_tick = simroot::get_current_tick() + tlb_miss_latency;
+            if(pgofs == HUGE_PAGE_ADDR_OFFSET) {
+                ne.ppn = ((*paddr) >> HUGE_PAGE_ADDR_OFFSET) * HUGE_PAGE_PGCNT;
+                LineIndexT hkey = tlb_key(asid, vpn / HUGE_PAGE_PGCNT);
+                TLBEntry *he = nullptr;
+                if(tlb_huge->get_line(hkey, &he, false) && he->ppn == ne.ppn) ne.perm |= he->perm;
+                tlb_huge->insert_line(hkey, &ne, nullptr, nullptr);
+            }
+            else {
+                ne.ppn = ((*paddr) >> PAGE_ADDR_OFFSET);
+                if(tag_hit && e->ppn == ne.ppn) ne.perm |= e->perm;
+                tlb->insert_line(key, &ne, nullptr, nullptr);
+            }
+            if(tlb_miss_latency) return SimError::miss;
         }
         return ret;
     }
     
     void init_all();
 
-    typedef struct {
-        VirtAddrT pc;
-        RVInstT inst_raw;
-    } InstRaw;
-
-    typedef struct {
-        RV64InstDecoded inst;
-        RawDataT arg0;
-        RawDataT arg1;
-        RawDataT vaddr;
-        SimError err = SimError::success;
-        bool passp3 = false;
-        bool passp4 = false;
-        uint64_t mem_start_tick = 0;
-        uint64_t mem_finish_tick = 0;
-        bool cache_missed = false;
-    } P5InstDecoded;
-
     typedef struct {
         uint32_t busy = false;
         IntDataT value;
@@ -296,10 +365,6 @@ protected:
     std::ofstream *log_file_commited_inst = nullptr;
     std::ofstream *log_file_ldst = nullptr;
 
-    inline void dcache_prefetch(VirtAddrT vaddr) {
-        
-    }
-
     // inline PhysAddrT mem_trans_check_error(VirtAddrT vaddr, PageFlagT flg, VirtAddrT pc) {
     //     PhysAddrT paddr = 0;
     //     SimError res = io_sys_port->v_to_p(cpu_id, vaddr, &paddr, flg);
@@ -369,6 +434,14 @@ struct {
     uint64_t st_inst_cnt = 0;
     uint64_t st_mem_tick_sum = 0;
 
+    uint64_t decode_cache_hit_count = 0;
+    uint64_t decode_cache_miss_count = 0;
+
+    uint64_t tlb_hit_count = 0;
+    uint64_t tlb_miss_count = 0;
+    uint64_t tlb_huge_hit_count = 0;
+    uint64_t itlb_refill_stall_count = 0;
+
 } statistic;
 
 };
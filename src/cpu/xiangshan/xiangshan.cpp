@@ -49,6 +49,7 @@ XiangShanCPU::XiangShanCPU(
     XSREADCONF(ftq_size);
     XSREADCONF(inst_buffer_size);
     XSREADCONF(decode_width);
+    XSREADCONF(decode_cache_size);
     XSREADCONF(rob_size);
     XSREADCONF(branch_inst_cnt);
     XSREADCONF(phys_ireg_cnt);
@@ -99,6 +100,7 @@ XiangShanCPU::XiangShanCPU(
     fetch_result_queue = make_unique<SimpleTickQueue<FTQEntry*>>(1, 1, 0);
     pdec_result_queue = make_unique<SimpleTickQueue<FTQEntry*>>(1, 1, 0);
     inst_buffer = make_unique<SimpleTickQueue<XSInst*>>(1 + param.fetch_width_bytes / 2, cpu_width, param.inst_buffer_size);
+    decode_cache = make_unique<isa::DecodeCache>(param.decode_cache_size);
     
     bpu = make_unique<BPU>(&param, &ftq, 0);
     bpu->debug_ofile = debug_bpu_ofile;
@@ -128,11 +130,11 @@ XiangShanCPU::XiangShanCPU(
     fmac2 = make_unique<IntFPEXU>(2, param.fp_rs_size * 2, 2, "FMAC2");
     fmisc = make_unique<IntFPEXU>(2, param.fp_rs_size * 2, 2, "FMISC");
 
-    rs_ld = make_unique<LimitedTickList<XSInst*>>(2, param.mem_rs_size * 2);
-    rs_sta = make_unique<LimitedTickList<XSInst*>>(2, param.mem_rs_size * 2);
-    rs_std = make_unique<LimitedTickList<XSInst*>>(2, param.mem_rs_size * 2);
-    rs_amo = make_unique<LimitedTickList<XSInst*>>(1, 1);
-    rs_fence = make_unique<LimitedTickList<XSInst*>>(1, 1);
+    rs_ld = make_unique<LimitedTickVector<XSInst*>>(2, param.mem_rs_size * 2);
+    rs_sta = make_unique<LimitedTickVector<XSInst*>>(2, param.mem_rs_size * 2);
+    rs_std = make_unique<LimitedTickVector<XSInst*>>(2, param.mem_rs_size * 2);
+    rs_amo = make_unique<LimitedTickVector<XSInst*>>(1, 1);
+    rs_fence = make_unique<LimitedTickVector<XSInst*>>(1, 1);
 
     lsu_port.ld = rs_ld.get();
     lsu_port.sta = rs_sta.get();
@@ -193,6 +195,7 @@ void XiangShanCPU::apply_next_tick() {
 
 void XiangShanCPU::clear_statistic() {
     memset(&statistic, 0, sizeof(statistic));
+    decode_cache->hit_cnt = decode_cache->miss_cnt = 0;
 }
 
 #define LOGTOFILE(fmt, ...) do{sprintf(log_buf, fmt, ##__VA_ARGS__);ofile << log_buf;}while(0)
@@ -220,6 +223,11 @@ void XiangShanCPU::print_statistic(std::ofstream &ofile) {
     LOGTOFILE("\n");
     STATU64(fetch_pack_cnt);
     STATU64(fetch_pack_hit_cnt);
+    LOGTOFILE("\n");
+    statistic.decode_cache_hit_cnt = decode_cache->hit_cnt;
+    statistic.decode_cache_miss_cnt = decode_cache->miss_cnt;
+    STATU64(decode_cache_hit_cnt);
+    STATU64(decode_cache_miss_cnt);
     #undef STATU64
 }
 
@@ -393,7 +401,7 @@ void XiangShanCPU::dump_core(std::ofstream &ofile) {
     log_exu(fmisc.get(), "FMISC");
     LOGTOFILE("\n");
 
-    auto log_mrs = [&](LimitedTickList<XSInst*> *rs, string name) -> void {
+    auto log_mrs = [&](LimitedTickVector<XSInst*> *rs, string name) -> void {
         LOGTOFILE("#%s-RS:\n", name.c_str());
         int i = 0;
         for(auto &p : rs->get()) {
@@ -765,7 +773,7 @@ void XiangShanCPU::_cur_decode() {
     while(dec_to_rnm->can_push() && inst_buffer->can_pop() && !unique_inst_in_pipeline) {
         RV64InstDecoded dec;
         XSInst *inst = inst_buffer->top();
-        bool res = isa::decode_rv64(inst->inst, &dec);
+        bool res = decode_cache->decode(inst->inst, &dec);
         if(!res) [[unlikely]] {
             insert_error(dec_errors, SimError::illegalinst, inst->pc, inst->inst, 0);
             break;
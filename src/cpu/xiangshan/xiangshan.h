@@ -114,6 +114,7 @@ protected:
     unique_ptr<SimpleTickQueue<FTQEntry*>> fetch_result_queue;
     unique_ptr<SimpleTickQueue<FTQEntry*>> pdec_result_queue;
     unique_ptr<SimpleTickQueue<XSInst*>> inst_buffer;
+    unique_ptr<isa::DecodeCache> decode_cache;
 
     struct {
         uint8_t         rawbuf[CACHE_LINE_LEN_BYTE];
@@ -321,11 +322,11 @@ protected:
     */
     void _cur_intfp_exu(IntFPEXU *exu);
 
-    unique_ptr<LimitedTickList<XSInst*>> rs_ld;
-    unique_ptr<LimitedTickList<XSInst*>> rs_sta;
-    unique_ptr<LimitedTickList<XSInst*>> rs_std;
-    unique_ptr<LimitedTickList<XSInst*>> rs_amo;
-    unique_ptr<LimitedTickList<XSInst*>> rs_fence;
+    unique_ptr<LimitedTickVector<XSInst*>> rs_ld;
+    unique_ptr<LimitedTickVector<XSInst*>> rs_sta;
+    unique_ptr<LimitedTickVector<XSInst*>> rs_std;
+    unique_ptr<LimitedTickVector<XSInst*>> rs_amo;
+    unique_ptr<LimitedTickVector<XSInst*>> rs_fence;
     LSUPort lsu_port;
     unique_ptr<LSU> lsu;
     void cur_mem_disp2();
@@ -396,6 +397,9 @@ protected:
 
         uint64_t fetch_pack_cnt = 0;
         uint64_t fetch_pack_hit_cnt = 0;
+
+        uint64_t decode_cache_hit_cnt = 0;
+        uint64_t decode_cache_miss_cnt = 0;
     } statistic;
 };
 
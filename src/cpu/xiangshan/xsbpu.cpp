@@ -97,8 +97,10 @@ void BPU::dump_core(std::ofstream &ofile) {
         LOGTOFILE("#BPU-FTB:\n");
         for(uint32_t s = 0; s < ftb->set_count; s++) {
             LOGTOFILE("set %d: ", s);
-            for(auto &e : ftb->p_sets[s]) {
-                FTBEntry &f = e.second;
+            std::vector<std::pair<LineIndexT, FTBEntry*>> lines;
+            ftb->get_set_lines(s, lines);
+            for(auto &e : lines) {
+                FTBEntry &f = *(e.second);
                 LOGTOFILE("0x%lx:len%d %ldbr(%d) %djmp 0x%lx | ", e.first, f.ft_len, f.branchs.size(), f.always_taken, (int)(f.jmpinfo), f.jaltarget);
             }
             LOGTOFILE("\n");
@@ -109,8 +111,10 @@ void BPU::dump_core(std::ofstream &ofile) {
         LOGTOFILE("#BPU-uBTB:\n");
         for(uint32_t s = 0; s < ubtb->set_count; s++) {
             LOGTOFILE("set %d: ", s);
-            for(auto &e : ubtb->p_sets[s]) {
-                FTBEntry &f = e.second;
+            std::vector<std::pair<LineIndexT, FTBEntry*>> lines;
+            ubtb->get_set_lines(s, lines);
+            for(auto &e : lines) {
+                FTBEntry &f = *(e.second);
                 LOGTOFILE("0x%lx:len%d %ldbr %djmp 0x%lx | ", e.first, f.ft_len, f.branchs.size(), (int)(f.jmpinfo), f.jaltarget);
             }
             LOGTOFILE("\n");
@@ -642,7 +642,7 @@ void LSU::_cur_load_queue() {
         if(ldq.count(lindex) != 0) {
             if(cop->err == SimError::busy || cop->err == SimError::coherence) {
                 // dcache暂时没法响应这个请求，扔回队尾等重发
-                ld_waiting.get().push_front(lindex);
+                ld_waiting.get().insert(ld_waiting.get().begin(), lindex);
             }
         }
         ld_indexing.erase(lindex);
@@ -659,7 +659,7 @@ void LSU::_cur_load_queue() {
         cop->len = CACHE_LINE_LEN_BYTE;
         io_dcache_port->ld_input->push(cop);
         ld_indexing.insert(lindex);
-        ld_waiting.get().remove(lindex);
+        std::erase(ld_waiting.get(), lindex);
         if(debug_ofile) {
             sprintf(log_buf, "%ld:INDEXING: LINE 0x%lx", simroot::get_current_tick(), lindex);
             simroot::log_line(debug_ofile, log_buf);
@@ -807,7 +807,7 @@ void LSU::_cur_st_addr_trans() {
         }
         else {
             apl_inst_finished.push_back(inst);
-            port->std->get().remove(inst);
+            std::erase(port->std->get(), inst);
         }
 
         if(debug_ofile) {
@@ -47,11 +47,11 @@ using simcache::CacheInterfaceV2;
  * RS中指令的就绪状态与操作数获取由外部的流水线控制逻辑处理
 */
 typedef struct {
-    LimitedTickList<XSInst*> *ld;
-    LimitedTickList<XSInst*> *sta;
-    LimitedTickList<XSInst*> *std;
-    LimitedTickList<XSInst*> *amo; // 只有在amo处于commit头部时才会实际执行以保证amo正确，当前amo完成前不能接收另一个amo
-    LimitedTickList<XSInst*> *fence;
+    LimitedTickVector<XSInst*> *ld;
+    LimitedTickVector<XSInst*> *sta;
+    LimitedTickVector<XSInst*> *std;
+    LimitedTickVector<XSInst*> *amo; // 只有在amo处于commit头部时才会实际执行以保证amo正确，当前amo完成前不能接收另一个amo
+    LimitedTickVector<XSInst*> *fence;
     unordered_map<PhysReg, RawDataT> *apl_int_bypass;
     unordered_map<PhysReg, RawDataT> *apl_fp_bypass;
 } LSUPort;
@@ -120,7 +120,7 @@ protected:
 
     CacheInterfaceV2 *io_dcache_port;
     std::set<LineIndexT> ld_indexing;
-    TickList<LineIndexT> ld_waiting;
+    TickVector<LineIndexT> ld_waiting;
 
     AMOState amo_state = AMOState::free;
 
@@ -26,6 +26,7 @@
 #include "common.h"
 #include "simerror.h"
 #include "tickqueue.h"
+#include "objpool.h"
 
 #include "cpu/isa.h"
 
@@ -251,7 +252,7 @@ typedef struct {
     int32_t     jmp_offset = 0;
 } FTQBranch;
 
-typedef struct {
+typedef struct FTQEntry {
     vector<RVInstT>     insts;      // 指令列表
     VirtAddrT           startpc;    // Fetch块第一条指令的pc
     VirtAddrT           endpc;      // Fetch块最后一条指令的下一条指令的pc
@@ -262,6 +263,7 @@ typedef struct {
     RASSnapShot         ras;        // 进行函数跳转预测前的RAS信息
     uint16_t            commit_cnt;
     bool                commit_ras; // 是否进行了RAS预测，如果进行了就需要在提交时更新RAS
+    OBJPOOL_NEW_DELETE(FTQEntry)
 } FTQEntry;
 
 inline VirtAddrT nextpc(FTQEntry *fetch) {
@@ -287,7 +289,7 @@ inline bool inst_later_than(XSInstID a, XSInstID b) {
     return (((a>>62) == 0UL && (b>>62) == 3UL) || a > b);
 }
 
-typedef struct {
+typedef struct XSInst {
     XSInstID        id;
     FTQEntry        *ftq;
     VirtAddrT       pc;
@@ -310,6 +312,7 @@ typedef struct {
     bool            finished;
     void            *rs;
     string          dbgname;
+    OBJPOOL_NEW_DELETE(XSInst)
 } XSInst;
 
 inline bool inst_ready(XSInst *inst) {
@@ -412,6 +415,7 @@ typedef struct {
     uint32_t inst_buffer_size = 48;
 
     uint32_t decode_width = 6;
+    uint32_t decode_cache_size = 4096;
     uint32_t rob_size = 64;
     uint32_t branch_inst_cnt = 16;
 
@@ -201,9 +201,11 @@ bool mp_moesi_l1l2(std::vector<string> &argv) {
         nodes, nodes, cha_width, route, "Bus"
     );
     simroot::add_sim_object(bus.get(), "Bus", 1);
+    // 不同模拟线程中的对象只通过总线通信
+    simroot::set_cross_thread_lookahead(bus->get_route_latency());
     
-    uint8_t *pmem = new uint8_t[param.mem_sz];
-    unique_ptr<PhysPageAllocator> ppman = make_unique<PhysPageAllocator>(0UL, param.mem_sz, pmem);
+    uint8_t *pmem = PhysPageAllocator::alloc_host_memory(param.mem_sz, conf::get_int("multicore", "host_numa_interleave", 0));
+    unique_ptr<PhysPageAllocator> ppman = make_unique<PhysPageAllocator>(0UL, param.mem_sz, pmem, true);
 
     BusPortT busport;
 
@@ -220,6 +222,7 @@ bool mp_moesi_l1l2(std::vector<string> &argv) {
     cp.mshr_num = conf::get_int("llc", "mshr_num", 8);
     cp.index_latency = conf::get_int("llc", "index_cycle", 4);
     cp.index_width = 1;
+    cp.bank_num = conf::get_int("llc", "bank_num", 1);
 
     assert(busmap.get_homenode_port(0, &busport));
     std::unique_ptr<LLCMoesiDirNoi> l2 =  std::make_unique<LLCMoesiDirNoi>(
@@ -228,6 +231,7 @@ bool mp_moesi_l1l2(std::vector<string> &argv) {
     simroot::add_sim_object(l2.get(), "L2Cache", 1);
 
     std::unique_ptr<SimSystemMultiCore> simsys = std::make_unique<SimSystemMultiCore>();
+    simroot::add_sim_object(simsys.get(), "System", 1);
 
     simcache::CacheParam icp, dcp;
     dcp.set_offset = conf::get_int("l1cache", "dcache_set_offset", 5);
@@ -298,7 +302,7 @@ bool mp_moesi_l1l2(std::vector<string> &argv) {
 
     simroot::start_sim();
 
-    delete[] pmem;
+    PhysPageAllocator::free_host_memory(pmem, param.mem_sz);
 
     return true;
 }
@@ -254,9 +254,11 @@ bool mp_moesi_l3(std::vector<string> &argv) {
         busmap.ports, busmap.port2node, cha_width, busmap.route_table, "Bus"
     );
     simroot::add_sim_object(bus.get(), "Bus", 1);
+    // 不同模拟线程中的对象只通过总线通信
+    simroot::set_cross_thread_lookahead(bus->get_route_latency());
     
-    uint8_t *pmem = new uint8_t[param.mem_sz];
-    unique_ptr<PhysPageAllocator> ppman = make_unique<PhysPageAllocator>(0UL, param.mem_sz, pmem);
+    uint8_t *pmem = PhysPageAllocator::alloc_host_memory(param.mem_sz, conf::get_int("multicore", "host_numa_interleave", 0));
+    unique_ptr<PhysPageAllocator> ppman = make_unique<PhysPageAllocator>(0UL, param.mem_sz, pmem, true);
 
     vector<unique_ptr<MultiCoreL3AddrMap>> mem_addr_maps(param.mem_node_num);
     vector<unique_ptr<MemoryNode>> mem_nodes(param.mem_node_num);
@@ -277,6 +279,7 @@ bool mp_moesi_l3(std::vector<string> &argv) {
     cp.mshr_num = conf::get_int("llc", "mshr_num", 8);
     cp.index_latency = conf::get_int("llc", "index_cycle", 10);
     cp.index_width = 1;
+    cp.bank_num = conf::get_int("llc", "bank_num", 1);
     cp.nuca_num = param.cpu_num;
     cp.nuca_index = 0;
 
@@ -290,6 +293,7 @@ bool mp_moesi_l3(std::vector<string> &argv) {
     }
 
     unique_ptr<SimSystemMultiCore> simsys = make_unique<SimSystemMultiCore>();
+    simroot::add_sim_object(simsys.get(), "System", 1);
 
     simcache::CacheParam icp, dcp;
     dcp.set_offset = conf::get_int("l1cache", "dcache_set_offset", 5);
@@ -308,9 +312,16 @@ bool mp_moesi_l3(std::vector<string> &argv) {
     cp.mshr_num = conf::get_int("l2cache", "mshr_num", 8);
     cp.index_latency = conf::get_int("l2cache", "index_latency", 4);
     cp.index_width = conf::get_int("l2cache", "index_width", 1);
+    cp.bank_num = conf::get_int("l2cache", "bank_num", 1);
     cp.nuca_index = 0;
     cp.nuca_num = 1;
 
+    simcache::PrefetcherParam pfp;
+    simcache::Prefetcher::load_param(pfp);
+    string l1d_pf_type = conf::get_str("l1cache", "dcache_prefetcher", "none");
+    string l2_pf_type = conf::get_str("l2cache", "prefetcher", "none");
+    bool l1i_pf = conf::get_int("l1cache", "icache_next_line_prefetch", 0);
+
     vector<unique_ptr<PrivL1L2Moesi>> l2s(param.cpu_num);
     vector<unique_ptr<PrivL1L2MoesiL1IPort>> l1is(param.cpu_num);
     vector<unique_ptr<PrivL1L2MoesiL1DPort>> l1ds(param.cpu_num);
@@ -319,6 +330,7 @@ bool mp_moesi_l3(std::vector<string> &argv) {
         l2s[i] = make_unique<PrivL1L2Moesi>(
             cp, dcp, icp, bus.get(), busmap.l2_ports[i], &busmap, "L2Cache" + to_string(i), get_global_cache_event_trace()
         );
+        l2s[i]->set_prefetcher(pfp, l1d_pf_type, l2_pf_type, l1i_pf);
         simroot::add_sim_object(l2s[i].get(), "L2Cache" + to_string(i), 1);
         l1is[i] = make_unique<PrivL1L2MoesiL1IPort>(l2s[i].get());
         l1ds[i] = make_unique<PrivL1L2MoesiL1DPort>(l2s[i].get());
@@ -329,6 +341,8 @@ bool mp_moesi_l3(std::vector<string> &argv) {
     if(cpu_type.compare("pipeline5") == 0) {
         for(uint32_t i = 0; i < param.cpu_num; i++) {
             cpus[i] = make_unique<PipeLine5CPU>(l1is[i].get(), l1ds[i].get(), simsys.get(), i);
+            // L1端口的时钟由PrivL1L2Moesi驱动，停机的CPU可以休眠
+            cpus[i]->sleep_on_halt = true;
         }
     }
     else if(cpu_type.compare("xiangshan") == 0) {
@@ -360,7 +374,7 @@ bool mp_moesi_l3(std::vector<string> &argv) {
 
     simroot::start_sim();
 
-    delete[] pmem;
+    PhysPageAllocator::free_host_memory(pmem, param.mem_sz);
 
     return true;
 }
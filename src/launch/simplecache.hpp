@@ -123,7 +123,10 @@ bool mp_scc_l1l2(std::vector<string> &argv) {
         simroot::add_sim_object_next_thread(cpus[i].get(), strbuf, 1);
     }
     simroot::add_sim_object_next_thread(l2.get(), "L2cache&Mem", 1);
+    simroot::add_sim_object(sys.get(), "System", 1);
     simroot::add_sim_object(dma.get(), "DMA", 1);
+    // SCC端口的请求与监听信号在下一周期即可见
+    simroot::set_cross_thread_lookahead(1);
 
     simroot::print_log_info("Start Simulator !!!");
 
@@ -24,15 +24,21 @@
 #include "common.h"
 #include "simroot.h"
 #include "configuration.h"
+#include "tickqueue.h"
+#include "objpool.h"
 
 #include "bus/routetable.h"
 #include "bus/symmulcha.h"
 
 #include "cache/moesi/test_moesi.h"
+#include "cache/dramctrl.h"
+#include "cache/prefetcher.h"
 
 #include "cpu/isa.h"
 
 #include "sys/syscallmem.h"
+#include "sys/pagemmap.h"
+#include "sys/hostio.h"
 
 #include "launch/launch.h"
 #include "launch/simplecache.hpp"
@@ -182,6 +188,18 @@ void execution() {
         TEST(_test_uint());
     });
 
+    OPERATION(op, "test_tickqueue", {
+        TEST(test::test_tickqueue());
+    });
+
+    OPERATION(op, "test_tickqueue_perf", {
+        TEST(test::test_tickqueue_perf());
+    });
+
+    OPERATION(op, "test_objpool", {
+        TEST(test::test_objpool());
+    });
+
 
     // -------- Simulator Test --------
 
@@ -197,6 +215,26 @@ void execution() {
         TEST(test::test_syscall_memory());
     });
 
+    OPERATION(op, "test_radix_page_map", {
+        TEST(test::test_radix_page_map());
+    });
+
+    OPERATION(op, "test_phys_page_allocator", {
+        TEST(test::test_phys_page_allocator());
+    });
+
+    OPERATION(op, "test_vaddr_seg_map", {
+        TEST(test::test_vaddr_seg_map());
+    });
+
+    OPERATION(op, "test_lazy_zero_page", {
+        TEST(test::test_lazy_zero_page());
+    });
+
+    OPERATION(op, "test_host_io", {
+        TEST(test::test_host_io());
+    });
+
     OPERATION(op, "test_ini_file", {
         TEST(test::test_ini_file());
     });
@@ -231,10 +269,26 @@ void execution() {
         TEST(test::test_moesi_cache_l3nuca_rand());
     });
 
+    OPERATION(op, "test_moesi_cache_l3nuca_rand_prefetch", {
+        TEST(test::test_moesi_cache_l3nuca_rand_prefetch());
+    });
+
+    OPERATION(op, "test_moesi_cache_l3nuca_rand_banked", {
+        TEST(test::test_moesi_cache_l3nuca_rand_banked());
+    });
+
     OPERATION(op, "test_moesi_l1_dma", {
         TEST(test::test_moesi_l1_dma());
     });
 
+    OPERATION(op, "test_dram_ctrl", {
+        TEST(test::test_dram_ctrl());
+    });
+
+    OPERATION(op, "test_prefetcher", {
+        TEST(test::test_prefetcher());
+    });
+
     
     OPERATION(op, "test_scc_1l24l1_seq_wr", {
         TEST(test::test_scc_1l24l1_seq_wr());
@@ -255,6 +309,9 @@ void execution() {
     OPERATION(op, "test_sym_mul_cha_bus", {
         TEST(test::test_sym_mul_cha_bus());
     });
+    OPERATION(op, "test_sym_mul_cha_bus_threads", {
+        TEST(test::test_sym_mul_cha_bus_threads());
+    });
 }
 
 
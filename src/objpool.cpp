@@ -0,0 +1,184 @@
+// MIT License
+
+// Copyright (c) 2024 Meng Chengzhen, in Shandong University
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "objpool.h"
+#include "common.h"
+
+#include <algorithm>
+
+namespace objpool {
+
+typedef struct {
+    std::mutex                  mtx;
+    std::vector<PoolStatistic*> pools;
+} PoolRegistry;
+
+static PoolRegistry &registry() {
+    static PoolRegistry r;
+    return r;
+}
+
+PoolStatistic::PoolStatistic(const char *name) : name(name) {
+    PoolRegistry &r = registry();
+    std::lock_guard<std::mutex> lk(r.mtx);
+    r.pools.push_back(this);
+}
+
+void PoolStatistic::attach(ThreadFreeListBase *list) {
+    std::lock_guard<std::mutex> lk(mtx);
+    lists.push_back(list);
+}
+
+void PoolStatistic::detach(ThreadFreeListBase *list) {
+    std::lock_guard<std::mutex> lk(mtx);
+    exited_alloc_cnt += list->alloc_cnt.load();
+    exited_reuse_cnt += list->reuse_cnt.load();
+    exited_free_cnt += list->free_cnt.load();
+    auto res = std::find(lists.begin(), lists.end(), list);
+    if(res != lists.end()) lists.erase(res);
+}
+
+void PoolStatistic::print_statistic(std::ofstream &ofile) {
+    char buf[256];
+    uint64_t alloc = 0, reuse = 0, free = 0;
+    {
+        std::lock_guard<std::mutex> lk(mtx);
+        alloc = exited_alloc_cnt;
+        reuse = exited_reuse_cnt;
+        free = exited_free_cnt;
+        for(auto l : lists) {
+            alloc += l->alloc_cnt.load(std::memory_order_relaxed);
+            reuse += l->reuse_cnt.load(std::memory_order_relaxed);
+            free += l->free_cnt.load(std::memory_order_relaxed);
+        }
+    }
+    sprintf(buf, "pool_%s_alloc_count: %ld\n", name, alloc);
+    ofile << buf;
+    sprintf(buf, "pool_%s_reuse_rate: %f\n", name, (alloc)?(((double)reuse) / alloc):0.);
+    ofile << buf;
+    // 模拟结束时仍未释放的对象数量，包括各模块中正在处理的对象
+    sprintf(buf, "pool_%s_live_count: %ld\n", name, (int64_t)(alloc - free));
+    ofile << buf;
+}
+
+void print_statistic(std::ofstream &ofile) {
+    PoolRegistry &r = registry();
+    std::lock_guard<std::mutex> lk(r.mtx);
+    ofile << "ObjectPool\n";
+    for(auto p : r.pools) {
+        p->print_statistic(ofile);
+    }
+}
+
+}
+
+namespace test {
+
+typedef struct PoolTestObj {
+    uint64_t    id = 0;
+    uint64_t    buf[7];
+    OBJPOOL_NEW_DELETE(PoolTestObj)
+} PoolTestObj;
+
+typedef struct {
+    uint64_t    id = 0;
+    uint64_t    buf[7];
+} PlainTestObj;
+
+static void *_pool_test_thread(void *param) {
+    std::vector<PoolTestObj*> *objs = (std::vector<PoolTestObj*>*)param;
+    for(auto p : *objs) delete p;
+    for(uint64_t i = 0; i < objs->size(); i++) {
+        (*objs)[i] = new PoolTestObj;
+        (*objs)[i]->id = i;
+    }
+    return nullptr;
+}
+
+bool test_objpool() {
+    const uint64_t num = 1024;
+
+    std::vector<PoolTestObj*> objs(num);
+    std::set<PoolTestObj*> addrs;
+    for(uint64_t i = 0; i < num; i++) {
+        objs[i] = new PoolTestObj;
+        objs[i]->id = i;
+        addrs.insert(objs[i]);
+    }
+    for(auto p : objs) delete p;
+#ifndef NDEBUG
+    for(auto p : objs) {
+        if(((uint8_t*)p)[0] != objpool::POISON_BYTE || ((uint8_t*)p)[sizeof(PoolTestObj) - 1] != objpool::POISON_BYTE) {
+            printf("Freed object @%p is not poisoned\n", p);
+            return false;
+        }
+    }
+#endif
+    for(uint64_t i = 0; i < num; i++) {
+        objs[i] = new PoolTestObj;
+        if(addrs.find(objs[i]) == addrs.end()) {
+            printf("Object %ld is not reused from the free list\n", i);
+            return false;
+        }
+        if(objs[i]->id != 0) {
+            printf("Object %ld is not constructed\n", i);
+            return false;
+        }
+    }
+
+    // 由其他线程释放并重新分配，对象在线程退出时被归还
+    pthread_t th;
+    pthread_create(&th, nullptr, _pool_test_thread, &objs);
+    pthread_join(th, nullptr);
+    for(uint64_t i = 0; i < num; i++) {
+        if(objs[i]->id != i) {
+            printf("Object %ld from another thread is corrupted\n", i);
+            return false;
+        }
+        delete objs[i];
+    }
+
+    const uint64_t round = 1UL << 24;
+    const uint64_t live = 64;
+    std::vector<PoolTestObj*> pool_live(live, nullptr);
+    std::vector<PlainTestObj*> plain_live(live, nullptr);
+    uint64_t t0 = get_current_time_us();
+    for(uint64_t i = 0; i < round; i++) {
+        uint64_t idx = (i * 37) % live;
+        if(pool_live[idx]) delete pool_live[idx];
+        pool_live[idx] = new PoolTestObj;
+    }
+    uint64_t t1 = get_current_time_us();
+    for(uint64_t i = 0; i < round; i++) {
+        uint64_t idx = (i * 37) % live;
+        if(plain_live[idx]) delete plain_live[idx];
+        plain_live[idx] = new PlainTestObj;
+    }
+    uint64_t t2 = get_current_time_us();
+    for(auto p : pool_live) delete p;
+    for(auto p : plain_live) delete p;
+    printf("new/delete %ld objects: pool %ld us, plain %ld us\n", round, t1 - t0, t2 - t1);
+
+    return true;
+}
+
+}
@@ -0,0 +1,165 @@
+// MIT License
+
+// Copyright (c) 2024 Meng Chengzhen, in Shandong University
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef RVSIM_OBJPOOL_H
+#define RVSIM_OBJPOOL_H
+
+#include <atomic>
+#include <mutex>
+#include <new>
+
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+
+#include <fstream>
+#include <vector>
+
+namespace objpool {
+
+/**
+ * 按类型区分的对象池，每个线程持有独立的空闲链表，分配与释放不需要加锁
+ * 在另一个线程释放的对象进入释放线程的空闲链表
+ * 在结构体内使用OBJPOOL_NEW_DELETE(T)后，该类型的new/delete都经过对象池
+ * 未定义NDEBUG时，释放的对象会被填充为POISON_BYTE，并检查重复释放
+ */
+
+const uint8_t POISON_BYTE = 0xa5;
+const uint64_t POISON_WORD = 0xa5a5a5a5a5a5a5a5UL;
+
+class ThreadFreeListBase;
+
+class PoolStatistic {
+public:
+    PoolStatistic(const char *name);
+
+    const char *name;
+
+    void attach(ThreadFreeListBase *list);
+    void detach(ThreadFreeListBase *list);
+    void print_statistic(std::ofstream &ofile);
+
+protected:
+    std::mutex mtx;
+    std::vector<ThreadFreeListBase*> lists;
+    uint64_t exited_alloc_cnt = 0;
+    uint64_t exited_reuse_cnt = 0;
+    uint64_t exited_free_cnt = 0;
+};
+
+class ThreadFreeListBase {
+public:
+    // 计数只由所属线程写入，读取仅用于统计输出
+    std::atomic<uint64_t> alloc_cnt = 0;
+    std::atomic<uint64_t> reuse_cnt = 0;
+    std::atomic<uint64_t> free_cnt = 0;
+
+    inline void inc(std::atomic<uint64_t> &cnt) {
+        cnt.store(cnt.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+};
+
+void print_statistic(std::ofstream &ofile);
+
+template<typename T>
+class ObjectPool {
+public:
+
+    static void *alloc_raw(size_t sz) {
+        assert(sz == sizeof(T));
+        if(list_dead) [[unlikely]] return ::operator new(sizeof(T));
+        ThreadFreeList &l = list;
+        l.inc(l.alloc_cnt);
+        if(l.free.empty()) return ::operator new(sizeof(T));
+        l.inc(l.reuse_cnt);
+        void *ret = l.free.back();
+        l.free.pop_back();
+        return ret;
+    }
+
+    static void free_raw(void *p) {
+        if(!p) return;
+#ifndef NDEBUG
+        if constexpr(sizeof(T) >= sizeof(uint64_t)) {
+            uint64_t tail;
+            memcpy(&tail, ((uint8_t*)p) + sizeof(T) - sizeof(uint64_t), sizeof(uint64_t));
+            uint64_t head;
+            memcpy(&head, p, sizeof(uint64_t));
+            assert(!(head == POISON_WORD && tail == POISON_WORD));
+        }
+        memset(p, POISON_BYTE, sizeof(T));
+#endif
+        if(list_dead) [[unlikely]] {
+            ::operator delete(p);
+            return;
+        }
+        ThreadFreeList &l = list;
+        l.inc(l.free_cnt);
+        if(l.free.size() >= MAX_CACHED_OBJ) [[unlikely]] {
+            ::operator delete(p);
+            return;
+        }
+        l.free.push_back(p);
+    }
+
+    static PoolStatistic &statistic() {
+        static PoolStatistic s(T::objpool_name());
+        return s;
+    }
+
+protected:
+    static const size_t MAX_CACHED_OBJ = 65536;
+
+    class ThreadFreeList : public ThreadFreeListBase {
+    public:
+        ThreadFreeList() {
+            free.reserve(256);
+            statistic().attach(this);
+        }
+        ~ThreadFreeList() {
+            statistic().detach(this);
+            for(void *p : free) ::operator delete(p);
+            free.clear();
+            list_dead = true;
+        }
+        std::vector<void*> free;
+    };
+
+    static inline thread_local ThreadFreeList list;
+    // 线程退出时空闲链表先于其他对象析构，此后释放的对象直接归还给系统
+    static inline thread_local bool list_dead = false;
+};
+
+}
+
+#define OBJPOOL_NEW_DELETE(T) \
+    static const char *objpool_name() { return #T; } \
+    static void *operator new(size_t sz) { return objpool::ObjectPool<T>::alloc_raw(sz); } \
+    static void operator delete(void *p) { objpool::ObjectPool<T>::free_raw(p); }
+
+namespace test {
+
+bool test_objpool();
+
+}
+
+#endif
@@ -23,11 +23,28 @@
 #include "simroot.h"
 #include "configuration.h"
 #include "spinlocks.h"
+#include "objpool.h"
 
 #include <filesystem>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
 
 namespace simroot {
 
+// 用于采样对象开销与屏障等待时间的host时钟
+inline uint64_t get_host_cycle() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000000UL + t.tv_nsec;
+#endif
+}
+
 typedef struct {
     std::ofstream *ofile = nullptr;
     std::list<string> buf;
@@ -50,8 +67,10 @@ typedef struct alignas(64) {
     SimObject *p_obj = nullptr;
     int latency = 0;
     int current = 0;
+    uint64_t cost = 0;      // 采样得到的host开销
+    uint32_t group = 0;     // 同一组的对象始终在同一线程中执行
 
-    uint8_t pad[64 - sizeof(name) - sizeof(p_obj) - sizeof(latency) - sizeof(current)];
+    uint8_t pad[64 - sizeof(name) - sizeof(p_obj) - sizeof(latency) - sizeof(current) - sizeof(cost) - sizeof(group)];
 } SimObjectWithFreq;
 
 typedef struct alignas(64) {
@@ -59,9 +78,16 @@ typedef struct alignas(64) {
     double cur_sum = 0;
     double apl_sum = 0;
 
-    bool do_clear_statistic = false;
+    uint64_t obj_tick_cnt = 0;
+    uint64_t obj_tick_skipped_cnt = 0;
+
+    uint64_t next_wakeup_tick = 0;  // 本线程所有对象均休眠时最早的定时唤醒周期，0表示没有定时唤醒
+    bool quiescent = false;         // 本线程所有对象在下一周期均保持休眠
 
-    uint8_t pad[64 - sizeof(simobjs) - sizeof(cur_sum) - sizeof(apl_sum) - sizeof(do_clear_statistic)];
+    uint64_t sampled_cycles = 0;        // 采样周期中的host开销总和
+    uint64_t barrier_wait_cycles = 0;   // 采样周期中等待屏障的host开销
+
+    bool do_clear_statistic = false;
 } SimRootThreadTask;
 
 struct SimRootThreadTaskCmpCur {
@@ -85,6 +111,13 @@ public:
 
         global_freq = conf::get_int("root", "global_freq_mhz", 1000) * 1000000UL;
         wall_time_freq = conf::get_int("root", "wall_time_freq_mhz", 1000) * 1000000UL;
+        fast_forward = conf::get_int("root", "fast_forward", 1);
+        sample_interval = conf::get_int("root", "balance_sample_interval", 64);
+        if(sample_interval == 0) sample_interval = 1;
+        balance_interval = ((thread_num > 1)?conf::get_int("root", "balance_interval", 1000000):0);
+        conf_sync_quantum = conf::get_int("root", "sync_quantum", 1);
+        if(conf_sync_quantum == 0) conf_sync_quantum = 1;
+        next_balance_tick = balance_interval;
         start_time_us = get_current_time_us();
 
         std::string log_dir = conf::get_str("root", "out_dir", "out");
@@ -106,6 +139,7 @@ public:
 
     SimRootThreadTask *tasks = nullptr;
     uint32_t insert_thread_idx = 0;
+    uint32_t insert_group_idx = 0;
 
     SpinLock lock_log;
 
@@ -113,14 +147,30 @@ public:
     pthread_t *ths = nullptr;
 
     bool is_processing = false;
-    uint64_t current_tick = 0;
+    std::atomic<uint64_t> current_tick = 0;  // 由线程0发布，host线程（如IO reactor中的sim_wakeup）也会读取
     uint64_t global_freq = 0;
     uint64_t start_time_us = 0;
     uint64_t wall_time_freq = 0;
 
+    uint64_t last_1mtick_tick = 0;
     uint64_t last_1mtick_real_time_us = 0;
     uint64_t last_1mtick_real_time_interval_us = 0;
 
+    bool fast_forward = true;
+    uint64_t fast_forward_cnt = 0;
+    uint64_t fast_forward_tick_cnt = 0;
+
+    uint64_t conf_sync_quantum = 1;
+    uint64_t sync_quantum = 1;              // 线程间每sync_quantum个周期同步一次
+    uint64_t cross_thread_lookahead = 1;    // 不同线程的对象之间最短的通信延迟
+    uint64_t cross_thread_latency = 0;      // 跨线程通道的最小延迟，只有一个线程有对象时为0
+
+    uint64_t sample_interval = 64;
+    uint64_t balance_interval = 0;
+    uint64_t next_balance_tick = 0;
+    uint64_t balance_cnt = 0;
+    uint64_t balance_migrate_cnt = 0;
+
     std::set<LogFile*> logfiles;
 
     std::ofstream stdout_logfile;
@@ -129,6 +179,9 @@ public:
 
 SimRoot *root = nullptr;
 
+thread_local bool is_sim_thread = false;
+thread_local uint64_t sim_thread_tick = 0;
+
 void int_signal_handler(int signum) {
     printf("Recieve SIGINT\n");
     dump_core();
@@ -148,7 +201,8 @@ void add_sim_object(SimObject *p_obj, std::string name, int latency) {
         .name = name,
         .p_obj = p_obj,
         .latency = latency,
-        .current = ((latency > 0)?(latency - 1):0)
+        .current = ((latency > 0)?(latency - 1):0),
+        .group = root->insert_group_idx
     };
     root->all_sim_objs.push_back(tmp);
     if(latency) {
@@ -163,6 +217,36 @@ void add_sim_object(SimObject *p_obj, std::string name, int latency) {
 void add_sim_object_next_thread(SimObject *p_obj, std::string name, int latency) {
     add_sim_object(p_obj, name, latency);
     root->insert_thread_idx = (root->insert_thread_idx + 1) % root->thread_num;
+    root->insert_group_idx++;
+}
+
+void set_cross_thread_lookahead(uint64_t latency) {
+    init_simroot();
+    root->cross_thread_lookahead = std::max<uint64_t>(latency, 1);
+}
+
+uint64_t get_cross_thread_latency() {
+    init_simroot();
+    return root->cross_thread_latency;
+}
+
+void set_sim_thread_num(uint32_t thread_num) {
+    init_simroot();
+    simroot_assert(thread_num > 0 && !root->is_processing && root->all_sim_objs.empty());
+    if(thread_num == root->thread_num) return;
+    delete[] root->tasks;
+    delete[] root->ths;
+    root->thread_num = thread_num;
+    root->tasks = new SimRootThreadTask[thread_num];
+    root->ths = new pthread_t[thread_num];
+    root->barrier.~SpinBarrier();
+    new (&(root->barrier)) SpinBarrier(thread_num);
+    root->insert_thread_idx = root->insert_group_idx = 0;
+}
+
+void set_sync_quantum(uint64_t quantum) {
+    init_simroot();
+    root->conf_sync_quantum = ((quantum)?quantum:1);
 }
 
 void clear_sim_object() {
@@ -170,8 +254,15 @@ void clear_sim_object() {
     for(int i = 0; i < root->thread_num; i++) {
         root->tasks[i].simobjs.clear();
         root->tasks[i].cur_sum = root->tasks[i].apl_sum = 0;
+        root->tasks[i].obj_tick_cnt = root->tasks[i].obj_tick_skipped_cnt = 0;
+        root->tasks[i].sampled_cycles = root->tasks[i].barrier_wait_cycles = 0;
     }
     root->all_sim_objs.clear();
+    root->insert_thread_idx = root->insert_group_idx = 0;
+    root->cross_thread_lookahead = 1;
+    root->cross_thread_latency = 0;
+    root->fast_forward_cnt = root->fast_forward_tick_cnt = 0;
+    root->balance_cnt = root->balance_migrate_cnt = 0;
 }
 
 void __attribute__((noinline)) sync_cur() {
@@ -182,6 +273,132 @@ void __attribute__((noinline)) sync_apl() {
     root->barrier.wait();
 }
 
+void __attribute__((noinline)) sync_ff() {
+    root->barrier.wait();
+}
+
+void __attribute__((noinline)) sync_balance() {
+    root->barrier.wait();
+}
+
+
+// 休眠对象在被请求唤醒或到达定时唤醒周期时恢复调度
+// 各模拟线程的周期在一个同步周期内最多相差sync_quantum（host线程读到的current_tick可能超前1），因此唤醒判断保留sync_quantum个周期的余量
+inline bool sim_object_wakeup_requested(SimObject *p) {
+    uint64_t req = p->get_sim_wakeup_req_tick();
+    return (req != UINT64_MAX && req + root->sync_quantum >= p->sim_sleep_tick);
+}
+
+inline bool check_sim_object_awake(SimObject *p, uint64_t tick) {
+    if(!p->sim_sleeping) [[likely]] return true;
+    if(sim_object_wakeup_requested(p) || (p->sim_wakeup_tick && p->sim_wakeup_tick <= tick)) {
+        p->sim_sleeping = false;
+        return true;
+    }
+    return false;
+}
+
+// 对象在周期tick开始时是否仍保持休眠
+inline bool check_sim_object_keep_sleeping(SimObject *p, uint64_t tick) {
+    return (p->sim_sleeping && !sim_object_wakeup_requested(p) && !(p->sim_wakeup_tick && p->sim_wakeup_tick <= tick));
+}
+
+/**
+ * 所有线程的所有对象都保持休眠时，没有任何对象会在定时唤醒之前改变状态，
+ * 此时直接将current_tick推进到最早的定时唤醒周期。没有定时唤醒时（例如只在等待host IO），仍然逐周期执行。
+ * 每个线程在sync_apl之后读取所有线程的结果，因此所有线程会得到相同的结论。
+ * @return 跳过的周期数
+ */
+uint64_t check_global_fast_forward(uint64_t tick) {
+    uint64_t target = 0;
+    for(int i = 0; i < root->thread_num; i++) {
+        SimRootThreadTask &t = root->tasks[i];
+        if(!t.quiescent) return 0;
+        if(t.next_wakeup_tick && (target == 0 || t.next_wakeup_tick < target)) target = t.next_wakeup_tick;
+    }
+    if(target <= tick) return 0;
+    return target - tick;
+}
+
+/**
+ * 按采样得到的开销重新分配对象到各线程（LPT贪心：开销大的组优先放到当前负载最小的线程）。
+ * 通过add_sim_object连续加入的对象属于同一组，launch时默认它们在同一线程中执行（例如CPU直接驱动L1/L2），
+ * 因此只在组之间迁移。新分配使最重线程的负载降低超过10%时才迁移，避免采样噪声导致对象来回迁移。
+ * 只能在所有线程都停在屏障处时由线程0调用。
+ */
+void rebalance_tasks() {
+    std::map<uint32_t, uint64_t> group_cost;
+    std::map<uint32_t, uint32_t> old_thread;
+    std::vector<uint64_t> old_load(root->thread_num, 0);
+    for(uint32_t i = 0; i < root->thread_num; i++) {
+        for(auto &entry : root->tasks[i].simobjs) {
+            group_cost[entry.group] += entry.cost;
+            old_thread[entry.group] = i;
+            old_load[i] += entry.cost;
+            entry.cost = 0;
+        }
+    }
+    root->balance_cnt++;
+
+    std::vector<std::pair<uint64_t, uint32_t>> order;
+    for(auto &g : group_cost) order.emplace_back(g.second, g.first);
+    std::stable_sort(order.begin(), order.end(), [](auto &a, auto &b) { return a.first > b.first; });
+
+    std::vector<uint64_t> load(root->thread_num, 0);
+    std::map<uint32_t, uint32_t> new_thread;
+    for(auto &o : order) {
+        uint32_t dst = std::min_element(load.begin(), load.end()) - load.begin();
+        load[dst] += o.first;
+        new_thread[o.second] = dst;
+    }
+
+    uint64_t old_max = *std::max_element(old_load.begin(), old_load.end());
+    uint64_t new_max = *std::max_element(load.begin(), load.end());
+    if(new_max * 10 >= old_max * 9) return;
+
+    std::vector<SimObjectWithFreq> all;
+    for(uint32_t i = 0; i < root->thread_num; i++) {
+        SimRootThreadTask &t = root->tasks[i];
+        all.insert(all.end(), t.simobjs.begin(), t.simobjs.end());
+        t.simobjs.clear();
+        t.cur_sum = t.apl_sum = 0;
+    }
+    for(auto &g : new_thread) {
+        if(g.second != old_thread[g.first]) {
+            root->balance_migrate_cnt++;
+        }
+    }
+    for(auto &entry : all) {
+        uint32_t dst = new_thread[entry.group];
+        if(dst != old_thread[entry.group]) {
+            print_log_info("Migrate " + entry.name + " to Thread " + std::to_string(dst));
+        }
+        SimRootThreadTask &t = root->tasks[dst];
+        t.cur_sum += entry.p_obj->do_on_current_tick;
+        t.apl_sum += entry.p_obj->do_apply_next_tick;
+        t.simobjs.push_back(entry);
+    }
+}
+
+void update_1mtick_real_time() {
+    if(root->current_tick - root->last_1mtick_tick >= 1000000) [[unlikely]] {
+        root->last_1mtick_tick = root->current_tick;
+        uint64_t rt = get_current_time_us();
+        if(root->last_1mtick_real_time_us == 0) {
+            root->last_1mtick_real_time_us = rt;
+        }
+        else {
+            uint64_t interval = rt - root->last_1mtick_real_time_us;
+            root->last_1mtick_real_time_us = rt;
+            if(root->last_1mtick_real_time_interval_us == 0) {
+                root->last_1mtick_real_time_interval_us = interval;
+            }
+            else {
+                root->last_1mtick_real_time_interval_us = interval / 2 + root->last_1mtick_real_time_interval_us / 2;
+            }
+        }
+    }
+}
 
 void* simroot_thread_function(void *param) {
     uint64_t index = (uint64_t)param;
@@ -192,60 +409,178 @@ void* simroot_thread_function(void *param) {
     }
     print_log_info(s);
 
+    SimRootThreadTask &task = root->tasks[index];
+    const uint64_t quantum = root->sync_quantum;
+
+    // 模拟线程使用自己的周期计数，只在同步点与其他线程对齐
+    uint64_t tick = root->current_tick;
+    is_sim_thread = true;
+
     while(root->is_processing) {
+
+        // 同步周期大于1时没有sync_cur，需要等所有线程读取完is_processing与静止标志后才能开始下一个同步周期
+        if(quantum > 1) sync_cur();
         
-        for(auto &entry : root->tasks[index].simobjs) {
-            if(entry.current == 0 && entry.p_obj->do_on_current_tick) {
-                entry.p_obj->on_current_tick();
+        bool sample = (((tick / quantum) % root->sample_interval) == 0);
+        uint64_t tick_start = (sample?get_host_cycle():0);
+        uint64_t wait_start = 0;
+        // 同步周期内执行过的对象可能唤醒了其他线程中已完成检查的对象，因此只有整个同步周期都在休眠的对象才视为静止
+        bool quiescent = root->fast_forward;
+        uint64_t next_wakeup_tick = 0;
+
+        for(uint64_t q = 0; q < quantum; q++, tick++) {
+            sim_thread_tick = tick;
+
+            for(auto &entry : task.simobjs) {
+                if(entry.current == 0) {
+                    task.obj_tick_cnt++;
+                    if(!check_sim_object_awake(entry.p_obj, tick)) {
+                        task.obj_tick_skipped_cnt++;
+                        continue;
+                    }
+                    if(entry.p_obj->do_on_current_tick) {
+                        if(sample) [[unlikely]] {
+                            uint64_t t0 = get_host_cycle();
+                            entry.p_obj->on_current_tick();
+                            entry.cost += get_host_cycle() - t0;
+                        }
+                        else entry.p_obj->on_current_tick();
+                    }
+                }
             }
-        }
-
-        sync_cur();
 
-        for(auto &entry : root->tasks[index].simobjs) {
-            if(entry.current == 0) {
-                if(entry.p_obj->do_apply_next_tick) entry.p_obj->apply_next_tick();
-                entry.current = entry.latency;
+            // 同步周期大于1时线程间只在同步周期结束时对齐，线程内仍然先执行所有对象的on_current_tick
+            if(quantum == 1) {
+                if(sample) [[unlikely]] wait_start = get_host_cycle();
+                sync_cur();
+                if(sample) [[unlikely]] task.barrier_wait_cycles += get_host_cycle() - wait_start;
             }
-            entry.current--;
-        }
-        
-        if(index == 0) {
-            root->current_tick++;
-            if(root->current_tick % 1000000 == 0) [[unlikely]] {
-                uint64_t rt = get_current_time_us();
-                if(root->last_1mtick_real_time_us == 0) {
-                    root->last_1mtick_real_time_us = rt;
-                }
-                else {
-                    uint64_t interval = rt - root->last_1mtick_real_time_us;
-                    root->last_1mtick_real_time_us = rt;
-                    if(root->last_1mtick_real_time_interval_us == 0) {
-                        root->last_1mtick_real_time_interval_us = interval;
+
+            next_wakeup_tick = 0;
+            for(auto &entry : task.simobjs) {
+                SimObject *p = entry.p_obj;
+                bool slept = p->sim_sleeping;
+                if(entry.current == 0) {
+                    if(check_sim_object_awake(p, tick) && p->do_apply_next_tick) {
+                        if(sample) [[unlikely]] {
+                            uint64_t t0 = get_host_cycle();
+                            p->apply_next_tick();
+                            entry.cost += get_host_cycle() - t0;
+                        }
+                        else p->apply_next_tick();
                     }
-                    else {
-                        root->last_1mtick_real_time_interval_us = interval / 2 + root->last_1mtick_real_time_interval_us / 2;
+                    entry.current = entry.latency;
+                }
+                entry.current--;
+                if(quiescent) {
+                    quiescent = slept && check_sim_object_keep_sleeping(p, tick + 1);
+                    if(p->sim_wakeup_tick && (next_wakeup_tick == 0 || p->sim_wakeup_tick < next_wakeup_tick)) {
+                        next_wakeup_tick = p->sim_wakeup_tick;
                     }
                 }
             }
+
+            if(index == 0) {
+                root->current_tick.store(tick + 1, std::memory_order_relaxed);
+                update_1mtick_real_time();
+            }
         }
-        if(root->tasks[index].do_clear_statistic) {
-            for(auto &entry : root->tasks[index].simobjs) {
+        sim_thread_tick = tick;
+        task.quiescent = quiescent;
+        task.next_wakeup_tick = next_wakeup_tick;
+
+        if(task.do_clear_statistic) {
+            for(auto &entry : task.simobjs) {
                 entry.p_obj->clear_statistic();
             }
-            root->tasks[index].do_clear_statistic = false;
+            task.obj_tick_cnt = task.obj_tick_skipped_cnt = 0;
+            task.sampled_cycles = task.barrier_wait_cycles = 0;
+            if(index == 0) {
+                root->fast_forward_cnt = root->fast_forward_tick_cnt = 0;
+                root->balance_cnt = root->balance_migrate_cnt = 0;
+            }
+            task.do_clear_statistic = false;
+            sample = false;
         }
 
+        if(sample) [[unlikely]] wait_start = get_host_cycle();
         sync_apl();
+        if(sample) [[unlikely]] {
+            uint64_t t1 = get_host_cycle();
+            task.barrier_wait_cycles += t1 - wait_start;
+            task.sampled_cycles += t1 - tick_start;
+        }
+
+        if(root->fast_forward) {
+            uint64_t skip = check_global_fast_forward(tick);
+            if(skip) [[unlikely]] {
+                for(auto &entry : task.simobjs) {
+                    if(entry.latency > 1) {
+                        entry.current = (entry.current + entry.latency - (skip % entry.latency)) % entry.latency;
+                    }
+                }
+                tick += skip;
+                sim_thread_tick = tick;
+                if(index == 0) {
+                    root->current_tick = tick;
+                    root->last_1mtick_tick += skip;
+                    root->fast_forward_cnt++;
+                    root->fast_forward_tick_cnt += skip;
+                }
+                sync_ff();
+            }
+        }
+
+        if(root->balance_interval && tick >= root->next_balance_tick) [[unlikely]] {
+            sync_balance();
+            if(index == 0) {
+                rebalance_tasks();
+                root->next_balance_tick = tick + root->balance_interval;
+            }
+            sync_balance();
+        }
 
     }
 
+    is_sim_thread = false;
+
     std::string s2 = "Simulator Thread " + std::to_string(index) + " Exited";
     print_log_info(s2);
 
     return nullptr;
 }
 
+void print_simroot_statistic(std::ofstream &ofile) {
+    char buf[128];
+    uint64_t total = 0, skipped = 0;
+    ofile << "SimRoot\n";
+    for(int i = 0; i < root->thread_num; i++) {
+        SimRootThreadTask &t = root->tasks[i];
+        total += t.obj_tick_cnt;
+        skipped += t.obj_tick_skipped_cnt;
+        sprintf(buf, "thread_%d_skipped_object_tick_rate: %f\n", i, (t.obj_tick_cnt)?(((double)t.obj_tick_skipped_cnt) / t.obj_tick_cnt):0.);
+        ofile << buf;
+        sprintf(buf, "thread_%d_barrier_wait_rate: %f\n", i, (t.sampled_cycles)?(((double)t.barrier_wait_cycles) / t.sampled_cycles):0.);
+        ofile << buf;
+    }
+    sprintf(buf, "total_object_tick_count: %ld\n", total);
+    ofile << buf;
+    sprintf(buf, "skipped_object_tick_count: %ld\n", skipped);
+    ofile << buf;
+    sprintf(buf, "skipped_object_tick_rate: %f\n", (total)?(((double)skipped) / total):0.);
+    ofile << buf;
+    sprintf(buf, "fast_forward_count: %ld\n", root->fast_forward_cnt);
+    ofile << buf;
+    sprintf(buf, "fast_forward_tick_count: %ld\n", root->fast_forward_tick_cnt);
+    ofile << buf;
+    sprintf(buf, "sync_quantum: %ld\n", root->sync_quantum);
+    ofile << buf;
+    sprintf(buf, "balance_count: %ld\n", root->balance_cnt);
+    ofile << buf;
+    sprintf(buf, "balance_migrate_group_count: %ld\n", root->balance_migrate_cnt);
+    ofile << buf;
+}
+
 void start_sim() {
     
     init_simroot();
@@ -262,6 +597,21 @@ void start_sim() {
         setup_log_file.close();
     }
 
+    // 只有一个线程有对象时不存在跨线程通信，同步周期不受限制
+    uint32_t busy_thread_cnt = 0;
+    for(int i = 0; i < root->thread_num; i++) {
+        if(!root->tasks[i].simobjs.empty()) busy_thread_cnt++;
+    }
+    root->sync_quantum = root->conf_sync_quantum;
+    if(busy_thread_cnt > 1 && root->sync_quantum > root->cross_thread_lookahead) {
+        print_log_info("sync_quantum " + std::to_string(root->sync_quantum) + " is limited by cross thread lookahead " + std::to_string(root->cross_thread_lookahead));
+        root->sync_quantum = root->cross_thread_lookahead;
+    }
+    root->cross_thread_latency = ((busy_thread_cnt > 1)?root->cross_thread_lookahead:0);
+    for(auto &entry: root->all_sim_objs) {
+        entry.p_obj->on_sim_start();
+    }
+
     root->is_processing = true;
     for(int i = 0; i < root->thread_num; i++) {
         root->tasks[i].do_clear_statistic = false;
@@ -274,6 +624,10 @@ void start_sim() {
 
     {
         std::ofstream statistic_log_file(log_dir + "/statistic.txt", std::ios::out);
+        print_simroot_statistic(statistic_log_file);
+        statistic_log_file << std::endl;
+        objpool::print_statistic(statistic_log_file);
+        statistic_log_file << std::endl;
         for(auto &entry: root->all_sim_objs) {
             statistic_log_file << entry.name << std::string(" Latency:") << std::to_string(entry.latency) << std::string("\n");
             entry.p_obj->print_statistic(statistic_log_file);
@@ -384,8 +738,9 @@ void set_current_tick(uint64_t tick) {
 }
 
 uint64_t get_current_tick() {
+    if(is_sim_thread) [[likely]] return sim_thread_tick;
     init_simroot();
-    return root->current_tick;
+    return root->current_tick.load(std::memory_order_relaxed);
 }
 
 uint64_t get_wall_time_tick() {
@@ -423,12 +778,146 @@ uint64_t get_sim_tick_per_real_sec() {
 }
 
 
+uint64_t SimObject::sim_tick_for_wakeup() {
+    return simroot::get_current_tick();
+}
+
 namespace test{
 
+class TestTickCounter : public SimObject {
+public:
+    uint64_t cur_cnt = 0;
+    uint64_t apl_cnt = 0;
+    virtual void on_current_tick() { cur_cnt++; };
+    virtual void apply_next_tick() { apl_cnt++; };
+};
+
+// 每次运行后定时休眠interval个周期，运行limit次后结束模拟
+class TestTimedSleeper : public SimObject {
+public:
+    TestTimedSleeper(uint64_t interval, uint64_t limit) : interval(interval), limit(limit) { do_on_current_tick = 0; };
+    uint64_t interval = 0;
+    uint64_t limit = 0;
+    uint64_t run_cnt = 0;
+    uint64_t next_tick = 0;
+    uint64_t ff_tick_cnt = 0;   // 结束时已跳过的周期数，start_sim返回前会清空统计
+    bool early = false;
+    virtual void apply_next_tick() {
+        uint64_t tick = simroot::get_current_tick();
+        if(run_cnt >= limit) return; // 同步周期大于1时结束模拟后仍会执行到同步周期结束
+        if(run_cnt && tick < next_tick) early = true;
+        run_cnt++;
+        if(run_cnt >= limit) {
+            ff_tick_cnt = simroot::root->fast_forward_tick_cnt;
+            simroot::stop_sim_and_exit();
+            return;
+        }
+        next_tick = tick + interval;
+        sim_sleep(next_tick);
+    };
+};
+
+// 第一次运行后无定时休眠，只能被TestWakeupDriver唤醒
+class TestWakeupWaiter : public SimObject {
+public:
+    TestWakeupWaiter() { do_on_current_tick = 0; };
+    uint64_t run_cnt = 0;
+    virtual void apply_next_tick() {
+        run_cnt++;
+        sim_sleep();
+    };
+};
+
+// 在wakeup_tick唤醒waiter，在stop_tick结束模拟
+class TestWakeupDriver : public SimObject {
+public:
+    TestWakeupDriver(TestWakeupWaiter *waiter, uint64_t wakeup_tick, uint64_t stop_tick)
+    : waiter(waiter), wakeup_tick(wakeup_tick), stop_tick(stop_tick) { do_on_current_tick = 0; };
+    TestWakeupWaiter *waiter = nullptr;
+    uint64_t wakeup_tick = 0;
+    uint64_t stop_tick = 0;
+    uint64_t waiter_run_before_wakeup = 0;
+    virtual void apply_next_tick() {
+        uint64_t tick = simroot::get_current_tick();
+        if(tick == wakeup_tick) {
+            waiter_run_before_wakeup = waiter->run_cnt;
+            waiter->sim_wakeup();
+        }
+        if(tick == stop_tick) simroot::stop_sim_and_exit();
+    };
+};
 
 bool test_simroot() {
-    
-    return false;
+    simroot::init_simroot();
+    simroot::SimRoot *root = simroot::root;
+    bool ret = true;
+
+    // 没有收到唤醒请求的对象不能因为在第0/1周期休眠而被误唤醒，需要在模拟开始时运行
+    {
+        // 唤醒判断保留了余量，被唤醒后再次休眠时可能多运行一次
+        TestWakeupWaiter waiter;
+        uint64_t start = root->current_tick;
+        TestWakeupDriver driver(&waiter, start + 1000, start + 2000);
+        simroot::add_sim_object(&waiter, "Waiter", 1);
+        simroot::add_sim_object(&driver, "Driver", 1);
+        simroot::start_sim();
+        printf("Waiter: run %ld times before wakeup, %ld times in total\n", driver.waiter_run_before_wakeup, waiter.run_cnt);
+        if(driver.waiter_run_before_wakeup != 1 || waiter.run_cnt < 2) {
+            printf("Waiter woke up without a wakeup request\n");
+            ret = false;
+        }
+    }
+
+    // 只有定时休眠的对象时，空闲周期应被整体跳过
+    {
+        TestTimedSleeper sleeper(100000, 100);
+        uint64_t start = root->current_tick;
+        simroot::add_sim_object(&sleeper, "Sleeper", 1);
+        simroot::start_sim();
+        uint64_t elapsed = root->current_tick - start;
+        printf("Sleeper: run %ld times in %ld ticks\n", sleeper.run_cnt, elapsed);
+        if(sleeper.run_cnt != sleeper.limit || sleeper.early) {
+            printf("Sleeper woke up at wrong tick\n");
+            ret = false;
+        }
+        if(elapsed < (sleeper.limit - 1) * sleeper.interval) {
+            printf("Ticks lost during fast-forward\n");
+            ret = false;
+        }
+        if(root->fast_forward && sleeper.ff_tick_cnt == 0) {
+            printf("No fast-forward happened\n");
+            ret = false;
+        }
+    }
+
+    // 存在不休眠的对象时不能跳过周期，且on_current_tick与apply_next_tick成对执行，放宽同步后结果不变
+    uint64_t conf_quantum = root->conf_sync_quantum;
+    for(uint64_t quantum : {1UL, 8UL}) {
+        TestTimedSleeper sleeper(100, 10);
+        std::vector<TestTickCounter> counters(root->thread_num * 2);
+        uint64_t start = root->current_tick;
+        for(int i = 0; i < counters.size(); i++) {
+            simroot::add_sim_object_next_thread(&(counters[i]), "Counter" + std::to_string(i), 1);
+        }
+        simroot::add_sim_object(&sleeper, "Sleeper", 1);
+        root->conf_sync_quantum = quantum;
+        simroot::set_cross_thread_lookahead(quantum);
+        simroot::start_sim();
+        uint64_t elapsed = root->current_tick - start;
+        if(sleeper.run_cnt != sleeper.limit || sleeper.early) {
+            printf("Sleeper woke up at wrong tick with quantum %ld\n", quantum);
+            ret = false;
+        }
+        for(auto &c : counters) {
+            if(c.cur_cnt != c.apl_cnt || c.apl_cnt < elapsed) {
+                printf("Counter: cur %ld, apl %ld in %ld ticks with quantum %ld\n", c.cur_cnt, c.apl_cnt, elapsed, quantum);
+                ret = false;
+            }
+        }
+    }
+    root->conf_sync_quantum = conf_quantum;
+
+    return ret;
 }
 
 }
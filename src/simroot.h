@@ -36,6 +36,25 @@ namespace simroot {
 void add_sim_object(SimObject *p_obj, std::string name, int latency=1);
 void add_sim_object_next_thread(SimObject *p_obj, std::string name, int latency=1);
 
+/**
+ * 声明不同线程的对象之间最短的通信延迟（周期），root.sync_quantum不会超过该值，
+ * 从而保证线程间放宽同步后结果不变。未声明时认为不同线程的对象之间每周期都可能通信。
+ */
+void set_cross_thread_lookahead(uint64_t latency);
+
+/**
+ * 跨线程通道（如总线端口）应使用的最小延迟：有多个线程运行对象时为声明的lookahead，否则为0。
+ * 通道的写入与释放都延迟该周期数后才对另一端可见，使结果与线程间的执行先后无关。
+ * 在start_sim调用各对象的on_sim_start之前确定。
+ */
+uint64_t get_cross_thread_latency();
+
+/**
+ * 测试用：替换模拟线程数与root.sync_quantum，只能在没有注册对象且模拟未运行时调用
+ */
+void set_sim_thread_num(uint32_t thread_num);
+void set_sync_quantum(uint64_t quantum);
+
 void clear_sim_object();
 
 void start_sim();
@@ -0,0 +1,359 @@
+// MIT License
+
+// Copyright (c) 2024 Meng Chengzhen, in Shandong University
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include "hostio.h"
+#include "simroot.h"
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <poll.h>
+
+void HostIOReactor::start(std::function<void()> notify) {
+    simroot_assert(!running);
+    this->notify = notify;
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    simroot_assertf(epfd >= 0, "HostIOReactor: epoll_create1 failed: %d", errno);
+    evfd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    simroot_assertf(evfd >= 0, "HostIOReactor: eventfd failed: %d", errno);
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.fd = evfd;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, evfd, &ev);
+    running = true;
+    pthread_create(&th, nullptr, __thread_function, this);
+}
+
+void HostIOReactor::stop() {
+    if(!running) return;
+    stopping = true;
+    uint64_t one = 1;
+    [[maybe_unused]] ssize_t n = write(evfd, &one, sizeof(one));
+    pthread_join(th, nullptr);
+    close(evfd);
+    close(epfd);
+    running = false;
+}
+
+void *HostIOReactor::__thread_function(void *param) {
+    ((HostIOReactor*)param)->__loop();
+    return nullptr;
+}
+
+void HostIOReactor::__loop() {
+    const int MAX_EVENTS = 64;
+    struct epoll_event evs[MAX_EVENTS];
+    while(!stopping) {
+        int n = epoll_wait(epfd, evs, MAX_EVENTS, -1);
+        if(n < 0) {
+            simroot_assertf(errno == EINTR, "HostIOReactor: epoll_wait failed: %d", errno);
+            continue;
+        }
+        wakeup_cnt++;
+        bool done = false;
+        mtx.lock();
+        for(int i = 0; i < n; i++) {
+            int fd = evs[i].data.fd;
+            if(fd == evfd) {
+                uint64_t v = 0;
+                [[maybe_unused]] ssize_t r = read(evfd, &v, sizeof(v));
+                continue;
+            }
+            auto w = watches.find(fd);
+            if(w == watches.end()) continue;
+            vector<uint64_t> ids(w->second.ids.begin(), w->second.ids.end());
+            for(auto id : ids) {
+                auto r = requests.find(id);
+                if(r == requests.end()) continue;
+                int64_t ret = 0;
+                if(r->second.func(&ret)) {
+                    __finish_nolock(id, ret);
+                    done = true;
+                }
+                else {
+                    retry_fail_cnt++;
+                }
+            }
+        }
+        mtx.unlock();
+        if(done && notify) notify();
+    }
+}
+
+void HostIOReactor::__update_watch(int fd) {
+    auto w = watches.find(fd);
+    struct epoll_event ev;
+    ev.data.fd = fd;
+    if(w == watches.end()) {
+        return;
+    }
+    if(w->second.ids.empty()) {
+        epoll_ctl(epfd, EPOLL_CTL_DEL, fd, &ev);
+        watches.erase(w);
+        return;
+    }
+    uint32_t events = 0;
+    for(auto id : w->second.ids) {
+        for(auto &f : requests[id].fds) {
+            if(f.fd == fd) events |= f.events;
+        }
+    }
+    events &= (EPOLLIN | EPOLLOUT | EPOLLPRI | EPOLLRDHUP);
+    ev.events = events;
+    if(w->second.events == 0) {
+        // 普通文件不支持epoll，但总是就绪，由登记时的立即尝试完成
+        if(epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) && errno == EEXIST) epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &ev);
+    }
+    else if(w->second.events != events) {
+        // fd关闭后epoll自动移除该fd，同一个编号被重新打开时需要重新添加
+        if(epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &ev) && errno == ENOENT) epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+    }
+    w->second.events = events;
+}
+
+void HostIOReactor::__finish_nolock(uint64_t id, int64_t ret) {
+    auto r = requests.find(id);
+    if(r == requests.end()) return;
+    vector<IOFd> fds;
+    fds.swap(r->second.fds);
+    requests.erase(r);
+    for(auto &f : fds) {
+        auto w = watches.find(f.fd);
+        if(w == watches.end()) continue;
+        w->second.ids.erase(id);
+        __update_watch(f.fd);
+    }
+    completed.emplace_back(id, ret);
+}
+
+void HostIOReactor::submit(uint64_t id, vector<IOFd> &fds, IOFunc func) {
+    simroot_assert(running);
+    mtx.lock();
+    simroot_assertf(requests.find(id) == requests.end(), "HostIOReactor: Request 0x%lx already exists", id);
+    requests.emplace(id, Request{.fds = fds, .func = func});
+    for(auto &f : fds) {
+        watches[f.fd].ids.insert(id);
+        __update_watch(f.fd);
+    }
+    // fd可能在登记之前已经就绪
+    int64_t ret = 0;
+    bool done = func(&ret);
+    if(done) __finish_nolock(id, ret);
+    mtx.unlock();
+    if(done && notify) notify();
+}
+
+bool HostIOReactor::cancel(uint64_t id) {
+    mtx.lock();
+    auto r = requests.find(id);
+    bool ret = (r != requests.end());
+    if(ret) {
+        vector<IOFd> fds;
+        fds.swap(r->second.fds);
+        requests.erase(r);
+        for(auto &f : fds) {
+            auto w = watches.find(f.fd);
+            if(w == watches.end()) continue;
+            w->second.ids.erase(id);
+            __update_watch(f.fd);
+        }
+    }
+    mtx.unlock();
+    return ret;
+}
+
+void HostIOReactor::pop_completed(vector<std::pair<uint64_t, int64_t>> &out) {
+    out.clear();
+    mtx.lock();
+    out.swap(completed);
+    mtx.unlock();
+}
+
+void SimTimerWheel::add(uint64_t id, uint64_t tick) {
+    remove(id);
+    if(tick < current) tick = current;
+    Slot &s = slots[tick & slot_mask];
+    s.emplace_front(tick, id);
+    index.emplace(id, s.begin());
+}
+
+void SimTimerWheel::remove(uint64_t id) {
+    auto res = index.find(id);
+    if(res == index.end()) return;
+    slots[res->second->first & slot_mask].erase(res->second);
+    index.erase(res);
+}
+
+void SimTimerWheel::expire(uint64_t tick, vector<uint64_t> &out) {
+    out.clear();
+    if(tick < current) return;
+    uint64_t cnt = std::min<uint64_t>(tick - current + 1, slots.size());
+    for(uint64_t i = 0; i < cnt && !index.empty(); i++) {
+        Slot &s = slots[(current + i) & slot_mask];
+        for(auto iter = s.begin(); iter != s.end(); ) {
+            if(iter->first <= tick) {
+                out.push_back(iter->second);
+                index.erase(iter->second);
+                iter = s.erase(iter);
+            }
+            else iter++;
+        }
+    }
+    current = tick + 1;
+}
+
+uint64_t SimTimerWheel::next_deadline() {
+    if(index.empty()) return 0;
+    // 一圈之内到期的定时器一定位于从current开始的第一个含有本圈定时器的槽
+    uint64_t round_end = current + slots.size();
+    for(uint64_t t = current; t < round_end; t++) {
+        for(auto &e : slots[t & slot_mask]) {
+            if(e.first < round_end) return e.first;
+        }
+    }
+    uint64_t ret = UINT64_MAX;
+    for(auto &e : index) ret = std::min(ret, e.second->first);
+    return ret;
+}
+
+namespace test {
+
+bool test_host_io() {
+    SimTimerWheel tw(4);
+    std::multimap<uint64_t, uint64_t> ref;
+    std::unordered_map<uint64_t, uint64_t> ref_tick;
+    vector<uint64_t> out;
+
+    srand(4321);
+    uint64_t tick = 0;
+    for(uint64_t round = 0; round < 100000; round++) {
+        uint32_t op = rand() % 4;
+        if(op == 0) {
+            uint64_t id = rand() % 64;
+            uint64_t t = tick + 1 + (rand() % ((rand() & 1)?8:100));
+            if(ref_tick.count(id)) {
+                for(auto iter = ref.begin(); iter != ref.end(); iter++) {
+                    if(iter->second == id) {
+                        ref.erase(iter);
+                        break;
+                    }
+                }
+            }
+            tw.add(id, t);
+            ref.emplace(t, id);
+            ref_tick[id] = t;
+        }
+        else if(op == 1) {
+            uint64_t id = rand() % 64;
+            tw.remove(id);
+            if(ref_tick.count(id)) {
+                for(auto iter = ref.begin(); iter != ref.end(); iter++) {
+                    if(iter->second == id) {
+                        ref.erase(iter);
+                        break;
+                    }
+                }
+                ref_tick.erase(id);
+            }
+        }
+        else {
+            uint64_t expect_next = (ref.empty()?0:ref.begin()->first);
+            if(tw.next_deadline() != expect_next) {
+                printf("Next deadline %ld, expect %ld\n", tw.next_deadline(), expect_next);
+                return false;
+            }
+            tick += ((op == 2)?1:(rand() % 40));
+            tw.expire(tick, out);
+            std::set<uint64_t> got(out.begin(), out.end());
+            std::set<uint64_t> expect;
+            while(!ref.empty() && ref.begin()->first <= tick) {
+                expect.insert(ref.begin()->second);
+                ref_tick.erase(ref.begin()->second);
+                ref.erase(ref.begin());
+            }
+            if(got != expect || got.size() != out.size()) {
+                printf("Expired timers mismatch at tick %ld: %ld, expect %ld\n", tick, out.size(), expect.size());
+                return false;
+            }
+        }
+        if(tw.size() != ref.size()) {
+            printf("Timer count mismatch: %ld, expect %ld\n", tw.size(), ref.size());
+            return false;
+        }
+    }
+
+    // 事件循环：多个请求等待同一个管道，每次写入唤醒一个读请求，取消的请求不会完成
+    int pfd[2];
+    simroot_assert(pipe(pfd) == 0);
+    HostIOReactor io;
+    std::atomic<uint32_t> notified = 0;
+    io.start([&]() { notified++; });
+    const uint64_t reqcnt = 4;
+    uint8_t bufs[reqcnt] = {};
+    vector<HostIOReactor::IOFd> fds = {HostIOReactor::IOFd{.fd = pfd[0], .events = POLLIN}};
+    for(uint64_t i = 0; i < reqcnt; i++) {
+        uint8_t *b = &(bufs[i]);
+        io.submit(i, fds, [=](int64_t *ret) -> bool {
+            struct pollfd p = {.fd = pfd[0], .events = POLLIN, .revents = 0};
+            if(poll(&p, 1, 0) <= 0) return false;
+            *ret = read(pfd[0], b, 1);
+            return true;
+        });
+    }
+    if(!io.cancel(reqcnt - 1) || io.cancel(reqcnt)) {
+        printf("Cancel result mismatch\n");
+        return false;
+    }
+    vector<std::pair<uint64_t, int64_t>> done, all;
+    for(uint8_t i = 0; i < reqcnt - 1; i++) {
+        uint8_t v = 0x10 + i;
+        simroot_assert(write(pfd[1], &v, 1) == 1);
+        uint64_t t0 = get_current_time_us();
+        while(all.size() <= i && get_current_time_us() - t0 < 1000000UL) {
+            io.pop_completed(done);
+            all.insert(all.end(), done.begin(), done.end());
+        }
+    }
+    io.stop();
+    close(pfd[0]);
+    close(pfd[1]);
+    if(all.size() != reqcnt - 1 || notified.load() < reqcnt - 1) {
+        printf("Completed %ld requests, notified %d\n", all.size(), notified.load());
+        return false;
+    }
+    std::set<uint8_t> vals;
+    for(auto &e : all) {
+        if(e.first >= reqcnt - 1 || e.second != 1) {
+            printf("Bad completion (%ld, %ld)\n", e.first, e.second);
+            return false;
+        }
+        vals.insert(bufs[e.first]);
+    }
+    if(vals.size() != reqcnt - 1 || *vals.begin() != 0x10) {
+        printf("Pipe data mismatch\n");
+        return false;
+    }
+    return true;
+}
+
+}
@@ -0,0 +1,128 @@
+// MIT License
+
+// Copyright (c) 2024 Meng Chengzhen, in Shandong University
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#ifndef RVSIM_SYS_HOST_IO_H
+#define RVSIM_SYS_HOST_IO_H
+
+#include "common.h"
+
+#include <functional>
+#include <mutex>
+
+/**
+ * 宿主IO事件循环：所有阻塞在宿主fd上的系统调用共用一个宿主线程，通过epoll等待fd就绪
+ * fd就绪后在事件线程中调用请求的IOFunc以非阻塞方式重试一次，完成的请求放入完成队列并调用notify，
+ * 由模拟系统在自己的周期中取出完成结果并唤醒模拟线程
+ * 请求的超时由模拟系统按模拟周期判断，不在事件线程中计时
+ */
+class HostIOReactor {
+public:
+    // 尝试执行一次非阻塞操作，未就绪时返回false，完成时返回true并通过ret输出系统调用返回值
+    typedef std::function<bool(int64_t *ret)> IOFunc;
+    typedef struct {
+        int         fd = -1;
+        uint32_t    events = 0;     // POLLIN/POLLOUT/POLLPRI，与EPOLLIN/EPOLLOUT/EPOLLPRI取值相同
+    } IOFd;
+
+    HostIOReactor() {};
+    ~HostIOReactor() { stop(); };
+
+    void start(std::function<void()> notify);
+    void stop();
+
+    /**
+     * 登记一个以id标识的请求，fds中任一fd就绪后调用func，登记时也会立即尝试一次
+     */
+    void submit(uint64_t id, vector<IOFd> &fds, IOFunc func);
+    /**
+     * 取消请求，返回false表示请求已经完成（结果在完成队列中或已被取出）
+     */
+    bool cancel(uint64_t id);
+    // 取出所有已完成的请求(id, ret)
+    void pop_completed(vector<std::pair<uint64_t, int64_t>> &out);
+
+    std::atomic<uint64_t> wakeup_cnt = 0;       // epoll返回的次数
+    std::atomic<uint64_t> retry_fail_cnt = 0;   // fd就绪但重试操作仍未完成的次数
+
+protected:
+    typedef struct {
+        vector<IOFd>    fds;
+        IOFunc          func;
+    } Request;
+    typedef struct {
+        uint32_t        events = 0;
+        std::set<uint64_t> ids;
+    } FdWatch;
+
+    std::mutex mtx;
+    unordered_map<uint64_t, Request> requests;
+    unordered_map<int, FdWatch> watches;
+    vector<std::pair<uint64_t, int64_t>> completed;
+    std::function<void()> notify;
+
+    int epfd = -1;
+    int evfd = -1;
+    pthread_t th;
+    bool running = false;
+    std::atomic<bool> stopping = false;
+
+    static void *__thread_function(void *param);
+    void __loop();
+
+    void __update_watch(int fd);
+    void __finish_nolock(uint64_t id, int64_t ret);
+};
+
+/**
+ * 以模拟周期计时的散列计时轮，每个槽对应一个周期，超过一圈的定时器在到期前保留在槽中
+ * 定时器以id标识，每个id同时最多有一个定时器
+ */
+class SimTimerWheel {
+public:
+    SimTimerWheel(uint32_t slot_bits = 10) : slot_mask((1UL << slot_bits) - 1), slots(1UL << slot_bits) {};
+
+    void add(uint64_t id, uint64_t tick);
+    void remove(uint64_t id);
+    // 取出所有在tick及之前到期的定时器，按槽的顺序输出
+    void expire(uint64_t tick, vector<uint64_t> &out);
+    // 最早的到期周期，没有定时器时返回0
+    uint64_t next_deadline();
+
+    inline uint64_t size() { return index.size(); };
+
+protected:
+    typedef std::list<std::pair<uint64_t, uint64_t>> Slot; // (到期周期, id)
+
+    uint64_t slot_mask = 0;
+    vector<Slot> slots;
+    unordered_map<uint64_t, Slot::iterator> index;
+    uint64_t current = 0;   // 下一个需要检查的周期
+};
+
+namespace test {
+
+bool test_host_io();
+
+}
+
+#endif
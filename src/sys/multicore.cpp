@@ -54,6 +54,8 @@ void SimSystemMultiCore::init(SimWorkload &workload, std::vector<CPUInterface*>
             .exec_thread = nullptr
         });
     }
+    simroot_assertf(cpu_num <= 64, "Too many CPUs for the affinity mask: %d", cpu_num);
+    run_queues.resize(cpu_num);
 
     this->dma = dma;
 
@@ -73,10 +75,17 @@ void SimSystemMultiCore::init(SimWorkload &workload, std::vector<CPUInterface*>
     log_info = conf::get_int("sys", "log_info_to_stdout", 0);
     log_syscall = conf::get_int("sys", "log_ecall_to_stdout", 0);
     sch_lock.wait_interval = conf::get_int("sys", "sch_lock_wait_interval", 64);
+    thp_mode = conf::get_int("sys", "transparent_hugepage", 0);
+    uint64_t futex_bucket_num = conf::get_int("sys", "futex_bucket_num", 64);
+    simroot_assertf(futex_bucket_num && !(futex_bucket_num & (futex_bucket_num - 1)), "futex_bucket_num must be a power of 2: %ld", futex_bucket_num);
+    futex_buckets = std::vector<FutexBucket>(futex_bucket_num);
+    for(auto &b : futex_buckets) b.lock.wait_interval = sch_lock.wait_interval;
+    host_io.start([this]() { sim_wakeup(); });
     syscall_memory_amo_lock.wait_interval = 32;
     log_bufs.assign(cpu_num, std::array<char, 512>());
 
     uint64_t entry = 0, sp = 0;
+    this->ppman = ppman;
     RVThread *init_thread = new RVThread(workload, ppman, &entry, &sp);
     RVRegArray regs;
     isa::zero_regs(regs);
@@ -90,6 +99,53 @@ void SimSystemMultiCore::init(SimWorkload &workload, std::vector<CPUInterface*>
 
 
 
+RVThread *SimSystemMultiCore::pick_next_thread_nolock(uint32_t cpuid) {
+    std::deque<RVThread*> &q = run_queues[cpuid];
+    sch_pick_cnt++;
+    sch_runq_len_sum += q.size();
+    for(auto iter = q.begin(); iter != q.end(); iter++) {
+        if(cpu_allowed(*iter, cpuid)) {
+            RVThread *ret = *iter;
+            q.erase(iter);
+            return ret;
+        }
+    }
+    // 本CPU没有可运行的线程，从最长的队列中窃取
+    uint32_t victim = cpu_num;
+    uint64_t victim_len = 0;
+    for(uint32_t i = 0; i < cpu_num; i++) {
+        if(i != cpuid && run_queues[i].size() > victim_len) {
+            for(auto t : run_queues[i]) {
+                if(cpu_allowed(t, cpuid)) {
+                    victim = i;
+                    victim_len = run_queues[i].size();
+                    break;
+                }
+            }
+        }
+    }
+    if(victim == cpu_num) return nullptr;
+    std::deque<RVThread*> &vq = run_queues[victim];
+    // 从队尾窃取，保留被窃取队列头部线程的局部性
+    for(auto iter = vq.rbegin(); iter != vq.rend(); iter++) {
+        if(cpu_allowed(*iter, cpuid)) {
+            RVThread *ret = *iter;
+            vq.erase(std::next(iter).base());
+            sch_steal_cnt++;
+            return ret;
+        }
+    }
+    return nullptr;
+}
+
+void SimSystemMultiCore::run_thread_on_nolock(RVThread *thread, uint32_t cpuid) {
+    cpu_devs[cpuid].exec_thread = thread;
+    if(thread && thread->last_cpu != cpuid) {
+        if(thread->last_cpu != UINT32_MAX) sch_migrate_cnt++;
+        thread->last_cpu = cpuid;
+    }
+}
+
 bool SimSystemMultiCore::switch_next_thread_nolock(uint32_t cpuid, uint32_t flag) {
     bool ret = false;
     uint64_t tid = cpu_devs[cpuid].exec_thread->tid;
@@ -106,9 +162,9 @@ bool SimSystemMultiCore::switch_next_thread_nolock(uint32_t cpuid, uint32_t flag
         delete thread;
         cpu_devs[cpuid].exec_thread = nullptr;
         bool no_running_thread = (waiting_threads.empty());
-        if(!ready_threads.empty()) {
-            cpu_devs[cpuid].exec_thread = ready_threads.front();
-            ready_threads.pop_front();
+        RVThread *next = pick_next_thread_nolock(cpuid);
+        if(next) {
+            run_thread_on_nolock(next, cpuid);
             no_running_thread = false;
         }
         else {
@@ -117,6 +173,9 @@ bool SimSystemMultiCore::switch_next_thread_nolock(uint32_t cpuid, uint32_t flag
                     no_running_thread = false;
                 }
             }
+            for(auto &q : run_queues) {
+                if(!q.empty()) no_running_thread = false;
+            }
         }
         ret = (cpu_devs[cpuid].exec_thread != nullptr);
         if(no_running_thread) {
@@ -131,10 +190,8 @@ bool SimSystemMultiCore::switch_next_thread_nolock(uint32_t cpuid, uint32_t flag
     else if(flag == SWFLAG_WAIT) {
         waiting_threads.insert(cpu_devs[cpuid].exec_thread);
         cpu_devs[cpuid].exec_thread = nullptr;
-        if(!ready_threads.empty()) {
-            cpu_devs[cpuid].exec_thread = ready_threads.front();
-            ready_threads.pop_front();
-        }
+        RVThread *next = pick_next_thread_nolock(cpuid);
+        if(next) run_thread_on_nolock(next, cpuid);
         ret = (cpu_devs[cpuid].exec_thread != nullptr);
         if(log_syscall) {
             sprintf(log_buf, "SCHD: Waited thread %ld @CPU %d -> thread %ld", tid, cpuid, ret?(cpu_devs[cpuid].exec_thread->tid):0);
@@ -142,9 +199,12 @@ bool SimSystemMultiCore::switch_next_thread_nolock(uint32_t cpuid, uint32_t flag
         }
     }
     else if(flag == SWFLAG_YIELD) {
-        ready_threads.push_back(cpu_devs[cpuid].exec_thread);
-        cpu_devs[cpuid].exec_thread = ready_threads.front();
-        ready_threads.pop_front();
+        RVThread *thread = cpu_devs[cpuid].exec_thread;
+        RVThread *next = pick_next_thread_nolock(cpuid);
+        if(next) {
+            run_queues[cpuid].push_back(thread);
+            run_thread_on_nolock(next, cpuid);
+        }
         if(log_syscall) {
             sprintf(log_buf, "SCHD: Yield thread %ld @CPU %d -> thread %ld", tid, cpuid, cpu_devs[cpuid].exec_thread->tid);
             simroot::print_log_info(log_buf);
@@ -160,30 +220,40 @@ bool SimSystemMultiCore::switch_next_thread_nolock(uint32_t cpuid, uint32_t flag
 
 void SimSystemMultiCore::insert_ready_thread_nolock(RVThread *thread, uint32_t prefered_cpu){
     uint32_t cpuid = cpu_num;
-    if(cpu_devs[prefered_cpu].exec_thread == nullptr) {
+    if(cpu_devs[prefered_cpu].exec_thread == nullptr && cpu_allowed(thread, prefered_cpu)) {
         cpuid = prefered_cpu;
     }
     else {
         for(uint32_t i = 0; i < cpu_num; i++) {
-            if(cpu_devs[i].exec_thread == nullptr) {
+            if(cpu_devs[i].exec_thread == nullptr && cpu_allowed(thread, i)) {
                 cpuid = i;
                 break;
             }
         }
     }
+    waiting_threads.erase(thread);
+    uint32_t qid = prefered_cpu;
     if(cpuid < cpu_num) {
-        waiting_threads.erase(thread);
-        cpu_devs[cpuid].exec_thread = thread;
+        run_thread_on_nolock(thread, cpuid);
         RVRegArray regs;
         VirtAddrT nextpc = thread->recover_context_stack(regs);
         cpu_devs[cpuid].cpu->redirect(nextpc, regs);
     }
     else {
-        ready_threads.push_back(thread);
+        // 优先进入上次运行的CPU的队列，不允许时选择允许的CPU中队列最短的
+        if(thread->last_cpu < cpu_num && cpu_allowed(thread, thread->last_cpu)) qid = thread->last_cpu;
+        if(!cpu_allowed(thread, qid)) {
+            qid = cpu_num;
+            for(uint32_t i = 0; i < cpu_num; i++) {
+                if(cpu_allowed(thread, i) && (qid == cpu_num || run_queues[i].size() < run_queues[qid].size())) qid = i;
+            }
+        }
+        run_queues[qid].push_back(thread);
+        sch_runq_len_max = std::max<uint64_t>(sch_runq_len_max, run_queues[qid].size());
     }
     if(log_syscall) {
         if(cpuid < cpu_num) sprintf(log_buf, "SCHD: Ready thread %ld -> CPU %d", thread->tid, cpuid);
-        else sprintf(log_buf, "SCHD: Ready thread %ld -> Wait Queue", thread->tid);
+        else sprintf(log_buf, "SCHD: Ready thread %ld -> Run Queue %d", thread->tid, qid);
         simroot::print_log_info(log_buf);
     }
 }
@@ -193,6 +263,16 @@ SimError SimSystemMultiCore::v_to_p(uint32_t cpu_id, VirtAddrT addr, PhysAddrT *
     return cpu_devs[cpu_id].exec_thread->va2pa(addr, out, flg);
 }
 
+SimError SimSystemMultiCore::v_to_p_pgofs(uint32_t cpu_id, VirtAddrT addr, PhysAddrT *out, PageFlagT flg, uint32_t *pgofs) {
+    simroot_assert(cpu_devs[cpu_id].exec_thread);
+    return cpu_devs[cpu_id].exec_thread->va2pa(addr, out, flg, pgofs);
+}
+
+AsidT SimSystemMultiCore::get_asid(uint32_t cpu_id) {
+    simroot_assert(cpu_devs[cpu_id].exec_thread);
+    return cpu_devs[cpu_id].exec_thread->pgtable->asid;
+}
+
 uint32_t SimSystemMultiCore::is_dev_mem(uint32_t cpu_id, VirtAddrT addr) {
     return (((addr >= syscall_mem_vaddr_start) && (addr < syscall_mem_vaddr_start + syscall_mem_length)))?1:0;
 }
@@ -282,8 +362,6 @@ VirtAddrT SimSystemMultiCore::ecall(uint32_t cpu_id, VirtAddrT addr, RVRegArray
     MP_SYSCALL_CASE(94, exitgroup);
     MP_SYSCALL_CASE(96, set_tid_address);
     MP_SYSCALL_CASE(99, set_robust_list);
-    MP_SYSCALL_CASE(122, sched_setaffinity);
-    MP_SYSCALL_CASE(123, sched_getaffinity);
     MP_SYSCALL_CASE(124, sched_yield);
     MP_SYSCALL_CASE(131, tgkill);
     MP_SYSCALL_CASE(172, getpid);
@@ -325,6 +403,8 @@ VirtAddrT SimSystemMultiCore::ecall(uint32_t cpu_id, VirtAddrT addr, RVRegArray
     MP_SYSCALL_CASE(1098, host_futex);
     MP_SYSCALL_CASE(1113, host_clock_gettime);
     MP_SYSCALL_CASE(1115, host_clock_nanosleep);
+    MP_SYSCALL_CASE(1122, host_sched_setaffinity);
+    MP_SYSCALL_CASE(1123, host_sched_getaffinity);
     MP_SYSCALL_CASE(1134, host_sigaction);
     MP_SYSCALL_CASE(1135, host_sigprocmask);
     MP_SYSCALL_CASE(1199, host_socketpair);
@@ -413,6 +493,8 @@ VirtAddrT SimSystemMultiCore::exception(uint32_t cpu_id, VirtAddrT pc, SimError
 
         VPageIndexT missed = (arg1 >> PAGE_ADDR_OFFSET);
         VPageIndexT tmppage = curt->cow_realloc_missed_page(missed);
+        tlb_shootdown(missed << PAGE_ADDR_OFFSET, PAGE_LEN_BYTE);
+        tlb_shootdown(tmppage << PAGE_ADDR_OFFSET, PAGE_LEN_BYTE);
 
         iregs[RV_REG_a0] = (missed << PAGE_ADDR_OFFSET);
         iregs[RV_REG_a1] = (tmppage << PAGE_ADDR_OFFSET);
@@ -458,180 +540,237 @@ void SimSystemMultiCore::dma_complete_callback(uint64_t callbackid) {
     global_lock.unlock();
 }
 
-void * SimSystemMultiCore::poll_wait_thread_function(void * _param) {
-    PollWaitThread *p = (PollWaitThread*)_param;
-    SimSystemMultiCore * sys = p->sys;
+void SimSystemMultiCore::print_statistic(std::ofstream &ofile) {
+    if(!ppman) return;
+    ofile << "minor_fault_zero_map_count: " << ppman->minor_fault_zero_map_cnt.load() << "\n";
+    ofile << "minor_fault_zero_cow_count: " << ppman->minor_fault_zero_cow_cnt.load() << "\n";
+    ofile << "minor_fault_host_alloc_count: " << ppman->minor_fault_host_alloc_cnt.load() << "\n";
+    ofile << "huge_page_alloc_count: " << ppman->huge_page_alloc_cnt.load() << "\n";
+    ofile << "huge_page_split_count: " << ppman->huge_page_split_cnt.load() << "\n";
+    ofile << "host_page_release_count: " << ppman->host_release_cnt.load() << "\n";
+    ofile << "host_zero_skip_count: " << ppman->host_zero_skip_cnt.load() << "\n";
+    ofile << "io_wait_count: " << io_wait_cnt << "\n";
+    ofile << "io_timeout_count: " << io_timeout_cnt << "\n";
+    ofile << "host_io_wakeup_count: " << host_io.wakeup_cnt.load() << "\n";
+    ofile << "host_io_retry_fail_count: " << host_io.retry_fail_cnt.load() << "\n";
+    ofile << "futex_wait_count: " << futex_wait_cnt << "\n";
+    ofile << "futex_wake_count: " << futex_wake_cnt << "\n";
+    ofile << "futex_requeue_count: " << futex_requeue_cnt << "\n";
+    ofile << "futex_timeout_count: " << futex_timeout_cnt << "\n";
+    ofile << "sched_migrate_count: " << sch_migrate_cnt << "\n";
+    ofile << "sched_steal_count: " << sch_steal_cnt << "\n";
+    ofile << "sched_runq_len_avg: " << ((sch_pick_cnt)?(((double)sch_runq_len_sum) / sch_pick_cnt):0.) << "\n";
+    ofile << "sched_runq_len_max: " << sch_runq_len_max << "\n";
+}
+
+void SimSystemMultiCore::on_current_tick() {
+    uint64_t tick = simroot::get_current_tick();
+    vector<std::pair<uint64_t, int64_t>> done;
+    vector<uint64_t> expired;
+    host_io.pop_completed(done);
+    sch_lock.lock();
+    for(auto &e : done) {
+        auto res = io_wait_threads.find((RVThread*)(e.first));
+        if(res != io_wait_threads.end()) wake_io_wait_thread_nolock(res, e.second);
+    }
+    wait_timers.expire(tick, expired);
+    vector<RVThread*> futex_expired;
+    for(auto id : expired) {
+        auto res = io_wait_threads.find((RVThread*)id);
+        if(res == io_wait_threads.end()) continue;
+        if(res->second.is_futex) {
+            futex_expired.push_back(res->second.thread);
+            continue;
+        }
+        // 取消失败说明IO已经完成，结果在下一次取出完成队列时处理
+        if(res->second.has_io && !host_io.cancel(id)) continue;
+        io_timeout_cnt++;
+        wake_io_wait_thread_nolock(res, res->second.on_timeout());
+    }
+    sch_lock.unlock();
+    for(auto t : futex_expired) futex_timeout(t);
+}
 
-    double simtime2realtime = ((double)(simroot::get_global_freq()) / (double)(simroot::get_sim_tick_per_real_sec()));
-    int64_t ret = poll((struct pollfd *)(p->host_fds), p->nfds, (simtime2realtime * p->timeout_us) / 1000);
-    if(ret < 0) ret = -errno;
-    p->thread->context_stack.back().regs[RV_REG_a0] = ret;
+void SimSystemMultiCore::apply_next_tick() {
+    sch_lock.lock();
+    uint64_t next = wait_timers.next_deadline();
+    sch_lock.unlock();
+    sim_sleep(next);
+}
 
-    if(sys->log_syscall) {
+void SimSystemMultiCore::wake_io_wait_thread_nolock(std::unordered_map<RVThread *, IOWaitThread>::iterator iter, int64_t ret) {
+    RVThread *thread = iter->second.thread;
+    thread->context_stack.back().regs[RV_REG_a0] = ret;
+    if(log_syscall) {
         char buf[256];
-        sprintf(buf, "Thread %ld Syscall host_poll Return %ld", p->thread->tid, ret);
+        sprintf(buf, "Thread %ld Syscall %s Return %ld", thread->tid, iter->second.name, ret);
         simroot::print_log_info(buf);
     }
-
-    sys->sch_lock.lock();
-    sys->poll_wait_threads.erase(p->thread);
-    sys->insert_ready_thread_nolock(p->thread, p->cpuid);
-    sys->sch_lock.unlock();
-
-    return nullptr;
+    wait_timers.remove((uint64_t)thread);
+    uint32_t cpuid = iter->second.cpuid;
+    io_wait_threads.erase(iter);
+    insert_ready_thread_nolock(thread, cpuid);
 }
 
-void * SimSystemMultiCore::select_wait_thread_function(void * _param) {
-    SelectWaitThread *p = (SelectWaitThread*)_param;
-    SimSystemMultiCore * sys = p->sys;
-
-    double simtime2realtime = ((double)(simroot::get_global_freq()) / (double)(simroot::get_sim_tick_per_real_sec()));
-    uint64_t rtmo_us = (simtime2realtime * p->timeout_us);
-    timespec timeout;
-    timeout.tv_sec = rtmo_us / 1000000UL;
-    timeout.tv_nsec = 1000UL * (rtmo_us % 1000000UL);
-    
-    int64_t ret = pselect(
-        p->host_nfds,
-        ((p->readfds)?(&p->host_readfds):nullptr),
-        ((p->writefds)?(&p->host_writefds):nullptr),
-        ((p->exceptfds)?(&p->host_exceptfds):nullptr),
-        &timeout,
-        nullptr
-    );
-    if(ret < 0) ret = -errno;
-    p->thread->context_stack.back().regs[RV_REG_a0] = ret;
-
-    if(ret > 0) {
-        if(p->readfds) {
-            FD_ZERO(p->readfds);
-            for(int i = 0; i < p->host_nfds; i++) {
-                if(FD_ISSET(i, &p->host_readfds)) FD_SET(p->hostfd_to_simfd[i], p->readfds);
-            }
-        }
-        if(p->writefds) {
-            FD_ZERO(p->writefds);
-            for(int i = 0; i < p->host_nfds; i++) {
-                if(FD_ISSET(i, &p->host_writefds)) FD_SET(p->hostfd_to_simfd[i], p->writefds);
-            }
-        }
-        if(p->exceptfds) {
-            FD_ZERO(p->exceptfds);
-            for(int i = 0; i < p->host_nfds; i++) {
-                if(FD_ISSET(i, &p->host_exceptfds)) FD_SET(p->hostfd_to_simfd[i], p->exceptfds);
-            }
-        }
+VirtAddrT SimSystemMultiCore::wait_host_io(uint32_t cpu_id, VirtAddrT pc, RVRegArray &iregs, const char *name,
+    vector<HostIOReactor::IOFd> &fds, HostIOReactor::IOFunc func, int64_t timeout_ticks, std::function<int64_t()> on_timeout) {
+    RVThread *thread = cpu_devs[cpu_id].exec_thread;
+    thread->save_context_stack(pc + 4, iregs, true);
+    sch_lock.lock();
+    io_wait_cnt++;
+    io_wait_threads.emplace(thread, IOWaitThread{
+        .thread = thread, .cpuid = cpu_id, .name = name, .has_io = !fds.empty(), .on_timeout = on_timeout
+    });
+    if(timeout_ticks >= 0) {
+        wait_timers.add((uint64_t)thread, simroot::get_current_tick() + std::max<int64_t>(timeout_ticks, 1));
     }
-
-    if(sys->log_syscall) {
-        char buf[256];
-        sprintf(buf, "Thread %ld Syscall host_select Return %ld", p->thread->tid, ret);
-        simroot::print_log_info(buf);
+    bool ret = switch_next_thread_nolock(cpu_id, SWFLAG_WAIT);
+    sch_lock.unlock();
+    // 线程已经换出，完成结果由on_current_tick写回
+    if(!fds.empty()) host_io.submit((uint64_t)thread, fds, func);
+    sim_wakeup();
+    if(ret) {
+        simroot_assert(cpu_devs[cpu_id].exec_thread);
+        RVRegArray regs;
+        VirtAddrT nextpc = cpu_devs[cpu_id].exec_thread->recover_context_stack(regs);
+        cpu_devs[cpu_id].cpu->redirect(nextpc, regs);
+        return nextpc;
     }
-
-    sys->sch_lock.lock();
-    sys->select_wait_threads.erase(p->thread);
-    sys->insert_ready_thread_nolock(p->thread, p->cpuid);
-    sys->sch_lock.unlock();
-
-    return nullptr;
+    cpu_devs[cpu_id].cpu->halt();
+    return 0;
 }
 
-void * SimSystemMultiCore::sleep_wait_thread_function(void * _param) {
-    SleepWaitThread *p = (SleepWaitThread*)_param;
-    SimSystemMultiCore * sys = p->sys;
-
-    int64_t ret = clock_nanosleep(0, 0, &p->host_time, 0);
-    if(ret < 0) ret = -errno;
-    p->thread->context_stack.back().regs[RV_REG_a0] = ret;
-
-    if(sys->log_syscall) {
-        char buf[256];
-        sprintf(buf, "Thread %ld Syscall host_clock_nanosleep Return %ld", p->thread->tid, ret);
-        simroot::print_log_info(buf);
+uint64_t SimSystemMultiCore::futex_wait_thread_pop(PhysAddrT paddr, uint32_t futex_mask, uint64_t max_cnt, vector<FutexWaitThread> &out) {
+    FutexBucket &b = futex_bucket(paddr);
+    auto res = b.waiters.find(paddr);
+    if(res == b.waiters.end()) return 0;
+    uint64_t cnt = 0;
+    for(auto iter = res->second.begin(); iter != res->second.end() && cnt < max_cnt; ) {
+        if(iter->futex_mask & futex_mask) {
+            out.push_back(*iter);
+            iter = res->second.erase(iter);
+            cnt++;
+        }
+        else iter++;
     }
-
-    sys->sch_lock.lock();
-    sys->poll_wait_threads.erase(p->thread);
-    sys->insert_ready_thread_nolock(p->thread, p->cpuid);
-    sys->sch_lock.unlock();
-
-    return nullptr;
+    if(res->second.empty()) b.waiters.erase(res);
+    return cnt;
 }
 
-void * SimSystemMultiCore::blkread_wait_thread_function(void * _param) {
-    BlockreadWaitThread *p = (BlockreadWaitThread*)_param;
-    SimSystemMultiCore * sys = p->sys;
-
-    int64_t ret = read(p->hostfd, p->buf, p->bufsz);
-    if(ret < 0) ret = -errno;
-    p->thread->context_stack.back().regs[RV_REG_a0] = ret;
-
-    if(sys->log_syscall) {
-        char buf[256];
-        sprintf(buf, "Thread %ld Syscall host_read_blocked Return %ld", p->thread->tid, ret);
-        simroot::print_log_info(buf);
+uint64_t SimSystemMultiCore::futex_requeue_nolock(PhysAddrT paddr, PhysAddrT paddr2, uint64_t max_cnt) {
+    if(max_cnt == 0 || paddr == paddr2) return 0;
+    FutexBucket &b = futex_bucket(paddr);
+    FutexBucket &b2 = futex_bucket(paddr2);
+    // 两个地址可能在同一个桶中，插入可能导致rehash，先取得目标队列再查找源队列
+    std::list<FutexWaitThread> &dst = b2.waiters[paddr2];
+    auto res = b.waiters.find(paddr);
+    uint64_t cnt = 0;
+    if(res != b.waiters.end()) {
+        sch_lock.lock();
+        while(!res->second.empty() && cnt < max_cnt) {
+            auto iter = res->second.begin();
+            auto wt = io_wait_threads.find(iter->thread);
+            if(wt != io_wait_threads.end() && wt->second.is_futex) wt->second.futex_paddr = paddr2;
+            dst.splice(dst.end(), res->second, iter);
+            cnt++;
+        }
+        futex_requeue_cnt += cnt;
+        sch_lock.unlock();
+        if(res->second.empty()) b.waiters.erase(res);
     }
-
-    sys->sch_lock.lock();
-    sys->blkread_wait_threads.erase(p->thread);
-    sys->insert_ready_thread_nolock(p->thread, p->cpuid);
-    sys->sch_lock.unlock();
-
-    return nullptr;
+    if(dst.empty()) b2.waiters.erase(paddr2);
+    return cnt;
 }
 
-void * SimSystemMultiCore::socksend_wait_thread_function(void * _param) {
-    SockSendWaitThread *p = (SockSendWaitThread*)_param;
-    SimSystemMultiCore * sys = p->sys;
-
-    int64_t ret = sendto(p->hostfd, p->buf, p->bufsz, p->flags, (struct sockaddr *)(p->dest_addr), p->addrlen);
-    if(ret < 0) ret = -errno;
-    p->thread->context_stack.back().regs[RV_REG_a0] = ret;
-
-    if(sys->log_syscall) {
-        char buf[256];
-        sprintf(buf, "Thread %ld Syscall host_sendto Return %ld", p->thread->tid, ret);
-        simroot::print_log_info(buf);
+void SimSystemMultiCore::futex_wake_threads(vector<FutexWaitThread> &threads) {
+    if(threads.empty()) return;
+    sch_lock.lock();
+    for(auto &fwt : threads) {
+        auto res = io_wait_threads.find(fwt.thread);
+        if(res != io_wait_threads.end()) {
+            wait_timers.remove((uint64_t)(fwt.thread));
+            io_wait_threads.erase(res);
+        }
+        fwt.thread->context_stack.back().regs[RV_REG_a0] = 0;
+        insert_ready_thread_nolock(fwt.thread, fwt.last_cpu_id);
     }
-
-    sys->sch_lock.lock();
-    sys->socksend_wait_threads.erase(p->thread);
-    sys->insert_ready_thread_nolock(p->thread, p->cpuid);
-    sys->sch_lock.unlock();
-
-    return nullptr;
+    futex_wake_cnt += threads.size();
+    sch_lock.unlock();
 }
 
-void * SimSystemMultiCore::sockrecv_wait_thread_function(void * _param) {
-    SockRecvWaitThread *p = (SockRecvWaitThread*)_param;
-    SimSystemMultiCore * sys = p->sys;
+uint64_t SimSystemMultiCore::futex_wake(PhysAddrT paddr, uint32_t futex_mask, uint64_t max_cnt) {
+    vector<FutexWaitThread> woken;
+    FutexBucket &b = futex_bucket(paddr);
+    b.lock.lock();
+    futex_wait_thread_pop(paddr, futex_mask, max_cnt, woken);
+    b.lock.unlock();
+    futex_wake_threads(woken);
+    return woken.size();
+}
 
-    int64_t ret = recvmsg(p->hostfd, &p->msg, p->flags);
-    if(ret < 0) ret = -errno;
-    else {
-        p->hbuf_msg->msg_controllen = p->msg.msg_controllen;
-        p->hbuf_msg->msg_namelen = p->msg.msg_namelen;
-        p->hbuf_msg->msg_flags = p->msg.msg_flags;
+VirtAddrT SimSystemMultiCore::futex_wait(uint32_t cpu_id, VirtAddrT pc, RVRegArray &iregs, PhysAddrT paddr, uint32_t futex_mask, int64_t timeout_ticks) {
+    RVThread *thread = cpu_devs[cpu_id].exec_thread;
+    FutexBucket &b = futex_bucket(paddr);
+    thread->save_context_stack(pc + 4, iregs, true);
+    futex_wait_thread_insert(paddr, thread, futex_mask, cpu_id);
+    sch_lock.lock();
+    futex_wait_cnt++;
+    if(timeout_ticks >= 0) {
+        io_wait_threads.emplace(thread, IOWaitThread{
+            .thread = thread, .cpuid = cpu_id, .name = "host_futex", .has_io = false, .on_timeout = nullptr,
+            .is_futex = true, .futex_paddr = paddr
+        });
+        wait_timers.add((uint64_t)thread, simroot::get_current_tick() + std::max<int64_t>(timeout_ticks, 1));
     }
-    p->thread->context_stack.back().regs[RV_REG_a0] = ret;
-
-    if(sys->log_syscall) {
-        char buf[256];
-        sprintf(buf, "Thread %ld Syscall host_recvmsg Return %ld", p->thread->tid, ret);
-        simroot::print_log_info(buf);
+    bool ret = switch_next_thread_nolock(cpu_id, SWFLAG_WAIT);
+    sch_lock.unlock();
+    b.lock.unlock();
+    if(timeout_ticks >= 0) sim_wakeup();
+    if(ret) {
+        simroot_assert(cpu_devs[cpu_id].exec_thread);
+        RVRegArray regs;
+        VirtAddrT nextpc = cpu_devs[cpu_id].exec_thread->recover_context_stack(regs);
+        cpu_devs[cpu_id].cpu->redirect(nextpc, regs);
+        return nextpc;
     }
-
-    sys->sch_lock.lock();
-    sys->sockrecv_wait_threads.erase(p->thread);
-    sys->insert_ready_thread_nolock(p->thread, p->cpuid);
-    sys->sch_lock.unlock();
-
-    return nullptr;
+    cpu_devs[cpu_id].cpu->halt();
+    return 0;
 }
 
+void SimSystemMultiCore::futex_timeout(RVThread *thread) {
+    // 持有sch_lock时不能再取桶锁，先在sch_lock下读出等待地址，释放后按桶锁 -> sch_lock的顺序重新加锁
+    // 等待期间线程可能被重新排队到其他地址，地址变化时重试
+    while(true) {
+        sch_lock.lock();
+        auto res = io_wait_threads.find(thread);
+        if(res == io_wait_threads.end() || !res->second.is_futex) {
+            sch_lock.unlock();
+            return;
+        }
+        PhysAddrT paddr = res->second.futex_paddr;
+        sch_lock.unlock();
 
-
+        FutexBucket &b = futex_bucket(paddr);
+        b.lock.lock();
+        sch_lock.lock();
+        res = io_wait_threads.find(thread);
+        bool done = (res == io_wait_threads.end() || !res->second.is_futex);
+        if(!done && res->second.futex_paddr == paddr) {
+            auto wl = b.waiters.find(paddr);
+            if(wl != b.waiters.end()) {
+                wl->second.remove_if([thread](FutexWaitThread &w) { return w.thread == thread; });
+                if(wl->second.empty()) b.waiters.erase(wl);
+            }
+            io_timeout_cnt++;
+            futex_timeout_cnt++;
+            wake_io_wait_thread_nolock(res, -ETIMEDOUT);
+            done = true;
+        }
+        sch_lock.unlock();
+        b.lock.unlock();
+        if(done) return;
+    }
+}
 
 // -----------------------------------------------------------------
 //   Syscall Handlers
@@ -722,6 +861,24 @@ MP_SYSCALL_DEFINE(62, lseek) {
 MP_SYSCALL_DEFINE(94, exitgroup) {
     CPUFLOG("CPU%d Raise an ECALL: EXITGROUP", cpu_id);
     RVThread *thread = CURT;
+    // 先从futex等待队列中移除所有子线程
+    std::set<RVThread*> childs(CURT->threadgroup->begin(), CURT->threadgroup->end());
+    childs.erase(CURT);
+    for(auto &b : futex_buckets) {
+        b.lock.lock();
+        for(auto iter = b.waiters.begin(); iter != b.waiters.end(); ) {
+            iter->second.remove_if([&childs](FutexWaitThread &w) { return childs.count(w.thread) != 0; });
+            if(iter->second.empty()) iter = b.waiters.erase(iter);
+            else iter++;
+        }
+        b.lock.unlock();
+    }
+    if(thread->do_child_cleartid) {
+        // Wake up all futex
+        PhysAddrT paddr = 0;
+        simroot_assert(sys_va2pa(thread, thread->clear_child_tid, &paddr) == SimError::success);
+        futex_wake(paddr, FUTEX_BITSET_MATCH_ANY, UINT64_MAX);
+    }
     sch_lock.lock();
     // 结束所有子线程
     for(RVThread *child : *(CURT->threadgroup)) {
@@ -732,36 +889,12 @@ MP_SYSCALL_DEFINE(94, exitgroup) {
                 u.exec_thread = nullptr;
             }
         }
-        for(auto &e : futex_wait_threads) {
-            for(auto iter = e.second.begin(); iter != e.second.end(); ) {
-                if(iter->thread == child) iter = e.second.erase(iter);
-                else iter++;
-            }
-        }
         cancle_wait_thread_nolock(child);
-        for(auto iter = ready_threads.begin(); iter != ready_threads.end(); ) {
-            if(*iter == child) iter = ready_threads.erase(iter);
-            else iter++;
-        }
-        // std::remove(ready_threads.begin(), ready_threads.end(), child);
+        remove_ready_thread_nolock(child);
         waiting_threads.erase(child);
         CPUFLOG("CPU%d : Cancle Thread %ld", cpu_id, child->tid);
         delete child;
     }
-    if(thread->do_child_cleartid) {
-        // Wake up all futex
-        PhysAddrT paddr = 0;
-        simroot_assert(thread->va2pa(thread->clear_child_tid, &paddr, 0) == SimError::success);
-        auto res = futex_wait_threads.find(paddr);
-        if(res != futex_wait_threads.end()) {
-            auto &tl = res->second;
-            for(auto &fwt : tl) {
-                fwt.thread->context_stack.back().regs[RV_REG_a0] = 0;
-                insert_ready_thread_nolock(fwt.thread, fwt.last_cpu_id);
-            }
-            futex_wait_threads.erase(res);
-        }
-    }
     if(switch_next_thread_nolock(cpu_id, SWFLAG_EXIT)) {
         sch_lock.unlock();
         simroot_assert(cpu_devs[cpu_id].exec_thread);
@@ -803,18 +936,6 @@ MP_SYSCALL_DEFINE(99, set_robust_list) {
     return pc + 4;
 }
 
-MP_SYSCALL_DEFINE(122, sched_setaffinity) {
-    LOG_SYSCALL_3("sched_setaffinity", "%ld", IREG_V(a0), "%ld", IREG_V(a1), "0x%lx", IREG_V(a2), "%ld", 0UL);
-    IREG_V(a0) = 0;
-    return pc + 4;
-}
-
-MP_SYSCALL_DEFINE(123, sched_getaffinity) {
-    LOG_SYSCALL_3("sched_getaffinity", "%ld", IREG_V(a0), "%ld", IREG_V(a1), "0x%lx", IREG_V(a2), "%ld", 0UL);
-    IREG_V(a0) = 0;
-    return pc + 4;
-}
-
 MP_SYSCALL_DEFINE(124, sched_yield) {
     LOG_SYSCALL_1("sched_yield", "%ld", IREG_V(a0), "%ld", 0UL);
     IREG_V(a0) = 0;
@@ -909,10 +1030,63 @@ MP_SYSCALL_DEFINE(201, listen) {
     return pc + 4;
 }
 
+VirtAddrT SimSystemMultiCore::map_huge_pages_and_wait(uint32_t cpu_id, VirtAddrT pc, RVRegArray &iregs, VirtAddrT vaddr, uint64_t length) {
+    RVThread *thread = cpu_devs[cpu_id].exec_thread;
+    std::vector<PageIndexT> blocks;
+    thread->sys_map_huge(vaddr, length, &blocks);
+    if(blocks.empty()) return pc + 4;
+
+    thread->save_context_stack(pc + 4, iregs, true);
+
+    // 回收的物理页可能仍在缓存中，通过DMA清零以保证一致性
+    uint8_t *zero = new uint8_t[HUGE_PAGE_LEN_BYTE];
+    memset(zero, 0, HUGE_PAGE_LEN_BYTE);
+    list<DMARequestUnit> reqs;
+    for(PageIndexT ppi : blocks) {
+        reqs.emplace_back(DMARequestUnit{
+            .src = (PhysAddrT)zero,
+            .dst = (ppi << PAGE_ADDR_OFFSET),
+            .size = HUGE_PAGE_LEN_BYTE,
+            .flag = DMAFLG_SRC_HOST,
+            .callback = (uint64_t)thread
+        });
+    }
+
+    DMAWaitThread waitthread;
+    waitthread.thread = thread;
+    waitthread.last_cpu_id = cpu_id;
+    waitthread.ref_cnt = reqs.size();
+    waitthread.to_free.emplace_back(zero);
+
+    dma->push_dma_requests(reqs);
+
+    sch_lock.lock();
+    dma_wait_threads.emplace(thread, waitthread);
+    bool nextthread = switch_next_thread_nolock(cpu_id, SWFLAG_WAIT);
+    sch_lock.unlock();
+    if(nextthread) {
+        simroot_assert(cpu_devs[cpu_id].exec_thread);
+        RVRegArray regs;
+        VirtAddrT nextpc = cpu_devs[cpu_id].exec_thread->recover_context_stack(regs);
+        cpu_devs[cpu_id].cpu->redirect(nextpc, regs);
+        return nextpc;
+    }
+    cpu_devs[cpu_id].cpu->halt();
+    return 0;
+}
+
 MP_SYSCALL_DEFINE(214, brk) {
     uint64_t arg0 = IREG_V(a0);
+    VirtAddrT oldbrk = CURT->pgtable->brk_va;
     IREG_V(a0) = CURT->sys_brk(arg0);
+    if(IREG_V(a0) != oldbrk) {
+        VirtAddrT lo = std::min<VirtAddrT>(oldbrk, IREG_V(a0)), hi = std::max<VirtAddrT>(oldbrk, IREG_V(a0));
+        tlb_shootdown(lo, hi - lo);
+    }
     LOG_SYSCALL_1("brk", "0x%lx", arg0, "0x%lx", IREG_V(a0));
+    if(thp_mode >= 2 && IREG_V(a0) > oldbrk) {
+        return map_huge_pages_and_wait(cpu_id, pc, iregs, oldbrk, IREG_V(a0) - oldbrk);
+    }
     return pc + 4;
 }
 
@@ -921,6 +1095,7 @@ MP_SYSCALL_DEFINE(215, munmap) {
     uint64_t length = IREG_V(a1);
     LOG_SYSCALL_2("munmap", "0x%lx", IREG_V(a0), "0x%lx", IREG_V(a1), "%ld", 0UL);
     CURT->sys_munmap(vaddr, length);
+    tlb_shootdown(vaddr, length);
     IREG_V(a0) = 0;
     return pc + 4;
 }
@@ -947,9 +1122,12 @@ MP_SYSCALL_DEFINE(222, mmap) {
         bool initzero = (!(flags & MAP_STACK));
         string info = " ";
         if(flags & MAP_STACK) info = "stack";
-        ret = (flags & MAP_FIXED)?(thread->sys_mmap_fixed(vaddr, length, pgflg, -1, 0, info)):(thread->sys_mmap(length, pgflg, -1, 0, info));
+        bool thp = (thp_mode >= 2 && length >= HUGE_PAGE_LEN_BYTE && !(flags & (MAP_SHARED | MAP_STACK)));
+        ret = (flags & MAP_FIXED)?(thread->sys_mmap_fixed(vaddr, length, pgflg, -1, 0, info)):(thread->sys_mmap(length, pgflg, -1, 0, info, (thp?HUGE_PAGE_PGCNT:1)));
+        if(flags & MAP_FIXED) tlb_shootdown(vaddr, length);
         LOG_SYSCALL_6("mmap", "0x%lx", IREG_V(a0), "0x%lx", IREG_V(a1), "0x%lx", IREG_V(a2), "0x%lx", IREG_V(a3), "%ld", IREG_V(a4), "0x%lx", IREG_V(a5), "%ld", ret);
         IREG_V(a0) = ret;
+        if(thp && ret) return map_huge_pages_and_wait(cpu_id, pc, iregs, ret, length);
         return pc + 4;
     }
     else if((flags & MAP_PRIVATE) && fd > 0) {
@@ -958,6 +1136,7 @@ MP_SYSCALL_DEFINE(222, mmap) {
         if(prot & PROT_READ) pgflg |= PGFLAG_R;
         if(prot & PROT_WRITE) pgflg |= PGFLAG_W;
         ret = (flags & MAP_FIXED)?(thread->sys_mmap_fixed(vaddr, length, pgflg, -1, 0, "file")):(thread->sys_mmap(length, pgflg, -1, 0, "file"));
+        if(flags & MAP_FIXED) tlb_shootdown(vaddr, length);
         LOG_SYSCALL_6("mmap", "0x%lx", IREG_V(a0), "0x%lx", IREG_V(a1), "0x%lx", IREG_V(a2), "0x%lx", IREG_V(a3), "%ld", IREG_V(a4), "0x%lx", IREG_V(a5), "0x%lx", ret);
         IREG_V(a0) = ret;
         if(ret == 0) return pc+4;
@@ -967,8 +1146,11 @@ MP_SYSCALL_DEFINE(222, mmap) {
         struct stat _fs;
         int sysfd = thread->fdtable_trans(fd);
         fstat(sysfd, &_fs);
+        // 超出文件长度的部分保持按需分配的零页，不需要DMA（至少加载一页以复用DMA等待流程）
+        uint64_t load_len = std::min<uint64_t>(length, PAGE_LEN_BYTE);
         if(_fs.st_size > offset) {
             uint64_t valid_sz = std::min<uint64_t>(length, _fs.st_size - offset);
+            load_len = std::min<uint64_t>(length, ALIGN(valid_sz, PAGE_LEN_BYTE));
             uint8_t *tmpmap = (uint8_t *)mmap(0, valid_sz, PROT_READ, MAP_PRIVATE, thread->fdtable_trans(fd), offset);
             memcpy(buf, tmpmap, valid_sz);
             if(length > valid_sz) memset(buf + valid_sz, 0, length - valid_sz);
@@ -983,9 +1165,9 @@ MP_SYSCALL_DEFINE(222, mmap) {
         uint64_t cur = 0;
         if(dma_dst & (PAGE_LEN_BYTE - 1)) {
             uint32_t offset = (dma_dst & (PAGE_LEN_BYTE - 1));
-            cur = std::min<uint32_t>(PAGE_LEN_BYTE - offset, length);
+            cur = std::min<uint32_t>(PAGE_LEN_BYTE - offset, load_len);
             PhysAddrT paddr = 0;
-            simroot_assert(thread->va2pa(dma_dst, &paddr, 0) == SimError::success);
+            simroot_assert(sys_va2pa(thread, dma_dst, &paddr) == SimError::success);
             reqs.emplace_back(DMARequestUnit{
                 .src = (PhysAddrT)buf,
                 .dst = paddr,
@@ -994,10 +1176,10 @@ MP_SYSCALL_DEFINE(222, mmap) {
                 .callback = (uint64_t)thread
             });
         }
-        while(cur < length) {
+        while(cur < load_len) {
             PhysAddrT paddr = 0;
-            simroot_assert(thread->va2pa(dma_dst + cur, &paddr, 0) == SimError::success);
-            uint32_t step = std::min<uint32_t>(PAGE_LEN_BYTE, length - cur);
+            simroot_assert(sys_va2pa(thread, dma_dst + cur, &paddr) == SimError::success);
+            uint32_t step = std::min<uint32_t>(PAGE_LEN_BYTE, load_len - cur);
             reqs.emplace_back(DMARequestUnit{
                 .src = ((PhysAddrT)buf) + cur,
                 .dst = paddr,
@@ -1047,13 +1229,20 @@ MP_SYSCALL_DEFINE(226, mprotect) {
     if(flg & PROT_EXEC) pgflag |= PGFLAG_X;
     RVThread *thread = cpu_devs[cpu_id].exec_thread;
     thread->sys_mprotect(IREG_V(a0), IREG_V(a1), pgflag);
+    tlb_shootdown(IREG_V(a0), IREG_V(a1));
     IREG_V(a0) = 0;
     return pc + 4;
 }
 
 MP_SYSCALL_DEFINE(233, madvise) {
     LOG_SYSCALL_3("madvise", "0x%lx", IREG_V(a0), "%ld", IREG_V(a1), "%ld", IREG_V(a2), "%ld", 0UL);
+    VirtAddrT vaddr = IREG_V(a0);
+    uint64_t length = IREG_V(a1);
+    uint64_t advice = IREG_V(a2);
     IREG_V(a0) = 0;
+    if(thp_mode >= 1 && advice == MADV_HUGEPAGE) {
+        return map_huge_pages_and_wait(cpu_id, pc, iregs, vaddr, length);
+    }
     return pc + 4;
 }
 
@@ -1096,6 +1285,7 @@ MP_SYSCALL_DEFINE(904, host_get_tid_address) {
 
 MP_SYSCALL_DEFINE(905, host_free_cow_tmp_page) {
     CURT->cow_free_tmp_page(IREG_V(a0) >> PAGE_ADDR_OFFSET);
+    tlb_shootdown(IREG_V(a0), PAGE_LEN_BYTE);
     IREG_V(a0) = 0;
     return pc + 4;
 }
@@ -1212,35 +1402,17 @@ MP_SYSCALL_DEFINE(1063, host_read) {
         return pc + 4;
     }
     else if(select_ret == 0) {
-        BlockreadWaitThread wt;
-        wt.thread = CURT;
-        wt.sys = this;
-        wt.cpuid = cpu_id;
-        wt.simfd = simfd;
-        wt.hostfd = hostfd;
-        wt.buf = (uint8_t*)HOST_ADDR_OF_IREG(a1);
-        wt.bufsz = IREG_V(a2);
-        
+        uint8_t *buf = (uint8_t*)HOST_ADDR_OF_IREG(a1);
+        uint64_t bufsz = IREG_V(a2);
         LOG_SYSCALL_3("host_read_blocked", "%ld", IREG_V(a0), "0x%lx", IREG_V(a1), "0x%lx", IREG_V(a2), "%s", "blocked");
-
-        sch_lock.lock();
-        auto iter = blkread_wait_threads.emplace(CURT, wt).first;
-        sch_lock.unlock();
-        pthread_create(&wt.th, nullptr, blkread_wait_thread_function, &(iter->second));
-
-        CURT->save_context_stack(pc + 4, iregs, true);
-        sch_lock.lock();
-        bool ret = switch_next_thread_nolock(cpu_id, SWFLAG_WAIT);
-        sch_lock.unlock();
-        if(ret) {
-            simroot_assert(cpu_devs[cpu_id].exec_thread);
-            RVRegArray regs;
-            VirtAddrT nextpc = cpu_devs[cpu_id].exec_thread->recover_context_stack(regs);
-            cpu_devs[cpu_id].cpu->redirect(nextpc, regs);
-            return nextpc;
-        }
-        cpu_devs[cpu_id].cpu->halt();
-        return 0;
+        vector<HostIOReactor::IOFd> iofds = {HostIOReactor::IOFd{.fd = hostfd, .events = POLLIN}};
+        return wait_host_io(cpu_id, pc, iregs, "host_read_blocked", iofds, [=](int64_t *ret) -> bool {
+            struct pollfd pfd = {.fd = hostfd, .events = POLLIN, .revents = 0};
+            if(poll(&pfd, 1, 0) <= 0) return false;
+            *ret = read(hostfd, buf, bufsz);
+            if(*ret < 0) *ret = -errno;
+            return true;
+        }, -1, nullptr);
     }
     
     CPUERROR("CPU %d Failed to read fd %d->%d", cpu_id, simfd, hostfd);
@@ -1275,18 +1447,14 @@ MP_SYSCALL_DEFINE(1072, host_pselect6) {
         simroot_assert(0);
     }
 
-    SelectWaitThread wt;
-    wt.thread = CURT;
-    wt.nfds = nfds;
-    wt.timeout_us = (tmo?(tmo->tv_nsec / 1000L + tmo->tv_sec * 1000000L):-1L);
-    wt.sys = this;
-    wt.cpuid = cpu_id;
-    wt.readfds = readfds;
-    wt.writefds = writefds;
-    wt.exceptfds = exceptfds;
-    FD_ZERO(&wt.host_readfds);
-    FD_ZERO(&wt.host_writefds);
-    FD_ZERO(&wt.host_exceptfds);
+    int64_t timeout_ticks = (tmo?timespec_to_ticks(tmo):-1L);
+    int32_t host_nfds = 0;
+    fd_set host_readfds, host_writefds, host_exceptfds;
+    unordered_map<int, int> hostfd_to_simfd;
+    FD_ZERO(&host_readfds);
+    FD_ZERO(&host_writefds);
+    FD_ZERO(&host_exceptfds);
+    vector<HostIOReactor::IOFd> iofds;
     
     bool invalid_fd = false;
     for(int i = 0; i < nfds; i++) {
@@ -1296,9 +1464,10 @@ MP_SYSCALL_DEFINE(1072, host_pselect6) {
                 invalid_fd = true;
                 break;
             }
-            wt.host_nfds = std::max<int32_t>(wt.host_nfds, hostfd + 1);
-            wt.hostfd_to_simfd.emplace(hostfd, i);
-            FD_SET(hostfd, &wt.host_readfds);
+            host_nfds = std::max<int32_t>(host_nfds, hostfd + 1);
+            hostfd_to_simfd.emplace(hostfd, i);
+            FD_SET(hostfd, &host_readfds);
+            iofds.push_back(HostIOReactor::IOFd{.fd = hostfd, .events = POLLIN});
         }
         if(writefds && FD_ISSET(i, writefds)) {
             int32_t hostfd = CURT->fdtable_trans(i);
@@ -1306,9 +1475,10 @@ MP_SYSCALL_DEFINE(1072, host_pselect6) {
                 invalid_fd = true;
                 break;
             }
-            wt.host_nfds = std::max<int32_t>(wt.host_nfds, hostfd + 1);
-            wt.hostfd_to_simfd.emplace(hostfd, i);
-            FD_SET(hostfd, &wt.host_writefds);
+            host_nfds = std::max<int32_t>(host_nfds, hostfd + 1);
+            hostfd_to_simfd.emplace(hostfd, i);
+            FD_SET(hostfd, &host_writefds);
+            iofds.push_back(HostIOReactor::IOFd{.fd = hostfd, .events = POLLOUT});
         }
         if(exceptfds && FD_ISSET(i, exceptfds)) {
             int32_t hostfd = CURT->fdtable_trans(i);
@@ -1316,14 +1486,15 @@ MP_SYSCALL_DEFINE(1072, host_pselect6) {
                 invalid_fd = true;
                 break;
             }
-            wt.host_nfds = std::max<int32_t>(wt.host_nfds, hostfd + 1);
-            wt.hostfd_to_simfd.emplace(hostfd, i);
-            FD_SET(hostfd, &wt.host_exceptfds);
+            host_nfds = std::max<int32_t>(host_nfds, hostfd + 1);
+            hostfd_to_simfd.emplace(hostfd, i);
+            FD_SET(hostfd, &host_exceptfds);
+            iofds.push_back(HostIOReactor::IOFd{.fd = hostfd, .events = POLLPRI});
         }
     }
     
     if(log_syscall) {
-        sprintf(log_bufs[cpu_id].data(), "CPU %d Syscall host_pselect6: TMO %ldus", cpu_id, wt.timeout_us);
+        sprintf(log_bufs[cpu_id].data(), "CPU %d Syscall host_pselect6: TMO %ld ticks", cpu_id, timeout_ticks);
         string str = string(log_bufs[cpu_id].data());
         if(readfds) {
             str += ", RFDs: ";
@@ -1366,24 +1537,47 @@ MP_SYSCALL_DEFINE(1072, host_pselect6) {
         return pc + 4;
     }
 
-    sch_lock.lock();
-    auto iter = select_wait_threads.emplace(CURT, wt).first;
-    sch_lock.unlock();
-    pthread_create(&wt.th, nullptr, select_wait_thread_function, &(iter->second));
-
-    CURT->save_context_stack(pc + 4, iregs, true);
-    sch_lock.lock();
-    bool ret = switch_next_thread_nolock(cpu_id, SWFLAG_WAIT);
-    sch_lock.unlock();
-    if(ret) {
-        simroot_assert(cpu_devs[cpu_id].exec_thread);
-        RVRegArray regs;
-        VirtAddrT nextpc = cpu_devs[cpu_id].exec_thread->recover_context_stack(regs);
-        cpu_devs[cpu_id].cpu->redirect(nextpc, regs);
-        return nextpc;
+    // 在宿主上以0超时重新执行select，就绪的宿主fd转换回模拟的fd编号
+    auto try_select = [=](int64_t *ret) mutable -> bool {
+        fd_set r = host_readfds, w = host_writefds, e = host_exceptfds;
+        struct timeval zerotime;
+        zerotime.tv_sec = zerotime.tv_usec = 0;
+        *ret = select(host_nfds, (readfds?(&r):nullptr), (writefds?(&w):nullptr), (exceptfds?(&e):nullptr), &zerotime);
+        if(*ret == 0) return false;
+        if(*ret < 0) {
+            *ret = -errno;
+            return true;
+        }
+        if(readfds) FD_ZERO(readfds);
+        if(writefds) FD_ZERO(writefds);
+        if(exceptfds) FD_ZERO(exceptfds);
+        for(int i = 0; i < host_nfds; i++) {
+            if(readfds && FD_ISSET(i, &r)) FD_SET(hostfd_to_simfd[i], readfds);
+            if(writefds && FD_ISSET(i, &w)) FD_SET(hostfd_to_simfd[i], writefds);
+            if(exceptfds && FD_ISSET(i, &e)) FD_SET(hostfd_to_simfd[i], exceptfds);
+        }
+        return true;
+    };
+    int64_t ret = 0;
+    if(try_select(&ret) || timeout_ticks == 0 || iofds.empty()) {
+        if(ret == 0 && timeout_ticks != 0 && iofds.empty()) {
+            // 没有等待的fd时相当于睡眠
+            return wait_host_io(cpu_id, pc, iregs, "host_pselect6", iofds, nullptr, timeout_ticks, [](){ return 0L; });
+        }
+        if(ret == 0) {
+            if(readfds) FD_ZERO(readfds);
+            if(writefds) FD_ZERO(writefds);
+            if(exceptfds) FD_ZERO(exceptfds);
+        }
+        IREG_V(a0) = ret;
+        return pc + 4;
     }
-    cpu_devs[cpu_id].cpu->halt();
-    return 0;
+    return wait_host_io(cpu_id, pc, iregs, "host_pselect6", iofds, try_select, timeout_ticks, [=]() -> int64_t {
+        if(readfds) FD_ZERO(readfds);
+        if(writefds) FD_ZERO(writefds);
+        if(exceptfds) FD_ZERO(exceptfds);
+        return 0;
+    });
 }
 
 MP_SYSCALL_DEFINE(1073, host_ppoll) {
@@ -1397,17 +1591,11 @@ MP_SYSCALL_DEFINE(1073, host_ppoll) {
         simroot_assert(0);
     }
     
-    PollWaitThread wt;
-    wt.thread = CURT;
-    wt.host_fds = (uint8_t*)hostfd;
-    wt.nfds = nfds;
-    wt.timeout_us = (tmo?(tmo->tv_nsec / 1000L + tmo->tv_sec * 1000000L):-1L);
-    wt.sys = this;
-    wt.cpuid = cpu_id;
+    int64_t timeout_ticks = (tmo?timespec_to_ticks(tmo):-1L);
 
     bool invalid_fd = false;
     if(log_syscall) {
-        sprintf(log_bufs[cpu_id].data(), "CPU %d Syscall host_ppoll: TMO %ldus, FDs: ", cpu_id, wt.timeout_us);
+        sprintf(log_bufs[cpu_id].data(), "CPU %d Syscall host_ppoll: TMO %ld ticks, FDs: ", cpu_id, timeout_ticks);
         string str = string(log_bufs[cpu_id].data());
         for(uint64_t i = 0; i < nfds; i++) {
             int simfd = hostfd[i].fd;
@@ -1438,24 +1626,25 @@ MP_SYSCALL_DEFINE(1073, host_ppoll) {
         return pc + 4;
     }
 
-    sch_lock.lock();
-    auto iter = poll_wait_threads.emplace(CURT, wt).first;
-    sch_lock.unlock();
-    pthread_create(&wt.th, nullptr, poll_wait_thread_function, &(iter->second));
-
-    CURT->save_context_stack(pc + 4, iregs, true);
-    sch_lock.lock();
-    bool ret = switch_next_thread_nolock(cpu_id, SWFLAG_WAIT);
-    sch_lock.unlock();
-    if(ret) {
-        simroot_assert(cpu_devs[cpu_id].exec_thread);
-        RVRegArray regs;
-        VirtAddrT nextpc = cpu_devs[cpu_id].exec_thread->recover_context_stack(regs);
-        cpu_devs[cpu_id].cpu->redirect(nextpc, regs);
-        return nextpc;
+    auto try_poll = [=](int64_t *ret) -> bool {
+        *ret = poll(hostfd, nfds, 0);
+        if(*ret == 0) return false;
+        if(*ret < 0) *ret = -errno;
+        return true;
+    };
+    int64_t ret = 0;
+    if(try_poll(&ret) || timeout_ticks == 0) {
+        IREG_V(a0) = ret;
+        return pc + 4;
     }
-    cpu_devs[cpu_id].cpu->halt();
-    return 0;
+    vector<HostIOReactor::IOFd> iofds;
+    for(uint64_t i = 0; i < nfds; i++) {
+        iofds.push_back(HostIOReactor::IOFd{.fd = hostfd[i].fd, .events = (uint32_t)(hostfd[i].events)});
+    }
+    return wait_host_io(cpu_id, pc, iregs, "host_ppoll", iofds, try_poll, timeout_ticks, [=]() -> int64_t {
+        for(uint64_t i = 0; i < nfds; i++) hostfd[i].revents = 0;
+        return 0;
+    });
 }
 
 MP_SYSCALL_DEFINE(1078, host_readlinkat) {
@@ -1485,21 +1674,13 @@ MP_SYSCALL_DEFINE(1080, host_fstat) {
 MP_SYSCALL_DEFINE(1093, host_exit) {
     CPUFLOG("CPU%d Raise an ECALL: EXIT(%ld)", cpu_id, IREG_V(a0));
     RVThread *thread = cpu_devs[cpu_id].exec_thread;
-    sch_lock.lock();
     if(thread->clear_child_tid) {
         // Wake up all futex
         PhysAddrT paddr = 0;
-        simroot_assert(thread->va2pa(thread->clear_child_tid, &paddr, 0) == SimError::success);
-        auto res = futex_wait_threads.find(paddr);
-        if(res != futex_wait_threads.end()) {
-            auto &tl = res->second;
-            for(auto &fwt : tl) {
-                fwt.thread->context_stack.back().regs[RV_REG_a0] = 0;
-                insert_ready_thread_nolock(fwt.thread, fwt.last_cpu_id);
-            }
-            futex_wait_threads.erase(res);
-        }
+        simroot_assert(sys_va2pa(thread, thread->clear_child_tid, &paddr) == SimError::success);
+        futex_wake(paddr, FUTEX_BITSET_MATCH_ANY, UINT64_MAX);
     }
+    sch_lock.lock();
     if(switch_next_thread_nolock(cpu_id, SWFLAG_EXIT)) {
         sch_lock.unlock();
         simroot_assert(cpu_devs[cpu_id].exec_thread);
@@ -1524,7 +1705,7 @@ typedef struct {
     uint64_t    uaddr2;
     uint32_t    fval2;
     uint32_t    val3;
-    uint32_t    unlocked;
+    uint64_t    timeout;
 } HostFutexArgs;
 
 MP_SYSCALL_DEFINE(1098, host_futex) {
@@ -1533,62 +1714,102 @@ MP_SYSCALL_DEFINE(1098, host_futex) {
 
     LOG_SYSCALL_6("host_futex", "0x%lx", pargs->uaddr, "0x%x", pargs->futex_op, "0x%x", pargs->val, "0x%lx", pargs->uaddr2, "0x%x", pargs->val2, "0x%x", pargs->val3, "%s", "xxx");
 
-    uint64_t *plock = (uint64_t*)(syscall_memory->get_host_addr(syscall_memory->get_futex_lock_vaddr()));
     PhysAddrT paddr = 0, paddr2 = 0;
-    simroot_assert(thread->va2pa(pargs->uaddr, &paddr, 0) == SimError::success);
-    if(pargs->uaddr2) simroot_assert(thread->va2pa(pargs->uaddr2, &paddr2, 0) == SimError::success);
+    simroot_assert(sys_va2pa(thread, pargs->uaddr, &paddr) == SimError::success);
+    if(pargs->uaddr2) simroot_assert(sys_va2pa(thread, pargs->uaddr2, &paddr2) == SimError::success);
 
     uint32_t futex_op = pargs->futex_op;
     uint32_t futex_flag = (futex_op >> 8);
     futex_op &= 127;
 
     if(futex_op == FUTEX_WAIT || futex_op == FUTEX_WAIT_BITSET) {
+        uint32_t futex_mask = ((futex_op == FUTEX_WAIT_BITSET)?(pargs->val3):FUTEX_BITSET_MATCH_ANY);
+        if(!futex_mask) {
+            IREG_V(a0) = -EINVAL;
+            return pc + 4;
+        }
+        int64_t timeout_ticks = -1;
+        if(pargs->timeout) {
+            struct timespec *t = (struct timespec *)(syscall_memory->get_host_addr(pargs->timeout));
+            timeout_ticks = timespec_to_ticks(t);
+            if(futex_op == FUTEX_WAIT_BITSET) {
+                // FUTEX_WAIT_BITSET的超时是绝对时间
+                uint64_t freq = simroot::get_global_freq();
+                if(futex_flag & (FUTEX_CLOCK_REALTIME >> 8)) {
+                    timeout_ticks -= (int64_t)(simroot::get_sim_time_us() * (freq / 1000000UL));
+                }
+                else {
+                    timeout_ticks -= (int64_t)(simroot::get_current_tick());
+                }
+                if(timeout_ticks <= 0) {
+                    IREG_V(a0) = -ETIMEDOUT;
+                    return pc + 4;
+                }
+            }
+        }
+        FutexBucket &b = futex_bucket(paddr);
+        b.lock.lock();
         if(pargs->fval != pargs->val) {
+            b.lock.unlock();
             IREG_V(a0) = -EAGAIN;
             return pc + 4;
         }
         CPULOG("CPU %d Futex Wait", cpu_id);
-        thread->save_context_stack(pc + 4, iregs, true);
-        sch_lock.lock();
-        futex_wait_thread_insert(paddr, thread, (futex_op == FUTEX_WAIT_BITSET)?(pargs->val3):0, cpu_id);
-        bool ret = switch_next_thread_nolock(cpu_id, SWFLAG_WAIT);
-        sch_lock.unlock();
-        if(ret) {
-            simroot_assert(cpu_devs[cpu_id].exec_thread);
-            RVRegArray regs;
-            VirtAddrT nextpc = cpu_devs[cpu_id].exec_thread->recover_context_stack(regs);
-            cpu_devs[cpu_id].cpu->redirect(nextpc, regs);
-            return nextpc;
-        }
-        cpu_devs[cpu_id].cpu->halt();
-        return 0;
+        IREG_V(a0) = 0;
+        return futex_wait(cpu_id, pc, iregs, paddr, futex_mask, timeout_ticks);
     }
     else if(futex_op == FUTEX_WAKE || futex_op == FUTEX_WAKE_BITSET) {
-        FutexWaitThread buf;
-        uint32_t futex_mask = ((futex_op == FUTEX_WAKE_BITSET)?(pargs->val3):0);
-        uint64_t wake_cnt = 0;
-        sch_lock.lock();
-        for(wake_cnt = 0; wake_cnt < pargs->val; wake_cnt++) {
-            if(!futex_wait_thread_pop(paddr, futex_mask, &buf)) {
-                break;
-            }
-            insert_ready_thread_nolock(buf.thread, buf.last_cpu_id);
+        uint32_t futex_mask = ((futex_op == FUTEX_WAKE_BITSET)?(pargs->val3):FUTEX_BITSET_MATCH_ANY);
+        if(!futex_mask) {
+            IREG_V(a0) = -EINVAL;
+            return pc + 4;
         }
-        sch_lock.unlock();
-        IREG_V(a0) = wake_cnt;
+        IREG_V(a0) = futex_wake(paddr, futex_mask, pargs->val);
         return pc + 4;
     }
-    else if(futex_op == FUTEX_REQUEUE) {
-        LOG(ERROR) << "Unknown futex op " << futex_op;
-        simroot_assert(0);
-    }
-    else if(futex_op == FUTEX_CMP_REQUEUE) {
-        LOG(ERROR) << "Unknown futex op " << futex_op;
-        simroot_assert(0);
-    }
-    else if(futex_op == FUTEX_WAKE_OP) {
-        LOG(ERROR) << "Unknown futex op " << futex_op;
-        simroot_assert(0);
+    else if(futex_op == FUTEX_REQUEUE || futex_op == FUTEX_CMP_REQUEUE || futex_op == FUTEX_WAKE_OP) {
+        // 按桶下标的顺序加锁
+        uint64_t i1 = futex_bucket_index(paddr), i2 = futex_bucket_index(paddr2);
+        FutexBucket &b1 = futex_buckets[std::min(i1, i2)];
+        FutexBucket &b2 = futex_buckets[std::max(i1, i2)];
+        b1.lock.lock();
+        if(i1 != i2) b2.lock.lock();
+        int64_t ret = 0;
+        vector<FutexWaitThread> woken;
+        if(futex_op == FUTEX_CMP_REQUEUE && pargs->fval != pargs->val3) {
+            ret = -EAGAIN;
+        }
+        else if(futex_op == FUTEX_WAKE_OP) {
+            // 对*uaddr2的原子操作已经由代理函数完成，fval2为旧值
+            uint32_t cmp = ((pargs->val3 >> 24) & 0xf);
+            int32_t cmparg = (((int32_t)(pargs->val3 << 20)) >> 20);
+            int32_t oldval = (int32_t)(pargs->fval2);
+            bool cond = false;
+            switch (cmp)
+            {
+            case FUTEX_OP_CMP_EQ: cond = (oldval == cmparg); break;
+            case FUTEX_OP_CMP_NE: cond = (oldval != cmparg); break;
+            case FUTEX_OP_CMP_LT: cond = (oldval < cmparg); break;
+            case FUTEX_OP_CMP_LE: cond = (oldval <= cmparg); break;
+            case FUTEX_OP_CMP_GT: cond = (oldval > cmparg); break;
+            case FUTEX_OP_CMP_GE: cond = (oldval >= cmparg); break;
+            default: ret = -ENOSYS;
+            }
+            if(ret == 0) {
+                ret = futex_wait_thread_pop(paddr, FUTEX_BITSET_MATCH_ANY, pargs->val, woken);
+                if(cond) ret += futex_wait_thread_pop(paddr2, FUTEX_BITSET_MATCH_ANY, pargs->val2, woken);
+            }
+        }
+        else {
+            ret = futex_wait_thread_pop(paddr, FUTEX_BITSET_MATCH_ANY, pargs->val, woken);
+            uint64_t requeued = futex_requeue_nolock(paddr, paddr2, pargs->val2);
+            if(futex_op == FUTEX_CMP_REQUEUE) ret += requeued;
+        }
+        if(i1 != i2) b2.lock.unlock();
+        b1.lock.unlock();
+        futex_wake_threads(woken);
+        IREG_V(a0) = ret;
+        return pc + 4;
     }
     else if(futex_op == FUTEX_LOCK_PI) {
         LOG(ERROR) << "Unknown futex op " << futex_op;
@@ -1605,37 +1826,8 @@ MP_SYSCALL_DEFINE(1098, host_futex) {
 
 MP_SYSCALL_DEFINE(1115, host_clock_nanosleep) {
     struct timespec* time = (struct timespec*)HOST_ADDR_OF_IREG(a2);
-    double simtime2realtime = ((double)(simroot::get_global_freq()) / (double)(simroot::get_sim_tick_per_real_sec()));
-    struct timespec ht;
-    ht.tv_nsec = time->tv_nsec * simtime2realtime;
-    ht.tv_sec = time->tv_sec * simtime2realtime;
-    ht.tv_sec += (ht.tv_nsec / 1000000000UL);
-    ht.tv_nsec = (ht.tv_nsec % 1000000000UL);
-    
-    SleepWaitThread wt;
-    wt.thread = CURT;
-    wt.host_time = ht;
-    wt.sys = this;
-    wt.cpuid = cpu_id;
-
-    sch_lock.lock();
-    auto iter = sleep_wait_threads.emplace(CURT, wt).first;
-    sch_lock.unlock();
-    pthread_create(&wt.th, nullptr, sleep_wait_thread_function, &(iter->second));
-
-    CURT->save_context_stack(pc + 4, iregs, true);
-    sch_lock.lock();
-    bool ret = switch_next_thread_nolock(cpu_id, SWFLAG_WAIT);
-    sch_lock.unlock();
-    if(ret) {
-        simroot_assert(cpu_devs[cpu_id].exec_thread);
-        RVRegArray regs;
-        VirtAddrT nextpc = cpu_devs[cpu_id].exec_thread->recover_context_stack(regs);
-        cpu_devs[cpu_id].cpu->redirect(nextpc, regs);
-        return nextpc;
-    }
-    cpu_devs[cpu_id].cpu->halt();
-    return 0;
+    vector<HostIOReactor::IOFd> fds;
+    return wait_host_io(cpu_id, pc, iregs, "host_clock_nanosleep", fds, nullptr, timespec_to_ticks(time), [](){ return 0L; });
 }
 
 MP_SYSCALL_DEFINE(1113, host_clock_gettime) {
@@ -1665,6 +1857,67 @@ MP_SYSCALL_DEFINE(1113, host_clock_gettime) {
     return pc + 4;
 }
 
+MP_SYSCALL_DEFINE(1122, host_sched_setaffinity) {
+    uint64_t len = IREG_V(a1);
+    uint64_t mask = 0;
+    memcpy(&mask, HOST_ADDR_OF_IREG(a2), std::min<uint64_t>(len, sizeof(mask)));
+    if(cpu_num < 64) mask &= ((1UL << cpu_num) - 1UL);
+    int64_t ret = 0;
+    RVThread *thread = nullptr;
+    sch_lock.lock();
+    if(IREG_V(a0) == 0) thread = CURT;
+    else for(auto t : *(CURT->threadgroup)) {
+        if(t->tid == IREG_V(a0)) thread = t;
+    }
+    if(!thread) ret = -ESRCH;
+    else if(!mask) ret = -EINVAL;
+    else thread->cpu_affinity = mask;
+    LOG_SYSCALL_3("host_sched_setaffinity", "%ld", IREG_V(a0), "%ld", IREG_V(a1), "0x%lx", mask, "%ld", ret);
+    IREG_V(a0) = ret;
+    if(ret || cpu_allowed(CURT, cpu_id)) {
+        sch_lock.unlock();
+        return pc + 4;
+    }
+    // 当前线程不再允许在本CPU上运行，迁移到允许的CPU
+    thread = CURT;
+    thread->save_context_stack(pc + 4, iregs, true);
+    cpu_devs[cpu_id].exec_thread = nullptr;
+    insert_ready_thread_nolock(thread, cpu_id);
+    RVThread *next = pick_next_thread_nolock(cpu_id);
+    if(next) run_thread_on_nolock(next, cpu_id);
+    sch_lock.unlock();
+    if(next) {
+        RVRegArray regs;
+        VirtAddrT nextpc = next->recover_context_stack(regs);
+        cpu_devs[cpu_id].cpu->redirect(nextpc, regs);
+        return nextpc;
+    }
+    cpu_devs[cpu_id].cpu->halt();
+    return 0;
+}
+
+MP_SYSCALL_DEFINE(1123, host_sched_getaffinity) {
+    uint64_t len = IREG_V(a1);
+    int64_t ret = sizeof(uint64_t);
+    RVThread *thread = nullptr;
+    sch_lock.lock();
+    if(IREG_V(a0) == 0) thread = CURT;
+    else for(auto t : *(CURT->threadgroup)) {
+        if(t->tid == IREG_V(a0)) thread = t;
+    }
+    if(!thread) ret = -ESRCH;
+    else if(len * 8 < cpu_num || (len & (sizeof(uint64_t) - 1))) ret = -EINVAL;
+    else {
+        uint64_t mask = thread->cpu_affinity;
+        if(cpu_num < 64) mask &= ((1UL << cpu_num) - 1UL);
+        memcpy(HOST_ADDR_OF_IREG(a2), &mask, sizeof(mask));
+    }
+    sch_lock.unlock();
+    LOG_SYSCALL_3("host_sched_getaffinity", "%ld", IREG_V(a0), "%ld", IREG_V(a1), "0x%lx", IREG_V(a2), "%ld", ret);
+    IREG_V(a0) = ret;
+    return pc + 4;
+}
+
 MP_SYSCALL_DEFINE(1134, host_sigaction) {
     RVThread *thread = cpu_devs[cpu_id].exec_thread;
     thread->sys_sigaction(IREG_V(a0), (RVKernelSigaction *)HOST_ADDR_OF_IREG(a1), (RVKernelSigaction *)HOST_ADDR_OF_IREG(a2));
@@ -1724,38 +1977,28 @@ MP_SYSCALL_DEFINE(1206, host_sendto) {
         IREG_V(a0) = -EBADF;
         return pc + 4;
     }
-    SockSendWaitThread wt;
-    wt.thread = CURT;
-    wt.sys = this;
-    wt.cpuid = cpu_id;
-    wt.simfd = simfd;
-    wt.hostfd = hostfd;
-    wt.buf = (uint8_t*)HOST_ADDR_OF_IREG(a1);
-    wt.bufsz = IREG_V(a2);
-    wt.flags = IREG_V(a3);
-    wt.dest_addr = (uint8_t*)HOST_ADDR_OF_IREG(a4);
-    wt.addrlen = IREG_V(a5);
-    
-    LOG_SYSCALL_6("host_sendto", "%ld", IREG_V(a0), "0x%lx", IREG_V(a1), "%ld", IREG_V(a2), "0x%lx", IREG_V(a3), "0x%lx", IREG_V(a4), "%ld", IREG_V(a5), "%s", "blocked");
-
-    sch_lock.lock();
-    auto iter = socksend_wait_threads.emplace(CURT, wt).first;
-    sch_lock.unlock();
-    pthread_create(&wt.th, nullptr, socksend_wait_thread_function, &(iter->second));
-
-    CURT->save_context_stack(pc + 4, iregs, true);
-    sch_lock.lock();
-    bool ret = switch_next_thread_nolock(cpu_id, SWFLAG_WAIT);
-    sch_lock.unlock();
-    if(ret) {
-        simroot_assert(cpu_devs[cpu_id].exec_thread);
-        RVRegArray regs;
-        VirtAddrT nextpc = cpu_devs[cpu_id].exec_thread->recover_context_stack(regs);
-        cpu_devs[cpu_id].cpu->redirect(nextpc, regs);
-        return nextpc;
+    uint8_t *buf = (uint8_t*)HOST_ADDR_OF_IREG(a1);
+    uint64_t bufsz = IREG_V(a2);
+    uint32_t flags = IREG_V(a3);
+    uint8_t *dest_addr = (uint8_t*)HOST_ADDR_OF_IREG(a4);
+    uint64_t addrlen = IREG_V(a5);
+
+    // 以非阻塞方式发送，阻塞的socket在缓冲区满时登记到宿主IO事件循环等待可写
+    auto try_send = [=](int64_t *ret) -> bool {
+        *ret = sendto(hostfd, buf, bufsz, flags | MSG_DONTWAIT, (struct sockaddr *)dest_addr, addrlen);
+        if(*ret >= 0) return true;
+        *ret = -errno;
+        return (*ret != -EAGAIN && *ret != -EWOULDBLOCK);
+    };
+    int64_t ret = 0;
+    if(try_send(&ret) || (flags & MSG_DONTWAIT) || (fcntl(hostfd, F_GETFL) & O_NONBLOCK)) {
+        LOG_SYSCALL_6("host_sendto", "%ld", IREG_V(a0), "0x%lx", IREG_V(a1), "%ld", IREG_V(a2), "0x%lx", IREG_V(a3), "0x%lx", IREG_V(a4), "%ld", IREG_V(a5), "%ld", ret);
+        IREG_V(a0) = ret;
+        return pc + 4;
     }
-    cpu_devs[cpu_id].cpu->halt();
-    return 0;
+    LOG_SYSCALL_6("host_sendto", "%ld", IREG_V(a0), "0x%lx", IREG_V(a1), "%ld", IREG_V(a2), "0x%lx", IREG_V(a3), "0x%lx", IREG_V(a4), "%ld", IREG_V(a5), "%s", "blocked");
+    vector<HostIOReactor::IOFd> iofds = {HostIOReactor::IOFd{.fd = hostfd, .events = POLLOUT}};
+    return wait_host_io(cpu_id, pc, iregs, "host_sendto", iofds, try_send, -1, nullptr);
 }
 
 MP_SYSCALL_DEFINE(1208, host_setsockopt) {
@@ -1786,47 +2029,46 @@ MP_SYSCALL_DEFINE(1212, host_recvmsg) {
         IREG_V(a0) = -EBADF;
         return pc + 4;
     }
-    SockRecvWaitThread wt;
-    wt.thread = CURT;
-    wt.sys = this;
-    wt.cpuid = cpu_id;
-    wt.simfd = simfd;
-    wt.hostfd = hostfd;
-    wt.hbuf_msg = ((struct msghdr*)HOST_ADDR_OF_IREG(a1));
-    wt.msg = *(wt.hbuf_msg);
-    wt.flags = IREG_V(a2);
-
-    if(wt.msg.msg_name) wt.msg.msg_name = syscall_memory->get_host_addr((uint64_t)wt.msg.msg_name);
-    if(wt.msg.msg_control) wt.msg.msg_control = syscall_memory->get_host_addr((uint64_t)wt.msg.msg_control);
-    struct iovec * host_iovecs = (struct iovec *)syscall_memory->get_host_addr((uint64_t)wt.msg.msg_iov);
-    wt.iovecs.resize(wt.msg.msg_iovlen);
-    for(uint64_t i = 0; i < wt.msg.msg_iovlen; i++) {
-        wt.iovecs[i].iov_len = host_iovecs[i].iov_len;
-        wt.iovecs[i].iov_base = syscall_memory->get_host_addr((uint64_t)host_iovecs[i].iov_base);
-    }
-    wt.msg.msg_iov = wt.iovecs.data();
-    
-    LOG_SYSCALL_3("host_recvmsg", "%ld", IREG_V(a0), "0x%lx", IREG_V(a1), "0x%lx", IREG_V(a2), "%s", "blocked");
-
-    sch_lock.lock();
-    auto iter = sockrecv_wait_threads.emplace(CURT, wt).first;
-    iter->second.msg.msg_iov = iter->second.iovecs.data();
-    sch_lock.unlock();
-    pthread_create(&wt.th, nullptr, sockrecv_wait_thread_function, &(iter->second));
-
-    CURT->save_context_stack(pc + 4, iregs, true);
-    sch_lock.lock();
-    bool ret = switch_next_thread_nolock(cpu_id, SWFLAG_WAIT);
-    sch_lock.unlock();
-    if(ret) {
-        simroot_assert(cpu_devs[cpu_id].exec_thread);
-        RVRegArray regs;
-        VirtAddrT nextpc = cpu_devs[cpu_id].exec_thread->recover_context_stack(regs);
-        cpu_devs[cpu_id].cpu->redirect(nextpc, regs);
-        return nextpc;
+    typedef struct {
+        struct msghdr   msg;
+        vector<struct iovec> iovecs;
+        struct msghdr  *hbuf_msg = nullptr;
+    } RecvMsg;
+    std::shared_ptr<RecvMsg> rm = std::make_shared<RecvMsg>();
+    uint32_t flags = IREG_V(a2);
+    rm->hbuf_msg = ((struct msghdr*)HOST_ADDR_OF_IREG(a1));
+    rm->msg = *(rm->hbuf_msg);
+
+    if(rm->msg.msg_name) rm->msg.msg_name = syscall_memory->get_host_addr((uint64_t)rm->msg.msg_name);
+    if(rm->msg.msg_control) rm->msg.msg_control = syscall_memory->get_host_addr((uint64_t)rm->msg.msg_control);
+    struct iovec * host_iovecs = (struct iovec *)syscall_memory->get_host_addr((uint64_t)rm->msg.msg_iov);
+    rm->iovecs.resize(rm->msg.msg_iovlen);
+    for(uint64_t i = 0; i < rm->msg.msg_iovlen; i++) {
+        rm->iovecs[i].iov_len = host_iovecs[i].iov_len;
+        rm->iovecs[i].iov_base = syscall_memory->get_host_addr((uint64_t)host_iovecs[i].iov_base);
+    }
+    rm->msg.msg_iov = rm->iovecs.data();
+
+    auto try_recv = [=](int64_t *ret) -> bool {
+        *ret = recvmsg(hostfd, &(rm->msg), flags | MSG_DONTWAIT);
+        if(*ret < 0) {
+            *ret = -errno;
+            return (*ret != -EAGAIN && *ret != -EWOULDBLOCK);
+        }
+        rm->hbuf_msg->msg_controllen = rm->msg.msg_controllen;
+        rm->hbuf_msg->msg_namelen = rm->msg.msg_namelen;
+        rm->hbuf_msg->msg_flags = rm->msg.msg_flags;
+        return true;
+    };
+    int64_t ret = 0;
+    if(try_recv(&ret) || (flags & MSG_DONTWAIT) || (fcntl(hostfd, F_GETFL) & O_NONBLOCK)) {
+        LOG_SYSCALL_3("host_recvmsg", "%ld", IREG_V(a0), "0x%lx", IREG_V(a1), "0x%lx", IREG_V(a2), "%ld", ret);
+        IREG_V(a0) = ret;
+        return pc + 4;
     }
-    cpu_devs[cpu_id].cpu->halt();
-    return 0;
+    LOG_SYSCALL_3("host_recvmsg", "%ld", IREG_V(a0), "0x%lx", IREG_V(a1), "0x%lx", IREG_V(a2), "%s", "blocked");
+    vector<HostIOReactor::IOFd> iofds = {HostIOReactor::IOFd{.fd = hostfd, .events = POLLIN}};
+    return wait_host_io(cpu_id, pc, iregs, "host_recvmsg", iofds, try_recv, -1, nullptr);
 }
 
 MP_SYSCALL_DEFINE(1220, host_clone) {
@@ -1842,6 +2084,8 @@ MP_SYSCALL_DEFINE(1220, host_clone) {
     VirtAddrT ret = alloc_tid();
     RVThread *newthread = new RVThread(thread, ret, clone_flags);
     newthread->clear_child_tid = child_tidptr;
+    // 非CLONE_VM时父进程的可写页被改为COW，同时新页表分配了新的ASID
+    if(newthread->pgtable != thread->pgtable) tlb_shootdown_all();
 
     RVRegArray newregs;
     memcpy(newregs.data(), iregs.data(), iregs.size() * sizeof(uint64_t));
@@ -1898,6 +2142,7 @@ MP_SYSCALL_DEFINE(1221, host_execve) {
     uint64_t entry = 0, sp = 0;
     list<MemPagesToLoad> ldpg;
     CURT->elf_exec(workload, &ldpg, &entry, &sp);
+    tlb_shootdown_all();
 
     auto &context = CURT->context_stack.back();
     context.recover_a0 = true;
@@ -1920,7 +2165,7 @@ MP_SYSCALL_DEFINE(1221, host_execve) {
             waitthread.to_free.push_back(buf);
             memcpy(buf, pg.data.data() + (PAGE_LEN_BYTE * i), PAGE_LEN_BYTE);
             PhysAddrT paddr = 0;
-            simroot_assert(CURT->va2pa((pg.vpi + i) << PAGE_ADDR_OFFSET, &paddr, 0) == SimError::success);
+            simroot_assert(sys_va2pa(CURT, (pg.vpi + i) << PAGE_ADDR_OFFSET, &paddr) == SimError::success);
             reqs.emplace_back(DMARequestUnit{
                 .src = (PhysAddrT)buf,
                 .dst = paddr,
@@ -1983,6 +2228,8 @@ MP_SYSCALL_DEFINE(1435, host_clone3) {
     VirtAddrT ret = alloc_tid();
     RVThread *newthread = new RVThread(thread, ret, clone_flags);
     newthread->clear_child_tid = child_tidptr;
+    // 非CLONE_VM时父进程的可写页被改为COW，同时新页表分配了新的ASID
+    if(newthread->pgtable != thread->pgtable) tlb_shootdown_all();
 
     RVRegArray newregs;
     memcpy(newregs.data(), iregs.data(), iregs.size() * sizeof(uint64_t));
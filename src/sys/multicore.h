@@ -34,6 +34,9 @@
 #include "rvthread.h"
 #include "syscallmem.h"
 #include "pagemmap.h"
+#include "hostio.h"
+
+#include <deque>
 
 #include <sys/uio.h>
 #include <sys/socket.h>
@@ -49,7 +52,7 @@ using simcache::SimDMADevice;
 
 using isa::RVRegArray;
 
-class SimSystemMultiCore : public CPUSystemInterface, public DMACallBackHandler {
+class SimSystemMultiCore : public CPUSystemInterface, public DMACallBackHandler, public SimObject {
 public:
 
     SimSystemMultiCore() {};
@@ -57,6 +60,8 @@ public:
     void init(SimWorkload &workload, std::vector<CPUInterface*> &cpus, PhysPageAllocator *ppman, SimDMADevice *dma);
 
     virtual SimError v_to_p(uint32_t cpu_id, VirtAddrT addr, PhysAddrT *out, PageFlagT flg);
+    virtual SimError v_to_p_pgofs(uint32_t cpu_id, VirtAddrT addr, PhysAddrT *out, PageFlagT flg, uint32_t *pgofs);
+    virtual AsidT get_asid(uint32_t cpu_id);
     virtual uint32_t is_dev_mem(uint32_t cpu_id, VirtAddrT addr);
     virtual bool dev_input(uint32_t cpu_id, VirtAddrT addr, uint32_t len, void *buf);
     virtual bool dev_output(uint32_t cpu_id, VirtAddrT addr, uint32_t len, void *buf);
@@ -67,6 +72,13 @@ public:
 
     virtual void dma_complete_callback(uint64_t callbackid);
 
+    // 唤醒宿主IO已完成或定时器到期的线程，唤醒时会重定向CPU，因此不能在apply阶段进行
+    virtual void on_current_tick();
+    // 没有待处理的事件时休眠到下一个定时器到期周期
+    virtual void apply_next_tick();
+
+    virtual void print_statistic(std::ofstream &ofile);
+
 protected:
     bool has_init = false;
 
@@ -82,43 +94,86 @@ protected:
     uint32_t cpu_num = 0;
     std::vector<CPUDevice> cpu_devs;
 
+    // 页表修改后通知所有CPU失效对应的TLB表项，超过阈值时直接清空TLB
+    const uint64_t TLB_SHOOTDOWN_MAX_PAGES = 64;
+    inline void tlb_shootdown(VirtAddrT vaddr, uint64_t length) {
+        VPageIndexT vpn = (vaddr >> PAGE_ADDR_OFFSET);
+        VPageIndexT vpn_end = CEIL_DIV(vaddr + length, PAGE_LEN_BYTE);
+        for(auto &dev : cpu_devs) {
+            if(vpn_end - vpn > TLB_SHOOTDOWN_MAX_PAGES) {
+                dev.cpu->flush_tlb_all();
+                continue;
+            }
+            for(VPageIndexT i = vpn; i < vpn_end; i++) dev.cpu->flush_tlb(i);
+        }
+    }
+    inline void tlb_shootdown_all() {
+        for(auto &dev : cpu_devs) dev.cpu->flush_tlb_all();
+    }
+    // 系统直接读写用户内存（futex、DMA、clear_child_tid）时使用，零页被换成独占页后CPU中缓存的旧翻译需要清除
+    inline SimError sys_va2pa(RVThread *thread, VirtAddrT vaddr, PhysAddrT *out) {
+        bool remapped = false;
+        SimError ret = thread->va2pa_sys(vaddr, out, &remapped);
+        if(remapped) tlb_shootdown(vaddr, 1);
+        return ret;
+    }
+
+    /**
+     * futex等待队列按物理地址散列到futex_buckets中，每个桶有独立的锁
+     * 加锁顺序：global_lock（系统调用中） -> 桶锁（两个桶时按下标从小到大） -> sch_lock
+     * futex_timeout在系统调用之外触发，不取global_lock，只按桶锁 -> sch_lock的顺序加锁
+     * 等待的线程在持有桶锁时换出，因此从桶中取出的线程一定已经不在CPU上
+     */
     typedef struct {
         RVThread *      thread = nullptr;
         uint32_t        futex_mask = 0;
         uint32_t        last_cpu_id = 0;
     } FutexWaitThread;
-
-    std::unordered_map<PhysAddrT, std::list<FutexWaitThread>> futex_wait_threads;
+    typedef struct {
+        SpinLock lock;
+        std::unordered_map<PhysAddrT, std::list<FutexWaitThread>> waiters;
+    } FutexBucket;
+    std::vector<FutexBucket> futex_buckets;
+    inline uint64_t futex_bucket_index(PhysAddrT paddr) {
+        return ((paddr >> 2) ^ (paddr >> 12)) & (futex_buckets.size() - 1);
+    }
+    inline FutexBucket &futex_bucket(PhysAddrT paddr) {
+        return futex_buckets[futex_bucket_index(paddr)];
+    }
+    // 需要持有paddr所在的桶锁
     inline void futex_wait_thread_insert(PhysAddrT paddr, RVThread * thread, uint32_t futex_mask, uint32_t cpu_id) {
-        auto res = futex_wait_threads.find(paddr);
-        if(res == futex_wait_threads.end()) {
-            futex_wait_threads.emplace(paddr, std::list<FutexWaitThread>());
-            res = futex_wait_threads.find(paddr);
-        }
-        res->second.emplace_back(FutexWaitThread {
+        futex_bucket(paddr).waiters[paddr].emplace_back(FutexWaitThread {
             .thread = thread, .futex_mask = futex_mask, .last_cpu_id = cpu_id
         });
     }
-    inline bool futex_wait_thread_pop(PhysAddrT paddr, uint32_t futex_mask, FutexWaitThread* out) {
-        auto res = futex_wait_threads.find(paddr);
-        if(res != futex_wait_threads.end() && !res->second.empty()) {
-            auto iter = res->second.begin();
-            if(futex_mask != 0) {
-                for(; iter != res->second.end(); iter++) {
-                    if(iter->futex_mask == futex_mask) break;
-                }
-            }
-            if(iter != res->second.end()) {
-                if(out) *out = *iter;
-                res->second.erase(iter);
-                if(res->second.empty()) futex_wait_threads.erase(res);
-                return true;
-            }
-        }
-        return false;
-    }
+    // 需要持有paddr所在的桶锁，取出最多max_cnt个掩码匹配的线程
+    uint64_t futex_wait_thread_pop(PhysAddrT paddr, uint32_t futex_mask, uint64_t max_cnt, vector<FutexWaitThread> &out);
+    // 需要持有两个地址所在的桶锁，将最多max_cnt个线程从paddr移动到paddr2
+    uint64_t futex_requeue_nolock(PhysAddrT paddr, PhysAddrT paddr2, uint64_t max_cnt);
+    // 唤醒已经从桶中取出的线程，不能持有sch_lock
+    void futex_wake_threads(vector<FutexWaitThread> &threads);
+    uint64_t futex_wake(PhysAddrT paddr, uint32_t futex_mask, uint64_t max_cnt);
+    // 线程在futex上等待直到被唤醒或超时，调用时持有paddr所在的桶锁，返回前释放
+    VirtAddrT futex_wait(uint32_t cpu_id, VirtAddrT pc, RVRegArray &iregs, PhysAddrT paddr, uint32_t futex_mask, int64_t timeout_ticks);
+    void futex_timeout(RVThread *thread);
+
+    uint64_t futex_wait_cnt = 0;
+    uint64_t futex_wake_cnt = 0;
+    uint64_t futex_requeue_cnt = 0;
+    uint64_t futex_timeout_cnt = 0;
 
     SimDMADevice *dma = nullptr;
+    PhysPageAllocator *ppman = nullptr;
+
+    // 透明大页：0关闭，1仅对madvise(MADV_HUGEPAGE)的区间，2对不小于2MB的匿名mmap与brk区间
+    uint32_t thp_mode = 0;
+    /**
+     * 将[vaddr, vaddr+length)中完整的2MB区间映射为大页，新分配的物理页通过DMA清零，期间线程等待
+     * 调用前需要设置好返回值寄存器
+     * @return 下一条指令的地址
+     */
+    VirtAddrT map_huge_pages_and_wait(uint32_t cpu_id, VirtAddrT pc, RVRegArray &iregs, VirtAddrT vaddr, uint64_t length);
+
     typedef struct {
         RVThread *      thread = nullptr;
         uint32_t        ref_cnt = 0;
@@ -128,103 +183,75 @@ protected:
     } DMAWaitThread;
     std::unordered_map<RVThread *, DMAWaitThread> dma_wait_threads;
 
+    /**
+     * 等待宿主IO或定时器的线程：宿主fd上的阻塞操作登记到host_io，超时登记到wait_timers，
+     * 二者都以RVThread指针为id，先发生的一方唤醒线程并取消另一方
+     */
     typedef struct {
-        SimSystemMultiCore * sys = nullptr;
-        uint32_t        cpuid = 0;
-        pthread_t       th;
-        RVThread *      thread = nullptr;
-        uint8_t *       host_fds = nullptr;
-        uint64_t        nfds = 0;
-        int64_t         timeout_us = 0;
-    } PollWaitThread;
-    std::unordered_map<RVThread *, PollWaitThread> poll_wait_threads;
-    static void * poll_wait_thread_function(void * param);
-
-    typedef struct {
-        SimSystemMultiCore * sys = nullptr;
-        uint32_t        cpuid = 0;
-        pthread_t       th;
-        RVThread *      thread = nullptr;
-        fd_set *        readfds = nullptr;
-        fd_set *        writefds = nullptr;
-        fd_set *        exceptfds = nullptr;
-        fd_set          host_readfds;
-        fd_set          host_writefds;
-        fd_set          host_exceptfds;
-        unordered_map<int, int> hostfd_to_simfd;
-        int32_t         nfds = 0;
-        int32_t         host_nfds = 0;
-        int64_t         timeout_us = 0;
-    } SelectWaitThread;
-    std::unordered_map<RVThread *, SelectWaitThread> select_wait_threads;
-    static void * select_wait_thread_function(void * param);
-
-    typedef struct {
-        SimSystemMultiCore * sys = nullptr;
-        uint32_t        cpuid = 0;
-        pthread_t       th;
-        RVThread *      thread = nullptr;
-        struct timespec host_time;
-    } SleepWaitThread;
-    std::unordered_map<RVThread *, SleepWaitThread> sleep_wait_threads;
-    static void * sleep_wait_thread_function(void * param);
-
-    typedef struct {
-        SimSystemMultiCore * sys = nullptr;
-        uint32_t        cpuid = 0;
-        pthread_t       th;
         RVThread *      thread = nullptr;
-        int32_t         simfd = 0;
-        int32_t         hostfd = 0;
-        uint8_t *       buf = nullptr;
-        uint64_t        bufsz = 0;
-    } BlockreadWaitThread;
-    std::unordered_map<RVThread *, BlockreadWaitThread> blkread_wait_threads;
-    static void * blkread_wait_thread_function(void * param);
-
-    typedef struct {
-        SimSystemMultiCore * sys = nullptr;
         uint32_t        cpuid = 0;
-        pthread_t       th;
-        RVThread *      thread = nullptr;
-        int32_t         simfd = 0;
-        int32_t         hostfd = 0;
-        uint32_t        flags = 0;
-        uint8_t *       buf = nullptr;
-        uint64_t        bufsz = 0;
-        uint8_t *       dest_addr = nullptr;
-        uint64_t        addrlen = 0;
-    } SockSendWaitThread;
-    std::unordered_map<RVThread *, SockSendWaitThread> socksend_wait_threads;
-    static void * socksend_wait_thread_function(void * param);
+        const char *    name = "";
+        bool            has_io = false;
+        std::function<int64_t()> on_timeout;   // 超时时调用，返回系统调用的返回值
+        bool            is_futex = false;      // futex等待的超时需要先从桶中移除，不调用on_timeout
+        PhysAddrT       futex_paddr = 0;
+    } IOWaitThread;
+    std::unordered_map<RVThread *, IOWaitThread> io_wait_threads;
+    HostIOReactor host_io;
+    SimTimerWheel wait_timers;
+    uint64_t io_wait_cnt = 0;
+    uint64_t io_timeout_cnt = 0;
 
-    typedef struct {
-        SimSystemMultiCore * sys = nullptr;
-        uint32_t        cpuid = 0;
-        pthread_t       th;
-        RVThread *      thread = nullptr;
-        int32_t         simfd = 0;
-        int32_t         hostfd = 0;
-        uint32_t        flags = 0;
-        struct msghdr   msg;
-        vector<struct iovec> iovecs;
-        struct msghdr  *hbuf_msg = nullptr;
-    } SockRecvWaitThread;
-    std::unordered_map<RVThread *, SockRecvWaitThread> sockrecv_wait_threads;
-    static void * sockrecv_wait_thread_function(void * param);
+    /**
+     * 当前线程进入等待并切换到下一个线程，fds为空时只等待超时
+     * @param timeout_ticks 小于0表示不超时
+     * @return 下一条指令的地址
+     */
+    VirtAddrT wait_host_io(uint32_t cpu_id, VirtAddrT pc, RVRegArray &iregs, const char *name,
+        vector<HostIOReactor::IOFd> &fds, HostIOReactor::IOFunc func, int64_t timeout_ticks, std::function<int64_t()> on_timeout);
+    void wake_io_wait_thread_nolock(std::unordered_map<RVThread *, IOWaitThread>::iterator iter, int64_t ret);
+    inline int64_t timespec_to_ticks(struct timespec *t) {
+        uint64_t freq = simroot::get_global_freq();
+        return t->tv_sec * freq + (uint64_t)(((uint128_t)(t->tv_nsec) * freq) / 1000000000UL);
+    }
 
     inline void cancle_wait_thread_nolock(RVThread *thread) {
         dma_wait_threads.erase(thread);
-        poll_wait_threads.erase(thread);
-        select_wait_threads.erase(thread);
-        sleep_wait_threads.erase(thread);
-        blkread_wait_threads.erase(thread);
-        socksend_wait_threads.erase(thread);
-        sockrecv_wait_threads.erase(thread);
+        auto res = io_wait_threads.find(thread);
+        if(res != io_wait_threads.end()) {
+            if(res->second.has_io) host_io.cancel((uint64_t)thread);
+            wait_timers.remove((uint64_t)thread);
+            io_wait_threads.erase(res);
+        }
     }
 
-    std::list<RVThread*> ready_threads;
+    /**
+     * 每个CPU一个就绪队列，线程优先进入唤醒它的CPU（或上次运行的CPU）的队列，
+     * CPU空闲且自身队列为空时从最长的队列中窃取一个允许在本CPU上运行的线程
+     */
+    std::vector<std::deque<RVThread*>> run_queues;
     std::set<RVThread*> waiting_threads;
+    inline bool cpu_allowed(RVThread *thread, uint32_t cpuid) {
+        return (thread->cpu_affinity >> cpuid) & 1;
+    }
+    // 在本CPU或其他CPU的队列中取出下一个可以在cpuid上运行的线程
+    RVThread *pick_next_thread_nolock(uint32_t cpuid);
+    // 将线程放到cpuid上运行，更新迁移统计
+    void run_thread_on_nolock(RVThread *thread, uint32_t cpuid);
+    inline void remove_ready_thread_nolock(RVThread *thread) {
+        for(auto &q : run_queues) {
+            for(auto iter = q.begin(); iter != q.end(); ) {
+                if(*iter == thread) iter = q.erase(iter);
+                else iter++;
+            }
+        }
+    }
+
+    uint64_t sch_migrate_cnt = 0;
+    uint64_t sch_steal_cnt = 0;
+    uint64_t sch_pick_cnt = 0;
+    uint64_t sch_runq_len_sum = 0;   // 每次取线程时本CPU队列长度之和
+    uint64_t sch_runq_len_max = 0;
 
     /**
      * 核心上正在运行的进程需要换出
@@ -266,8 +293,6 @@ protected:
     MP_SYSCALL_CLAIM(94, exitgroup);
     MP_SYSCALL_CLAIM(96, set_tid_address);
     MP_SYSCALL_CLAIM(99, set_robust_list);
-    MP_SYSCALL_CLAIM(122, sched_setaffinity); // Un-used
-    MP_SYSCALL_CLAIM(123, sched_getaffinity); // Un-used
     MP_SYSCALL_CLAIM(124, sched_yield);
     MP_SYSCALL_CLAIM(131, tgkill);
     MP_SYSCALL_CLAIM(172, getpid);
@@ -308,6 +333,8 @@ protected:
     MP_SYSCALL_CLAIM(1098, host_futex);
     MP_SYSCALL_CLAIM(1113, host_clock_gettime);
     MP_SYSCALL_CLAIM(1115, host_clock_nanosleep);
+    MP_SYSCALL_CLAIM(1122, host_sched_setaffinity);
+    MP_SYSCALL_CLAIM(1123, host_sched_getaffinity);
     MP_SYSCALL_CLAIM(1134, host_sigaction);
     MP_SYSCALL_CLAIM(1135, host_sigprocmask);
     MP_SYSCALL_CLAIM(1199, host_socketpair);
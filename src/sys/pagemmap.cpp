@@ -24,4 +24,403 @@
 #include "pagemmap.h"
 #include "simroot.h"
 
+#include <linux/mempolicy.h>
+#include <sys/syscall.h>
 
+#include <sstream>
+
+uint8_t *PhysPageAllocator::alloc_host_memory(uint64_t size, bool numa_interleave) {
+    void *p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    simroot_assertf(p != MAP_FAILED, "Failed to map %ld bytes of host memory for physical memory", size);
+    if(!numa_interleave) return (uint8_t*)p;
+
+    // 内存节点按缓存行交错编址，无法按节点绑定地址区间，因此将宿主页交错到所有在线的NUMA节点
+    std::ifstream f("/sys/devices/system/node/online");
+    string online;
+    if(!f.is_open() || !std::getline(f, online)) return (uint8_t*)p;
+    uint64_t nodemask = 0;
+    std::stringstream ss(online);
+    string item;
+    while(std::getline(ss, item, ',')) {
+        uint32_t a = 0, b = 0;
+        int n = sscanf(item.c_str(), "%u-%u", &a, &b);
+        if(n <= 0) continue;
+        if(n == 1) b = a;
+        for(uint32_t i = a; i <= b && i < 64; i++) nodemask |= (1UL << i);
+    }
+    if(std::__popcount(nodemask) > 1) {
+        if(syscall(SYS_mbind, p, size, MPOL_INTERLEAVE, &nodemask, 64, 0)) {
+            LOG(WARNING) << "Failed to interleave physical memory across host NUMA nodes " << online;
+        }
+    }
+    return (uint8_t*)p;
+}
+
+void PhysPageAllocator::free_host_memory(uint8_t *p_mem, uint64_t size) {
+    munmap(p_mem, size);
+}
+
+
+
+namespace test {
+
+bool test_radix_page_map() {
+    RadixPageMap pm;
+    std::map<VPageIndexT, PPageEntry> ref;
+    const VPageIndexT vpn_max = (MAX_VADDR >> PAGE_ADDR_OFFSET);
+
+    auto check = [&](RadixPageMap &m) -> bool {
+        if(m.size() != ref.size()) {
+            printf("Size mismatch: %ld, %ld\n", m.size(), ref.size());
+            return false;
+        }
+        auto iter = ref.begin();
+        bool pass = true;
+        m.for_each([&](VPageIndexT vpi, PPageEntry &pg) {
+            if(!pass) return;
+            if(iter == ref.end() || iter->first != vpi || iter->second.ppi != pg.ppi || iter->second.flg != pg.flg) {
+                printf("Entry mismatch @0x%lx\n", vpi);
+                pass = false;
+                return;
+            }
+            iter++;
+        });
+        return pass && (iter == ref.end());
+    };
+
+    for(uint64_t n = 0; n < 64; n++) {
+        VPageIndexT base = rand_long() % (vpn_max - 4096);
+        uint64_t cnt = RAND(1, 4096);
+        for(VPageIndexT vpi = base; vpi < base + cnt; vpi++) {
+            PPageEntry pg = {.ppi = rand_long(), .flg = (PageFlagT)RAND(0, 8), .fd = -1, .offset = 0};
+            bool inserted = (pm.insert(vpi, pg) != nullptr);
+            if(inserted != (ref.find(vpi) == ref.end())) {
+                printf("Insert mismatch @0x%lx\n", vpi);
+                return false;
+            }
+            if(inserted) ref.emplace(vpi, pg);
+        }
+    }
+    if(!check(pm)) return false;
+
+    for(uint64_t n = 0; n < 4096; n++) {
+        VPageIndexT vpi = ref.empty() ? 0 : std::next(ref.begin(), RAND(0, ref.size()))->first;
+        PPageEntry *pg = pm.find(vpi);
+        if(!pg || pg->ppi != ref[vpi].ppi) {
+            printf("Find mismatch @0x%lx\n", vpi);
+            return false;
+        }
+        if(pm.find(vpi + vpn_max) || pm.find(rand_long() | (1UL << 40))) {
+            printf("Find out-of-range VPN\n");
+            return false;
+        }
+    }
+
+    RadixPageMap cp(pm);
+    for(uint64_t n = 0; n < 64; n++) {
+        VPageIndexT vpi1 = rand_long() % vpn_max;
+        VPageIndexT vpi2 = vpi1 + RAND(1, 1<<20);
+        uint64_t erased = 0;
+        pm.erase_range(vpi1, vpi2, [&](VPageIndexT vpi, PPageEntry &pg) {
+            erased++;
+        });
+        uint64_t expected = 0;
+        for(auto iter = ref.lower_bound(vpi1); iter != ref.end() && iter->first < vpi2; ) {
+            iter = ref.erase(iter);
+            expected++;
+        }
+        if(erased != expected) {
+            printf("Erase range mismatch [0x%lx, 0x%lx): %ld, %ld\n", vpi1, vpi2, erased, expected);
+            return false;
+        }
+    }
+    if(!check(pm)) return false;
+
+    std::map<VPageIndexT, PPageEntry> remain = ref;
+    for(auto &e : remain) {
+        PPageEntry pg;
+        if(!pm.erase(e.first, &pg) || pg.ppi != e.second.ppi) {
+            printf("Erase mismatch @0x%lx\n", e.first);
+            return false;
+        }
+        ref.erase(e.first);
+    }
+    if(!pm.empty() || !check(pm)) return false;
+
+    // 复制出的页表不受原页表修改的影响
+    uint64_t cnt = 0;
+    cp.for_each_range(0, vpn_max, [&](VPageIndexT vpi, PPageEntry &pg) { cnt++; });
+    if(cnt != cp.size() || cnt == 0) {
+        printf("Copied map corrupted: %ld, %ld\n", cnt, cp.size());
+        return false;
+    }
+
+    return true;
+}
+
+}
+
+namespace test {
+
+bool test_phys_page_allocator() {
+    const uint64_t pgcnt = 8192 + 37;
+    std::vector<uint8_t> mem(pgcnt * PAGE_LEN_BYTE);
+    PhysPageAllocator pm(0x80000000UL, pgcnt * PAGE_LEN_BYTE, mem.data());
+    const PageIndexT base = (0x80000000UL >> PAGE_ADDR_OFFSET);
+
+    if(pm.get_free_page_cnt() != pgcnt - 1) {
+        printf("Zero page is not reserved\n");
+        return false;
+    }
+
+    std::set<PageIndexT> alloced;
+    for(uint64_t i = 0; i < pgcnt / 2; i++) {
+        PageIndexT ppi = pm.alloc();
+        if(ppi < base || ppi >= base + pgcnt || ppi == pm.get_zero_page() || !alloced.insert(ppi).second) {
+            printf("Bad page 0x%lx\n", ppi);
+            return false;
+        }
+        if(pm.real_addr_of(ppi) != mem.data() + ((ppi - base) << PAGE_ADDR_OFFSET)) {
+            printf("Bad real address of page 0x%lx\n", ppi);
+            return false;
+        }
+    }
+    // 随机释放一半后，连续分配只能落在完全空闲且对齐的区间上
+    for(auto iter = alloced.begin(); iter != alloced.end(); ) {
+        if(rand() & 1) {
+            pm.free(*iter);
+            iter = alloced.erase(iter);
+        }
+        else iter++;
+    }
+    PageIndexT huge = 0;
+    if(!pm.alloc_contiguous(512, 512, &huge)) {
+        printf("Contiguous allocation failed\n");
+        return false;
+    }
+    if(huge % 512) {
+        printf("Contiguous allocation is not aligned: 0x%lx\n", huge);
+        return false;
+    }
+    for(PageIndexT p = huge; p < huge + 512; p++) {
+        if(!alloced.insert(p).second) {
+            printf("Contiguous allocation overlaps page 0x%lx\n", p);
+            return false;
+        }
+    }
+    PageIndexT tmp = 0;
+    if(pm.alloc_contiguous(pgcnt, 1, &tmp)) {
+        printf("Oversized contiguous allocation succeeded\n");
+        return false;
+    }
+
+    PageIndexT shared = *alloced.begin();
+    pm.reuse(shared);
+    if(!pm.is_shared(shared) || pm.free(shared) || pm.is_shared(shared)) {
+        printf("Reference count mismatch\n");
+        return false;
+    }
+
+    uint64_t remain = pm.get_free_page_cnt();
+    for(uint64_t i = 0; i < remain; i++) {
+        PageIndexT ppi = pm.alloc();
+        if(!alloced.insert(ppi).second) {
+            printf("Page 0x%lx allocated twice\n", ppi);
+            return false;
+        }
+    }
+    if(alloced.size() != pgcnt - 1) {
+        printf("Pages lost: %ld\n", alloced.size());
+        return false;
+    }
+    for(auto p : alloced) pm.free(p);
+    if(pm.get_free_page_cnt() != pgcnt - 1) {
+        printf("Free count mismatch: %ld\n", pm.get_free_page_cnt());
+        return false;
+    }
+
+    // 宿主mmap内存：释放的页归还宿主，再次分配时内容为0
+    const uint64_t hostpgcnt = 64;
+    uint8_t *hostmem = PhysPageAllocator::alloc_host_memory(hostpgcnt * PAGE_LEN_BYTE, false);
+    {
+        PhysPageAllocator hm(0, hostpgcnt * PAGE_LEN_BYTE, hostmem, true);
+        vector<PageIndexT> pgs;
+        for(uint64_t i = 0; i < hostpgcnt - 1; i++) {
+            bool zeroed = false;
+            pgs.push_back(hm.alloc(&zeroed));
+            if(!zeroed) {
+                printf("Untouched host page 0x%lx is not reported as zeroed\n", pgs.back());
+                return false;
+            }
+            memset(hm.real_addr_of(pgs.back()), 0x5a, PAGE_LEN_BYTE);
+        }
+        for(auto p : pgs) hm.free(p);
+        for(uint64_t i = 0; i < hostpgcnt - 1; i++) {
+            bool zeroed = false;
+            PageIndexT ppi = hm.alloc(&zeroed);
+            uint8_t *host = hm.real_addr_of(ppi);
+            if(!zeroed || host[0] || host[PAGE_LEN_BYTE - 1]) {
+                printf("Released host page 0x%lx is not zeroed\n", ppi);
+                return false;
+            }
+        }
+    }
+    PhysPageAllocator::free_host_memory(hostmem, hostpgcnt * PAGE_LEN_BYTE);
+
+    return true;
+}
+
+// 两个页表中只被读过的按需分页页都映射在零页上，系统访问其中一个时只换出该页，之后的写入不再改变物理地址
+bool test_lazy_zero_page() {
+    const uint64_t pgcnt = 64;
+    std::vector<uint8_t> mem(pgcnt * PAGE_LEN_BYTE);
+    PhysPageAllocator pm(0x80000000UL, pgcnt * PAGE_LEN_BYTE, mem.data());
+    const PageIndexT zero = pm.get_zero_page();
+    const VPageIndexT vpi = 0x1000;
+    {
+        ThreadPageTable t1(&pm), t2(&pm);
+        t1.__alloc_multi_page(vpi, 1, PGFLAG_R | PGFLAG_W, 0, 0, true);
+        t2.__alloc_multi_page(vpi, 1, PGFLAG_R | PGFLAG_W, 0, 0, true);
+        PPageEntry *pg1 = t1.pgtable.find(vpi);
+        PPageEntry *pg2 = t2.pgtable.find(vpi);
+        t1.map_zero_page(pg1);
+        t2.map_zero_page(pg2);
+        if(pg1->ppi != zero || pg2->ppi != zero || !(pg1->flg & PGFLAG_COW) || (pg1->flg & PGFLAG_W)) {
+            printf("Read-only touched page is not a COW zero page\n");
+            return false;
+        }
+
+        t1.unshare_zero_page(pg1);
+        // 换出后页可写，之后的写入直接命中该页，futex等待与唤醒使用同一个物理地址
+        PageIndexT key = pg1->ppi;
+        if(key == zero || (pg1->flg & PGFLAG_COW) || !(pg1->flg & PGFLAG_W)) {
+            printf("System access still sees the zero page\n");
+            return false;
+        }
+        uint8_t *host = pm.real_addr_of(key);
+        for(uint64_t i = 0; i < PAGE_LEN_BYTE; i++) {
+            if(host[i]) {
+                printf("Unshared page is not zeroed\n");
+                return false;
+            }
+        }
+        if(pg2->ppi != zero || !pm.is_shared(zero)) {
+            printf("Other page table lost the zero page\n");
+            return false;
+        }
+        t2.unshare_zero_page(pg2);
+        if(pg2->ppi == key || pg2->ppi == zero) {
+            printf("Pages of different page tables alias\n");
+            return false;
+        }
+    }
+    if(pm.get_free_page_cnt() != pgcnt - 1) {
+        printf("Pages leaked: %ld free\n", pm.get_free_page_cnt());
+        return false;
+    }
+    return true;
+}
+
+bool test_vaddr_seg_map() {
+    const VPageIndexT end = 4096;
+    VAddrSegMap sm(end);
+    vector<int32_t> ref(end, -1); // 每页所属区间的info编号，-1为空闲
+
+    // 按参考模型检查区间内容与自顶向下的首次适配结果
+    auto check = [&](VAddrSegMap &m) -> bool {
+        vector<int32_t> got(end, -1);
+        VPageIndexT last = 0;
+        bool ok = true;
+        m.for_each([&](VAddrSeg &seg) {
+            if(seg.vpindex < last || seg.vpcnt == 0) ok = false;
+            last = seg.vpindex + seg.vpcnt;
+            for(VPageIndexT v = seg.vpindex; v < last && v < end; v++) got[v] = std::stoi(seg.info);
+        });
+        if(!ok || got != ref) {
+            printf("Segment content mismatch\n");
+            return false;
+        }
+        for(uint64_t cnt : {1UL, 3UL, 17UL, 256UL}) {
+            for(uint64_t align : {1UL, 8UL}) {
+                VPageIndexT top = end - 100;
+                VPageIndexT expect = 0;
+                bool found = false;
+                for(VPageIndexT v = ((top - cnt) / align) * align; ; v -= align) {
+                    bool free = true;
+                    for(VPageIndexT i = v; i < v + cnt; i++) if(ref[i] >= 0) { free = false; break; }
+                    if(free) {
+                        expect = v;
+                        found = true;
+                        break;
+                    }
+                    if(v < align) break;
+                }
+                VPageIndexT res = 0;
+                bool fres = m.find_free_top(cnt, align, top, &res);
+                if(fres) {
+                    for(VPageIndexT i = res; i < res + cnt; i++) {
+                        if(ref[i] >= 0 || i >= top || (res % align)) {
+                            printf("Bad placement 0x%lx for %ld pages\n", res, cnt);
+                            return false;
+                        }
+                    }
+                }
+                // 首次适配按空闲区间判断，对齐时可能放弃区间内的可用位置，只要求不高于参考值
+                if(fres != found && (align == 1 || fres)) {
+                    printf("Placement result mismatch for %ld pages, align %ld\n", cnt, align);
+                    return false;
+                }
+                if(align == 1 && fres && res != expect) {
+                    printf("Placement 0x%lx, expect 0x%lx\n", res, expect);
+                    return false;
+                }
+            }
+        }
+        return true;
+    };
+
+    srand(1234);
+    for(uint64_t round = 0; round < 4096; round++) {
+        uint32_t op = rand() % 3;
+        if(op == 0) {
+            uint64_t cnt = (rand() % 32) + 1;
+            VPageIndexT vpi = 0;
+            if(!sm.find_free_top(cnt, 1, end, &vpi)) continue;
+            int32_t info = rand() % 4;
+            sm.insert(VAddrSeg{.vpindex = vpi, .vpcnt = cnt, .info = to_string(info)});
+            for(VPageIndexT v = vpi; v < vpi + cnt; v++) ref[v] = info;
+        }
+        else if(op == 1) {
+            VPageIndexT vpi = rand() % end;
+            uint64_t cnt = std::min<uint64_t>((rand() % 16) + 1, end - vpi);
+            bool free = true;
+            for(VPageIndexT v = vpi; v < vpi + cnt; v++) if(ref[v] >= 0) free = false;
+            if(!free) continue;
+            int32_t info = rand() % 4;
+            sm.insert(VAddrSeg{.vpindex = vpi, .vpcnt = cnt, .info = to_string(info)});
+            for(VPageIndexT v = vpi; v < vpi + cnt; v++) ref[v] = info;
+        }
+        else {
+            VPageIndexT vpi = rand() % end;
+            uint64_t cnt = std::min<uint64_t>((rand() % 64) + 1, end - vpi);
+            sm.erase(vpi, vpi + cnt);
+            for(VPageIndexT v = vpi; v < vpi + cnt; v++) ref[v] = -1;
+        }
+        if((round & 63) == 0 && !check(sm)) {
+            printf("Round %ld failed\n", round);
+            return false;
+        }
+    }
+    if(!check(sm)) return false;
+
+    VAddrSegMap cp(sm);
+    sm.clear();
+    if(!check(cp) || sm.size() != 0) {
+        printf("Copy or clear failed\n");
+        return false;
+    }
+
+    return true;
+}
+
+}
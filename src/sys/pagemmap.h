@@ -27,61 +27,122 @@
 #include "spinlocks.h"
 #include "simroot.h"
 
+#include <sys/mman.h>
+
+/**
+ * 物理页分配器：模拟的物理内存是一段连续的主机内存，按页下标直接索引引用计数与主机地址
+ * 空闲页用位图记录（1为空闲），支持按对齐要求分配连续的多个页
+ */
 class PhysPageAllocator {
 
 public:
 
-    PhysPageAllocator(PhysAddrT start, uint64_t size, uint8_t *p_mem) : lock(64) {
-        init_segment(start, size, p_mem);
-    }
-
-    inline void init_segment(PhysAddrT start, uint64_t size, uint8_t *p_mem) {
+    /**
+     * 模拟的物理内存由宿主的匿名mmap提供（MAP_NORESERVE），未访问过的页不占用宿主内存
+     * numa_interleave为真时将宿主页交错分布到所有在线的NUMA节点
+     */
+    static uint8_t *alloc_host_memory(uint64_t size, bool numa_interleave);
+    static void free_host_memory(uint8_t *p_mem, uint64_t size);
+
+    /**
+     * host_mapped: p_mem由alloc_host_memory分配，引用计数归零的页通过madvise(MADV_DONTNEED)归还宿主，
+     * 再次分配时宿主保证其内容为0，不需要重新清零
+     */
+    PhysPageAllocator(PhysAddrT start, uint64_t size, uint8_t *p_mem, bool host_mapped = false) : lock(64) {
         simroot_assert((start & (PAGE_LEN_BYTE - 1)) == 0);
         simroot_assert((size & (PAGE_LEN_BYTE - 1)) == 0);
-        for(PageAddrT ppa = start; ppa + PAGE_LEN_BYTE <= (start + size); ppa += PAGE_LEN_BYTE) {
-            valid_pages.push_back(ppa >> PAGE_ADDR_OFFSET);
-            page_real_addr.insert(std::make_pair(ppa >> PAGE_ADDR_OFFSET, p_mem + (ppa - start)));
-        }
+        base_ppi = (start >> PAGE_ADDR_OFFSET);
+        page_cnt = (size >> PAGE_ADDR_OFFSET);
+        this->p_mem = p_mem;
+        refcnt.assign(page_cnt, 0);
+        free_bits.assign(CEIL_DIV(page_cnt, 64), ~0UL);
+        if(page_cnt & 63) free_bits.back() = ((1UL << (page_cnt & 63)) - 1);
+        free_cnt = page_cnt;
+        this->host_mapped = host_mapped;
+        zero_bits.assign(CEIL_DIV(page_cnt, 64), host_mapped?(~0UL):0UL);
+        // 全局共享的零页，只读映射给未写入过的匿名页，分配器自身持有一个引用因此永远不会被释放
+        zero_ppi = alloc();
+        memset(real_addr_of(zero_ppi), 0, PAGE_LEN_BYTE);
     }
 
     inline uint8_t * real_addr_of(PageIndexT ppindex) {
-        auto res = page_real_addr.find(ppindex);
-        simroot_assert(res != page_real_addr.end());
-        return res->second;
+        simroot_assert(ppindex - base_ppi < page_cnt);
+        return p_mem + ((ppindex - base_ppi) << PAGE_ADDR_OFFSET);
     }
 
-    inline PageIndexT alloc() {
+    /**
+     * @param zeroed 非空时返回该页在宿主上是否已经全为0
+     */
+    inline PageIndexT alloc(bool *zeroed = nullptr) {
         lock.lock();
-        if(valid_pages.empty()) {
+        if(free_cnt == 0) {
             sprintf(log_buf, "Physical memory run out!!!");
             LOG(ERROR) << log_buf;
             simroot_assert(0);
         }
-        PageIndexT ret = valid_pages.front();
-        valid_pages.pop_front();
-        alloced_pages.insert(std::make_pair(ret, 1));
+        uint64_t w = search_hint;
+        while(!free_bits[w]) {
+            w++;
+            if(w == free_bits.size()) w = 0;
+        }
+        search_hint = w;
+        uint64_t idx = (w << 6) + std::__countr_zero<uint64_t>(free_bits[w]);
+        if(zeroed) *zeroed = (zero_bits[w] >> (idx & 63)) & 1;
+        __take(idx, 1);
+        lock.unlock();
+        return base_ppi + idx;
+    }
+
+    /**
+     * 分配cnt个连续的物理页，首页的页号按align_cnt个页对齐
+     * @return 空闲页不足时返回false
+     */
+    inline bool alloc_contiguous(uint64_t cnt, uint64_t align_cnt, PageIndexT *out) {
+        simroot_assert(cnt > 0);
+        if(align_cnt == 0) align_cnt = 1;
+        bool ret = false;
+        lock.lock();
+        uint64_t idx = ALIGN(base_ppi, align_cnt) - base_ppi;
+        while(free_cnt >= cnt && idx + cnt <= page_cnt) {
+            uint64_t used = __find_used(idx, cnt);
+            if(used == UINT64_MAX) {
+                __take(idx, cnt);
+                *out = base_ppi + idx;
+                ret = true;
+                break;
+            }
+            idx = ALIGN(base_ppi + used + 1, align_cnt) - base_ppi;
+        }
         lock.unlock();
         return ret;
     }
 
     inline void reuse(PageIndexT ppindex) {
         lock.lock();
-        auto res = alloced_pages.find(ppindex);
-        simroot_assert(res != alloced_pages.end());
-        res->second ++;
+        uint64_t idx = ppindex - base_ppi;
+        simroot_assert(idx < page_cnt && refcnt[idx]);
+        refcnt[idx]++;
         lock.unlock();
     }
 
     inline bool free(PageIndexT ppindex) {
         bool ret = true;
         lock.lock();
-        auto res = alloced_pages.find(ppindex);
-        simroot_assert(res != alloced_pages.end());
-        if(res->second <= 1) {
-            alloced_pages.erase(res);
+        uint64_t idx = ppindex - base_ppi;
+        simroot_assert(idx < page_cnt && refcnt[idx]);
+        if((--refcnt[idx]) == 0) {
+            if(host_mapped) {
+                // 引用计数为0但尚未标记空闲，不会被其他线程分配，释放锁后再进行系统调用
+                lock.unlock();
+                madvise(real_addr_of(ppindex), PAGE_LEN_BYTE, MADV_DONTNEED);
+                host_release_cnt++;
+                lock.lock();
+                zero_bits[idx >> 6] |= (1UL << (idx & 63));
+            }
+            free_bits[idx >> 6] |= (1UL << (idx & 63));
+            free_cnt++;
         }
         else {
-            res->second --;
             ret = false;
         }
         lock.unlock();
@@ -90,29 +151,78 @@ public:
 
     inline bool is_shared(PageIndexT ppindex) {
         lock.lock();
-        auto res = alloced_pages.find(ppindex);
-        bool ret = (res != alloced_pages.end() && (res->second) > 1);
+        uint64_t idx = ppindex - base_ppi;
+        bool ret = (idx < page_cnt && refcnt[idx] > 1);
         lock.unlock();
         return ret;
     }
 
+    inline uint64_t get_free_page_cnt() {
+        return free_cnt;
+    }
+
+    inline PageIndexT get_zero_page() {
+        return zero_ppi;
+    }
+
+    // 按需分页统计
+    std::atomic<uint64_t> minor_fault_zero_map_cnt = 0;   // 首次读访问映射到零页
+    std::atomic<uint64_t> minor_fault_zero_cow_cnt = 0;   // 首次写访问从零页复制
+    std::atomic<uint64_t> minor_fault_host_alloc_cnt = 0; // 系统/DMA访问时直接分配
+    std::atomic<uint64_t> huge_page_alloc_cnt = 0;
+    std::atomic<uint64_t> huge_page_split_cnt = 0;
+    std::atomic<uint64_t> host_release_cnt = 0;           // 通过madvise归还宿主的页
+    std::atomic<uint64_t> host_zero_skip_cnt = 0;         // 分配时已为0而省去清零的页
+
     inline void debug_print_alloc_pages() {
         printf("Phys page allocator:\n");
-        for(auto &p : alloced_pages) {
-            printf("(0x%lx, %d), ", p.first, p.second);
+        for(uint64_t i = 0; i < page_cnt; i++) {
+            if(refcnt[i]) printf("(0x%lx, %d), ", base_ppi + i, refcnt[i]);
         }
         printf("\n");
     }
 
 protected:
 
-    std::unordered_map<PageIndexT, uint8_t*> page_real_addr;
+    PageIndexT base_ppi = 0;
+    uint64_t page_cnt = 0;
+    uint8_t *p_mem = nullptr;
 
     SpinLock lock;
-    std::list<PageIndexT> valid_pages;
-    std::unordered_map<PageIndexT, uint32_t> alloced_pages;
+    std::vector<uint32_t> refcnt;
+    std::vector<uint64_t> free_bits;
+    uint64_t free_cnt = 0;
+    uint64_t search_hint = 0;
+
+    bool host_mapped = false;
+    std::vector<uint64_t> zero_bits;
+
+    PageIndexT zero_ppi = 0;
 
     char log_buf[128];
+
+    inline void __take(uint64_t idx, uint64_t cnt) {
+        for(uint64_t i = idx; i < idx + cnt; i++) {
+            free_bits[i >> 6] &= ~(1UL << (i & 63));
+            zero_bits[i >> 6] &= ~(1UL << (i & 63));
+            refcnt[i] = 1;
+        }
+        free_cnt -= cnt;
+    }
+
+    // 返回[idx, idx+cnt)中第一个已分配页的下标，全部空闲时返回UINT64_MAX
+    inline uint64_t __find_used(uint64_t idx, uint64_t cnt) {
+        uint64_t end = idx + cnt;
+        while(idx < end) {
+            uint64_t b = (idx & 63);
+            uint64_t n = std::min<uint64_t>(64 - b, end - idx);
+            uint64_t used = ((~free_bits[idx >> 6]) >> b);
+            if(n < 64) used &= ((1UL << n) - 1);
+            if(used) return idx + std::__countr_zero<uint64_t>(used);
+            idx += n;
+        }
+        return UINT64_MAX;
+    }
 };
 
 
@@ -140,6 +250,439 @@ typedef struct {
     string      info;
 } VAddrSeg;
 
+/**
+ * 按Sv48的形状组织的4级基数树页表，每级9位，叶节点直接保存PPageEntry
+ * 查找只需要固定次数的指针访问，范围操作跳过不存在的子树，空节点在删除时回收
+ * 复制时叶节点整体拷贝，不需要逐项插入
+ */
+class RadixPageMap {
+public:
+    static const uint32_t LEVEL_BITS = 9;
+    static const uint32_t LEVEL_CNT = 4;
+    static const uint32_t NODE_ENTRIES = (1U << LEVEL_BITS);
+    static const uint32_t VPN_BITS = LEVEL_BITS * LEVEL_CNT;
+
+    RadixPageMap() { root = new InnerNode(); };
+    RadixPageMap(const RadixPageMap &o) {
+        root = (InnerNode*)__copy_node(o.root, LEVEL_CNT - 1);
+        entry_cnt = o.entry_cnt;
+    };
+    RadixPageMap& operator=(const RadixPageMap &o) {
+        if(this == &o) return *this;
+        __free_node(root, LEVEL_CNT - 1);
+        root = (InnerNode*)__copy_node(o.root, LEVEL_CNT - 1);
+        entry_cnt = o.entry_cnt;
+        return *this;
+    };
+    ~RadixPageMap() { __free_node(root, LEVEL_CNT - 1); };
+
+    inline uint64_t size() { return entry_cnt; };
+    inline bool empty() { return entry_cnt == 0; };
+
+    inline PPageEntry *find(VPageIndexT vpi) {
+        if(vpi >> VPN_BITS) [[unlikely]] return nullptr;
+        void *n = root;
+        for(uint32_t l = LEVEL_CNT - 1; l > 0; l--) {
+            n = ((InnerNode*)n)->child[__index_of(vpi, l)];
+            if(!n) return nullptr;
+        }
+        LeafNode *leaf = (LeafNode*)n;
+        uint32_t i = __index_of(vpi, 0);
+        return (leaf->test(i))?(&(leaf->entries[i])):nullptr;
+    }
+
+    // return nullptr if already exists
+    inline PPageEntry *insert(VPageIndexT vpi, const PPageEntry &entry) {
+        simroot_assertf(!(vpi >> VPN_BITS), "RadixPageMap: VPN 0x%lx out of range", vpi);
+        InnerNode *n = root;
+        for(uint32_t l = LEVEL_CNT - 1; l > 1; l--) {
+            void *&c = n->child[__index_of(vpi, l)];
+            if(!c) {
+                c = new InnerNode();
+                n->cnt++;
+            }
+            n = (InnerNode*)c;
+        }
+        void *&c = n->child[__index_of(vpi, 1)];
+        if(!c) {
+            c = new LeafNode();
+            n->cnt++;
+        }
+        LeafNode *leaf = (LeafNode*)c;
+        uint32_t i = __index_of(vpi, 0);
+        if(leaf->test(i)) return nullptr;
+        leaf->set(i);
+        leaf->entries[i] = entry;
+        entry_cnt++;
+        return &(leaf->entries[i]);
+    }
+
+    inline bool erase(VPageIndexT vpi, PPageEntry *out = nullptr) {
+        bool ret = false;
+        if(vpi >> VPN_BITS) [[unlikely]] return false;
+        auto func = [&](VPageIndexT v, PPageEntry &e) {
+            if(out) *out = e;
+            ret = true;
+        };
+        __erase_range(root, LEVEL_CNT - 1, 0, vpi, vpi + 1, func);
+        return ret;
+    }
+
+    /**
+     * 按VPN递增顺序访问[vpi1, vpi2)中存在的表项，func(VPageIndexT, PPageEntry&)
+     */
+    template<typename Func>
+    inline void for_each_range(VPageIndexT vpi1, VPageIndexT vpi2, Func func) {
+        vpi2 = std::min<VPageIndexT>(vpi2, 1UL << VPN_BITS);
+        if(vpi1 < vpi2) __for_each_range(root, LEVEL_CNT - 1, 0, vpi1, vpi2, func);
+    }
+    template<typename Func>
+    inline void for_each(Func func) {
+        __for_each_range(root, LEVEL_CNT - 1, 0, 0, 1UL << VPN_BITS, func);
+    }
+
+    /**
+     * 删除[vpi1, vpi2)中存在的表项，删除前对每一项调用func(VPageIndexT, PPageEntry&)
+     */
+    template<typename Func>
+    inline void erase_range(VPageIndexT vpi1, VPageIndexT vpi2, Func func) {
+        vpi2 = std::min<VPageIndexT>(vpi2, 1UL << VPN_BITS);
+        if(vpi1 < vpi2) __erase_range(root, LEVEL_CNT - 1, 0, vpi1, vpi2, func);
+    }
+
+    inline void clear() {
+        __free_node(root, LEVEL_CNT - 1);
+        root = new InnerNode();
+        entry_cnt = 0;
+    }
+
+protected:
+
+    typedef struct InnerNode {
+        void *      child[NODE_ENTRIES] = {};
+        uint32_t    cnt = 0;
+    } InnerNode;
+
+    typedef struct LeafNode {
+        uint64_t    valid[NODE_ENTRIES / 64] = {};
+        uint32_t    cnt = 0;
+        PPageEntry  entries[NODE_ENTRIES] = {};
+        inline bool test(uint32_t i) { return (valid[i >> 6] >> (i & 63)) & 1; }
+        inline void set(uint32_t i) { valid[i >> 6] |= (1UL << (i & 63)); cnt++; }
+        inline void reset(uint32_t i) { valid[i >> 6] &= ~(1UL << (i & 63)); cnt--; }
+    } LeafNode;
+
+    InnerNode *root = nullptr;
+    uint64_t entry_cnt = 0;
+
+    static inline uint32_t __index_of(VPageIndexT vpi, uint32_t level) {
+        return ((vpi >> (level * LEVEL_BITS)) & (NODE_ENTRIES - 1));
+    }
+    static inline uint64_t __span_of(uint32_t level) {
+        return (1UL << (level * LEVEL_BITS));
+    }
+
+    static void *__copy_node(void *node, uint32_t level) {
+        if(level == 0) return new LeafNode(*((LeafNode*)node));
+        InnerNode *src = (InnerNode*)node;
+        InnerNode *ret = new InnerNode();
+        ret->cnt = src->cnt;
+        for(uint32_t i = 0; i < NODE_ENTRIES; i++) {
+            if(src->child[i]) ret->child[i] = __copy_node(src->child[i], level - 1);
+        }
+        return ret;
+    }
+
+    static void __free_node(void *node, uint32_t level) {
+        if(level == 0) {
+            delete (LeafNode*)node;
+            return;
+        }
+        InnerNode *n = (InnerNode*)node;
+        for(uint32_t i = 0; i < NODE_ENTRIES && n->cnt; i++) {
+            if(n->child[i]) {
+                __free_node(n->child[i], level - 1);
+                n->child[i] = nullptr;
+                n->cnt--;
+            }
+        }
+        delete n;
+    }
+
+    template<typename Func>
+    static void __for_each_range(void *node, uint32_t level, VPageIndexT base, VPageIndexT vpi1, VPageIndexT vpi2, Func &func) {
+        uint64_t span = __span_of(level);
+        uint32_t i1 = (vpi1 > base)?((vpi1 - base) / span):0;
+        uint32_t i2 = std::min<uint64_t>(NODE_ENTRIES, CEIL_DIV(vpi2 - base, span));
+        if(level == 0) {
+            LeafNode *leaf = (LeafNode*)node;
+            for(uint32_t i = i1; i < i2; i++) {
+                if(leaf->test(i)) func(base + i, leaf->entries[i]);
+            }
+            return;
+        }
+        InnerNode *n = (InnerNode*)node;
+        for(uint32_t i = i1; i < i2; i++) {
+            if(n->child[i]) __for_each_range(n->child[i], level - 1, base + i * span, vpi1, vpi2, func);
+        }
+    }
+
+    // return true if the node becomes empty
+    template<typename Func>
+    bool __erase_range(void *node, uint32_t level, VPageIndexT base, VPageIndexT vpi1, VPageIndexT vpi2, Func &func) {
+        uint64_t span = __span_of(level);
+        uint32_t i1 = (vpi1 > base)?((vpi1 - base) / span):0;
+        uint32_t i2 = std::min<uint64_t>(NODE_ENTRIES, CEIL_DIV(vpi2 - base, span));
+        if(level == 0) {
+            LeafNode *leaf = (LeafNode*)node;
+            for(uint32_t i = i1; i < i2; i++) {
+                if(leaf->test(i)) {
+                    func(base + i, leaf->entries[i]);
+                    leaf->reset(i);
+                    entry_cnt--;
+                }
+            }
+            return (leaf->cnt == 0);
+        }
+        InnerNode *n = (InnerNode*)node;
+        for(uint32_t i = i1; i < i2; i++) {
+            if(n->child[i] && __erase_range(n->child[i], level - 1, base + i * span, vpi1, vpi2, func)) {
+                __free_node(n->child[i], level - 1);
+                n->child[i] = nullptr;
+                n->cnt--;
+            }
+        }
+        return (n->cnt == 0 && n != root);
+    }
+};
+
+/**
+ * 虚拟地址区间表：有序的VAddrSeg加上按地址排序的空闲区间树（treap，每个节点维护子树中最大的空闲长度）
+ * 自顶向下的首次适配、区间的拆分与合并都是O(log n)
+ * 相邻且info相同的区间在插入时合并
+ */
+class VAddrSegMap {
+public:
+    VAddrSegMap(VPageIndexT end_vpi) : end_vpi(end_vpi) {
+        gaps = __new_gap(0, end_vpi);
+    };
+    VAddrSegMap(const VAddrSegMap &o) : end_vpi(o.end_vpi), segs(o.segs), rng(o.rng) {
+        gaps = __copy_gap(o.gaps);
+    };
+    VAddrSegMap& operator=(const VAddrSegMap &o) {
+        if(this == &o) return *this;
+        __free_gap(gaps);
+        end_vpi = o.end_vpi;
+        segs = o.segs;
+        rng = o.rng;
+        gaps = __copy_gap(o.gaps);
+        return *this;
+    };
+    ~VAddrSegMap() { __free_gap(gaps); };
+
+    inline uint64_t size() { return segs.size(); };
+
+    inline void clear() {
+        __free_gap(gaps);
+        segs.clear();
+        gaps = __new_gap(0, end_vpi);
+    }
+
+    // return nullptr if vpi is not in any segment
+    inline VAddrSeg *find(VPageIndexT vpi) {
+        auto iter = segs.upper_bound(vpi);
+        if(iter == segs.begin()) return nullptr;
+        iter--;
+        return (vpi < iter->second.vpindex + iter->second.vpcnt)?(&(iter->second)):nullptr;
+    }
+
+    // [seg.vpindex, seg.vpindex + seg.vpcnt)必须完全空闲
+    inline void insert(const VAddrSeg &seg) {
+        VPageIndexT v1 = seg.vpindex, v2 = seg.vpindex + seg.vpcnt;
+        simroot_assertf(seg.vpcnt > 0 && v2 <= end_vpi, "VAddrSegMap: Bad segment 0x%lx, %ld", v1, seg.vpcnt);
+        GapNode *g = __gap_floor(gaps, v1);
+        simroot_assertf(g && g->start + g->len >= v2, "VAddrSegMap: Segment 0x%lx, %ld overlaps", v1, seg.vpcnt);
+        VPageIndexT g1 = g->start, g2 = g->start + g->len;
+        __gap_replace(g1, g2, g1, v1, v2, g2);
+
+        VAddrSeg tmp = seg;
+        auto next = segs.lower_bound(v2);
+        if(next != segs.end() && next->first == v2 && next->second.info == seg.info) {
+            tmp.vpcnt += next->second.vpcnt;
+            segs.erase(next);
+        }
+        auto prev = segs.lower_bound(v1);
+        if(prev != segs.begin()) {
+            prev--;
+            if(prev->first + prev->second.vpcnt == v1 && prev->second.info == seg.info) {
+                prev->second.vpcnt += tmp.vpcnt;
+                return;
+            }
+        }
+        segs.emplace(v1, tmp);
+    }
+
+    // 删除[vpi1, vpi2)内的所有区间，跨边界的区间被拆分
+    inline void erase(VPageIndexT vpi1, VPageIndexT vpi2) {
+        if(vpi1 >= vpi2) return;
+        auto iter = segs.lower_bound(vpi1);
+        if(iter != segs.begin()) {
+            auto prev = std::prev(iter);
+            if(prev->first + prev->second.vpcnt > vpi1) iter = prev;
+        }
+        bool changed = false;
+        while(iter != segs.end() && iter->first < vpi2) {
+            VAddrSeg seg = iter->second;
+            VPageIndexT s1 = seg.vpindex, s2 = seg.vpindex + seg.vpcnt;
+            iter = segs.erase(iter);
+            if(s1 < vpi1) {
+                VAddrSeg lo = seg;
+                lo.vpcnt = vpi1 - s1;
+                segs.emplace(s1, lo);
+            }
+            if(s2 > vpi2) {
+                VAddrSeg hi = seg;
+                hi.vpindex = vpi2;
+                hi.vpcnt = s2 - vpi2;
+                iter = segs.emplace(vpi2, hi).first;
+            }
+            changed = true;
+        }
+        if(!changed) return;
+        // 被删除的部分与两侧的空闲区间合并为一个
+        VPageIndexT lo = 0, hi = end_vpi;
+        auto next = segs.lower_bound(vpi1);
+        if(next != segs.end()) hi = next->first;
+        if(next != segs.begin()) {
+            auto prev = std::prev(next);
+            lo = prev->first + prev->second.vpcnt;
+        }
+        __gap_replace(lo, hi, lo, hi, hi, hi);
+    }
+
+    /**
+     * 在top以下自顶向下寻找第一个能放下vpcnt个页的空闲区间，起始页号按align_pgcnt对齐
+     * @return 没有足够大的空闲区间时返回false
+     */
+    inline bool find_free_top(uint64_t vpcnt, uint64_t align_pgcnt, VPageIndexT top, VPageIndexT *out) {
+        if(align_pgcnt == 0) align_pgcnt = 1;
+        uint64_t need = vpcnt + align_pgcnt - 1;
+        GapNode *g = __gap_top_fit(gaps, top, need);
+        if(!g) return false;
+        VPageIndexT end = std::min(g->start + g->len, top);
+        *out = ((end - vpcnt) / align_pgcnt) * align_pgcnt;
+        return true;
+    }
+
+    template<typename Func>
+    inline void for_each(Func func) {
+        for(auto &e : segs) func(e.second);
+    }
+
+protected:
+    typedef struct GapNode {
+        VPageIndexT start = 0;
+        uint64_t    len = 0;
+        uint64_t    max_len = 0;
+        uint64_t    prio = 0;
+        GapNode     *l = nullptr;
+        GapNode     *r = nullptr;
+    } GapNode;
+
+    VPageIndexT end_vpi = 0;
+    std::map<VPageIndexT, VAddrSeg> segs;
+    GapNode *gaps = nullptr;
+    uint64_t rng = 0x9e3779b97f4a7c15UL;
+
+    inline GapNode *__new_gap(VPageIndexT start, uint64_t len) {
+        GapNode *n = new GapNode();
+        n->start = start;
+        n->len = n->max_len = len;
+        rng ^= (rng << 13);
+        rng ^= (rng >> 7);
+        rng ^= (rng << 17);
+        n->prio = rng;
+        return n;
+    }
+    GapNode *__copy_gap(GapNode *n) {
+        if(!n) return nullptr;
+        GapNode *ret = new GapNode(*n);
+        ret->l = __copy_gap(n->l);
+        ret->r = __copy_gap(n->r);
+        return ret;
+    }
+    void __free_gap(GapNode *n) {
+        if(!n) return;
+        __free_gap(n->l);
+        __free_gap(n->r);
+        delete n;
+    }
+    inline void __pull(GapNode *n) {
+        n->max_len = n->len;
+        if(n->l) n->max_len = std::max(n->max_len, n->l->max_len);
+        if(n->r) n->max_len = std::max(n->max_len, n->r->max_len);
+    }
+    // a: start < key, b: start >= key
+    void __split(GapNode *n, VPageIndexT key, GapNode **a, GapNode **b) {
+        if(!n) {
+            *a = *b = nullptr;
+            return;
+        }
+        if(n->start < key) {
+            __split(n->r, key, &(n->r), b);
+            *a = n;
+        }
+        else {
+            __split(n->l, key, a, &(n->l));
+            *b = n;
+        }
+        __pull(n);
+    }
+    GapNode *__merge(GapNode *a, GapNode *b) {
+        if(!a) return b;
+        if(!b) return a;
+        if(a->prio > b->prio) {
+            a->r = __merge(a->r, b);
+            __pull(a);
+            return a;
+        }
+        b->l = __merge(a, b->l);
+        __pull(b);
+        return b;
+    }
+    // 删除起始页号在[lo, hi)内的空闲区间，然后插入非空的[n1, n2)与[n3, n4)
+    inline void __gap_replace(VPageIndexT lo, VPageIndexT hi, VPageIndexT n1, VPageIndexT n2, VPageIndexT n3, VPageIndexT n4) {
+        GapNode *a = nullptr, *m = nullptr, *c = nullptr;
+        __split(gaps, lo, &a, &m);
+        __split(m, hi, &m, &c);
+        __free_gap(m);
+        if(n2 > n1) a = __merge(a, __new_gap(n1, n2 - n1));
+        if(n4 > n3) a = __merge(a, __new_gap(n3, n4 - n3));
+        gaps = __merge(a, c);
+    }
+    GapNode *__gap_floor(GapNode *n, VPageIndexT vpi) {
+        GapNode *ret = nullptr;
+        while(n) {
+            if(n->start <= vpi) {
+                ret = n;
+                n = n->r;
+            }
+            else n = n->l;
+        }
+        return ret;
+    }
+    // 起始页号最大的、截断到top以下后长度不小于need的空闲区间
+    GapNode *__gap_top_fit(GapNode *n, VPageIndexT top, uint64_t need) {
+        if(!n || n->max_len < need) return nullptr;
+        if(n->start < top) {
+            GapNode *ret = __gap_top_fit(n->r, top, need);
+            if(ret) return ret;
+            if(std::min(n->start + n->len, top) - n->start >= need) return n;
+        }
+        return __gap_top_fit(n->l, top, need);
+    }
+};
+
 /**
  * For static elf
  * 0                                                                        MAX_MMAP_VADDR
@@ -162,28 +705,41 @@ class ThreadPageTable {
 
 public:
 
-    ThreadPageTable(PhysPageAllocator *ppman) : ppman(ppman) {} ;
+    ThreadPageTable(PhysPageAllocator *ppman) : ppman(ppman), mmap_segments(1UL << RadixPageMap::VPN_BITS) {
+        // 创建新页表时系统会清空所有CPU的TLB，因此ASID回绕后复用旧值不会命中过期表项
+        asid = (AsidT)(asid_alloc.fetch_add(1) + 1);
+    };
     ~ThreadPageTable() {
-        for(auto &entry : pgtable) {
-            ppman->free(entry.second.ppi);
-        }
+        pgtable.for_each([&](VPageIndexT vpi, PPageEntry &pg) {
+            if(!(pg.flg & PGFLAG_LAZY)) ppman->free(pg.ppi);
+        });
     }
 
     PhysPageAllocator *ppman;
 
+    AsidT asid = 0;
+    static inline std::atomic<uint32_t> asid_alloc = 0;
+
     VirtAddrT brk_va = 0;
-    std::list<VAddrSeg> mmap_segments; // Ordered from high addr to low addr
+    VAddrSegMap mmap_segments;
 
-    std::unordered_map<VPageIndexT, PPageEntry> pgtable;
+    RadixPageMap pgtable;
 
-    inline void __alloc_multi_page(VPageIndexT vpindex, uint64_t vpcnt, PageFlagT flag, int32_t fd, uint64_t offset) {
+    inline void __alloc_multi_page(VPageIndexT vpindex, uint64_t vpcnt, PageFlagT flag, int32_t fd, uint64_t offset, bool lazy = false) {
         for(VPageIndexT vpi = vpindex; vpi < vpindex + vpcnt; vpi++) {
-            if(pgtable.find(vpi) != pgtable.end()) {
+            if(pgtable.find(vpi)) {
                 LOG(ERROR) << "Virt Addr Space Re-Allocated";
                 simroot_assert(0);
             }
+            if(lazy) {
+                pgtable.insert(vpi, PPageEntry{
+                    .ppi = 0, .flg = (flag | PGFLAG_LAZY), .fd = fd, .offset = offset
+                });
+                if(fd > 0) offset += PAGE_LEN_BYTE;
+                continue;
+            }
             PageIndexT ppi = ppman->alloc();
-            pgtable.emplace(vpi, PPageEntry{
+            pgtable.insert(vpi, PPageEntry{
                 .ppi = ppi, .flg = flag, .fd = fd, .offset = offset
             });
             if(fd > 0) {
@@ -192,14 +748,108 @@ public:
         }
     }
 
+    /**
+     * 按需分页：CPU首次访问时把保留的页映射到只读零页，可写页标记为COW，写访问由COW缺页流程复制
+     * MAP_SHARED的页需要在fork后保持共享，不使用按需分页
+     */
+    inline bool __lazy_mapping(PageFlagT flag) {
+        return !(flag & PGFLAG_SHARE);
+    }
+    inline void map_zero_page(PPageEntry *pg) {
+        simroot_assert(pg->flg & PGFLAG_LAZY);
+        pg->ppi = ppman->get_zero_page();
+        ppman->reuse(pg->ppi);
+        pg->flg &= (~PGFLAG_LAZY);
+        if(pg->flg & PGFLAG_W) {
+            pg->flg &= (~PGFLAG_W);
+            pg->flg |= PGFLAG_COW;
+        }
+        ppman->minor_fault_zero_map_cnt++;
+    }
+    // 由系统直接写入的页（DMA目标、futex地址等）需要独占的物理页
+    inline void materialize_page(PPageEntry *pg) {
+        simroot_assert(pg->flg & PGFLAG_LAZY);
+        bool zeroed = false;
+        pg->ppi = ppman->alloc(&zeroed);
+        if(zeroed) ppman->host_zero_skip_cnt++;
+        else memset(ppman->real_addr_of(pg->ppi), 0, PAGE_LEN_BYTE);
+        pg->flg &= (~PGFLAG_LAZY);
+        ppman->minor_fault_host_alloc_cnt++;
+    }
+    // CPU读过的页映射在共享的零页上，系统直接访问（futex、DMA等）前换成独占的全0页
+    // 否则futex按零页的物理地址排队，而写入后的COW会把该页换到新的物理页上
+    inline void unshare_zero_page(PPageEntry *pg) {
+        simroot_assert(!(pg->flg & PGFLAG_LAZY) && pg->ppi == ppman->get_zero_page());
+        bool zeroed = false;
+        PageIndexT ppi = ppman->alloc(&zeroed);
+        if(zeroed) ppman->host_zero_skip_cnt++;
+        else memset(ppman->real_addr_of(ppi), 0, PAGE_LEN_BYTE);
+        ppman->free(pg->ppi);
+        pg->ppi = ppi;
+        if(pg->flg & PGFLAG_COW) {
+            pg->flg &= (~PGFLAG_COW);
+            pg->flg |= PGFLAG_W;
+        }
+        ppman->minor_fault_zero_cow_cnt++;
+    }
+
+    /**
+     * 大页：2MB对齐的区间内512个表项指向连续对齐的物理页并带有PGFLAG_HUGE，权限保持一致
+     * 只有完整保留且未被访问过的区间可以转换为大页，部分修改（munmap/mprotect边界、fork的COW）时拆分为普通页
+     */
+    inline void map_huge(VPageIndexT vpi1, VPageIndexT vpi2, std::vector<PageIndexT> *out) {
+        for(VPageIndexT b = ALIGN(vpi1, HUGE_PAGE_PGCNT); b + HUGE_PAGE_PGCNT <= vpi2; b += HUGE_PAGE_PGCNT) {
+            bool ok = true;
+            uint64_t n = 0;
+            PageFlagT flg = 0;
+            pgtable.for_each_range(b, b + HUGE_PAGE_PGCNT, [&](VPageIndexT vpi, PPageEntry &pg) {
+                if(n == 0) flg = pg.flg;
+                if(pg.flg != flg || !(pg.flg & PGFLAG_LAZY) || (pg.flg & PGFLAG_SHARE)) ok = false;
+                n++;
+            });
+            if(!ok || n != HUGE_PAGE_PGCNT) continue;
+            PageIndexT ppi = 0;
+            if(!ppman->alloc_contiguous(HUGE_PAGE_PGCNT, HUGE_PAGE_PGCNT, &ppi)) break;
+            pgtable.for_each_range(b, b + HUGE_PAGE_PGCNT, [&](VPageIndexT vpi, PPageEntry &pg) {
+                pg.ppi = ppi + (vpi - b);
+                pg.flg &= (~PGFLAG_LAZY);
+                pg.flg |= PGFLAG_HUGE;
+            });
+            ppman->huge_page_alloc_cnt++;
+            if(out) out->push_back(ppi);
+        }
+    }
+    inline void split_huge(VPageIndexT vpi) {
+        PPageEntry *pg = pgtable.find(vpi);
+        if(!pg || !(pg->flg & PGFLAG_HUGE)) return;
+        VPageIndexT b = ((vpi / HUGE_PAGE_PGCNT) * HUGE_PAGE_PGCNT);
+        pgtable.for_each_range(b, b + HUGE_PAGE_PGCNT, [&](VPageIndexT v, PPageEntry &e) {
+            e.flg &= (~PGFLAG_HUGE);
+        });
+        ppman->huge_page_split_cnt++;
+    }
+
     inline void debug_print_alloc_pages() {
         printf("Thread page map:\n");
-        for(auto &p : pgtable) {
-            printf("(0x%lx -> 0x%lx, 0x%x), ", p.first, p.second.ppi, p.second.flg);
-        }
+        pgtable.for_each([&](VPageIndexT vpi, PPageEntry &pg) {
+            printf("(0x%lx -> 0x%lx, 0x%x), ", vpi, pg.ppi, pg.flg);
+        });
         printf("\n");
     }
 
+    // 按/proc/self/maps的格式输出mmap区间，权限取自区间首页
+    inline void debug_print_mmap_segments() {
+        mmap_segments.for_each([&](VAddrSeg &seg) {
+            PPageEntry *pg = pgtable.find(seg.vpindex);
+            PageFlagT flg = (pg?pg->flg:0);
+            printf("%012lx-%012lx %c%c%c%c %08lx 00:00 0 %s\n",
+                seg.vpindex << PAGE_ADDR_OFFSET, (seg.vpindex + seg.vpcnt) << PAGE_ADDR_OFFSET,
+                (flg & PGFLAG_R)?'r':'-', (flg & (PGFLAG_W | PGFLAG_COW))?'w':'-', (flg & PGFLAG_X)?'x':'-',
+                (flg & PGFLAG_SHARE)?'s':'p', (pg && pg->fd > 0)?(pg->offset):0UL, seg.info.c_str()
+            );
+        });
+    }
+
     inline VirtAddrT alloc_mmap_fixed(VirtAddrT addr, uint64_t size, PageFlagT flag, int32_t fd, uint64_t offset, string info) {
         VPageIndexT vpi = (addr >> PAGE_ADDR_OFFSET);
         VPageIndexT vpi2 = (ALIGN(addr + size, PAGE_LEN_BYTE) >> PAGE_ADDR_OFFSET);
@@ -207,81 +857,36 @@ public:
             return 0;
         }
         free_mmap(addr, size);
-        auto iter = mmap_segments.begin();
-        for(; iter != mmap_segments.end(); iter++) {
-            if(iter->vpindex + iter->vpcnt <= vpi) break;
-        }
-        mmap_segments.emplace(iter,VAddrSeg{
-                .vpindex = vpi, .vpcnt = vpi2 - vpi, .info = info
-            }
-        );
-        __alloc_multi_page(vpi, vpi2 - vpi, flag, fd, offset);
+        mmap_segments.insert(VAddrSeg{
+            .vpindex = vpi, .vpcnt = vpi2 - vpi, .info = info
+        });
+        __alloc_multi_page(vpi, vpi2 - vpi, flag, fd, offset, __lazy_mapping(flag));
         return addr;
     }
 
-    inline VirtAddrT alloc_mmap(uint64_t size, PageFlagT flag, int32_t fd, uint64_t offset, string info) {
+    inline VirtAddrT alloc_mmap(uint64_t size, PageFlagT flag, int32_t fd, uint64_t offset, string info, uint64_t align_pgcnt = 1) {
         uint64_t vpcnt = (ALIGN(size, PAGE_LEN_BYTE) >> PAGE_ADDR_OFFSET);
-        VPageIndexT top = (MAX_MMAP_VADDR >> PAGE_ADDR_OFFSET);
-        auto iter = mmap_segments.begin();
-        for(; iter != mmap_segments.end(); iter++) {
-            if(iter->vpindex + iter->vpcnt + vpcnt <= top) {
-                break;
-            }
-            top = iter->vpindex;
-        }
-        VPageIndexT vpindex = top - vpcnt;
-        if((vpindex << PAGE_ADDR_OFFSET) <= brk_va) {
+        VPageIndexT vpindex = 0;
+        if(!mmap_segments.find_free_top(vpcnt, align_pgcnt, (MAX_MMAP_VADDR >> PAGE_ADDR_OFFSET), &vpindex) || (vpindex << PAGE_ADDR_OFFSET) <= brk_va) {
             LOG(ERROR) << "Virt Addr Space Run out";
             simroot_assert(0);
         }
-        mmap_segments.emplace(iter,VAddrSeg{
-                .vpindex = vpindex, .vpcnt = vpcnt, .info = info
-            }
-        );
-        __alloc_multi_page(vpindex, vpcnt, flag, fd, offset);
+        mmap_segments.insert(VAddrSeg{
+            .vpindex = vpindex, .vpcnt = vpcnt, .info = info
+        });
+        __alloc_multi_page(vpindex, vpcnt, flag, fd, offset, __lazy_mapping(flag));
         return (vpindex << PAGE_ADDR_OFFSET);
     }
 
     inline void free_mmap(VirtAddrT va, uint64_t size) {
         VPageIndexT vpi = (va >> PAGE_ADDR_OFFSET);
         VPageIndexT vpi2 = (ALIGN(va + size, PAGE_LEN_BYTE) >> PAGE_ADDR_OFFSET);
-        for(auto iter = mmap_segments.begin(); iter != mmap_segments.end(); ) {
-            VPageIndexT i = iter->vpindex, i2 = iter->vpindex + iter->vpcnt;
-            if(i >= vpi2 || i2 <= vpi) {
-                iter++;
-                continue;
-            }
-            if(vpi > i && vpi2 < i2) {
-                VAddrSeg tmp = *iter;
-                iter->vpcnt = vpi - i;
-                tmp.vpindex = vpi2;
-                tmp.vpcnt = i2 - vpi2;
-                iter = mmap_segments.insert(iter, tmp);
-                iter++;
-                iter++;
-                continue;
-            }
-            if(vpi <= i && vpi2 >= i2) {
-                iter = mmap_segments.erase(iter);
-                continue;
-            }
-            if(vpi2 < i2) {
-                iter->vpindex = vpi2;
-                iter->vpcnt = i2 - vpi2;
-            }
-            else if(vpi > i) {
-                iter->vpcnt = vpi - i;
-            }
-            iter++;
-            continue;
-        }
-        for(VPageIndexT i = vpi; i < vpi2; i++) {
-            auto res = pgtable.find(i);
-            if(res != pgtable.end()) {
-                ppman->free(res->second.ppi);
-                pgtable.erase(res);
-            }
-        }
+        split_huge(vpi);
+        split_huge(vpi2 - 1);
+        mmap_segments.erase(vpi, vpi2);
+        pgtable.erase_range(vpi, vpi2, [&](VPageIndexT i, PPageEntry &pg) {
+            if(!(pg.flg & PGFLAG_LAZY)) ppman->free(pg.ppi);
+        });
     }
 
     inline void init_elf_seg(VirtAddrT start, uint64_t size, PageFlagT flag, string info) {
@@ -308,7 +913,7 @@ public:
         else {
             VPageIndexT vpindex = (ALIGN(brk_va, PAGE_LEN_BYTE) >> PAGE_ADDR_OFFSET);
             uint64_t vpcnt = (ALIGN(brk, PAGE_LEN_BYTE) >> PAGE_ADDR_OFFSET) - vpindex;
-            __alloc_multi_page(vpindex, vpcnt, (PGFLAG_R | PGFLAG_W), -1, 0);
+            __alloc_multi_page(vpindex, vpcnt, (PGFLAG_R | PGFLAG_W), -1, 0, true);
             ret = brk_va = brk;
         }
         return ret;
@@ -316,11 +921,12 @@ public:
 
     inline bool pgcpy_hostmem_to_va(VPageIndexT vpi, uint64_t vpcnt, void *hostmem) {
         for(uint64_t i = 0; i < vpcnt; i++) {
-            auto res = pgtable.find(vpi + i);
-            if(res == pgtable.end()) {
+            PPageEntry *res = pgtable.find(vpi + i);
+            if(!res) {
                 return false;
             }
-            uint8_t *hostpg = ppman->real_addr_of(res->second.ppi);
+            if(res->flg & PGFLAG_LAZY) materialize_page(res);
+            uint8_t *hostpg = ppman->real_addr_of(res->ppi);
             memcpy(hostpg, ((uint8_t*)hostmem) + (i * PAGE_LEN_BYTE), PAGE_LEN_BYTE);
         }
         return true;
@@ -332,4 +938,13 @@ public:
 };
 
 
+namespace test {
+
+bool test_radix_page_map();
+bool test_phys_page_allocator();
+bool test_vaddr_seg_map();
+bool test_lazy_zero_page();
+
+}
+
 #endif
@@ -100,6 +100,7 @@ RVThread::RVThread(RVThread *parent_thread, uint64_t newtid, uint64_t fork_flag)
     
     this->tid = newtid;
     this->pid = parent_thread->pid;
+    this->cpu_affinity = parent_thread->cpu_affinity;
     // memcpy(this->context_host_ecall, parent_thread->context_host_ecall, sizeof(this->context_host_ecall));
     // memcpy(this->context_switch, parent_thread->context_switch, sizeof(this->context_switch));
     // this->ecall_with_ret = parent_thread->ecall_with_ret;
@@ -201,16 +202,16 @@ RVThread::RVThread(RVThread *parent_thread, uint64_t newtid, uint64_t fork_flag)
         //     }
         // }
 
-        for(auto &entry : parent_pgtable->pgtable) {
-            VPageIndexT vpi = entry.first;
-            PPageEntry &pg = entry.second;
-            PageIndexT ppi = pg.ppi;
+        // 父子进程的COW按普通页处理，大页全部拆分
+        parent_pgtable->pgtable.for_each([&](VPageIndexT vpi, PPageEntry &pg) {
+            pg.flg &= (~PGFLAG_HUGE);
+            if(pg.flg & PGFLAG_LAZY) return;
             parent_pgtable->ppman->reuse(pg.ppi);
             if((pg.flg & PGFLAG_W) && !(pg.flg & (PGFLAG_SHARE))) {
                 pg.flg &= (~PGFLAG_W);
                 pg.flg |= (PGFLAG_COW);
             }
-        }
+        });
 
         this->pgtable->pgtable = parent_pgtable->pgtable;
 
@@ -301,9 +302,9 @@ void RVThread::elf_exec(SimWorkload &param, std::list<MemPagesToLoad> *out_vpgs,
     ThreadPageTable *raw_pgtable = pgtable.get();
 
     // 清空线程页表
-    for(auto &entry : raw_pgtable->pgtable) {
-        raw_pgtable->ppman->free(entry.second.ppi);
-    }
+    raw_pgtable->pgtable.for_each([&](VPageIndexT vpi, PPageEntry &pg) {
+        if(!(pg.flg & PGFLAG_LAZY)) raw_pgtable->ppman->free(pg.ppi);
+    });
     raw_pgtable->pgtable.clear();
     raw_pgtable->brk_va = 0;
     raw_pgtable->mmap_segments.clear();
@@ -642,13 +643,19 @@ VirtAddrT RVThread::sys_brk(VirtAddrT newbrk) {
     return ret;
 }
 
-VirtAddrT RVThread::sys_mmap(uint64_t length, uint64_t pgflag, int32_t fd, uint64_t offset, string info) {
+VirtAddrT RVThread::sys_mmap(uint64_t length, uint64_t pgflag, int32_t fd, uint64_t offset, string info, uint64_t align_pgcnt) {
     shared_lock->write_lock();
-    VirtAddrT ret = pgtable->alloc_mmap(length, pgflag, fd, offset, info);
+    VirtAddrT ret = pgtable->alloc_mmap(length, pgflag, fd, offset, info, align_pgcnt);
     shared_lock->write_unlock();
     return ret;
 }
 
+void RVThread::sys_map_huge(VirtAddrT vaddr, uint64_t length, std::vector<PageIndexT> *out) {
+    shared_lock->write_lock();
+    pgtable->map_huge(vaddr >> PAGE_ADDR_OFFSET, ALIGN(vaddr + length, PAGE_LEN_BYTE) >> PAGE_ADDR_OFFSET, out);
+    shared_lock->write_unlock();
+}
+
 VirtAddrT RVThread::sys_mmap_fixed(VirtAddrT addr, uint64_t length, uint64_t pgflag, int32_t fd, uint64_t offset, string info) {
     shared_lock->write_lock();
     VirtAddrT ret = pgtable->alloc_mmap_fixed(addr, length, pgflag, fd, offset, info);
@@ -670,13 +677,15 @@ void RVThread::sys_mprotect(VirtAddrT vaddr, uint64_t length, PageFlagT flag) {
     VPageIndexT vpi1 = (vaddr >> PAGE_ADDR_OFFSET);
     VPageIndexT vpi2 = (ALIGN(vaddr + length, PAGE_LEN_BYTE) >> PAGE_ADDR_OFFSET);
     shared_lock->write_lock();
-    for(VPageIndexT vpi = vpi1; vpi < vpi2; vpi++) {
-        auto res = pgtable->pgtable.find(vpi);
-        if(res != pgtable->pgtable.end()) {
-            res->second.flg &= (~set_mask);
-            res->second.flg |= flag;
-        }
-    }
+    pgtable->split_huge(vpi1);
+    pgtable->split_huge(vpi2 - 1);
+    pgtable->pgtable.for_each_range(vpi1, vpi2, [&](VPageIndexT vpi, PPageEntry &pg) {
+        // COW页（包括映射到零页的页）保持只读，写权限由COW缺页流程恢复
+        bool cow = (pg.flg & PGFLAG_COW);
+        pg.flg &= (~(set_mask | PGFLAG_COW));
+        if(cow && (flag & PGFLAG_W)) pg.flg |= ((flag & (~PGFLAG_W)) | PGFLAG_COW);
+        else pg.flg |= flag;
+    });
     shared_lock->write_unlock();
 }
 
@@ -754,16 +763,17 @@ void RVThread::sys_prlimit(uint64_t resource, rlimit* p_new, rlimit* p_old) {
 
 VPageIndexT RVThread::cow_realloc_missed_page(VPageIndexT missed) {
     shared_lock->write_lock();
-    auto res = pgtable->pgtable.find(missed);
-    simroot_assertf(res != pgtable->pgtable.end(), "Unknown Memory Access @0x%lx", missed << PAGE_ADDR_OFFSET);
-    PPageEntry &pg = res->second;
+    PPageEntry *res = pgtable->pgtable.find(missed);
+    simroot_assertf(res, "Unknown Memory Access @0x%lx", missed << PAGE_ADDR_OFFSET);
+    PPageEntry &pg = *res;
     simroot_assertf(pg.flg & PGFLAG_COW, "Not a COW Page @0x%lx", missed << PAGE_ADDR_OFFSET);
+    if(pg.ppi == pgtable->ppman->get_zero_page()) pgtable->ppman->minor_fault_zero_cow_cnt++;
     
     VPageIndexT tmp = (pgtable->dyn_lib_brk >> PAGE_ADDR_OFFSET) + 1;
-    while(pgtable->pgtable.find(tmp) != pgtable->pgtable.end()) tmp++;
+    while(pgtable->pgtable.find(tmp)) tmp++;
     simroot_assertf(tmp < (MAX_VADDR >> PAGE_ADDR_OFFSET), "Virt Memory Space Run out");
 
-    pgtable->pgtable.emplace(tmp, PPageEntry{
+    pgtable->pgtable.insert(tmp, PPageEntry{
         .ppi = pg.ppi,
         .flg = PGFLAG_R,
         .fd = 0,
@@ -778,12 +788,36 @@ VPageIndexT RVThread::cow_realloc_missed_page(VPageIndexT missed) {
     return tmp;
 }
 
+SimError RVThread::va2pa_first_touch(VirtAddrT addr, PhysAddrT *out, PageFlagT flg, uint32_t *pgofs) {
+    shared_lock->write_lock();
+    PPageEntry *pg = pgtable->pgtable.find(addr >> PAGE_ADDR_OFFSET);
+    if(pg && (pg->flg & PGFLAG_LAZY)) {
+        // flg为0表示系统访问，其余为CPU访问
+        if(flg) pgtable->map_zero_page(pg);
+        else pgtable->materialize_page(pg);
+    }
+    shared_lock->write_unlock();
+    if(!pg) return SimError::invalidaddr;
+    return va2pa(addr, out, flg, pgofs);
+}
+
+SimError RVThread::va2pa_sys(VirtAddrT addr, PhysAddrT *out, bool *remapped) {
+    *remapped = false;
+    shared_lock->write_lock();
+    PPageEntry *pg = pgtable->pgtable.find(addr >> PAGE_ADDR_OFFSET);
+    if(pg && !(pg->flg & PGFLAG_LAZY) && pg->ppi == pgtable->ppman->get_zero_page()) {
+        pgtable->unshare_zero_page(pg);
+        *remapped = true;
+    }
+    shared_lock->write_unlock();
+    return va2pa(addr, out, 0);
+}
+
 void RVThread::cow_free_tmp_page(VPageIndexT tmppage) {
     shared_lock->write_lock();
-    auto res = pgtable->pgtable.find(tmppage);
-    simroot_assert(res != pgtable->pgtable.end());
-    pgtable->ppman->free(res->second.ppi);
-    pgtable->pgtable.erase(res);
+    PPageEntry pg;
+    simroot_assert(pgtable->pgtable.erase(tmppage, &pg));
+    pgtable->ppman->free(pg.ppi);
     shared_lock->write_unlock();
 }
 
@@ -103,6 +103,11 @@ public:
 
     RVThreadState state = RVThreadState::READY;
 
+    // 允许运行的模拟CPU掩码，由sched_setaffinity设置，clone时继承
+    uint64_t cpu_affinity = ~0UL;
+    // 上一次运行的CPU，用于统计迁移次数
+    uint32_t last_cpu = UINT32_MAX;
+
     std::list<RVThread*> childs;
     RVThread *parent = nullptr;
     std::shared_ptr<std::list<RVThread*>> threadgroup;
@@ -120,7 +125,8 @@ public:
     void fdtable_force_insert(int32_t user_fd, int32_t sys_fd);
 
     VirtAddrT sys_brk(VirtAddrT newbrk);
-    VirtAddrT sys_mmap(uint64_t length, uint64_t pgflag, int32_t fd, uint64_t offset, string info);
+    VirtAddrT sys_mmap(uint64_t length, uint64_t pgflag, int32_t fd, uint64_t offset, string info, uint64_t align_pgcnt = 1);
+    void sys_map_huge(VirtAddrT vaddr, uint64_t length, std::vector<PageIndexT> *out);
     VirtAddrT sys_mmap_fixed(VirtAddrT addr, uint64_t length, uint64_t pgflag, int32_t fd, uint64_t offset, string info);
     void sys_munmap(VirtAddrT vaddr, uint64_t length);
     void sys_mprotect(VirtAddrT vaddr, uint64_t length, PageFlagT flag);
@@ -129,29 +135,34 @@ public:
 
     VPageIndexT cow_realloc_missed_page(VPageIndexT missed);
     void cow_free_tmp_page(VPageIndexT tmppage);
+    SimError va2pa_first_touch(VirtAddrT addr, PhysAddrT *out, PageFlagT flg, uint32_t *pgofs);
+    // 系统直接访问用户内存时的地址翻译，映射在零页上的页会换成独占页，此时*remapped为true，需要清除各CPU的TLB项
+    SimError va2pa_sys(VirtAddrT addr, PhysAddrT *out, bool *remapped);
 
-    inline SimError va2pa(VirtAddrT addr, PhysAddrT *out, PageFlagT flg) {
+    // pgofs: 可选，输出该映射的页大小（地址偏移位数）
+    inline SimError va2pa(VirtAddrT addr, PhysAddrT *out, PageFlagT flg, uint32_t *pgofs = nullptr) {
         PageIndexT _ppi = 0;
         PageFlagT _flg = 0;
         bool hit = true;
         shared_lock->read_lock();
-        auto res = pgtable->pgtable.find(addr >> PAGE_ADDR_OFFSET);
-        if(res == pgtable->pgtable.end()) [[unlikely]] hit = false;
+        PPageEntry *res = pgtable->pgtable.find(addr >> PAGE_ADDR_OFFSET);
+        if(!res) [[unlikely]] hit = false;
         else {
-            _ppi = res->second.ppi;
-            _flg = res->second.flg;
+            _ppi = res->ppi;
+            _flg = res->flg;
         }
         shared_lock->read_unlock();
         if(!hit) [[unlikely]] return SimError::invalidaddr;
+        if(_flg & PGFLAG_LAZY) [[unlikely]] return va2pa_first_touch(addr, out, flg, pgofs);
         if((_flg & flg) != flg) [[unlikely]] {
             if((_flg & PGFLAG_COW) && (flg & PGFLAG_W)) {
                 bool owned = false;
                 shared_lock->write_lock();
                 if(!pgtable->ppman->is_shared(_ppi)) {
                     res = pgtable->pgtable.find(addr >> PAGE_ADDR_OFFSET);
-                    if(res != pgtable->pgtable.end()) [[likely]] {
-                        res->second.flg &= (~PGFLAG_COW);
-                        res->second.flg |= (PGFLAG_W);
+                    if(res) [[likely]] {
+                        res->flg &= (~PGFLAG_COW);
+                        res->flg |= (PGFLAG_W);
                         owned = true;
                     }
                 }
@@ -163,6 +174,7 @@ public:
             }
         }
         *out = (_ppi << PAGE_ADDR_OFFSET) + (addr & (PAGE_LEN_BYTE - 1));
+        if(pgofs) *pgofs = ((_flg & PGFLAG_HUGE)?HUGE_PAGE_ADDR_OFFSET:PAGE_ADDR_OFFSET);
         return SimError::success;
     }
 
@@ -60,8 +60,111 @@ bool test_simpletickqueue() {
     return true;
 }
 
+bool test_limitedtickvector() {
+
+    LimitedTickList<uint64_t> ref(2, 16);
+    LimitedTickVector<uint64_t> tq(2, 16);
+
+    uint64_t next_push = 0;
+    uint64_t round = 1000000UL;
+    for(uint64_t __n = 0; __n < round; __n ++) {
+        uint32_t op = RAND(0, 4);
+        if(op == 0) {
+            ref.apply_next_tick();
+            tq.apply_next_tick();
+        }
+        else if(op == 1) {
+            assert(ref.can_push() == tq.can_push());
+            if(ref.push_next_tick(next_push)) {
+                assert(tq.push_next_tick(next_push));
+                next_push++;
+            }
+        }
+        else if(op == 2) {
+            // 从主列表中间删除一项
+            assert(ref.cur_size() == tq.cur_size());
+            if(ref.cur_size()) {
+                uint32_t idx = RAND(0, ref.cur_size());
+                auto iter = ref.get().begin();
+                std::advance(iter, idx);
+                assert(*iter == tq.get()[idx]);
+                ref.get().erase(iter);
+                tq.get().erase(tq.get().begin() + idx);
+            }
+        }
+        else if(ref.cur_size()) {
+            assert(ref.front() == tq.front());
+            ref.pop_front();
+            tq.pop_front();
+        }
+        assert(ref.size() == tq.size());
+    }
+    printf("Test Limited Tick Vector Passed!!!\n");
+
+    return true;
+}
+
+template<typename Q>
+double _bench_tick_list(Q &q, uint32_t width, uint64_t round) {
+    uint64_t t0 = get_current_time_us();
+    uint64_t sum = 0;
+    for(uint64_t __n = 0; __n < round; __n ++) {
+        for(uint64_t i = 0; i < width; i++) {
+            q.push_next_tick(i);
+        }
+        q.apply_next_tick();
+        for(uint32_t i = 0; i < width; i++) {
+            sum += q.front();
+            q.pop_front();
+        }
+    }
+    uint64_t t1 = get_current_time_us();
+    if(sum == UINT64_MAX) printf("\n");
+    return ((double)(round * width * 2)) / ((double)(t1 - t0 + 1)) * 1000000.;
+}
+
+bool test_tickqueue_perf() {
+    const uint64_t round = 4000000UL;
+    const uint32_t width = 4;
+    {
+        LimitedTickList<uint64_t> q(width, width * 4);
+        printf("LimitedTickList: %.0f ops/sec\n", _bench_tick_list(q, width, round));
+    }
+    {
+        LimitedTickVector<uint64_t> q(width, width * 4);
+        printf("LimitedTickVector: %.0f ops/sec\n", _bench_tick_list(q, width, round));
+    }
+    {
+        TickList<uint64_t> q;
+        printf("TickList: %.0f ops/sec\n", _bench_tick_list(q, width, round));
+    }
+    {
+        TickVector<uint64_t> q;
+        printf("TickVector: %.0f ops/sec\n", _bench_tick_list(q, width, round));
+    }
+    {
+        SimpleTickQueue<uint64_t> q(width, width, width * 4);
+        uint64_t t0 = get_current_time_us();
+        uint64_t sum = 0;
+        for(uint64_t __n = 0; __n < round; __n ++) {
+            for(uint64_t i = 0; i < width; i++) {
+                q.push(i);
+            }
+            q.apply_next_tick();
+            while(q.can_pop()) {
+                sum += q.top();
+                q.pop();
+            }
+        }
+        uint64_t t1 = get_current_time_us();
+        if(sum == UINT64_MAX) printf("\n");
+        printf("SimpleTickQueue: %.0f ops/sec\n", ((double)(round * width * 2)) / ((double)(t1 - t0 + 1)) * 1000000.);
+    }
+    return true;
+}
+
 bool test_tickqueue() {
-    return test_simpletickqueue();
+    return test_simpletickqueue() && test_limitedtickvector();
 
     // OneTickQueue<uint64_t, 4, 3, 4> q;
     // std::list<uint64_t> buf;
@@ -26,6 +26,8 @@
 #include "common.h"
 #include "spinlocks.h"
 
+#include <atomic>
+
 /**
  * 延迟1周期写入的列表结构
  * 每周期最多向列表中写入input_width项，写入的项会在下一周期进入主列表
@@ -81,18 +83,177 @@ protected:
     std::list<T> q;
 };
 
-// template<typename T>
-// class LimitedTickVector {
-// public:
-//     LimitedTickList(uint32_t input_wid, uint32_t queue_size) {
+/**
+ * LimitedTickList的数组实现，语义相同，构造时按容量预留空间，之后push/apply不再分配内存
+ * 主列表按写入顺序排列，支持从中间erase，用于按条件遍历并从中间取出的保留站（RS）
+ * pop_front需要移动其余元素，只用于容量为1的amo/fence保留站；先进先出的流水级队列使用环形的SimpleTickQueue（pass_to）
+*/
+template<typename T>
+class LimitedTickVector {
+public:
+    LimitedTickVector(uint32_t input_wid, uint32_t queue_size) {
+        assert(input_wid > 0);
+        assert(input_wid < (1<<30));
+        iwid = input_wid;
+        qsize = queue_size;
+        push_buf.reserve(iwid);
+        q.reserve(std::max(iwid, qsize));
+    }
+    inline uint32_t can_push() {
+        return ((push_buf.size() < iwid && push_buf.size() + q.size() < qsize)?(iwid - push_buf.size()):0);
+    }
+    inline bool push_next_tick(T &v) {
+        if(can_push() == 0) return false;
+        push_buf.push_back(v);
+        return true;
+    }
+    inline void apply_next_tick() {
+        q.insert(q.end(), push_buf.begin(), push_buf.end());
+        push_buf.clear();
+    }
+    /**
+     * 获取当前的主列表内容
+    */
+    inline std::vector<T> &get() {return q;};
+    /**
+     * 元素总个数
+    */
+    inline uint64_t size() {return q.size() + push_buf.size();}
+    /**
+     * 主列表中的元素个数
+    */
+    inline uint64_t cur_size() {return q.size();}
+    inline bool empty() {return (q.empty() && push_buf.empty());}
+    inline T &front() {return q.front();}
+    inline void pop_front() {q.erase(q.begin());}
+    inline void clear() {q.clear(); push_buf.clear();}
+    inline void clear(std::list<T> *to_free) {
+        if(to_free) {
+            to_free->insert(to_free->end(), q.begin(), q.end());
+            to_free->insert(to_free->end(), push_buf.begin(), push_buf.end());
+        }
+        clear();
+    }
+protected:
+    uint32_t iwid, qsize;
+    std::vector<T> push_buf;
+    std::vector<T> q;
+};
 
-//     }
+/**
+ * 带时间戳的单生产者单消费者环形通道，用于在不同模拟线程的对象之间传递数据
+ * 通道模拟一条延迟为latency的链路，生产者在tick写入的项从tick+latency起对消费者可见
+ * 消费者在tick取出项后，该位置从tick+return_latency起才能被生产者重新写入
+ * 两个延迟都不小于线程间的同步周期时，一个同步周期内的写入与释放只在之后的同步周期中被对方看到，结果与线程间的执行先后无关
+ * 生产者与消费者各自只写自己的下标，无需加锁，push/pop不分配内存
+ * 同一通道的写入周期与取出周期均应单调不减
+*/
+template <typename T>
+class SPSCTickChannel {
+public:
+    SPSCTickChannel(uint32_t capacity, uint32_t latency = 0) : lat(latency) {
+        assert(capacity > 0);
+        assert(capacity < (1<<30));
+        len = 1;
+        while(len < capacity) len <<= 1;
+        mask = len - 1;
+        buf.resize(len);
+    }
+    SPSCTickChannel(const SPSCTickChannel &) = delete;
+    SPSCTickChannel &operator=(const SPSCTickChannel &) = delete;
 
-// protected:
-//     uint32_t iwid, qsize;
-//     std::vector<T> push_buf;
-//     std::vector<T> q;
-// };
+    inline uint32_t capacity() {return len;}
+    inline uint32_t latency() {return lat;}
+    inline uint32_t return_latency() {return ret_lat;}
+    /**
+     * 只能在生产者与消费者都不运行时调用
+    */
+    inline void set_latency(uint32_t latency, uint32_t return_latency) {
+        lat = latency;
+        ret_lat = return_latency;
+    }
+
+    /**
+     * 生产者侧：tick时剩余可写入的项数
+    */
+    inline uint32_t can_push(uint64_t tick) {
+        uint64_t t = tail.load(std::memory_order_relaxed);
+        head_cache = head.load(std::memory_order_acquire);
+        uint64_t end = head_cache + len;
+        // 释放周期按取出顺序单调，最后一个已释放的位置可用时前面的位置都可用
+        if(t == end || buf[(end - 1) & mask].free_tick <= tick) return end - t;
+        uint32_t n = 0;
+        for(; t + n < end && buf[(t + n) & mask].free_tick <= tick; n++) ;
+        return n;
+    }
+    /**
+     * 生产者侧：已写入的项均已被取走，且其位置在tick时都可重新写入
+    */
+    inline bool drained(uint64_t tick) {
+        return (can_push(tick) == len);
+    }
+    inline bool push(const T &v, uint64_t tick) {
+        uint64_t t = tail.load(std::memory_order_relaxed);
+        if(t - head_cache >= len) {
+            head_cache = head.load(std::memory_order_acquire);
+            if(t - head_cache >= len) [[unlikely]] return false;
+        }
+        Entry &e = buf[t & mask];
+        if(e.free_tick > tick) [[unlikely]] return false;
+        e.tick = tick + lat;
+        e.v = v;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * 消费者侧：获取队首之后第i项，该项不存在或在tick时尚不可见时返回nullptr
+    */
+    inline T *peek(uint32_t i, uint64_t tick) {
+        uint64_t h = head.load(std::memory_order_relaxed);
+        if(h + i >= tail_cache) {
+            tail_cache = tail.load(std::memory_order_acquire);
+            if(h + i >= tail_cache) return nullptr;
+        }
+        Entry &e = buf[(h + i) & mask];
+        return ((e.tick <= tick)?(&(e.v)):nullptr);
+    }
+    inline bool can_pop(uint64_t tick) {
+        return (peek(0, tick) != nullptr);
+    }
+    inline T &top() {
+        uint64_t h = head.load(std::memory_order_relaxed);
+        if(h >= tail_cache) tail_cache = tail.load(std::memory_order_acquire);
+        if(h >= tail_cache) [[unlikely]] assert(0);
+        return buf[h & mask].v;
+    }
+    inline void pop(uint64_t tick) {
+        uint64_t h = head.load(std::memory_order_relaxed);
+        if(h >= tail_cache) tail_cache = tail.load(std::memory_order_acquire);
+        if(h >= tail_cache) [[unlikely]] assert(0);
+        buf[h & mask].free_tick = tick + ret_lat;
+        head.store(h + 1, std::memory_order_release);
+    }
+
+protected:
+    typedef struct {
+        uint64_t    tick = 0;
+        uint64_t    free_tick = 0;  // 消费者释放该位置后，生产者可重新写入的周期
+        T           v;
+    } Entry;
+
+    uint32_t len = 0;
+    uint32_t mask = 0;
+    uint32_t lat = 0;
+    uint32_t ret_lat = 0;
+    std::vector<Entry> buf;
+
+    // 消费者写head，生产者写tail，两者分处不同缓存行，避免伪共享
+    alignas(64) std::atomic<uint64_t> head = 0;
+    uint64_t tail_cache = 0;
+    alignas(64) std::atomic<uint64_t> tail = 0;
+    uint64_t head_cache = 0;
+};
 
 /**
  * 延迟1周期写入的列表结构，写入的项会在下一周期进入主列表
@@ -137,6 +298,49 @@ protected:
     std::list<T> q;
 };
 
+/**
+ * TickList的数组实现，语义相同，容量只增不减，稳定运行后push/apply不再分配内存
+ * 与LimitedTickVector相同，用于需要遍历与中间erase的等待列表，pop_front需要移动其余元素
+*/
+template <typename T>
+class TickVector {
+public:
+    inline bool push_next_tick(T &v) {
+        push_buf.push_back(v);
+        return true;
+    }
+    inline void apply_next_tick() {
+        q.insert(q.end(), push_buf.begin(), push_buf.end());
+        push_buf.clear();
+    }
+    /**
+     * 获取当前的主列表内容
+    */
+    inline std::vector<T> &get() {return q;};
+    /**
+     * 元素总个数
+    */
+    inline uint64_t size() {return q.size() + push_buf.size();}
+    /**
+     * 主列表中的元素个数
+    */
+    inline uint64_t cur_size() {return q.size();}
+    inline bool empty() {return (q.empty() && push_buf.empty());}
+    inline T &front() {return q.front();}
+    inline void pop_front() {q.erase(q.begin());}
+    inline void clear() {q.clear(); push_buf.clear();}
+    inline void clear(std::list<T> *to_free) {
+        if(to_free) {
+            to_free->insert(to_free->end(), q.begin(), q.end());
+            to_free->insert(to_free->end(), push_buf.begin(), push_buf.end());
+        }
+        clear();
+    }
+protected:
+    std::vector<T> push_buf;
+    std::vector<T> q;
+};
+
 template <typename K, typename T>
 class TickMap {
 public:
@@ -159,12 +363,12 @@ public:
             for(auto &entry : m) {
                 to_free->emplace_back(entry.first, entry.second);
             }
-            to_free->splice(to_free->end(), push_buf);
+            to_free->insert(to_free->end(), push_buf.begin(), push_buf.end());
         }
         clear();
     }
 protected:
-    std::list<std::pair<K,T>> push_buf;
+    std::vector<std::pair<K,T>> push_buf;
     std::unordered_map<K,T> m;
 };
 
@@ -190,12 +394,12 @@ public:
             for(auto &entry : m) {
                 to_free->emplace_back(entry.first, entry.second);
             }
-            to_free->splice(to_free->end(), push_buf);
+            to_free->insert(to_free->end(), push_buf.begin(), push_buf.end());
         }
         clear();
     }
 protected:
-    std::list<std::pair<K,T>> push_buf;
+    std::vector<std::pair<K,T>> push_buf;
     std::unordered_multimap<K,T> m;
 };
 
@@ -243,7 +447,10 @@ public:
         iwid = input_wid;
         owid = output_wid;
         qsize = queue_size;
-        len = ALIGN((iwid + owid + qsize) * 2, 16);
+        // 长度取2的幂，下标回绕用与运算代替取模
+        len = 16;
+        while(len < (iwid + owid + qsize) * 2) len <<= 1;
+        mask = len - 1;
         bottom = q_bottom = push_bottom = ptr = pop_sz = q_sz = push_sz = 0;
         buf.resize(len);
         do_on_current_tick = 0;
@@ -252,25 +459,25 @@ public:
     virtual void apply_next_tick() {
         if(qsize) {
             uint32_t q2pop = std::min<uint32_t>(owid - pop_sz, q_sz);
-            q_bottom = (q_bottom + q2pop) % len;
+            q_bottom = (q_bottom + q2pop) & mask;
             pop_sz += q2pop;
             q_sz -= q2pop;
             if(push_sz) {
                 uint32_t push2pop = std::min<uint32_t>(owid - pop_sz, push_sz);
-                q_bottom = (q_bottom + push2pop) % len;
-                push_bottom = (push_bottom + push2pop) % len;
+                q_bottom = (q_bottom + push2pop) & mask;
+                push_bottom = (push_bottom + push2pop) & mask;
                 pop_sz += push2pop;
                 push_sz -= push2pop;
             }
             uint32_t push2q = std::min<uint32_t>(qsize - q_sz, push_sz);
-            push_bottom = (push_bottom + push2q) % len;
+            push_bottom = (push_bottom + push2q) & mask;
             q_sz += push2q;
             push_sz -= push2q;
         }
         else if(push_sz && owid > pop_sz) {
             uint32_t push2pop = std::min<uint32_t>(owid - pop_sz, push_sz);
-            q_bottom = (q_bottom + push2pop) % len;
-            push_bottom = (push_bottom + push2pop) % len;
+            q_bottom = (q_bottom + push2pop) & mask;
+            push_bottom = (push_bottom + push2pop) & mask;
             pop_sz += push2pop;
             push_sz -= push2pop;
         }
@@ -288,20 +495,20 @@ public:
 
     inline void pop() {
         if(pop_sz == 0) [[unlikely]] assert(0);
-        bottom = (bottom + 1) % len;
+        bottom = (bottom + 1) & mask;
         pop_sz--;
     }
     inline bool push(T &v) {
         if(push_sz >= iwid) [[unlikely]] return false;
         buf[ptr] = v;
-        ptr = (ptr + 1) % len;
+        ptr = (ptr + 1) & mask;
         push_sz++;
         return true;
     }
 
     inline void clear(std::list<T> *out = nullptr) {
         if(out) {
-            for(uint32_t i = bottom ; i != ptr; i = (i+1)%len) {
+            for(uint32_t i = bottom ; i != ptr; i = (i+1)&mask) {
                 out->push_back(buf[i]);
             }
         }
@@ -331,14 +538,14 @@ public:
 
     inline void dbg_get_all(std::vector<T> *out) {
         out->reserve(size());
-        for(uint32_t i = bottom ; i != ptr; i = (i+1)%len) {
+        for(uint32_t i = bottom ; i != ptr; i = (i+1)&mask) {
             out->push_back(buf[i]);
         }
     }
 
 protected:
     uint32_t iwid, owid, qsize;
-    uint32_t len, bottom, q_bottom, push_bottom, ptr;
+    uint32_t len, mask, bottom, q_bottom, push_bottom, ptr;
     uint32_t pop_sz, q_sz, push_sz;
     std::vector<T> buf;
 };
@@ -433,6 +640,7 @@ protected:
 namespace test {
 
 bool test_tickqueue();
+bool test_tickqueue_perf();
 
 }
 